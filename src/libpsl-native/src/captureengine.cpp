@@ -0,0 +1,600 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief capture the output of many child processes on a single thread
+
+#include "captureengine.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <new>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const size_t DefaultRingBufferSize = 64 * 1024;
+    const int MaxEventsPerWait = 64;
+
+    struct CaptureStream
+    {
+        int Fd;
+        int32_t Id;
+        int32_t Kind;
+        std::vector<uint8_t> Ring;
+        size_t Head;        // index of the oldest buffered byte
+        size_t Size;        // number of buffered bytes
+        bool Paused;        // out of the epoll set until the ring has room again
+        bool Retired;       // dropped by a failed register; the reader frees it
+    };
+
+    // Data read from a stream that the caller has not picked up yet. Chunks are consumed
+    // in order, and each one covers the oldest bytes still buffered in its stream's ring.
+    struct PendingChunk
+    {
+        CaptureStream* Stream;
+        int64_t Sequence;
+        size_t Length;      // 0 marks the end of the stream
+    };
+}
+
+struct CaptureEngine
+{
+    int EpollFd = -1;
+    int WakeFd = -1;
+    size_t RingBufferSize = 0;
+    std::thread Reader;
+    std::mutex Lock;
+    std::condition_variable DataAvailable;
+    std::deque<PendingChunk> Pending;
+    std::vector<CaptureStream*> Streams;
+    std::vector<CaptureStream*> Retired;
+    int64_t NextSequence = 0;
+    bool ShuttingDown = false;
+};
+
+template <typename TInt>
+static inline bool CheckInterrupted(TInt result)
+{
+    return result < 0 && errno == EINTR;
+}
+
+static void Wake(CaptureEngine* engine)
+{
+    uint64_t value = 1;
+    ssize_t result;
+    while (CheckInterrupted(result = write(engine->WakeFd, &value, sizeof(value))));
+}
+
+static void PauseStream(CaptureEngine* engine, CaptureStream* stream)
+{
+    epoll_ctl(engine->EpollFd, EPOLL_CTL_DEL, stream->Fd, nullptr);
+    stream->Paused = true;
+}
+
+// Called with the lock held
+static void ResumePausedStreams(CaptureEngine* engine)
+{
+    for (CaptureStream* stream : engine->Streams)
+    {
+        if (stream->Paused && stream->Size < stream->Ring.size())
+        {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = stream;
+            if (epoll_ctl(engine->EpollFd, EPOLL_CTL_ADD, stream->Fd, &event) == 0)
+            {
+                stream->Paused = false;
+            }
+        }
+    }
+}
+
+// Reads whatever is available from a stream straight into the free part of its ring.
+// The caller only ever consumes from the used part, so the read itself needs no lock.
+static void ReadStream(CaptureEngine* engine, CaptureStream* stream)
+{
+    struct iovec iov[2];
+    int iovCount = 1;
+    {
+        std::lock_guard<std::mutex> guard(engine->Lock);
+        if (stream->Retired)
+        {
+            return;
+        }
+
+        size_t capacity = stream->Ring.size();
+        size_t available = capacity - stream->Size;
+        if (available == 0)
+        {
+            PauseStream(engine, stream);
+            return;
+        }
+
+        size_t tail = (stream->Head + stream->Size) % capacity;
+        size_t first = std::min(available, capacity - tail);
+        iov[0].iov_base = &stream->Ring[tail];
+        iov[0].iov_len = first;
+        if (first < available)
+        {
+            iov[1].iov_base = &stream->Ring[0];
+            iov[1].iov_len = available - first;
+            iovCount = 2;
+        }
+    }
+
+    ssize_t count;
+    while (CheckInterrupted(count = readv(stream->Fd, iov, iovCount)));
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(engine->Lock);
+    if (count > 0)
+    {
+        stream->Size += static_cast<size_t>(count);
+
+        // Extend the newest chunk rather than queueing another one when nothing else
+        // was read in between, so chatty children produce few large chunks
+        if (!engine->Pending.empty() && engine->Pending.back().Stream == stream && engine->Pending.back().Length != 0)
+        {
+            engine->Pending.back().Length += static_cast<size_t>(count);
+        }
+        else
+        {
+            engine->Pending.push_back(PendingChunk { stream, engine->NextSequence++, static_cast<size_t>(count) });
+        }
+
+        if (stream->Size == stream->Ring.size())
+        {
+            PauseStream(engine, stream);
+        }
+    }
+    else
+    {
+        // End of file or a read error; either way this stream is done
+        epoll_ctl(engine->EpollFd, EPOLL_CTL_DEL, stream->Fd, nullptr);
+        close(stream->Fd);
+        stream->Fd = -1;
+        engine->Pending.push_back(PendingChunk { stream, engine->NextSequence++, 0 });
+    }
+
+    engine->DataAvailable.notify_all();
+}
+
+static void RunReader(CaptureEngine* engine)
+{
+    struct epoll_event events[MaxEventsPerWait];
+    while (true)
+    {
+        int count = epoll_wait(engine->EpollFd, events, MaxEventsPerWait, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.ptr == nullptr)
+            {
+                uint64_t value;
+                ssize_t result;
+                while (CheckInterrupted(result = read(engine->WakeFd, &value, sizeof(value))));
+
+                std::lock_guard<std::mutex> guard(engine->Lock);
+                if (engine->ShuttingDown)
+                {
+                    return;
+                }
+                ResumePausedStreams(engine);
+                continue;
+            }
+
+            ReadStream(engine, static_cast<CaptureStream*>(events[i].data.ptr));
+        }
+
+        // A retired stream is out of the epoll set, so once this batch is done
+        // no event can refer to it any more
+        std::lock_guard<std::mutex> guard(engine->Lock);
+        for (CaptureStream* stream : engine->Retired)
+        {
+            delete stream;
+        }
+        engine->Retired.clear();
+    }
+}
+
+static void RemoveStream(CaptureEngine* engine, CaptureStream* stream)
+{
+    engine->Streams.erase(std::remove(engine->Streams.begin(), engine->Streams.end(), stream), engine->Streams.end());
+    delete stream;
+}
+#endif
+
+//! @brief CaptureEngineCreate starts a capture engine, a single thread that
+//! reads the standard output and error of every registered child
+//!
+//! CaptureEngineCreate
+//!
+//! @param[in] ringBufferSize
+//! @parblock
+//! The size of the ring buffer allocated for each captured stream, or 0 for
+//! the default of 64 KiB. A stream whose ring is full is not read again until
+//! the caller has picked up its data, which applies back-pressure to the child.
+//! @endparblock
+//!
+//! @retval the engine, or NULL with errno set if unsuccessful
+//!
+struct CaptureEngine* CaptureEngineCreate(int32_t ringBufferSize)
+{
+    if (ringBufferSize < 0)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+#if defined(__linux__)
+    CaptureEngine* engine = new (std::nothrow) CaptureEngine();
+    if (engine == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    engine->RingBufferSize = ringBufferSize == 0 ? DefaultRingBufferSize : static_cast<size_t>(ringBufferSize);
+    engine->EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    engine->WakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (engine->EpollFd < 0 || engine->WakeFd < 0 ||
+        epoll_ctl(engine->EpollFd, EPOLL_CTL_ADD, engine->WakeFd, &event) != 0)
+    {
+        int priorErrno = errno;
+        if (engine->EpollFd >= 0)
+        {
+            close(engine->EpollFd);
+        }
+        if (engine->WakeFd >= 0)
+        {
+            close(engine->WakeFd);
+        }
+        delete engine;
+        errno = priorErrno;
+        return nullptr;
+    }
+
+    try
+    {
+        engine->Reader = std::thread(RunReader, engine);
+    }
+    catch (...)
+    {
+        close(engine->EpollFd);
+        close(engine->WakeFd);
+        delete engine;
+        errno = EAGAIN;
+        return nullptr;
+    }
+
+    return engine;
+#else
+    errno = ENOTSUP;
+    return nullptr;
+#endif
+}
+
+//! @brief CaptureEngineRegister hands a child's output descriptors to the engine
+//!
+//! CaptureEngineRegister
+//!
+//! The engine takes ownership of the descriptors, typically the stdoutFd and
+//! stderrFd returned by ForkAndExecProcess, and closes them at end of stream.
+//!
+//! @param[in] engine
+//! @parblock
+//! The engine returned by CaptureEngineCreate.
+//! @endparblock
+//!
+//! @param[in] id
+//! @parblock
+//! An id of the caller's choosing, reported with every chunk of this child's output.
+//! @endparblock
+//!
+//! @param[in] stdoutFd
+//! @parblock
+//! The read end of the child's standard output, or -1.
+//! @endparblock
+//!
+//! @param[in] stderrFd
+//! @parblock
+//! The read end of the child's standard error, or -1.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t CaptureEngineRegister(struct CaptureEngine* engine, int32_t id, int32_t stdoutFd, int32_t stderrFd)
+{
+    if (engine == nullptr || (stdoutFd < 0 && stderrFd < 0))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+#if defined(__linux__)
+    const int fds[2] = { stdoutFd, stderrFd };
+    const int32_t kinds[2] = { CAPTURE_STREAM_STDOUT, CAPTURE_STREAM_STDERR };
+    CaptureStream* streams[2] = { nullptr, nullptr };
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (fds[i] < 0)
+        {
+            continue;
+        }
+
+        int flags = fcntl(fds[i], F_GETFL);
+        if (flags == -1 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) == -1)
+        {
+            goto failed;
+        }
+
+        streams[i] = new (std::nothrow) CaptureStream();
+        if (streams[i] == nullptr)
+        {
+            errno = ENOMEM;
+            goto failed;
+        }
+
+        streams[i]->Fd = fds[i];
+        streams[i]->Id = id;
+        streams[i]->Kind = kinds[i];
+        streams[i]->Head = 0;
+        streams[i]->Size = 0;
+        streams[i]->Paused = false;
+        streams[i]->Retired = false;
+        try
+        {
+            streams[i]->Ring.resize(engine->RingBufferSize);
+        }
+        catch (...)
+        {
+            errno = ENOMEM;
+            goto failed;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(engine->Lock);
+        for (int i = 0; i < 2; i++)
+        {
+            if (streams[i] == nullptr)
+            {
+                continue;
+            }
+
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = streams[i];
+            if (epoll_ctl(engine->EpollFd, EPOLL_CTL_ADD, streams[i]->Fd, &event) != 0)
+            {
+                int priorErrno = errno;
+                if (i == 1 && streams[0] != nullptr)
+                {
+                    // The reader may already hold an event for the first stream, so
+                    // leave freeing it to the reader rather than deleting it here
+                    epoll_ctl(engine->EpollFd, EPOLL_CTL_DEL, streams[0]->Fd, nullptr);
+                    engine->Streams.pop_back();
+                    streams[0]->Retired = true;
+                    engine->Retired.push_back(streams[0]);
+                    streams[0] = nullptr;
+                    Wake(engine);
+                }
+                errno = priorErrno;
+                goto failed;
+            }
+            engine->Streams.push_back(streams[i]);
+        }
+    }
+
+    return 0;
+
+failed:
+    int priorErrno = errno;
+    delete streams[0];
+    delete streams[1];
+    errno = priorErrno;
+    return -1;
+#else
+    (void)id;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+//! @brief CaptureEngineReadBatch picks up the output read so far from every
+//! registered child
+//!
+//! CaptureEngineReadBatch
+//!
+//! Chunks are returned in the order their data was read, so the relative
+//! order of a child's standard output and error is preserved. Consecutive
+//! reads from the same stream are merged into a single chunk. A chunk with
+//! a Length of 0 marks the end of a stream.
+//!
+//! @param[in] timeoutMilliseconds
+//! @parblock
+//! How long to wait for output if none is buffered; -1 waits indefinitely.
+//! @endparblock
+//!
+//! @param[out] buffer
+//! @parblock
+//! Receives the data of the returned chunks, back to back.
+//! @endparblock
+//!
+//! @param[out] chunks
+//! @parblock
+//! Receives up to chunksLength chunks describing the data in buffer.
+//! @endparblock
+//!
+//! @param[out] chunkCount
+//! @parblock
+//! Receives the number of chunks returned, 0 if the timeout expired.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t CaptureEngineReadBatch(
+    struct CaptureEngine* engine,
+    int32_t timeoutMilliseconds,
+    uint8_t* buffer,
+    int32_t bufferLength,
+    struct CaptureChunk* chunks,
+    int32_t chunksLength,
+    int32_t* chunkCount)
+{
+    if (engine == nullptr || buffer == nullptr || bufferLength <= 0 || chunks == nullptr || chunksLength <= 0 ||
+        chunkCount == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *chunkCount = 0;
+
+#if defined(__linux__)
+    std::unique_lock<std::mutex> lock(engine->Lock);
+    auto hasData = [engine] { return !engine->Pending.empty(); };
+    if (timeoutMilliseconds < 0)
+    {
+        engine->DataAvailable.wait(lock, hasData);
+    }
+    else if (!engine->DataAvailable.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), hasData))
+    {
+        return 0;
+    }
+
+    size_t offset = 0;
+    int32_t count = 0;
+    bool resume = false;
+    while (!engine->Pending.empty() && count < chunksLength)
+    {
+        PendingChunk& pending = engine->Pending.front();
+        CaptureStream* stream = pending.Stream;
+        CaptureChunk& chunk = chunks[count];
+        chunk.Id = stream->Id;
+        chunk.Stream = stream->Kind;
+        chunk.Sequence = pending.Sequence;
+        chunk.Offset = static_cast<int32_t>(offset);
+
+        if (pending.Length == 0)
+        {
+            chunk.Length = 0;
+            count++;
+            engine->Pending.pop_front();
+            RemoveStream(engine, stream);
+            continue;
+        }
+
+        size_t room = static_cast<size_t>(bufferLength) - offset;
+        if (room == 0)
+        {
+            break;
+        }
+
+        size_t length = std::min(pending.Length, room);
+        size_t capacity = stream->Ring.size();
+        size_t first = std::min(length, capacity - stream->Head);
+        memcpy(buffer + offset, &stream->Ring[stream->Head], first);
+        memcpy(buffer + offset + first, &stream->Ring[0], length - first);
+
+        stream->Head = (stream->Head + length) % capacity;
+        stream->Size -= length;
+        resume = resume || stream->Paused;
+
+        chunk.Length = static_cast<int32_t>(length);
+        offset += length;
+        count++;
+
+        if (length == pending.Length)
+        {
+            engine->Pending.pop_front();
+        }
+        else
+        {
+            pending.Length -= length;
+        }
+    }
+
+    if (resume)
+    {
+        Wake(engine);
+    }
+
+    *chunkCount = count;
+    return 0;
+#else
+    (void)timeoutMilliseconds;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+//! @brief CaptureEngineDestroy stops the engine and closes every descriptor it still owns
+//!
+//! CaptureEngineDestroy
+//!
+void CaptureEngineDestroy(struct CaptureEngine* engine)
+{
+#if defined(__linux__)
+    if (engine == nullptr)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(engine->Lock);
+        engine->ShuttingDown = true;
+    }
+    Wake(engine);
+    engine->Reader.join();
+
+    for (CaptureStream* stream : engine->Streams)
+    {
+        if (stream->Fd >= 0)
+        {
+            close(stream->Fd);
+        }
+        delete stream;
+    }
+
+    for (CaptureStream* stream : engine->Retired)
+    {
+        delete stream;
+    }
+
+    close(engine->EpollFd);
+    close(engine->WakeFd);
+    delete engine;
+#else
+    (void)engine;
+#endif
+}
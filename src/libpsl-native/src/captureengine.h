@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+enum
+{
+    CAPTURE_STREAM_STDOUT = 1,
+    CAPTURE_STREAM_STDERR = 2
+};
+
+struct CaptureChunk
+{
+    int32_t Id;             // id the child was registered with
+    int32_t Stream;         // CAPTURE_STREAM_STDOUT or CAPTURE_STREAM_STDERR
+    int64_t Sequence;       // order in which the data was read, across all streams
+    int32_t Offset;         // offset of the data in the caller's buffer
+    int32_t Length;         // number of bytes, 0 marks the end of the stream
+};
+
+struct CaptureEngine;
+
+struct CaptureEngine* CaptureEngineCreate(int32_t ringBufferSize);
+int32_t CaptureEngineRegister(struct CaptureEngine* engine, int32_t id, int32_t stdoutFd, int32_t stderrFd);
+int32_t CaptureEngineReadBatch(
+    struct CaptureEngine* engine,
+    int32_t timeoutMilliseconds,    // -1 waits until data is available, 0 does not wait
+    uint8_t* buffer,                // [out] receives the data of the returned chunks
+    int32_t bufferLength,
+    struct CaptureChunk* chunks,    // [out] receives the chunks, in sequence order
+    int32_t chunksLength,
+    int32_t* chunkCount);           // [out] number of chunks returned
+void CaptureEngineDestroy(struct CaptureEngine* engine);
+
+PAL_END_EXTERNC
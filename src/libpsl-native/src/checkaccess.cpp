@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief check access to many files of one directory
+
+#include "checkaccess.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//! @brief CheckAccessBatch checks whether the caller may access each of many
+//! files in a directory
+//!
+//! CheckAccessBatch
+//!
+//! Unlike IsExecutable, which uses access and so the real user and group
+//! ids, the check uses the effective ids, as open and execve do. The names
+//! are resolved relative to an open directory, so the kernel does not walk
+//! the directory's path again for every name.
+//!
+//! @param[in] dirFd
+//! @parblock
+//! A descriptor for the directory, opened with O_RDONLY or O_PATH.
+//! @endparblock
+//!
+//! @param[in] names
+//! @parblock
+//! The names to check. They may contain '/', in which case they are resolved
+//! relative to dirFd like any other relative path.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] mode
+//! @parblock
+//! A combination of R_OK, W_OK and X_OK, or F_OK to only check that the
+//! names exist.
+//! @endparblock
+//!
+//! @param[out] results
+//! @parblock
+//! Receives nameCount bytes, 1 where access is allowed and 0 where it is not
+//! or the name does not exist.
+//! @endparblock
+//!
+//! @retval the number of names the caller may access, or -1 with errno set
+//!
+int32_t CheckAccessBatch(int32_t dirFd, const char* const names[], int32_t nameCount, int32_t mode, uint8_t* results)
+{
+    assert(names && results);
+    if (dirFd < 0 || nameCount < 0 || (mode & ~(R_OK | W_OK | X_OK)) != 0 ||
+        (nameCount > 0 && (names == nullptr || results == nullptr)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int32_t allowed = 0;
+    for (int32_t i = 0; i < nameCount; i++)
+    {
+        if (names[i] == nullptr)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        results[i] = faccessat(dirFd, names[i], mode, AT_EACCESS) == 0 ? 1 : 0;
+        allowed += results[i];
+    }
+
+    return allowed;
+}
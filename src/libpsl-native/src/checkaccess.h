@@ -0,0 +1,17 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+int32_t CheckAccessBatch(
+    int32_t dirFd,                  // open directory the names are relative to
+    const char* const names[],      // names to check, relative to dirFd
+    int32_t nameCount,
+    int32_t mode,                   // R_OK, W_OK and X_OK bits, or F_OK
+    uint8_t* results);              // [out] 1 for each name the caller may access, 0 otherwise
+
+PAL_END_EXTERNC
@@ -0,0 +1,85 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief classify a path with as few system calls as possible
+
+#include "classifypath.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static int32_t ClassifyMode(mode_t mode)
+{
+    switch (mode & S_IFMT)
+    {
+        case S_IFREG:
+            return PATH_CLASS_FILE | ((mode & (S_IXUSR | S_IXGRP | S_IXOTH)) ? PATH_CLASS_EXECUTABLE : 0);
+        case S_IFDIR:
+            return PATH_CLASS_DIRECTORY;
+        case S_IFCHR:
+            return PATH_CLASS_CHARACTER_DEVICE;
+        case S_IFBLK:
+            return PATH_CLASS_BLOCK_DEVICE;
+        case S_IFIFO:
+            return PATH_CLASS_FIFO;
+        case S_IFSOCK:
+            return PATH_CLASS_SOCKET;
+        default:
+            return 0;
+    }
+}
+
+//! @brief ClassifyPath answers IsFile, IsDirectory, IsSymLink and more about
+//! a path at once
+//!
+//! ClassifyPath
+//!
+//! Makes one lstat call, plus one stat call only if the path is a symbolic
+//! link. PATH_CLASS_EXECUTABLE only looks at the mode bits; use IsExecutable
+//! to ask whether the caller may actually execute the file.
+//!
+//! @param[in] path
+//! @parblock
+//! A pointer to the buffer that contains the file name
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @retval a combination of PATH_CLASS_* bits, 0 if the path does not exist,
+//! or -1 with errno set if it could not be examined
+//!
+int32_t ClassifyPath(const char* path)
+{
+    assert(path);
+    if (path == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct stat st;
+    if (lstat(path, &st) != 0)
+    {
+        return errno == ENOENT || errno == ENOTDIR ? 0 : -1;
+    }
+
+    if (!S_ISLNK(st.st_mode))
+    {
+        return PATH_CLASS_EXISTS | ClassifyMode(st.st_mode);
+    }
+
+    int32_t result = PATH_CLASS_EXISTS | PATH_CLASS_SYMLINK;
+    if (stat(path, &st) != 0)
+    {
+        return result | PATH_CLASS_BROKEN_LINK;
+    }
+
+    result |= ClassifyMode(st.st_mode);
+    if (S_ISDIR(st.st_mode))
+    {
+        result |= PATH_CLASS_SYMLINK_TO_DIRECTORY;
+    }
+    return result;
+}
@@ -0,0 +1,29 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Bits returned by ClassifyPath.  The type bits describe what a symbolic link points
+// to, PATH_CLASS_SYMLINK and PATH_CLASS_EXISTS describe the entry itself.
+enum
+{
+    PATH_CLASS_EXISTS = 0x00000001,                 // the entry exists, as for IsFile
+    PATH_CLASS_FILE = 0x00000002,                   // regular file
+    PATH_CLASS_DIRECTORY = 0x00000004,              // directory, as for IsDirectory
+    PATH_CLASS_SYMLINK = 0x00000008,                // the entry is a symbolic link, as for IsSymLink
+    PATH_CLASS_SYMLINK_TO_DIRECTORY = 0x00000010,   // symbolic link whose target is a directory
+    PATH_CLASS_BROKEN_LINK = 0x00000020,            // symbolic link whose target cannot be resolved
+    PATH_CLASS_EXECUTABLE = 0x00000040,             // regular file with an execute bit set in its mode
+    PATH_CLASS_CHARACTER_DEVICE = 0x00000080,
+    PATH_CLASS_BLOCK_DEVICE = 0x00000100,
+    PATH_CLASS_FIFO = 0x00000200,
+    PATH_CLASS_SOCKET = 0x00000400
+};
+
+int32_t ClassifyPath(const char* path);
+
+PAL_END_EXTERNC
@@ -0,0 +1,392 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief resolve command names against PATH from an index of its directories
+
+#include "commandindex.h"
+#include "checkaccess.h"
+#include "directoryreader.h"
+#include "fileio.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    struct IndexedDirectory
+    {
+        std::string Path;
+        bool Scanned = false;               // whether Executables reflects the directory as of the stamp below
+        dev_t Device = 0;
+        ino_t Inode = 0;
+        struct timespec ModifiedTime = {};
+        bool Racy = false;                  // modified too recently for the stamp to prove it unchanged
+        std::unordered_set<std::string> Executables;
+    };
+}
+
+// Directories are kept in search order.  Commands maps every name to the first
+// directory that has it, and is rebuilt from the per-directory sets whenever one
+// of them is rescanned, so that a lookup is a single hash probe.
+struct CommandIndex
+{
+    std::mutex Lock;
+    std::vector<IndexedDirectory> Directories;
+    std::unordered_map<std::string, size_t> Commands;
+    int64_t RevalidateInterval = 0;
+    int64_t LastValidated = 0;
+    bool Validated = false;
+};
+
+static int64_t GetMonotonicMilliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+#if defined(__APPLE__)
+#define st_mtim st_mtimespec
+#endif
+
+static bool IsSameStamp(const IndexedDirectory& directory, const struct stat& st)
+{
+    return directory.Device == st.st_dev && directory.Inode == st.st_ino &&
+           directory.ModifiedTime.tv_sec == st.st_mtim.tv_sec &&
+           directory.ModifiedTime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+// Relative entries, including the empty one that stands for the current directory,
+// would resolve differently whenever the working directory changes, so only absolute
+// directories are indexed
+static void ParseSearchPath(const char* searchPath, std::vector<IndexedDirectory>& directories)
+{
+    std::unordered_set<std::string> seen;
+    const char* start = searchPath;
+    while (true)
+    {
+        const char* end = strchr(start, ':');
+        std::string path(start, end != nullptr ? static_cast<size_t>(end - start) : strlen(start));
+        while (path.size() > 1 && path.back() == '/')
+        {
+            path.pop_back();
+        }
+
+        if (!path.empty() && path[0] == '/' && seen.insert(path).second)
+        {
+            IndexedDirectory directory;
+            directory.Path = path;
+            directories.push_back(std::move(directory));
+        }
+
+        if (end == nullptr)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+// Rereads the names of the executable files in a directory
+static void ScanDirectory(IndexedDirectory& directory, const struct stat& st)
+{
+    directory.Executables.clear();
+    directory.Scanned = true;
+    directory.Device = st.st_dev;
+    directory.Inode = st.st_ino;
+    directory.ModifiedTime = st.st_mtim;
+
+    // Directory timestamps come from a coarse clock, so a change made right after the
+    // scan can leave the mtime as it was.  Until the mtime is safely in the past, treat
+    // the scan as provisional and do it again on the next revalidation.
+    directory.Racy = st.st_mtim.tv_sec + RacyWindowSeconds >= time(nullptr);
+
+    DirectoryReader reader;
+    if (!reader.Open(AT_FDCWD, directory.Path.c_str()))
+    {
+        return;
+    }
+
+    // Only entries that can be regular files are candidates.  The listing already says
+    // which ones are; symbolic links and entries of unknown type need a stat, following
+    // links as execve does.
+    std::vector<std::string> candidates;
+    DirectoryEntry entry;
+    while (reader.Next(&entry) == 1)
+    {
+        if (entry.Type != DT_REG)
+        {
+            struct stat target;
+            if ((entry.Type != DT_LNK && entry.Type != DT_UNKNOWN) ||
+                fstatat(reader.Fd(), entry.Name, &target, 0) != 0 || !S_ISREG(target.st_mode))
+            {
+                continue;
+            }
+        }
+
+        candidates.emplace_back(entry.Name, entry.NameLength);
+    }
+
+    std::vector<const char*> names(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        names[i] = candidates[i].c_str();
+    }
+
+    std::vector<uint8_t> executable(candidates.size());
+    if (candidates.empty() ||
+        CheckAccessBatch(reader.Fd(), names.data(), static_cast<int32_t>(names.size()), X_OK, executable.data()) <= 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if (executable[i])
+        {
+            directory.Executables.insert(std::move(candidates[i]));
+        }
+    }
+}
+
+static void RebuildCommands(CommandIndex* index)
+{
+    index->Commands.clear();
+    for (size_t i = index->Directories.size(); i-- > 0;)
+    {
+        for (const std::string& name : index->Directories[i].Executables)
+        {
+            index->Commands[name] = i;
+        }
+    }
+}
+
+// Rescans every directory whose modification time changed since it was scanned.
+// Adding, removing or renaming an entry updates the mtime of its directory;
+// a chmod of a file in it does not, and is only seen on the next rescan.
+static void Revalidate(CommandIndex* index)
+{
+    int64_t now = GetMonotonicMilliseconds();
+    if (index->Validated && now - index->LastValidated < index->RevalidateInterval)
+    {
+        return;
+    }
+
+    bool changed = false;
+    for (IndexedDirectory& directory : index->Directories)
+    {
+        struct stat st;
+        if (stat(directory.Path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            if (directory.Scanned)
+            {
+                directory.Executables.clear();
+                directory.Scanned = false;
+                changed = true;
+            }
+            continue;
+        }
+
+        if (!directory.Scanned || directory.Racy || !IsSameStamp(directory, st))
+        {
+            ScanDirectory(directory, st);
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        RebuildCommands(index);
+    }
+
+    index->Validated = true;
+    index->LastValidated = now;
+}
+
+//! @brief CommandIndexCreate creates an index of the executables found in
+//! a search path
+//!
+//! CommandIndexCreate
+//!
+//! Each directory is listed once and the names of its executable files are
+//! kept in memory. A directory is only listed again when its modification
+//! time changes, which happens whenever a file is added to, removed from or
+//! renamed in it. Directories are scanned lazily, on the first lookup.
+//!
+//! @param[in] searchPath
+//! @parblock
+//! A colon separated list of directories, typically the value of PATH.
+//! Relative entries, including empty ones, are ignored.
+//! @endparblock
+//!
+//! @param[in] revalidateIntervalMilliseconds
+//! @parblock
+//! How long the directories' modification times are trusted before a lookup
+//! checks them again. 0 checks them on every lookup, which still costs only
+//! one stat per directory.
+//! @endparblock
+//!
+//! @retval the index, or NULL with errno set if unsuccessful
+//!
+struct CommandIndex* CommandIndexCreate(const char* searchPath, int32_t revalidateIntervalMilliseconds)
+{
+    if (searchPath == nullptr || revalidateIntervalMilliseconds < 0)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    CommandIndex* index = new (std::nothrow) CommandIndex();
+    if (index == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    index->RevalidateInterval = revalidateIntervalMilliseconds;
+    if (CommandIndexSetSearchPath(index, searchPath) != 0)
+    {
+        delete index;
+        return nullptr;
+    }
+
+    return index;
+}
+
+//! @brief CommandIndexSetSearchPath replaces the directories of an index
+//!
+//! CommandIndexSetSearchPath
+//!
+//! Directories that were already part of the search path keep their scans.
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t CommandIndexSetSearchPath(struct CommandIndex* index, const char* searchPath)
+{
+    assert(index && searchPath);
+    if (index == nullptr || searchPath == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    try
+    {
+        std::vector<IndexedDirectory> directories;
+        ParseSearchPath(searchPath, directories);
+
+        std::lock_guard<std::mutex> lock(index->Lock);
+        for (IndexedDirectory& directory : directories)
+        {
+            for (IndexedDirectory& existing : index->Directories)
+            {
+                if (existing.Path == directory.Path)
+                {
+                    directory = std::move(existing);
+                    break;
+                }
+            }
+        }
+
+        index->Directories = std::move(directories);
+        index->Validated = false;
+        RebuildCommands(index);
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief CommandIndexLookup resolves a command name against the search path
+//!
+//! CommandIndexLookup
+//!
+//! @param[in] name
+//! @parblock
+//! The command to look for. Names containing '/' are paths rather than
+//! commands and are never found.
+//! @endparblock
+//!
+//! @param[out] buffer
+//! @parblock
+//! Receives the full path of the first executable named name in the search
+//! path.
+//! @endparblock
+//!
+//! @retval the length of the resolved path, 0 if the command was not found,
+//! or -1 with errno set (ERANGE if buffer is too small)
+//!
+int32_t CommandIndexLookup(struct CommandIndex* index, const char* name, char* buffer, int32_t bufferLength)
+{
+    assert(index && name && buffer);
+    if (index == nullptr || name == nullptr || buffer == nullptr || bufferLength <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (name[0] == '\0' || strchr(name, '/') != nullptr)
+    {
+        return 0;
+    }
+
+    try
+    {
+        std::lock_guard<std::mutex> lock(index->Lock);
+        Revalidate(index);
+
+        auto found = index->Commands.find(name);
+        if (found == index->Commands.end())
+        {
+            return 0;
+        }
+
+        const std::string& directory = index->Directories[found->second].Path;
+        bool isRoot = directory.size() == 1;
+        size_t length = directory.size() + (isRoot ? 0 : 1) + found->first.size();
+        if (length >= static_cast<size_t>(bufferLength))
+        {
+            errno = ERANGE;
+            return -1;
+        }
+
+        memcpy(buffer, directory.data(), directory.size());
+        size_t offset = directory.size();
+        if (!isRoot)
+        {
+            buffer[offset++] = '/';
+        }
+        memcpy(buffer + offset, found->first.data(), found->first.size());
+        buffer[length] = '\0';
+        return static_cast<int32_t>(length);
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+}
+
+//! @brief CommandIndexDestroy frees an index
+//!
+//! CommandIndexDestroy
+//!
+void CommandIndexDestroy(struct CommandIndex* index)
+{
+    delete index;
+}
@@ -0,0 +1,23 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+struct CommandIndex;
+
+struct CommandIndex* CommandIndexCreate(
+    const char* searchPath,                 // colon separated directories, as in PATH
+    int32_t revalidateIntervalMilliseconds);// how long directory mtimes are trusted between lookups
+int32_t CommandIndexSetSearchPath(struct CommandIndex* index, const char* searchPath);
+int32_t CommandIndexLookup(
+    struct CommandIndex* index,
+    const char* name,                       // command name, without any '/'
+    char* buffer,                           // [out] receives the resolved path, null terminated
+    int32_t bufferLength);
+void CommandIndexDestroy(struct CommandIndex* index);
+
+PAL_END_EXTERNC
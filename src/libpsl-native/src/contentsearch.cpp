@@ -0,0 +1,902 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief search the lines of files for a literal string or regular expression
+
+#include "contentsearch.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Files are read in large chunks and searched a chunk of whole lines at a time;
+    // the buffer grows for lines longer than this
+    const size_t ReadBufferSize = 1024 * 1024;
+
+    const int32_t MaxThreadCount = 64;
+
+    inline char ToLowerAscii(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    inline char ToUpperAscii(char c)
+    {
+        return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+
+    // How common a byte is in text, roughly: spaces and lower case letters most,
+    // in the order of their frequency in English, then digits, upper case letters
+    // and punctuation
+    int GetByteRank(unsigned char c)
+    {
+        static const char LetterFrequency[] = "etaoinshrdlcumwfgypbvkjxqz";
+        if (c == ' ')
+        {
+            return 100;
+        }
+        if (c >= 'a' && c <= 'z')
+        {
+            return 90 - static_cast<int>(strchr(LetterFrequency, c) - LetterFrequency);
+        }
+        if ((c >= '0' && c <= '9') || c == '\n')
+        {
+            return 50;
+        }
+        if (c >= 'A' && c <= 'Z')
+        {
+            return 45 - static_cast<int>(strchr(LetterFrequency, c - 'A' + 'a') - LetterFrequency);
+        }
+        return c < 0x80 ? 10 : 0;
+    }
+
+    // Finds a literal string in a range of bytes by scanning with memchr for its
+    // least common byte, in both cases when case is ignored, and comparing the
+    // whole literal at each hit.  Where that byte turns out to be common in the
+    // text, a case sensitive search moves on to memmem.
+    class LiteralFinder
+    {
+    public:
+        LiteralFinder()
+            : m_ignoreCase(false), m_rareOffset(0), m_lower(0), m_upper(0)
+        {
+        }
+
+        void Assign(const std::string& literal, bool ignoreCase)
+        {
+            m_ignoreCase = ignoreCase;
+            m_literal = literal;
+            if (ignoreCase)
+            {
+                std::transform(m_literal.begin(), m_literal.end(), m_literal.begin(), ToLowerAscii);
+            }
+
+            // Folded letters are searched for in both cases, and so rank as lower case
+            m_rareOffset = 0;
+            int rarest = INT_MAX;
+            for (size_t i = 0; i < m_literal.size(); i++)
+            {
+                int rank = GetByteRank(static_cast<unsigned char>(m_literal[i]));
+                if (rank < rarest)
+                {
+                    rarest = rank;
+                    m_rareOffset = i;
+                }
+            }
+            m_lower = m_literal.empty() ? 0 : m_literal[m_rareOffset];
+            m_upper = ignoreCase ? ToUpperAscii(m_lower) : m_lower;
+        }
+
+        bool Empty() const
+        {
+            return m_literal.empty();
+        }
+
+        size_t Length() const
+        {
+            return m_literal.size();
+        }
+
+        const char* Find(const char* begin, const char* end) const
+        {
+            size_t length = m_literal.size();
+            if (static_cast<size_t>(end - begin) < length)
+            {
+                return nullptr;
+            }
+
+            // The rare byte of a match starting before last
+            const char* first = begin + m_rareOffset;
+            const char* last = end - length + 1 + m_rareOffset;
+            const char* lower = FindByte(first, last, m_lower);
+            const char* upper = m_lower == m_upper ? nullptr : FindByte(first, last, m_upper);
+            size_t misses = 0;
+            while (lower != nullptr || upper != nullptr)
+            {
+                const char* candidate;
+                if (upper == nullptr || (lower != nullptr && lower < upper))
+                {
+                    candidate = lower;
+                    lower = FindByte(lower + 1, last, m_lower);
+                }
+                else
+                {
+                    candidate = upper;
+                    upper = FindByte(upper + 1, last, m_upper);
+                }
+
+                candidate -= m_rareOffset;
+                if (m_ignoreCase ? EqualsIgnoreCase(candidate, m_literal.data(), length)
+                                 : memcmp(candidate, m_literal.data(), length) == 0)
+                {
+                    return candidate;
+                }
+
+                // More than one false hit in every 64 bytes
+                if (!m_ignoreCase && ++misses > 16 && static_cast<size_t>(candidate - begin) < misses * 64)
+                {
+                    return static_cast<const char*>(memmem(candidate + 1, static_cast<size_t>(end - candidate - 1), m_literal.data(), length));
+                }
+            }
+
+            return nullptr;
+        }
+
+    private:
+        static const char* FindByte(const char* begin, const char* end, char c)
+        {
+            return begin < end ? static_cast<const char*>(memchr(begin, c, static_cast<size_t>(end - begin))) : nullptr;
+        }
+
+        // lowered is already lower case
+        static bool EqualsIgnoreCase(const char* text, const char* lowered, size_t length)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                if (ToLowerAscii(text[i]) != lowered[i])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::string m_literal;
+        bool m_ignoreCase;
+        size_t m_rareOffset;            // of the byte searched for
+        char m_lower;
+        char m_upper;
+    };
+
+    // Counts the line terminators in [begin, end) a word at a time
+    int64_t CountLines(const char* begin, const char* end)
+    {
+        const uint64_t ones = 0x0101010101010101ULL;
+        const uint64_t lows = 0x7f7f7f7f7f7f7f7fULL;
+        int64_t count = 0;
+        while (begin < end && (reinterpret_cast<uintptr_t>(begin) & 7) != 0)
+        {
+            count += *begin++ == '\n';
+        }
+
+        // Each byte of sums counts up to 255 terminators before it is added up
+        while (end - begin >= 8)
+        {
+            uint64_t sums = 0;
+            for (int i = 0; i < 255 && end - begin >= 8; i++, begin += 8)
+            {
+                uint64_t word;
+                memcpy(&word, begin, sizeof(word));
+                uint64_t x = word ^ (ones * '\n');
+                // The high bit of each byte of found is set where that byte is zero
+                uint64_t found = ~(((x & lows) + lows) | x) & ~lows;
+                sums += found >> 7;
+            }
+            uint64_t pairs = (sums & 0x00ff00ff00ff00ffULL) + ((sums >> 8) & 0x00ff00ff00ff00ffULL);
+            count += static_cast<int64_t>((pairs * 0x0001000100010001ULL) >> 48);
+        }
+
+        while (begin < end)
+        {
+            count += *begin++ == '\n';
+        }
+        return count;
+    }
+
+    struct LineMatch
+    {
+        const char* Line;
+        size_t Length;                  // without the line terminator
+        const char* Next;               // the start of the following line
+        size_t MatchOffset;
+        size_t MatchLength;
+    };
+
+    // Finds matching lines.  Where every match has to contain some literal string,
+    // the text is scanned for that string and only the lines it is found in are
+    // given to the regular expression, so that most lines are never looked at
+    // individually.
+    class ContentMatcher
+    {
+    public:
+        ContentMatcher()
+            : m_simple(false), m_never(false), m_compiled(false)
+        {
+        }
+
+        ~ContentMatcher()
+        {
+            if (m_compiled)
+            {
+                regfree(&m_regex);
+            }
+        }
+
+        // Returns 0 or an errno value; throws std::bad_alloc
+        int Compile(const char* pattern, int32_t flags)
+        {
+            bool ignoreCase = (flags & CONTENT_SEARCH_IGNORE_CASE) != 0;
+            m_simple = (flags & CONTENT_SEARCH_SIMPLE_MATCH) != 0;
+            if (m_simple)
+            {
+                // A line never contains its terminator
+                m_never = strchr(pattern, '\n') != nullptr;
+                m_literal.Assign(pattern, ignoreCase);
+                return 0;
+            }
+
+            if (regcomp(&m_regex, pattern, REG_EXTENDED | (ignoreCase ? REG_ICASE : 0)) != 0)
+            {
+                return EINVAL;
+            }
+            m_compiled = true;
+
+            // Case folding beyond ASCII is left to the regular expression
+            std::string literal = GetRequiredLiteral(pattern);
+            if (!ignoreCase || std::all_of(literal.begin(), literal.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; }))
+            {
+                m_literal.Assign(literal, ignoreCase);
+            }
+            return 0;
+        }
+
+        // Finds the first matching line in [begin, end), which holds whole lines;
+        // scratch holds a copy of the line where regexec needs it null terminated
+        bool FindLine(const char* begin, const char* end, std::string& scratch, LineMatch& match) const
+        {
+            if (m_never)
+            {
+                return false;
+            }
+
+            const char* position = begin;
+            while (position < end)
+            {
+                const char* hit = nullptr;
+                const char* line = position;
+                if (!m_literal.Empty())
+                {
+                    hit = m_literal.Find(position, end);
+                    if (hit == nullptr)
+                    {
+                        return false;
+                    }
+
+                    const char* previous = hit > position
+                        ? static_cast<const char*>(memrchr(position, '\n', static_cast<size_t>(hit - position)))
+                        : nullptr;
+                    line = previous != nullptr ? previous + 1 : position;
+                }
+
+                const char* from = hit != nullptr ? hit : line;
+                const char* terminator = static_cast<const char*>(memchr(from, '\n', static_cast<size_t>(end - from)));
+                const char* lineEnd = terminator != nullptr ? terminator : end;
+                match.Line = line;
+                match.Next = terminator != nullptr ? terminator + 1 : end;
+                match.Length = static_cast<size_t>(lineEnd - line);
+                if (match.Length > 0 && line[match.Length - 1] == '\r')
+                {
+                    match.Length--;
+                }
+
+                if (m_simple)
+                {
+                    match.MatchOffset = static_cast<size_t>(hit - line);
+                    match.MatchLength = m_literal.Length();
+                    if (match.MatchOffset + match.MatchLength <= match.Length)
+                    {
+                        return true;
+                    }
+                }
+                else if (MatchRegex(line, match, scratch))
+                {
+                    return true;
+                }
+
+                position = match.Next;
+            }
+
+            return false;
+        }
+
+    private:
+        bool MatchRegex(const char* line, LineMatch& match, std::string& scratch) const
+        {
+            regmatch_t found[1];
+#if defined(REG_STARTEND)
+            (void)scratch;
+            found[0].rm_so = 0;
+            found[0].rm_eo = static_cast<regoff_t>(match.Length);
+            if (regexec(&m_regex, line, 1, found, REG_STARTEND) != 0)
+            {
+                return false;
+            }
+#else
+            scratch.assign(line, match.Length);
+            if (regexec(&m_regex, scratch.c_str(), 1, found, 0) != 0)
+            {
+                return false;
+            }
+#endif
+            match.MatchOffset = static_cast<size_t>(found[0].rm_so);
+            match.MatchLength = static_cast<size_t>(found[0].rm_eo - found[0].rm_so);
+            return true;
+        }
+
+        // Returns the end of the bracket expression starting at pattern, or nullptr
+        static const char* SkipBracket(const char* pattern)
+        {
+            const char* p = pattern + 1;
+            if (*p == '^')
+            {
+                p++;
+            }
+            if (*p == ']')
+            {
+                p++;
+            }
+            for (; *p != '\0' && *p != ']'; p++)
+            {
+                if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+                {
+                    const char* close = strchr(p + 2, ']');
+                    while (close != nullptr && close[-1] != p[1])
+                    {
+                        close = strchr(close + 1, ']');
+                    }
+                    if (close == nullptr)
+                    {
+                        return nullptr;
+                    }
+                    p = close;
+                }
+            }
+            return *p == ']' ? p : nullptr;
+        }
+
+        // Returns the end of the group starting at pattern, or nullptr
+        static const char* SkipGroup(const char* pattern)
+        {
+            int depth = 0;
+            for (const char* p = pattern; *p != '\0'; p++)
+            {
+                if (*p == '\\')
+                {
+                    if (*++p == '\0')
+                    {
+                        return nullptr;
+                    }
+                }
+                else if (*p == '[')
+                {
+                    if ((p = SkipBracket(p)) == nullptr)
+                    {
+                        return nullptr;
+                    }
+                }
+                else if (*p == '(')
+                {
+                    depth++;
+                }
+                else if (*p == ')' && --depth == 0)
+                {
+                    return p;
+                }
+            }
+            return nullptr;
+        }
+
+        static void EndRun(std::string& run, std::string& best)
+        {
+            if (run.size() > best.size())
+            {
+                best = run;
+            }
+            run.clear();
+        }
+
+        // Returns the longest run of literal characters that every match of an
+        // extended regular expression contains, or an empty string where there is
+        // none that is simple to be sure of.  Groups and bracket expressions are
+        // skipped, and a character followed by a quantifier that allows zero
+        // repetitions is not part of a run.
+        static std::string GetRequiredLiteral(const char* pattern)
+        {
+            std::string best;
+            if (strchr(pattern, '|') != nullptr)
+            {
+                return best;
+            }
+
+            std::string run;
+            for (const char* p = pattern; *p != '\0'; p++)
+            {
+                switch (*p)
+                {
+                    case '\\':
+                        // Escaped metacharacters are literal; anything else escaped is
+                        // a class, an anchor such as \< or a back-reference
+                        if (p[1] == '\0')
+                        {
+                            return best;
+                        }
+                        if (strchr(".[]\\*+?(){}|^$", p[1]) != nullptr)
+                        {
+                            run += p[1];
+                        }
+                        else
+                        {
+                            EndRun(run, best);
+                        }
+                        p++;
+                        break;
+                    case '*':
+                    case '?':
+                    case '{':
+                        // The last character is optional; one outside ASCII is several
+                        // bytes, so all the bytes outside ASCII at the end are dropped
+                        if (!run.empty() && static_cast<unsigned char>(run.back()) >= 0x80)
+                        {
+                            while (!run.empty() && static_cast<unsigned char>(run.back()) >= 0x80)
+                            {
+                                run.pop_back();
+                            }
+                        }
+                        else if (!run.empty())
+                        {
+                            run.pop_back();
+                        }
+                        EndRun(run, best);
+                        if (*p == '{' && (p = strchr(p, '}')) == nullptr)
+                        {
+                            return best;
+                        }
+                        break;
+                    case '[':
+                    case '(':
+                        EndRun(run, best);
+                        if ((p = *p == '[' ? SkipBracket(p) : SkipGroup(p)) == nullptr)
+                        {
+                            return std::string();
+                        }
+                        break;
+                    case '+':
+                    case '.':
+                    case '^':
+                    case '$':
+                    case ')':
+                    case '\n':
+                        EndRun(run, best);
+                        break;
+                    default:
+                        run += *p;
+                        break;
+                }
+            }
+
+            return run.size() > best.size() ? run : best;
+        }
+
+        LiteralFinder m_literal;
+        bool m_simple;
+        bool m_never;                   // the pattern cannot match within a line
+        bool m_compiled;
+        regex_t m_regex;
+    };
+
+    struct FileMatches
+    {
+        int Error;
+        std::vector<ContentMatch> Matches;
+        std::string Text;               // the matching lines, each null terminated
+    };
+
+    struct SearchWork
+    {
+        const char* const* Paths;
+        int32_t Count;
+        const char* Pattern;
+        int32_t Flags;
+        std::vector<FileMatches>* Files;
+        std::atomic<int32_t> Next;
+        std::atomic<bool> OutOfMemory;
+    };
+}
+
+// Searches the whole lines in [begin, end), which start at file offset lineOffset
+// and line number *lineNumber.  Returns true if the search of the file is done.
+// Throws std::bad_alloc.
+static bool SearchLines(
+    const char* begin,
+    const char* end,
+    int64_t lineOffset,
+    int64_t* lineNumber,
+    int32_t fileIndex,
+    const ContentMatcher& matcher,
+    bool list,
+    std::string& scratch,
+    FileMatches& file)
+{
+    const char* counted = begin;
+    LineMatch match;
+    bool done = false;
+    const char* position = begin;
+    while (position < end && matcher.FindLine(position, end, scratch, match))
+    {
+        *lineNumber += CountLines(counted, match.Line);
+        counted = match.Line;
+
+        ContentMatch found = {};
+        found.File = fileIndex;
+        found.LineNumber = *lineNumber;
+        found.LineOffset = lineOffset + (match.Line - begin);
+        found.LineLength = static_cast<int64_t>(match.Length);
+        found.MatchOffset = static_cast<int64_t>(match.MatchOffset);
+        found.MatchLength = static_cast<int64_t>(match.MatchLength);
+        found.TextOffset = static_cast<int64_t>(file.Text.size());
+        file.Matches.push_back(found);
+        file.Text.append(match.Line, match.Length);
+        file.Text.push_back('\0');
+
+        if (list)
+        {
+            done = true;
+            break;
+        }
+        position = match.Next;
+    }
+
+    *lineNumber += CountLines(counted, end);
+    return done;
+}
+
+// Returns 0 or the errno that kept the file from being read; throws std::bad_alloc
+static int SearchFile(
+    int32_t fileIndex, const SearchWork& work, const ContentMatcher& matcher, std::vector<char>& buffer, std::string& scratch, FileMatches& file)
+{
+    int fd;
+    while ((fd = open(work.Paths[fileIndex], O_RDONLY | O_CLOEXEC)) < 0 && errno == EINTR);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (buffer.empty())
+    {
+        buffer.resize(ReadBufferSize);
+    }
+
+    int error = 0;
+    size_t filled = 0;
+    int64_t bufferOffset = 0;       // file offset of the start of the buffer
+    int64_t lineNumber = 1;
+    bool list = (work.Flags & CONTENT_SEARCH_LIST) != 0;
+    bool endOfFile = false;
+    try
+    {
+        while (!endOfFile)
+        {
+            if (filled == buffer.size())
+            {
+                buffer.resize(buffer.size() * 2);
+            }
+
+            ssize_t count = read(fd, buffer.data() + filled, buffer.size() - filled);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            endOfFile = count == 0;
+            filled += static_cast<size_t>(count);
+
+            // Search up to the end of the last whole line and keep the rest for the
+            // next read; at the end of the file the last line needs no terminator
+            const char* data = buffer.data();
+            const char* lastTerminator = endOfFile ? nullptr : static_cast<const char*>(memrchr(data, '\n', filled));
+            size_t searched = endOfFile ? filled : lastTerminator != nullptr ? static_cast<size_t>(lastTerminator - data) + 1 : 0;
+            if (searched == 0)
+            {
+                continue;
+            }
+
+            if (SearchLines(data, data + searched, bufferOffset, &lineNumber, fileIndex, matcher, list, scratch, file))
+            {
+                break;
+            }
+
+            memmove(buffer.data(), buffer.data() + searched, filled - searched);
+            filled -= searched;
+            bufferOffset += static_cast<int64_t>(searched);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+    return error;
+}
+
+// Each worker compiles its own copy of the pattern, since regexec serializes the
+// threads that share one
+static void RunSearchWorker(SearchWork* work)
+{
+    try
+    {
+        // The pattern compiled once already, so only memory can run out here
+        ContentMatcher matcher;
+        if (matcher.Compile(work->Pattern, work->Flags) != 0)
+        {
+            work->OutOfMemory = true;
+            return;
+        }
+
+        std::vector<char> buffer;
+        std::string scratch;
+        int32_t index;
+        while (!work->OutOfMemory && (index = work->Next++) < work->Count)
+        {
+            FileMatches& file = (*work->Files)[index];
+            file.Error = work->Paths[index] == nullptr ? EINVAL : SearchFile(index, *work, matcher, buffer, scratch, file);
+            if (file.Error != 0)
+            {
+                file.Matches.clear();
+                file.Text.clear();
+            }
+
+            // A very long line may have grown the buffer; do not keep it for every file
+            if (buffer.size() > ReadBufferSize)
+            {
+                std::vector<char>().swap(buffer);
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        work->OutOfMemory = true;
+    }
+}
+
+//! @brief SearchFileContents finds the lines of files that match a pattern
+//!
+//! SearchFileContents
+//!
+//! Files are searched in parallel and read in large chunks, and each chunk
+//! is searched as a whole rather than line by line. A literal pattern, and
+//! the longest literal string every match of a regular expression has to
+//! contain, are found with memmem or memchr, and the regular expression is
+//! only run on the lines where that string is. Lines end at '\n', and a
+//! '\r' before it is not part of the line. Like Select-String, a line is
+//! reported once, with its first match. No decoding is done: the pattern
+//! and the files are compared byte by byte, so both should be in the same
+//! encoding, normally UTF-8.
+//!
+//! @param[in] paths
+//! @parblock
+//! The files to search; symbolic links are followed.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] count
+//! @parblock
+//! The number of paths.
+//! @endparblock
+//!
+//! @param[in] pattern
+//! @parblock
+//! A POSIX extended regular expression, or with CONTENT_SEARCH_SIMPLE_MATCH
+//! a literal string. It cannot be empty.
+//! @endparblock
+//!
+//! @param[in] flags
+//! @parblock
+//! CONTENT_SEARCH_IGNORE_CASE, CONTENT_SEARCH_SIMPLE_MATCH and
+//! CONTENT_SEARCH_LIST. Ignoring case only folds ASCII letters in literal
+//! patterns.
+//! @endparblock
+//!
+//! @param[in] threadCount
+//! @parblock
+//! How many files to search at a time, 0 for one per processor. At most 64
+//! threads are used.
+//! @endparblock
+//!
+//! @param[out] result
+//! @parblock
+//! Receives the matching lines and an error for each file that could not be
+//! read. Free it with FreeContentSearchResult.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set (EINVAL if the
+//! regular expression is not valid)
+//!
+int32_t SearchFileContents(
+    const char* const* paths, int32_t count, const char* pattern, int32_t flags, int32_t threadCount, struct ContentSearchResult** result)
+{
+    assert(paths && pattern && result);
+    if (paths == nullptr || pattern == nullptr || result == nullptr || *pattern == '\0' || count < 0 || threadCount < 0 ||
+        (flags & ~(CONTENT_SEARCH_IGNORE_CASE | CONTENT_SEARCH_SIMPLE_MATCH | CONTENT_SEARCH_LIST)) != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *result = nullptr;
+
+    try
+    {
+        {
+            ContentMatcher matcher;
+            int error = matcher.Compile(pattern, flags);
+            if (error != 0)
+            {
+                errno = error;
+                return -1;
+            }
+        }
+
+        if (threadCount == 0)
+        {
+            long processors = sysconf(_SC_NPROCESSORS_ONLN);
+            threadCount = processors > 0 ? static_cast<int32_t>(processors) : 1;
+        }
+        if (threadCount > MaxThreadCount)
+        {
+            threadCount = MaxThreadCount;
+        }
+        if (threadCount > count)
+        {
+            threadCount = count > 0 ? count : 1;
+        }
+
+        std::vector<FileMatches> files(count);
+        SearchWork work;
+        work.Paths = paths;
+        work.Count = count;
+        work.Pattern = pattern;
+        work.Flags = flags;
+        work.Files = &files;
+        work.Next = 0;
+        work.OutOfMemory = false;
+
+        std::vector<std::thread> threads;
+        try
+        {
+            threads.reserve(threadCount - 1);
+            for (int32_t i = 1; i < threadCount; i++)
+            {
+                threads.push_back(std::thread(RunSearchWorker, &work));
+            }
+        }
+        catch (const std::exception&)
+        {
+            // Search with the threads that did start
+        }
+
+        RunSearchWorker(&work);
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        if (work.OutOfMemory)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        size_t matchCount = 0;
+        size_t textLength = 0;
+        for (const FileMatches& file : files)
+        {
+            matchCount += file.Matches.size();
+            textLength += file.Text.size();
+        }
+        if (matchCount > static_cast<size_t>(INT32_MAX))
+        {
+            errno = EOVERFLOW;
+            return -1;
+        }
+
+        ContentSearchResult* searched = static_cast<ContentSearchResult*>(calloc(1, sizeof(ContentSearchResult)));
+        if (searched == nullptr ||
+            (searched->Matches = static_cast<ContentMatch*>(malloc(std::max<size_t>(matchCount, 1) * sizeof(ContentMatch)))) == nullptr ||
+            (searched->Errors = static_cast<int32_t*>(malloc(std::max<int32_t>(count, 1) * sizeof(int32_t)))) == nullptr ||
+            (searched->Text = static_cast<char*>(malloc(std::max<size_t>(textLength, 1)))) == nullptr)
+        {
+            FreeContentSearchResult(searched);
+            errno = ENOMEM;
+            return -1;
+        }
+
+        searched->MatchCount = static_cast<int32_t>(matchCount);
+        searched->FileCount = count;
+        size_t matchIndex = 0;
+        size_t textOffset = 0;
+        for (int32_t i = 0; i < count; i++)
+        {
+            const FileMatches& file = files[i];
+            searched->Errors[i] = file.Error;
+            for (const ContentMatch& match : file.Matches)
+            {
+                searched->Matches[matchIndex] = match;
+                searched->Matches[matchIndex].TextOffset += static_cast<int64_t>(textOffset);
+                matchIndex++;
+            }
+            memcpy(searched->Text + textOffset, file.Text.data(), file.Text.size());
+            textOffset += file.Text.size();
+        }
+
+        *result = searched;
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief FreeContentSearchResult frees the matches returned by
+//! SearchFileContents
+//!
+//! FreeContentSearchResult
+//!
+void FreeContentSearchResult(struct ContentSearchResult* result)
+{
+    if (result == nullptr)
+    {
+        return;
+    }
+
+    free(result->Matches);
+    free(result->Errors);
+    free(result->Text);
+    free(result);
+}
@@ -0,0 +1,49 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Flags for SearchFileContents
+enum
+{
+    CONTENT_SEARCH_IGNORE_CASE = 0x00000001,
+    CONTENT_SEARCH_SIMPLE_MATCH = 0x00000002,       // the pattern is a literal string rather than a regular expression
+    CONTENT_SEARCH_LIST = 0x00000004                // stop at the first matching line of each file
+};
+
+// One matching line
+struct ContentMatch
+{
+    int32_t File;                   // index of the file in the paths searched
+    int32_t Reserved;
+    int64_t LineNumber;             // 1 for the first line
+    int64_t LineOffset;             // byte offset of the line in the file
+    int64_t LineLength;             // without the line terminator
+    int64_t MatchOffset;            // byte offset of the first match in the line
+    int64_t MatchLength;
+    int64_t TextOffset;             // offset of the null terminated line in ContentSearchResult.Text
+};
+
+struct ContentSearchResult
+{
+    int32_t MatchCount;
+    int32_t FileCount;
+    struct ContentMatch* Matches;   // in the order of the paths, then of the lines
+    int32_t* Errors;                // FileCount errno values, 0 for each file that was searched
+    char* Text;
+};
+
+int32_t SearchFileContents(
+    const char* const* paths,
+    int32_t count,
+    const char* pattern,
+    int32_t flags,
+    int32_t threadCount,
+    struct ContentSearchResult** result);
+void FreeContentSearchResult(struct ContentSearchResult* result);
+
+PAL_END_EXTERNC
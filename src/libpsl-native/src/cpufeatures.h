@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Internal to libpsl-native, not exported
+
+#pragma once
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PAL_HAVE_X86_SHA_KERNELS 1
+#include <cpuid.h>
+
+// Whether the processor has the SHA extensions, along with the SSSE3 and SSE4.1
+// instructions the SHA-1 and SHA-256 kernels built on them also use
+inline bool HasShaExtensions()
+{
+    static const bool supported = []
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0)
+        {
+            return false;
+        }
+        return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0 && (ebx & (1u << 29)) != 0;
+    }();
+    return supported;
+}
+#endif
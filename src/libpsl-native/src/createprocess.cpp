@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 #include "createprocess.h"
+#include "environmentblock.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -12,13 +13,48 @@
 #include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 #include <syslog.h>
+#include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+
+#ifndef __NR_clone3
+#define __NR_clone3 435
+#endif
+
+// Mirrors struct clone_args from linux/sched.h, which older build hosts do not have
+struct CloneArgs
+{
+    uint64_t Flags;
+    uint64_t PidFd;
+    uint64_t ChildTid;
+    uint64_t ParentTid;
+    uint64_t ExitSignal;
+    uint64_t Stack;
+    uint64_t StackSize;
+    uint64_t Tls;
+    uint64_t SetTid;
+    uint64_t SetTidSize;
+    uint64_t Cgroup;
+};
+
+static const uint64_t CloneIntoCgroup = 0x200000000ULL;   // CLONE_INTO_CGROUP
+static const int IoPriorityWhoProcess = 1;                // IOPRIO_WHO_PROCESS
+static const int IoPriorityClassShift = 13;               // IOPRIO_CLASS_SHIFT
+#endif
 
 enum
 {
-    SUPPRESS_PROCESS_SIGINT = 0x00000001
+    SUPPRESS_PROCESS_SIGINT = 0x00000001,
+    CREATE_NEW_PROCESS_GROUP = 0x00000002,
+    CREATE_NEW_SESSION = 0x00000004
 };
 
 enum
@@ -50,6 +86,350 @@ static int Dup2WithInterruptedRetry(int oldfd, int newfd)
     return result;
 }
 
+// Spawn attributes converted to their native form before forking, so that the
+// child only has to make system calls before execve
+struct PreparedAttributes
+{
+    int32_t Flags = 0;
+    int Nice = 0;
+    int IoPriority = 0;
+    std::vector<std::pair<int, struct rlimit>> ResourceLimits;
+#if defined(__linux__)
+    cpu_set_t* CpuSet = nullptr;
+    size_t CpuSetSize = 0;
+#endif
+    int CgroupFd = -1;
+    int StdioFds[3] = { -1, -1, -1 };                  // descriptors for the child's stdin, stdout and stderr
+    bool OwnsStdioFd[3] = { false, false, false };     // whether we opened them and have to close them
+    bool MergeStderr = false;
+    int ControllingTerminal = -1;                      // terminal the child makes its controlling terminal, not owned
+    char* const* Environment = nullptr;                // SPAWN_ATTRIBUTE_ENVIRONMENT variables, used instead of envp
+
+    ~PreparedAttributes()
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (OwnsStdioFd[i])
+            {
+                CloseIfOpen(StdioFds[i]);
+            }
+        }
+
+#if defined(__linux__)
+        if (CpuSet != nullptr)
+        {
+            CPU_FREE(CpuSet);
+        }
+#endif
+        CloseIfOpen(CgroupFd);
+    }
+};
+
+static bool TryConvertResource(int32_t resource, int* nativeResource)
+{
+    switch (resource)
+    {
+        case SPAWN_RLIMIT_CPU: *nativeResource = RLIMIT_CPU; return true;
+        case SPAWN_RLIMIT_FSIZE: *nativeResource = RLIMIT_FSIZE; return true;
+        case SPAWN_RLIMIT_DATA: *nativeResource = RLIMIT_DATA; return true;
+        case SPAWN_RLIMIT_STACK: *nativeResource = RLIMIT_STACK; return true;
+        case SPAWN_RLIMIT_CORE: *nativeResource = RLIMIT_CORE; return true;
+        case SPAWN_RLIMIT_NOFILE: *nativeResource = RLIMIT_NOFILE; return true;
+        case SPAWN_RLIMIT_AS: *nativeResource = RLIMIT_AS; return true;
+        case SPAWN_RLIMIT_NPROC: *nativeResource = RLIMIT_NPROC; return true;
+        case SPAWN_RLIMIT_MEMLOCK: *nativeResource = RLIMIT_MEMLOCK; return true;
+        default: return false;
+    }
+}
+
+static rlim_t ConvertLimit(uint64_t limit)
+{
+    return limit == UINT64_MAX ? RLIM_INFINITY : static_cast<rlim_t>(limit);
+}
+
+// Resolves one SPAWN_ATTRIBUTE_STDIO target. Files are opened here in the parent,
+// so that a bad path or a permission problem fails the call instead of the child.
+static bool PrepareStdioTarget(const struct SpawnStdioTarget& target, int stream, PreparedAttributes& prepared)
+{
+    switch (target.Kind)
+    {
+        case SPAWN_STDIO_DEFAULT:
+            return true;
+
+        case SPAWN_STDIO_FD:
+            if (target.Fd < 0 || fcntl(target.Fd, F_GETFD) == -1)
+            {
+                errno = EBADF;
+                return false;
+            }
+            prepared.StdioFds[stream] = target.Fd;
+            return true;
+
+        case SPAWN_STDIO_PATH:
+        {
+            const int32_t knownOpenFlags = SPAWN_OPEN_CREATE | SPAWN_OPEN_TRUNCATE | SPAWN_OPEN_APPEND | SPAWN_OPEN_EXCLUSIVE;
+            if (target.Path == nullptr || (target.OpenFlags & ~knownOpenFlags) != 0)
+            {
+                errno = EINVAL;
+                return false;
+            }
+
+            int flags = (stream == STDIN_FILENO ? O_RDONLY : O_WRONLY) | O_CLOEXEC;
+            flags |= (target.OpenFlags & SPAWN_OPEN_CREATE) ? O_CREAT : 0;
+            flags |= (target.OpenFlags & SPAWN_OPEN_TRUNCATE) ? O_TRUNC : 0;
+            flags |= (target.OpenFlags & SPAWN_OPEN_APPEND) ? O_APPEND : 0;
+            flags |= (target.OpenFlags & SPAWN_OPEN_EXCLUSIVE) ? O_EXCL : 0;
+
+            int fd;
+            while (CheckInterrupted(fd = open(target.Path, flags, static_cast<mode_t>(target.Mode))));
+            if (fd < 0)
+            {
+                return false;
+            }
+            prepared.StdioFds[stream] = fd;
+            prepared.OwnsStdioFd[stream] = true;
+            return true;
+        }
+
+        case SPAWN_STDIO_MERGE_STDOUT:
+            if (stream != STDERR_FILENO)
+            {
+                errno = EINVAL;
+                return false;
+            }
+            prepared.MergeStderr = true;
+            return true;
+
+        default:
+            errno = EINVAL;
+            return false;
+    }
+}
+
+static bool HasEnvironment(const struct SpawnAttributes* attributes)
+{
+    return attributes != nullptr && (attributes->Flags & SPAWN_ATTRIBUTE_ENVIRONMENT) && attributes->Environment != nullptr;
+}
+
+// Validates the caller's attributes and converts them for ApplyAttributesInChild.
+// Returns false with errno set if the attributes are invalid or unsupported here.
+static bool PrepareAttributes(const struct SpawnAttributes* attributes, PreparedAttributes& prepared)
+{
+    if (attributes == nullptr)
+    {
+        return true;
+    }
+
+    const int32_t knownFlags = SPAWN_ATTRIBUTE_NICE | SPAWN_ATTRIBUTE_IO_PRIORITY | SPAWN_ATTRIBUTE_RESOURCE_LIMITS |
+                               SPAWN_ATTRIBUTE_CPU_AFFINITY | SPAWN_ATTRIBUTE_CGROUP | SPAWN_ATTRIBUTE_STDIO |
+                               SPAWN_ATTRIBUTE_ENVIRONMENT;
+    if ((attributes->Flags & ~knownFlags) != 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    prepared.Flags = attributes->Flags;
+    prepared.Nice = attributes->Nice;
+
+    if (attributes->Flags & SPAWN_ATTRIBUTE_RESOURCE_LIMITS)
+    {
+        if (attributes->ResourceLimitCount < 0 ||
+            (attributes->ResourceLimits == nullptr && attributes->ResourceLimitCount != 0))
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        for (int32_t i = 0; i < attributes->ResourceLimitCount; i++)
+        {
+            const struct SpawnResourceLimit& limit = attributes->ResourceLimits[i];
+            std::pair<int, struct rlimit> nativeLimit;
+            if (!TryConvertResource(limit.Resource, &nativeLimit.first))
+            {
+                errno = EINVAL;
+                return false;
+            }
+
+            nativeLimit.second.rlim_cur = ConvertLimit(limit.SoftLimit);
+            nativeLimit.second.rlim_max = ConvertLimit(limit.HardLimit);
+            prepared.ResourceLimits.push_back(nativeLimit);
+        }
+    }
+
+    if (attributes->Flags & SPAWN_ATTRIBUTE_ENVIRONMENT)
+    {
+        if (attributes->Environment == nullptr)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        prepared.Environment = EnvironmentBlockGetVariables(attributes->Environment);
+    }
+
+    if ((attributes->Flags & SPAWN_ATTRIBUTE_STDIO) &&
+        (!PrepareStdioTarget(attributes->Stdin, STDIN_FILENO, prepared) ||
+         !PrepareStdioTarget(attributes->Stdout, STDOUT_FILENO, prepared) ||
+         !PrepareStdioTarget(attributes->Stderr, STDERR_FILENO, prepared)))
+    {
+        return false;
+    }
+
+#if defined(__linux__)
+    if (attributes->Flags & SPAWN_ATTRIBUTE_IO_PRIORITY)
+    {
+        if (attributes->IoPriorityClass < 1 || attributes->IoPriorityClass > 3 ||
+            attributes->IoPriorityLevel < 0 || attributes->IoPriorityLevel > 7)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        prepared.IoPriority = (attributes->IoPriorityClass << IoPriorityClassShift) | attributes->IoPriorityLevel;
+    }
+
+    if (attributes->Flags & SPAWN_ATTRIBUTE_CPU_AFFINITY)
+    {
+        if (attributes->CpuAffinityMaskLength <= 0 || attributes->CpuAffinityMask == nullptr)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        int cpuCount = attributes->CpuAffinityMaskLength * 64;
+        prepared.CpuSet = CPU_ALLOC(cpuCount);
+        if (prepared.CpuSet == nullptr)
+        {
+            errno = ENOMEM;
+            return false;
+        }
+
+        prepared.CpuSetSize = CPU_ALLOC_SIZE(cpuCount);
+        CPU_ZERO_S(prepared.CpuSetSize, prepared.CpuSet);
+        for (int cpu = 0; cpu < cpuCount; cpu++)
+        {
+            if (attributes->CpuAffinityMask[cpu / 64] & (1ULL << (cpu % 64)))
+            {
+                CPU_SET_S(cpu, prepared.CpuSetSize, prepared.CpuSet);
+            }
+        }
+    }
+
+    if (attributes->Flags & SPAWN_ATTRIBUTE_CGROUP)
+    {
+        if (attributes->CgroupPath == nullptr)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        while (CheckInterrupted(prepared.CgroupFd = open(attributes->CgroupPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+        if (prepared.CgroupFd < 0)
+        {
+            return false;
+        }
+    }
+#else
+    if (attributes->Flags & (SPAWN_ATTRIBUTE_IO_PRIORITY | SPAWN_ATTRIBUTE_CPU_AFFINITY | SPAWN_ATTRIBUTE_CGROUP))
+    {
+        errno = ENOTSUP;
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+// Forks the child. When a cgroup was requested, clone3 with CLONE_INTO_CGROUP starts the
+// child directly inside it; *placedInCgroup tells the child whether it still has to move
+// itself because clone3 or CLONE_INTO_CGROUP is unavailable (before Linux 5.7, or blocked
+// by a seccomp policy).
+static pid_t ForkChild(const PreparedAttributes& prepared, bool* placedInCgroup)
+{
+    *placedInCgroup = false;
+
+#if defined(__linux__)
+    if (prepared.CgroupFd >= 0)
+    {
+        struct CloneArgs args;
+        memset(&args, 0, sizeof(args));
+        args.Flags = CloneIntoCgroup;
+        args.ExitSignal = SIGCHLD;
+        args.Cgroup = static_cast<uint64_t>(prepared.CgroupFd);
+
+        long result = syscall(__NR_clone3, &args, sizeof(args));
+        if (result >= 0)
+        {
+            *placedInCgroup = true;
+            return static_cast<pid_t>(result);
+        }
+
+        if (errno != ENOSYS && errno != E2BIG)
+        {
+            return -1;
+        }
+    }
+#endif
+
+    return fork();
+}
+
+// Applies the prepared attributes to the calling (child) process.
+// Only async-signal-safe calls may be made here.
+static int ApplyAttributesInChild(const PreparedAttributes& prepared, bool placedInCgroup)
+{
+#if defined(__linux__)
+    if (prepared.CgroupFd >= 0 && !placedInCgroup)
+    {
+        int procsFd;
+        while (CheckInterrupted(procsFd = openat(prepared.CgroupFd, "cgroup.procs", O_WRONLY | O_CLOEXEC)));
+        if (procsFd < 0)
+        {
+            return -1;
+        }
+
+        // Writing 0 moves the writing process
+        ssize_t written;
+        while (CheckInterrupted(written = write(procsFd, "0", 1)));
+        close(procsFd);
+        if (written != 1)
+        {
+            return -1;
+        }
+    }
+
+    if ((prepared.Flags & SPAWN_ATTRIBUTE_IO_PRIORITY) &&
+        syscall(SYS_ioprio_set, IoPriorityWhoProcess, 0, prepared.IoPriority) == -1)
+    {
+        return -1;
+    }
+
+    if ((prepared.Flags & SPAWN_ATTRIBUTE_CPU_AFFINITY) &&
+        sched_setaffinity(0, prepared.CpuSetSize, prepared.CpuSet) == -1)
+    {
+        return -1;
+    }
+#else
+    (void)placedInCgroup;
+#endif
+
+    if ((prepared.Flags & SPAWN_ATTRIBUTE_NICE) && setpriority(PRIO_PROCESS, 0, prepared.Nice) == -1)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < prepared.ResourceLimits.size(); i++)
+    {
+        if (setrlimit(prepared.ResourceLimits[i].first, &prepared.ResourceLimits[i].second) == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 int32_t SystemNative_Pipe(int32_t pipeFds[2], int32_t flags)
 {
     int32_t result;
@@ -76,6 +456,142 @@ int32_t SystemNative_Pipe(int32_t pipeFds[2], int32_t flags)
     return result;
 }
 
+// Returns the descriptor the child's stderr should be duplicated from when it is not
+// redirected to the parent: its own SPAWN_ATTRIBUTE_STDIO target, the same descriptor
+// as its stdout for SPAWN_STDIO_MERGE_STDOUT, or -1 to inherit the parent's.
+static int GetChildStderr(const PreparedAttributes& prepared, int childStdout)
+{
+    if (prepared.MergeStderr)
+    {
+        return childStdout != -1 ? childStdout : STDOUT_FILENO;
+    }
+
+    return prepared.StdioFds[STDERR_FILENO];
+}
+
+// Forks and executes a single child with the given descriptors as its standard streams;
+// -1 leaves the corresponding stream inherited from the parent.  With CREATE_NEW_PROCESS_GROUP,
+// a processGroup of 0 makes the child the leader of a new group and any other value makes it
+// join that group.  If holdFds is not null, the child waits before it executes until every
+// copy of the pipe's write end has been closed.  Returns the child's pid, or -1 with errno
+// set if the fork failed.
+static pid_t SpawnChild(
+    const char* filename,
+    char* const argv[],
+    char* const envp[],
+    const char* cwd,
+    int childStdin,
+    int childStdout,
+    int childStderr,
+    int32_t creationFlags,
+    pid_t processGroup,
+    const int* holdFds,
+    const PreparedAttributes& prepared)
+{
+    bool placedInCgroup = false;
+    pid_t processId = ForkChild(prepared, &placedInCgroup);
+    if (processId == -1)
+    {
+        return -1;
+    }
+
+    if (processId == 0) // processId == 0 if this is child process
+    {
+        // A source may itself be a standard descriptor, such as a SPAWN_STDIO_FD of 1 for stderr,
+        // which the dup2 onto an earlier stream would replace, so move those out of the way first
+        int* sources[] = { &childStdin, &childStdout, &childStderr };
+        for (int* source : sources)
+        {
+            if (*source != -1 && *source <= STDERR_FILENO &&
+                (*source = fcntl(*source, F_DUPFD_CLOEXEC, STDERR_FILENO + 1)) == -1)
+            {
+                _exit(errno != 0 ? errno : EXIT_FAILURE);
+            }
+        }
+
+        // For any redirections that should happen, dup the pipe descriptors onto stdin/out/err.
+        // We don't explicitly close out the old pipe descriptors because they are set to close on execve.
+        if ((childStdin != -1 && Dup2WithInterruptedRetry(childStdin, STDIN_FILENO) == -1) ||
+            (childStdout != -1 && Dup2WithInterruptedRetry(childStdout, STDOUT_FILENO) == -1) ||
+            (childStderr != -1 && Dup2WithInterruptedRetry(childStderr, STDERR_FILENO) == -1))
+        {
+            _exit(errno != 0 ? errno : EXIT_FAILURE);
+        }
+
+        // Detach from the parent's process group or session if requested, so the child
+        // and its descendants can be signaled, suspended and waited on as a unit
+        if (((creationFlags & CREATE_NEW_SESSION) && setsid() == -1) ||
+            ((creationFlags & CREATE_NEW_PROCESS_GROUP) && setpgid(0, processGroup) == -1))
+        {
+            _exit(errno != 0 ? errno : EXIT_FAILURE);
+        }
+
+        // Keep the group's leader alive until the rest of the pipeline has joined its group
+        if (holdFds != nullptr)
+        {
+            char unused;
+            close(holdFds[WRITE_END_OF_PIPE]);
+            while (CheckInterrupted(read(holdFds[READ_END_OF_PIPE], &unused, 1)));
+        }
+
+        // A session leader acquires its controlling terminal explicitly, as the terminal was
+        // opened with O_NOCTTY before the session existed
+        if (prepared.ControllingTerminal != -1 && ioctl(prepared.ControllingTerminal, TIOCSCTTY, 0) == -1)
+        {
+            _exit(errno != 0 ? errno : EXIT_FAILURE);
+        }
+
+        // Change to the designated working directory, if one was specified
+        if (nullptr != cwd)
+        {
+            int result;
+            while (CheckInterrupted(result = chdir(cwd)));
+            if (result == -1)
+            {
+                _exit(errno != 0 ? errno : EXIT_FAILURE);
+            }
+        }
+
+        // If SUPPRESS_PROCESS_SIGINT was chosen then create a process that ignores
+        // interrupt signals
+        if (creationFlags & SUPPRESS_PROCESS_SIGINT)
+        {
+            struct sigaction sa, saOld;
+            memset(&sa, 0, sizeof(sa));
+            memset(&saOld, 0, sizeof(saOld));
+            sigemptyset(&(sa.sa_mask));
+            sa.sa_handler = SIG_IGN;        // Ignore the signal
+
+            int result = sigaction(SIGINT, &sa, &saOld);
+            if (result == -1)
+            {
+                _exit(errno != 0 ? errno : EXIT_FAILURE);
+            }
+        }
+
+        // Apply scheduling, resource and placement attributes last, so that a lowered RLIMIT_NOFILE
+        // or a realtime I/O class cannot get in the way of the setup above
+        if (ApplyAttributesInChild(prepared, placedInCgroup) == -1)
+        {
+            _exit(errno != 0 ? errno : EXIT_FAILURE);
+        }
+
+        // Finally, execute the new process.  execve will not return if it's successful.
+        execve(filename, argv, prepared.Environment != nullptr ? prepared.Environment : envp);
+        _exit(errno != 0 ? errno : EXIT_FAILURE); // execve failed
+    }
+
+    // Also move the child into its process group from the parent, so that the group
+    // exists as soon as we return regardless of how far the child has gotten.  This fails
+    // harmlessly with EACCES if the child has already called execve.
+    if (creationFlags & CREATE_NEW_PROCESS_GROUP)
+    {
+        setpgid(processId, processGroup == 0 ? processId : processGroup);
+    }
+
+    return processId;
+}
+
 int32_t ForkAndExecProcess(
     const char* filename,
     char* const argv[],
@@ -89,16 +605,38 @@ int32_t ForkAndExecProcess(
     int32_t* stdinFd,
     int32_t* stdoutFd,
     int32_t* stderrFd)
+{
+    return ForkAndExecProcessWithAttributes(
+        filename, argv, envp, cwd, redirectStdin, redirectStdout, redirectStderr, creationFlags,
+        nullptr, childPid, stdinFd, stdoutFd, stderrFd);
+}
+
+int32_t ForkAndExecProcessWithAttributes(
+    const char* filename,
+    char* const argv[],
+    char* const envp[],
+    const char* cwd,
+    int32_t redirectStdin,
+    int32_t redirectStdout,
+    int32_t redirectStderr,
+    int32_t creationFlags,
+    const struct SpawnAttributes* attributes,
+    int32_t* childPid,
+    int32_t* stdinFd,
+    int32_t* stdoutFd,
+    int32_t* stderrFd)
 {
     int success = true;
     int processId = -1;
     int stdinFds[2] = { -1, -1 };
     int stdoutFds[2] = { -1, -1 };
     int stderrFds[2] = { -1, -1 };
+    int childStdout = -1;
+    PreparedAttributes prepared;
 
     // Validate arguments
-    if (nullptr == filename || nullptr == argv || nullptr == envp || nullptr == stdinFd || nullptr == stdoutFd ||
-        nullptr == stderrFd || nullptr == childPid)
+    if (nullptr == filename || nullptr == argv || (nullptr == envp && !HasEnvironment(attributes)) ||
+        nullptr == stdinFd || nullptr == stdoutFd || nullptr == stderrFd || nullptr == childPid)
     {
         assert(false && "null argument.");
         errno = EINVAL;
@@ -114,6 +652,15 @@ int32_t ForkAndExecProcess(
         goto done;
     }
 
+    // A new session always leads a new process group, so asking for both is ambiguous
+    if ((creationFlags & CREATE_NEW_PROCESS_GROUP) && (creationFlags & CREATE_NEW_SESSION))
+    {
+        assert(false && "CREATE_NEW_PROCESS_GROUP and CREATE_NEW_SESSION are mutually exclusive.");
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
     // Make sure we can find and access the executable. exec will do this, of course, but at that point it's already
     // in the child process, at which point it'll translate to the child process' exit code rather than to failing
     // the Start itself.  There's a race condition here, in that this could change prior to exec's checks, but there's
@@ -125,6 +672,25 @@ int32_t ForkAndExecProcess(
         goto done;
     }
 
+    // Everything the child needs from the attributes is resolved here, where failures can still be
+    // reported to the caller, so that the child only has to make the corresponding system calls
+    if (!PrepareAttributes(attributes, prepared))
+    {
+        success = false;
+        goto done;
+    }
+
+    // A stream can either be redirected to the parent or go to a target of its own, not both
+    if ((redirectStdin && prepared.StdioFds[STDIN_FILENO] != -1) ||
+        (redirectStdout && prepared.StdioFds[STDOUT_FILENO] != -1) ||
+        (redirectStderr && (prepared.StdioFds[STDERR_FILENO] != -1 || prepared.MergeStderr)))
+    {
+        assert(false && "redirect* inputs conflict with SPAWN_ATTRIBUTE_STDIO.");
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
     // Open pipes for any requests to redirect stdin/stdout/stderr
     if ((redirectStdin && SystemNative_Pipe(stdinFds, O_CLOEXEC) != 0) || 
         (redirectStdout && SystemNative_Pipe(stdoutFds, O_CLOEXEC) != 0) ||
@@ -135,58 +701,209 @@ int32_t ForkAndExecProcess(
     }
 
     // Fork the child process
-    if ((processId = fork()) == -1)
+    childStdout = redirectStdout ? stdoutFds[WRITE_END_OF_PIPE] : prepared.StdioFds[STDOUT_FILENO];
+    processId = SpawnChild(filename, argv, envp, cwd,
+                           redirectStdin ? stdinFds[READ_END_OF_PIPE] : prepared.StdioFds[STDIN_FILENO],
+                           childStdout,
+                           redirectStderr ? stderrFds[WRITE_END_OF_PIPE] : GetChildStderr(prepared, childStdout),
+                           creationFlags, 0, nullptr, prepared);
+    if (processId == -1)
     {
         success = false;
         goto done;
     }
 
-    if (processId == 0) // processId == 0 if this is child process
+    // This is the parent process. processId == pid of the child
+    *childPid = processId;
+    *stdinFd = stdinFds[WRITE_END_OF_PIPE];
+    *stdoutFd = stdoutFds[READ_END_OF_PIPE];
+    *stderrFd = stderrFds[READ_END_OF_PIPE];
+
+done:
+    int priorErrno = errno;
+
+    // Regardless of success or failure, close the parent's copy of the child's end of
+    // any opened pipes.  The parent doesn't need them anymore.
+    CloseIfOpen(stdinFds[READ_END_OF_PIPE]);
+    CloseIfOpen(stdoutFds[WRITE_END_OF_PIPE]);
+    CloseIfOpen(stderrFds[WRITE_END_OF_PIPE]);
+
+    // If we failed, close everything else and give back error values in all out arguments.
+    if (!success)
     {
-        // For any redirections that should happen, dup the pipe descriptors onto stdin/out/err.
-        // We don't explicitly close out the old pipe descriptors because they are set to close on execve.
-        if ((redirectStdin && Dup2WithInterruptedRetry(stdinFds[READ_END_OF_PIPE], STDIN_FILENO) == -1) ||
-            (redirectStdout && Dup2WithInterruptedRetry(stdoutFds[WRITE_END_OF_PIPE], STDOUT_FILENO) == -1) ||
-            (redirectStderr && Dup2WithInterruptedRetry(stderrFds[WRITE_END_OF_PIPE], STDERR_FILENO) == -1))
+        CloseIfOpen(stdinFds[WRITE_END_OF_PIPE]);
+        CloseIfOpen(stdoutFds[READ_END_OF_PIPE]);
+        CloseIfOpen(stderrFds[READ_END_OF_PIPE]);
+
+        *stdinFd = -1;
+        *stdoutFd = -1;
+        *stderrFd = -1;
+        *childPid = -1;
+
+        errno = priorErrno;
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t ForkAndExecPipeline(
+    int32_t commandCount,
+    const char* const filenames[],
+    char* const* const argvs[],
+    char* const envp[],
+    const char* cwd,
+    int32_t redirectStdin,
+    int32_t redirectStdout,
+    int32_t redirectStderr,
+    int32_t creationFlags,
+    const struct SpawnAttributes* attributes,
+    int32_t* childPids,
+    int32_t* stdinFd,
+    int32_t* stdoutFd,
+    int32_t* stderrFd)
+{
+    int success = true;
+    int32_t spawned = 0;
+    int stdinFds[2] = { -1, -1 };
+    int stdoutFds[2] = { -1, -1 };
+    int stderrFds[2] = { -1, -1 };
+    int holdFds[2] = { -1, -1 };
+    int previousReadFd = -1;
+    PreparedAttributes prepared;
+
+    // Validate arguments
+    if (commandCount <= 0 || nullptr == filenames || nullptr == argvs ||
+        (nullptr == envp && !HasEnvironment(attributes)) || nullptr == childPids ||
+        nullptr == stdinFd || nullptr == stdoutFd || nullptr == stderrFd)
+    {
+        assert(false && "null argument.");
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
+    if ((redirectStdin & ~1) != 0 || (redirectStdout & ~1) != 0 || (redirectStderr & ~1) != 0)
+    {
+        assert(false && "Boolean redirect* inputs must be 0 or 1.");
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
+    // Only one process can lead a new session, and the other stages could not join its
+    // process group from outside of it, so pipelines can only ask for a new process group
+    if (creationFlags & CREATE_NEW_SESSION)
+    {
+        assert(false && "CREATE_NEW_SESSION is not supported for pipelines.");
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
+    // Check every stage up front, so a typo in the last command doesn't leave the first ones running
+    for (int32_t i = 0; i < commandCount; i++)
+    {
+        if (nullptr == filenames[i] || nullptr == argvs[i])
         {
-            _exit(errno != 0 ? errno : EXIT_FAILURE);
+            assert(false && "null argument.");
+            errno = EINVAL;
+            success = false;
+            goto done;
         }
 
-        // Change to the designated working directory, if one was specified
-        if (nullptr != cwd)
+        if (access(filenames[i], X_OK) != 0)
         {
-            int result;
-            while (CheckInterrupted(result = chdir(cwd)));
-            if (result == -1)
-            {
-                _exit(errno != 0 ? errno : EXIT_FAILURE);
-            }
+            success = false;
+            goto done;
         }
+    }
 
-        // If SUPPRESS_PROCESS_SIGINT was chosen then create a process that ignores
-        // interrupt signals
-        if (creationFlags & SUPPRESS_PROCESS_SIGINT)
+    if (!PrepareAttributes(attributes, prepared))
+    {
+        success = false;
+        goto done;
+    }
+
+    if ((redirectStdin && prepared.StdioFds[STDIN_FILENO] != -1) ||
+        (redirectStdout && prepared.StdioFds[STDOUT_FILENO] != -1) ||
+        (redirectStderr && (prepared.StdioFds[STDERR_FILENO] != -1 || prepared.MergeStderr)))
+    {
+        assert(false && "redirect* inputs conflict with SPAWN_ATTRIBUTE_STDIO.");
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
+    if ((redirectStdin && SystemNative_Pipe(stdinFds, O_CLOEXEC) != 0) ||
+        (redirectStdout && SystemNative_Pipe(stdoutFds, O_CLOEXEC) != 0) ||
+        (redirectStderr && SystemNative_Pipe(stderrFds, O_CLOEXEC) != 0))
+    {
+        success = false;
+        goto done;
+    }
+
+    // The later stages join the first one's process group, which no longer exists once the
+    // first stage has exited and been reaped, so hold it back until they have all started.
+    // The hold pipe's write end is closed by this process below and by each later stage
+    // when it executes.
+    if ((creationFlags & CREATE_NEW_PROCESS_GROUP) && commandCount > 1 && SystemNative_Pipe(holdFds, O_CLOEXEC) != 0)
+    {
+        success = false;
+        goto done;
+    }
+
+    // Each stage reads from the pipe the previous stage writes to, so the data never
+    // passes through this process.  Every stage shares the same stderr.
+    if (redirectStdin)
+    {
+        previousReadFd = stdinFds[READ_END_OF_PIPE];
+        stdinFds[READ_END_OF_PIPE] = -1;
+    }
+    else if (prepared.StdioFds[STDIN_FILENO] != -1)
+    {
+        // Owned by the attributes, so the stage loop must not close it; dup it to a descriptor of our own
+        while (CheckInterrupted(previousReadFd = fcntl(prepared.StdioFds[STDIN_FILENO], F_DUPFD_CLOEXEC, 0)));
+        if (previousReadFd == -1)
         {
-            struct sigaction sa, saOld;
-            memset(&sa, 0, sizeof(sa));
-            memset(&saOld, 0, sizeof(saOld));
-            sigemptyset(&(sa.sa_mask));
-            sa.sa_handler = SIG_IGN;        // Ignore the signal
+            success = false;
+            goto done;
+        }
+    }
+    for (; spawned < commandCount; spawned++)
+    {
+        int stageFds[2] = { -1, -1 };
+        bool isLast = spawned == commandCount - 1;
+        if (!isLast && SystemNative_Pipe(stageFds, O_CLOEXEC) != 0)
+        {
+            success = false;
+            goto done;
+        }
 
-            int result = sigaction(SIGINT, &sa, &saOld);
-            if (result == -1)
-            {
-                _exit(errno != 0 ? errno : EXIT_FAILURE);
-            }
+        int childStdout = !isLast ? stageFds[WRITE_END_OF_PIPE] :
+                          redirectStdout ? stdoutFds[WRITE_END_OF_PIPE] : prepared.StdioFds[STDOUT_FILENO];
+        int childStderr = redirectStderr ? stderrFds[WRITE_END_OF_PIPE] : GetChildStderr(prepared, childStdout);
+        pid_t processId = SpawnChild(filenames[spawned], argvs[spawned], envp, cwd,
+                                     previousReadFd, childStdout, childStderr,
+                                     creationFlags, spawned == 0 ? 0 : childPids[0],
+                                     spawned == 0 && holdFds[READ_END_OF_PIPE] != -1 ? holdFds : nullptr, prepared);
+
+        // The parent has no use for either end once the stages holding them are running
+        int priorErrno = errno;
+        CloseIfOpen(previousReadFd);
+        CloseIfOpen(stageFds[WRITE_END_OF_PIPE]);
+        previousReadFd = stageFds[READ_END_OF_PIPE];
+        errno = priorErrno;
+
+        if (processId == -1)
+        {
+            success = false;
+            goto done;
         }
 
-        // Finally, execute the new process.  execve will not return if it's successful.
-        execve(filename, argv, envp);
-        _exit(errno != 0 ? errno : EXIT_FAILURE); // execve failed
+        childPids[spawned] = processId;
     }
 
-    // This is the parent process. processId == pid of the child
-    *childPid = processId;
     *stdinFd = stdinFds[WRITE_END_OF_PIPE];
     *stdoutFd = stdoutFds[READ_END_OF_PIPE];
     *stderrFd = stderrFds[READ_END_OF_PIPE];
@@ -194,23 +911,198 @@ int32_t ForkAndExecProcess(
 done:
     int priorErrno = errno;
 
-    // Regardless of success or failure, close the parent's copy of the child's end of
-    // any opened pipes.  The parent doesn't need them anymore.
+    CloseIfOpen(previousReadFd);
+    CloseIfOpen(holdFds[READ_END_OF_PIPE]);
+    CloseIfOpen(holdFds[WRITE_END_OF_PIPE]);
     CloseIfOpen(stdinFds[READ_END_OF_PIPE]);
     CloseIfOpen(stdoutFds[WRITE_END_OF_PIPE]);
     CloseIfOpen(stderrFds[WRITE_END_OF_PIPE]);
 
-    // If we failed, close everything else and give back error values in all out arguments.
     if (!success)
     {
         CloseIfOpen(stdinFds[WRITE_END_OF_PIPE]);
         CloseIfOpen(stdoutFds[READ_END_OF_PIPE]);
         CloseIfOpen(stderrFds[READ_END_OF_PIPE]);
 
-        *stdinFd = -1;
-        *stdoutFd = -1;
-        *stderrFd = -1;
-        *childPid = -1;
+        // A partial pipeline is useless to the caller, so take down the stages already started
+        for (int32_t i = 0; i < spawned; i++)
+        {
+            kill(childPids[i], SIGKILL);
+            while (CheckInterrupted(waitpid(childPids[i], nullptr, 0)));
+        }
+
+        if (nullptr != childPids)
+        {
+            for (int32_t i = 0; i < commandCount; i++)
+            {
+                childPids[i] = -1;
+            }
+        }
+
+        if (nullptr != stdinFd && nullptr != stdoutFd && nullptr != stderrFd)
+        {
+            *stdinFd = -1;
+            *stdoutFd = -1;
+            *stderrFd = -1;
+        }
+
+        errno = priorErrno;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Opens a new pseudo-terminal pair with the given window size.  Both descriptors are
+// close-on-exec and the slave is opened with O_NOCTTY, so that it only becomes a
+// controlling terminal where SpawnChild asks for it.
+static bool OpenPseudoTerminal(int32_t columns, int32_t rows, int* master, int* slave)
+{
+    *master = -1;
+    *slave = -1;
+
+    int masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (masterFd == -1)
+    {
+        return false;
+    }
+
+    int slaveFd = -1;
+    char slaveName[PATH_MAX];
+    if (fcntl(masterFd, F_SETFD, FD_CLOEXEC) == -1 || grantpt(masterFd) == -1 || unlockpt(masterFd) == -1)
+    {
+        goto fail;
+    }
+
+#if defined(__linux__)
+    if (ptsname_r(masterFd, slaveName, sizeof(slaveName)) != 0)
+    {
+        goto fail;
+    }
+#else
+    {
+        const char* name = ptsname(masterFd);
+        if (name == nullptr || strlen(name) >= sizeof(slaveName))
+        {
+            goto fail;
+        }
+        strcpy(slaveName, name);
+    }
+#endif
+
+    while (CheckInterrupted(slaveFd = open(slaveName, O_RDWR | O_NOCTTY | O_CLOEXEC)));
+    if (slaveFd == -1)
+    {
+        goto fail;
+    }
+
+    {
+        struct winsize size;
+        memset(&size, 0, sizeof(size));
+        size.ws_col = static_cast<unsigned short>(columns);
+        size.ws_row = static_cast<unsigned short>(rows);
+        if (ioctl(masterFd, TIOCSWINSZ, &size) == -1)
+        {
+            goto fail;
+        }
+    }
+
+    *master = masterFd;
+    *slave = slaveFd;
+    return true;
+
+fail:
+    int priorErrno = errno;
+    CloseIfOpen(slaveFd);
+    close(masterFd);
+    errno = priorErrno;
+    return false;
+}
+
+// Starts a child on a new pseudo-terminal, which becomes the controlling terminal of a new
+// session led by the child and its stdin, stdout and stderr unless SPAWN_ATTRIBUTE_STDIO
+// sends a stream elsewhere.  Use TerminalRelay to move data between the returned master
+// and the caller's descriptors.
+int32_t ForkAndExecProcessInTerminal(
+    const char* filename,
+    char* const argv[],
+    char* const envp[],
+    const char* cwd,
+    int32_t creationFlags,
+    const struct SpawnAttributes* attributes,
+    int32_t columns,
+    int32_t rows,
+    int32_t* childPid,
+    int32_t* masterFd)
+{
+    int success = true;
+    int processId = -1;
+    int master = -1;
+    int slave = -1;
+    int childStdout = -1;
+    PreparedAttributes prepared;
+
+    // Validate arguments
+    if (nullptr == filename || nullptr == argv || (nullptr == envp && !HasEnvironment(attributes)) ||
+        nullptr == childPid || nullptr == masterFd)
+    {
+        assert(false && "null argument.");
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
+    if (columns < 0 || columns > USHRT_MAX || rows < 0 || rows > USHRT_MAX)
+    {
+        errno = EINVAL;
+        success = false;
+        goto done;
+    }
+
+    if (access(filename, X_OK) != 0 || !PrepareAttributes(attributes, prepared) ||
+        !OpenPseudoTerminal(columns, rows, &master, &slave))
+    {
+        success = false;
+        goto done;
+    }
+
+    // Only a session leader can acquire a controlling terminal
+    creationFlags = (creationFlags & ~CREATE_NEW_PROCESS_GROUP) | CREATE_NEW_SESSION;
+    prepared.ControllingTerminal = slave;
+
+    childStdout = prepared.StdioFds[STDOUT_FILENO] != -1 ? prepared.StdioFds[STDOUT_FILENO] : slave;
+    processId = SpawnChild(filename, argv, envp, cwd,
+                           prepared.StdioFds[STDIN_FILENO] != -1 ? prepared.StdioFds[STDIN_FILENO] : slave,
+                           childStdout,
+                           prepared.MergeStderr || prepared.StdioFds[STDERR_FILENO] != -1 ? GetChildStderr(prepared, childStdout) : slave,
+                           creationFlags, 0, nullptr, prepared);
+    if (processId == -1)
+    {
+        success = false;
+        goto done;
+    }
+
+    *childPid = processId;
+    *masterFd = master;
+
+done:
+    int priorErrno = errno;
+
+    // The child has its own copy of the slave; holding on to ours would keep the master
+    // from seeing a hangup once the child and its descendants have closed theirs
+    CloseIfOpen(slave);
+
+    if (!success)
+    {
+        CloseIfOpen(master);
+        if (nullptr != childPid)
+        {
+            *childPid = -1;
+        }
+        if (nullptr != masterFd)
+        {
+            *masterFd = -1;
+        }
 
         errno = priorErrno;
         return -1;
@@ -6,8 +6,88 @@
 #include "pal.h"
 #include <sys/types.h>
 
+struct EnvironmentBlock;
+
 PAL_BEGIN_EXTERNC
 
+// Bits in SpawnAttributes.Flags selecting which attributes to apply to the child
+enum
+{
+    SPAWN_ATTRIBUTE_NICE = 0x00000001,
+    SPAWN_ATTRIBUTE_IO_PRIORITY = 0x00000002,         // Linux only
+    SPAWN_ATTRIBUTE_RESOURCE_LIMITS = 0x00000004,
+    SPAWN_ATTRIBUTE_CPU_AFFINITY = 0x00000008,        // Linux only
+    SPAWN_ATTRIBUTE_CGROUP = 0x00000010,              // Linux only, cgroup v2
+    SPAWN_ATTRIBUTE_STDIO = 0x00000020,
+    SPAWN_ATTRIBUTE_ENVIRONMENT = 0x00000040
+};
+
+// Platform independent resource ids for SpawnResourceLimit.Resource
+enum
+{
+    SPAWN_RLIMIT_CPU = 0,
+    SPAWN_RLIMIT_FSIZE = 1,
+    SPAWN_RLIMIT_DATA = 2,
+    SPAWN_RLIMIT_STACK = 3,
+    SPAWN_RLIMIT_CORE = 4,
+    SPAWN_RLIMIT_NOFILE = 5,
+    SPAWN_RLIMIT_AS = 6,
+    SPAWN_RLIMIT_NPROC = 7,
+    SPAWN_RLIMIT_MEMLOCK = 8
+};
+
+// UINT64_MAX in SoftLimit or HardLimit means RLIM_INFINITY
+struct SpawnResourceLimit
+{
+    int32_t Resource;
+    uint64_t SoftLimit;
+    uint64_t HardLimit;
+};
+
+// Values for SpawnStdioTarget.Kind
+enum
+{
+    SPAWN_STDIO_DEFAULT = 0,            // decided by the corresponding redirect* argument
+    SPAWN_STDIO_FD = 1,                 // the child uses Fd, which stays open in the parent
+    SPAWN_STDIO_PATH = 2,               // the child uses Path, opened with OpenFlags and Mode
+    SPAWN_STDIO_MERGE_STDOUT = 3        // stderr only, the child's stderr goes wherever its stdout goes
+};
+
+// Bits in SpawnStdioTarget.OpenFlags; stdin is always opened for reading, stdout and stderr for writing
+enum
+{
+    SPAWN_OPEN_CREATE = 0x00000001,
+    SPAWN_OPEN_TRUNCATE = 0x00000002,
+    SPAWN_OPEN_APPEND = 0x00000004,
+    SPAWN_OPEN_EXCLUSIVE = 0x00000008
+};
+
+struct SpawnStdioTarget
+{
+    int32_t Kind;                                       // SPAWN_STDIO_* value
+    int32_t Fd;
+    const char* Path;
+    int32_t OpenFlags;                                  // SPAWN_OPEN_* bits
+    int32_t Mode;                                       // permission bits for a file created through SPAWN_OPEN_CREATE
+};
+
+struct SpawnAttributes
+{
+    int32_t Flags;                                      // SPAWN_ATTRIBUTE_* bits for the fields below that are set
+    int32_t Nice;                                       // nice value, as for setpriority(2)
+    int32_t IoPriorityClass;                            // 1 = realtime, 2 = best effort, 3 = idle, as for ioprio_set(2)
+    int32_t IoPriorityLevel;                            // 0 (highest) to 7 (lowest) within the class
+    const struct SpawnResourceLimit* ResourceLimits;
+    int32_t ResourceLimitCount;
+    int32_t CpuAffinityMaskLength;                      // number of 64-bit words in CpuAffinityMask
+    const uint64_t* CpuAffinityMask;                    // bit n of word w selects CPU 64 * w + n
+    const char* CgroupPath;                             // cgroup v2 directory the child starts in
+    struct SpawnStdioTarget Stdin;                      // SPAWN_ATTRIBUTE_STDIO targets, which take the
+    struct SpawnStdioTarget Stdout;                     // place of a pipe to the parent, so the matching
+    struct SpawnStdioTarget Stderr;                     // redirect* argument must be 0 when one is used
+    const struct EnvironmentBlock* Environment;         // used instead of envp, which may then be null
+};
+
 int32_t ForkAndExecProcess(
     const char* filename,           // filename argument to execve
     char* const argv[],             // argv argument to execve
@@ -22,4 +102,48 @@ int32_t ForkAndExecProcess(
     int32_t* stdoutFd,              // [out] if redirectStdout, the parent's fd for the child's stdout
     int32_t* stderrFd);             // [out] if redirectStderr, the parent's fd for the child's stderr 
 
+int32_t ForkAndExecProcessWithAttributes(
+    const char* filename,
+    char* const argv[],
+    char* const envp[],
+    const char* cwd,
+    int32_t redirectStdin,
+    int32_t redirectStdout,
+    int32_t redirectStderr,
+    int32_t creationFlags,
+    const struct SpawnAttributes* attributes,   // attributes applied to the child before execve, may be null
+    int32_t* childPid,
+    int32_t* stdinFd,
+    int32_t* stdoutFd,
+    int32_t* stderrFd);
+
+int32_t ForkAndExecPipeline(
+    int32_t commandCount,                       // number of commands in the pipeline
+    const char* const filenames[],              // filename argument to execve, per command
+    char* const* const argvs[],                 // argv argument to execve, per command
+    char* const envp[],                         // envp argument to execve, shared by all commands
+    const char* cwd,                            // path passed to chdir in every child process
+    int32_t redirectStdin,                      // whether to redirect the first command's standard input from the parent
+    int32_t redirectStdout,                     // whether to redirect the last command's standard output to the parent
+    int32_t redirectStderr,                     // whether to redirect every command's standard error to the parent
+    int32_t creationFlags,                      // creation flags, CREATE_NEW_PROCESS_GROUP puts all commands in one group
+    const struct SpawnAttributes* attributes,   // attributes applied to every child, may be null
+    int32_t* childPids,                         // [out] commandCount process ids, in pipeline order
+    int32_t* stdinFd,                           // [out] if redirectStdin, the parent's fd for the first command's stdin
+    int32_t* stdoutFd,                          // [out] if redirectStdout, the parent's fd for the last command's stdout
+    int32_t* stderrFd);                         // [out] if redirectStderr, the parent's fd for the shared stderr
+
+int32_t ForkAndExecProcessInTerminal(
+    const char* filename,
+    char* const argv[],
+    char* const envp[],
+    const char* cwd,
+    int32_t creationFlags,                      // creation flags, the child always leads a new session
+    const struct SpawnAttributes* attributes,   // attributes applied to the child, SPAWN_ATTRIBUTE_STDIO targets
+                                                // take the place of the terminal for their stream; may be null
+    int32_t columns,                            // initial window size of the pseudo-terminal
+    int32_t rows,
+    int32_t* childPid,                          // [out] the child process' id
+    int32_t* masterFd);                         // [out] the parent's end of the child's pseudo-terminal
+
 PAL_END_EXTERNC
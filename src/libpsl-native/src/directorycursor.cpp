@@ -0,0 +1,242 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief read a directory a page at a time
+
+#include "directorycursor.h"
+#include "directoryfilter.h"
+#include "directoryreader.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <new>
+#include <string>
+
+struct DirectoryCursor
+{
+    DirectoryReader Reader;
+    CompiledDirectoryFilter Filter;
+    int64_t Position = 0;           // just past the last entry returned or filtered out
+    bool AtEnd = false;
+
+    // An entry that passed the filter but did not fit in the caller's page
+    bool HasPending = false;
+    std::string PendingName;
+    struct stat PendingStat;
+    int64_t PendingPosition = 0;
+};
+
+//! @brief DirectoryCursorOpen starts reading a directory a page at a time
+//!
+//! DirectoryCursorOpen
+//!
+//! Only one page of entries is held in memory at a time, whatever the size
+//! of the directory, and the first page is available as soon as it has been
+//! read.
+//!
+//! @param[in] path
+//! @parblock
+//! The directory to read.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] filter
+//! @parblock
+//! The conditions entries have to meet, as for EnumerateDirectory, or NULL.
+//! @endparblock
+//!
+//! @param[in] resumeToken
+//! @parblock
+//! 0 to start at the first entry, or a token from DirectoryCursorNext to
+//! continue where an earlier cursor on the same directory left off. Tokens
+//! outlive their cursor on Linux only; elsewhere a non-zero token fails
+//! with ENOTSUP. Entries added or removed in the meantime may or may not be
+//! seen, as with readdir.
+//! @endparblock
+//!
+//! @retval the cursor, or NULL with errno set if unsuccessful
+//!
+struct DirectoryCursor* DirectoryCursorOpen(const char* path, const struct DirectoryFilter* filter, int64_t resumeToken)
+{
+    assert(path);
+    if (path == nullptr)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+#if !defined(__linux__)
+    if (resumeToken != 0)
+    {
+        errno = ENOTSUP;
+        return nullptr;
+    }
+#endif
+
+    DirectoryCursor* cursor = new (std::nothrow) DirectoryCursor();
+    if (cursor == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    if (!cursor->Filter.Compile(filter) || !cursor->Reader.Open(AT_FDCWD, path) ||
+        (resumeToken != 0 && !cursor->Reader.Seek(resumeToken)))
+    {
+        int priorErrno = errno;
+        delete cursor;
+        errno = priorErrno;
+        return nullptr;
+    }
+
+    cursor->Position = resumeToken;
+    return cursor;
+}
+
+// Copies an entry into the caller's page.  Returns false if it does not fit.
+static bool AddToPage(
+    const char* name,
+    size_t nameLength,
+    const struct stat& st,
+    struct DirectoryEntryInfo* entries,
+    int32_t entriesLength,
+    char* names,
+    int32_t namesLength,
+    int32_t* entryCount,
+    size_t* namesUsed)
+{
+    if (*entryCount >= entriesLength || *namesUsed + nameLength + 1 > static_cast<size_t>(namesLength))
+    {
+        return false;
+    }
+
+    DirectoryEntryInfo& info = entries[*entryCount];
+    info.NameOffset = static_cast<int32_t>(*namesUsed);
+    info.NameLength = static_cast<int32_t>(nameLength);
+    FillDirectoryEntryInfo(st, &info);
+    memcpy(names + *namesUsed, name, nameLength + 1);
+
+    *namesUsed += nameLength + 1;
+    (*entryCount)++;
+    return true;
+}
+
+//! @brief DirectoryCursorNext returns the next page of entries
+//!
+//! DirectoryCursorNext
+//!
+//! Fills the page until either buffer is full or the directory ends.
+//!
+//! @param[out] entries
+//! @parblock
+//! Receives the entries. Their NameOffset refers to names.
+//! @endparblock
+//!
+//! @param[out] resumeToken
+//! @parblock
+//! Receives a token for DirectoryCursorOpen that continues right after the
+//! last entry returned so far.
+//! @endparblock
+//!
+//! @retval 1 if more entries may follow, 0 once the directory has been read
+//! to the end, or -1 with errno set (ERANGE if the next entry's name does not
+//! fit in an empty names buffer; that entry is kept, and a retry with a larger
+//! buffer returns it)
+//!
+int32_t DirectoryCursorNext(
+    struct DirectoryCursor* cursor,
+    struct DirectoryEntryInfo* entries,
+    int32_t entriesLength,
+    char* names,
+    int32_t namesLength,
+    int32_t* entryCount,
+    int64_t* resumeToken)
+{
+    assert(cursor && entries && names && entryCount && resumeToken);
+    if (cursor == nullptr || entries == nullptr || entriesLength <= 0 || names == nullptr || namesLength <= 0 ||
+        entryCount == nullptr || resumeToken == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *entryCount = 0;
+    size_t namesUsed = 0;
+
+    if (cursor->HasPending)
+    {
+        if (!AddToPage(cursor->PendingName.c_str(), cursor->PendingName.size(), cursor->PendingStat,
+                       entries, entriesLength, names, namesLength, entryCount, &namesUsed))
+        {
+            errno = ERANGE;
+            return -1;
+        }
+
+        cursor->HasPending = false;
+        cursor->Position = cursor->PendingPosition;
+    }
+
+    while (!cursor->AtEnd)
+    {
+        DirectoryEntry entry;
+        int status = cursor->Reader.Next(&entry);
+        if (status < 0)
+        {
+            return -1;
+        }
+
+        if (status == 0)
+        {
+            cursor->AtEnd = true;
+            break;
+        }
+
+        struct stat st;
+        if (!cursor->Filter.Evaluate(cursor->Reader.Fd(), entry, &st))
+        {
+            cursor->Position = entry.Position;
+            continue;
+        }
+
+        if (!AddToPage(entry.Name, entry.NameLength, st, entries, entriesLength, names, namesLength, entryCount, &namesUsed))
+        {
+            // Keep the entry for the next page, or for a retry with larger buffers
+            // if it does not fit even an empty one; the token still points before it
+            try
+            {
+                cursor->PendingName.assign(entry.Name, entry.NameLength);
+            }
+            catch (const std::bad_alloc&)
+            {
+                errno = ENOMEM;
+                return -1;
+            }
+            cursor->PendingStat = st;
+            cursor->PendingPosition = entry.Position;
+            cursor->HasPending = true;
+            if (*entryCount == 0)
+            {
+                errno = ERANGE;
+                return -1;
+            }
+            break;
+        }
+
+        cursor->Position = entry.Position;
+    }
+
+    *resumeToken = cursor->Position;
+    return cursor->AtEnd && !cursor->HasPending ? 0 : 1;
+}
+
+//! @brief DirectoryCursorClose closes a cursor
+//!
+//! DirectoryCursorClose
+//!
+void DirectoryCursorClose(struct DirectoryCursor* cursor)
+{
+    delete cursor;
+}
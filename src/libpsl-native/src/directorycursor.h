@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+#include "enumeratedirectory.h"
+
+PAL_BEGIN_EXTERNC
+
+struct DirectoryCursor;
+
+struct DirectoryCursor* DirectoryCursorOpen(
+    const char* path,
+    const struct DirectoryFilter* filter,   // may be null
+    int64_t resumeToken);                   // 0 to start at the beginning
+int32_t DirectoryCursorNext(
+    struct DirectoryCursor* cursor,
+    struct DirectoryEntryInfo* entries,     // [out] receives up to entriesLength entries
+    int32_t entriesLength,
+    char* names,                            // [out] receives their null terminated names
+    int32_t namesLength,
+    int32_t* entryCount,                    // [out] number of entries returned
+    int64_t* resumeToken);                  // [out] token to continue after the returned entries
+void DirectoryCursorClose(struct DirectoryCursor* cursor);
+
+PAL_END_EXTERNC
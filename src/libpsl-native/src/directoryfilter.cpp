@@ -0,0 +1,149 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief evaluate directory filters close to the file system
+
+#include "directoryfilter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+
+int32_t GetDirectoryEntryType(mode_t mode)
+{
+    switch (mode & S_IFMT)
+    {
+        case S_IFREG:
+            return DIRECTORY_ENTRY_FILE;
+        case S_IFDIR:
+            return DIRECTORY_ENTRY_DIRECTORY;
+        case S_IFLNK:
+            return DIRECTORY_ENTRY_SYMLINK;
+        default:
+            return DIRECTORY_ENTRY_OTHER;
+    }
+}
+
+void FillDirectoryEntryInfo(const struct stat& st, struct DirectoryEntryInfo* info)
+{
+    info->Type = GetDirectoryEntryType(st.st_mode);
+    info->Mode = static_cast<int32_t>(st.st_mode);
+    info->Size = st.st_size;
+    info->ModifiedTime = GetModifiedTimeNanoseconds(st);
+    info->Inode = static_cast<int64_t>(st.st_ino);
+}
+
+// Returns the entry type for a d_type value, or 0 if the listing did not say
+static int32_t GetDirectoryEntryTypeFromListing(unsigned char type)
+{
+    switch (type)
+    {
+        case DT_UNKNOWN:
+            return 0;
+        case DT_REG:
+            return DIRECTORY_ENTRY_FILE;
+        case DT_DIR:
+            return DIRECTORY_ENTRY_DIRECTORY;
+        case DT_LNK:
+            return DIRECTORY_ENTRY_SYMLINK;
+        default:
+            return DIRECTORY_ENTRY_OTHER;
+    }
+}
+
+bool CompiledDirectoryFilter::Compile(const struct DirectoryFilter* filter)
+{
+    if (filter == nullptr)
+    {
+        m_filter = DirectoryFilter();
+        return true;
+    }
+
+    const int32_t knownFlags = DIRECTORY_FILTER_INCLUDE | DIRECTORY_FILTER_EXCLUDE | DIRECTORY_FILTER_SIZE |
+                               DIRECTORY_FILTER_MODIFIED_TIME | DIRECTORY_FILTER_TYPE | DIRECTORY_FILTER_HIDDEN |
+                               DIRECTORY_FILTER_IGNORE_CASE;
+    if ((filter->Flags & ~knownFlags) != 0 ||
+        ((filter->Flags & DIRECTORY_FILTER_INCLUDE) && filter->IncludeGlob == nullptr) ||
+        ((filter->Flags & DIRECTORY_FILTER_EXCLUDE) && filter->ExcludeGlob == nullptr) ||
+        ((filter->Flags & DIRECTORY_FILTER_HIDDEN) &&
+         filter->HiddenRule != DIRECTORY_HIDDEN_EXCLUDE && filter->HiddenRule != DIRECTORY_HIDDEN_ONLY))
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    m_filter = *filter;
+    m_include = (filter->Flags & DIRECTORY_FILTER_INCLUDE) ? filter->IncludeGlob : "";
+    m_exclude = (filter->Flags & DIRECTORY_FILTER_EXCLUDE) ? filter->ExcludeGlob : "";
+    m_filter.IncludeGlob = nullptr;
+    m_filter.ExcludeGlob = nullptr;
+    return true;
+}
+
+bool CompiledDirectoryFilter::MatchesName(const char* name) const
+{
+    int32_t flags = m_filter.Flags;
+    if (flags & DIRECTORY_FILTER_HIDDEN)
+    {
+        bool hidden = name[0] == '.';
+        if (hidden != (m_filter.HiddenRule == DIRECTORY_HIDDEN_ONLY))
+        {
+            return false;
+        }
+    }
+
+    int matchFlags = (flags & DIRECTORY_FILTER_IGNORE_CASE) ? FNM_CASEFOLD : 0;
+    if ((flags & DIRECTORY_FILTER_INCLUDE) && fnmatch(m_include.c_str(), name, matchFlags) != 0)
+    {
+        return false;
+    }
+
+    if ((flags & DIRECTORY_FILTER_EXCLUDE) && fnmatch(m_exclude.c_str(), name, matchFlags) == 0)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool CompiledDirectoryFilter::Evaluate(int dirFd, const DirectoryEntry& entry, struct stat* st) const
+{
+    int32_t flags = m_filter.Flags;
+    if (!MatchesName(entry.Name))
+    {
+        return false;
+    }
+
+    int32_t listedType = GetDirectoryEntryTypeFromListing(entry.Type);
+    if ((flags & DIRECTORY_FILTER_TYPE) && listedType != 0 && (listedType & m_filter.TypeMask) == 0)
+    {
+        return false;
+    }
+
+    if (fstatat(dirFd, entry.Name, st, AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        return false;
+    }
+
+    if ((flags & DIRECTORY_FILTER_TYPE) && (GetDirectoryEntryType(st->st_mode) & m_filter.TypeMask) == 0)
+    {
+        return false;
+    }
+
+    if ((flags & DIRECTORY_FILTER_SIZE) &&
+        (st->st_size < m_filter.MinimumSize || st->st_size > m_filter.MaximumSize))
+    {
+        return false;
+    }
+
+    if (flags & DIRECTORY_FILTER_MODIFIED_TIME)
+    {
+        int64_t modified = GetModifiedTimeNanoseconds(*st);
+        if (modified < m_filter.ModifiedAfter || modified >= m_filter.ModifiedBefore)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
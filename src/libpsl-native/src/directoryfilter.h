@@ -0,0 +1,59 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Internal to libpsl-native, not exported
+
+#pragma once
+
+#include "directoryreader.h"
+#include "enumeratedirectory.h"
+
+#include <sys/stat.h>
+#include <string>
+
+// Nanoseconds since the epoch of the last modification
+inline int64_t GetModifiedTimeNanoseconds(const struct stat& st)
+{
+#if defined(__APPLE__)
+    return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+// Nanoseconds since the epoch of the last status change
+inline int64_t GetChangeTimeNanoseconds(const struct stat& st)
+{
+#if defined(__APPLE__)
+    return static_cast<int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    return static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+}
+
+int32_t GetDirectoryEntryType(mode_t mode);
+
+// Fills in everything but the name fields of a DirectoryEntryInfo
+void FillDirectoryEntryInfo(const struct stat& st, struct DirectoryEntryInfo* info);
+
+// A DirectoryFilter checked for consistency and copied, so that it no longer refers
+// to the caller's memory.  Conditions are evaluated cheapest first: the name, then
+// the type the directory listing reports, and only then a stat.
+class CompiledDirectoryFilter
+{
+public:
+    // Returns false with errno set to EINVAL if the filter is inconsistent.
+    // A null filter passes every entry.
+    bool Compile(const struct DirectoryFilter* filter);
+
+    // Returns true if the entry passes, in which case st holds its lstat.  Entries
+    // that vanish before they can be examined do not pass.
+    bool Evaluate(int dirFd, const DirectoryEntry& entry, struct stat* st) const;
+
+private:
+    bool MatchesName(const char* name) const;
+
+    struct DirectoryFilter m_filter = {};
+    std::string m_include;
+    std::string m_exclude;
+};
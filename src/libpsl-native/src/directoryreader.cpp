@@ -0,0 +1,197 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief read directory entries in batches
+
+#include "directoryreader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+
+namespace
+{
+    // Large enough for a few hundred entries per system call
+    const size_t BufferSize = 32 * 1024;
+
+    // Mirrors struct linux_dirent64, which glibc does not declare
+    struct LinuxDirent64
+    {
+        uint64_t Inode;
+        int64_t Offset;
+        unsigned short RecordLength;
+        unsigned char Type;
+        char Name[1];
+    };
+}
+#endif
+
+template <typename TInt>
+static inline bool CheckInterrupted(TInt result)
+{
+    return result < 0 && errno == EINTR;
+}
+
+static bool IsDotOrDotDot(const char* name)
+{
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+#if defined(__linux__)
+DirectoryReader::DirectoryReader() : m_fd(-1), m_offset(0), m_length(0)
+{
+}
+#else
+DirectoryReader::DirectoryReader() : m_fd(-1), m_dir(nullptr)
+{
+}
+#endif
+
+DirectoryReader::~DirectoryReader()
+{
+    Close();
+}
+
+bool DirectoryReader::Open(int dirFd, const char* path)
+{
+    Close();
+
+    int fd;
+    while (CheckInterrupted(fd = openat(dirFd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+    if (fd < 0)
+    {
+        return false;
+    }
+
+#if defined(__linux__)
+    if (m_buffer.size() != BufferSize)
+    {
+        m_buffer.resize(BufferSize);
+    }
+    m_offset = 0;
+    m_length = 0;
+#else
+    // fdopendir takes over the descriptor, so keep a duplicate for the caller's *at calls
+    int dirDescriptor = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dirDescriptor < 0 || (m_dir = fdopendir(dirDescriptor)) == nullptr)
+    {
+        int priorErrno = errno;
+        if (dirDescriptor >= 0)
+        {
+            close(dirDescriptor);
+        }
+        close(fd);
+        errno = priorErrno;
+        return false;
+    }
+#endif
+
+    m_fd = fd;
+    return true;
+}
+
+void DirectoryReader::Close()
+{
+#if !defined(__linux__)
+    if (m_dir != nullptr)
+    {
+        closedir(m_dir);
+        m_dir = nullptr;
+    }
+#endif
+
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool DirectoryReader::Seek(int64_t position)
+{
+    if (m_fd < 0)
+    {
+        errno = EBADF;
+        return false;
+    }
+
+#if defined(__linux__)
+    if (lseek(m_fd, static_cast<off_t>(position), SEEK_SET) == -1)
+    {
+        return false;
+    }
+
+    m_offset = 0;
+    m_length = 0;
+#else
+    seekdir(m_dir, static_cast<long>(position));
+#endif
+    return true;
+}
+
+int DirectoryReader::Next(DirectoryEntry* entry)
+{
+    if (m_fd < 0)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+#if defined(__linux__)
+    while (true)
+    {
+        if (m_offset >= m_length)
+        {
+            long count;
+            while (CheckInterrupted(count = syscall(SYS_getdents64, m_fd, m_buffer.data(), m_buffer.size())));
+            if (count <= 0)
+            {
+                return count == 0 ? 0 : -1;
+            }
+
+            m_offset = 0;
+            m_length = static_cast<size_t>(count);
+        }
+
+        const LinuxDirent64* record = reinterpret_cast<const LinuxDirent64*>(m_buffer.data() + m_offset);
+        m_offset += record->RecordLength;
+        if (IsDotOrDotDot(record->Name))
+        {
+            continue;
+        }
+
+        entry->Name = record->Name;
+        entry->NameLength = strlen(record->Name);
+        entry->Inode = record->Inode;
+        entry->Type = record->Type;
+        entry->Position = record->Offset;
+        return 1;
+    }
+#else
+    while (true)
+    {
+        errno = 0;
+        struct dirent* record = readdir(m_dir);
+        if (record == nullptr)
+        {
+            return errno == 0 ? 0 : -1;
+        }
+
+        if (IsDotOrDotDot(record->d_name))
+        {
+            continue;
+        }
+
+        entry->Name = record->d_name;
+        entry->NameLength = strlen(record->d_name);
+        entry->Inode = static_cast<uint64_t>(record->d_ino);
+        entry->Type = record->d_type;
+        entry->Position = static_cast<int64_t>(telldir(m_dir));
+        return 1;
+    }
+#endif
+}
@@ -0,0 +1,58 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Internal to libpsl-native, not exported
+
+#pragma once
+
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct DirectoryEntry
+{
+    const char* Name;           // valid until the next call to Next
+    size_t NameLength;
+    uint64_t Inode;
+    unsigned char Type;         // DT_* value, DT_UNKNOWN if the file system does not say
+    int64_t Position;           // opaque position just past this entry, for Seek
+};
+
+// Reads the entries of a directory in large batches, with getdents64 where available,
+// skipping "." and "..".  Unlike readdir, the reader works from a descriptor the caller
+// can keep using for *at calls on the entries.
+class DirectoryReader
+{
+public:
+    DirectoryReader();
+    ~DirectoryReader();
+
+    // Opens path, relative to dirFd if it is not absolute.  Returns false with errno set.
+    bool Open(int dirFd, const char* path);
+    void Close();
+
+    // Returns 1 and fills in entry, 0 at the end of the directory, -1 with errno set
+    int Next(DirectoryEntry* entry);
+
+    // Continues reading after the entry a Position was returned with.  On Linux the
+    // position stays valid for any reader of the same directory; elsewhere only for
+    // the reader that returned it.  Returns false with errno set.
+    bool Seek(int64_t position);
+
+    // The open directory, for fstatat and friends
+    int Fd() const { return m_fd; }
+
+private:
+    DirectoryReader(const DirectoryReader&) = delete;
+    DirectoryReader& operator=(const DirectoryReader&) = delete;
+
+    int m_fd;
+#if defined(__linux__)
+    std::vector<char> m_buffer;
+    size_t m_offset;
+    size_t m_length;
+#else
+    DIR* m_dir;
+#endif
+};
@@ -0,0 +1,306 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief total the space used by a directory tree, per directory
+
+#include "diskusage.h"
+#include "treewalker.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Files with several links are remembered by (device, inode); the set is split so
+    // that threads reading different directories rarely wait for each other
+    const size_t InodeShardCount = 16;
+
+    struct InodeKey
+    {
+        uint64_t Device;
+        uint64_t Inode;
+
+        bool operator==(const InodeKey& other) const
+        {
+            return Device == other.Device && Inode == other.Inode;
+        }
+    };
+
+    struct InodeKeyHash
+    {
+        size_t operator()(const InodeKey& key) const
+        {
+            return std::hash<uint64_t>()(key.Inode * 31 + key.Device);
+        }
+    };
+
+    struct InodeShard
+    {
+        std::mutex Lock;
+        std::unordered_set<InodeKey, InodeKeyHash> Seen;
+    };
+
+    struct UsageRow
+    {
+        std::string Path;           // relative to the root
+        int64_t Parent;
+        int Error;
+        int64_t ApparentSize;
+        int64_t AllocatedSize;
+        int64_t FileCount;
+    };
+}
+
+static inline int64_t GetAllocatedSize(const struct stat& st)
+{
+    return static_cast<int64_t>(st.st_blocks) * 512;
+}
+
+// Creates a row for every directory the walk will visit and fills it in once the
+// directory has been read.  A directory's own size is taken from its parent's listing,
+// so that it is counted even if the directory cannot be read.
+class UsageCollector : public TreeVisitor
+{
+public:
+    UsageCollector(std::vector<UsageRow>& rows, bool countLinks)
+        : m_rows(rows), m_countLinks(countLinks)
+    {
+    }
+
+    void Visit(const WalkDirectory& directory, std::vector<WalkEntry>& entries) override
+    {
+        int64_t apparentSize = 0;
+        int64_t allocatedSize = 0;
+        int64_t fileCount = 0;
+        for (const WalkEntry& entry : entries)
+        {
+            if (S_ISDIR(entry.Stat.st_mode) || !IsFirstLink(entry.Stat))
+            {
+                continue;
+            }
+
+            apparentSize += entry.Stat.st_size;
+            allocatedSize += GetAllocatedSize(entry.Stat);
+            fileCount++;
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        UsageRow& row = m_rows[directory.Tag];
+        row.Error = directory.Error;
+        row.ApparentSize += apparentSize;
+        row.AllocatedSize += allocatedSize;
+        row.FileCount += fileCount;
+
+        std::string parentPath = row.Path;
+        for (WalkEntry& entry : entries)
+        {
+            if (!entry.Descend)
+            {
+                continue;
+            }
+
+            UsageRow subdirectory;
+            subdirectory.Path = parentPath.empty() ? entry.Name : parentPath + "/" + entry.Name;
+            subdirectory.Parent = directory.Tag;
+            subdirectory.Error = 0;
+            subdirectory.ApparentSize = entry.Stat.st_size;
+            subdirectory.AllocatedSize = GetAllocatedSize(entry.Stat);
+            subdirectory.FileCount = 0;
+            entry.Tag = static_cast<int64_t>(m_rows.size());
+            m_rows.push_back(std::move(subdirectory));
+        }
+    }
+
+private:
+    bool IsFirstLink(const struct stat& st)
+    {
+        if (m_countLinks || st.st_nlink <= 1)
+        {
+            return true;
+        }
+
+        InodeKey key = { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino) };
+        InodeShard& shard = m_shards[InodeKeyHash()(key) % InodeShardCount];
+        std::lock_guard<std::mutex> lock(shard.Lock);
+        return shard.Seen.insert(key).second;
+    }
+
+    std::mutex m_lock;
+    std::vector<UsageRow>& m_rows;
+    bool m_countLinks;
+    InodeShard m_shards[InodeShardCount];
+};
+
+//! @brief GetDiskUsage totals the space used by a directory tree, for every
+//! directory in it
+//!
+//! GetDiskUsage
+//!
+//! The tree is read with several threads, so that the latency of each
+//! directory read, which dominates on network file systems, overlaps with
+//! others. Like du, a file with several hard links in the tree is counted
+//! once, against the first directory it is found in. Symbolic links are
+//! counted as themselves and not followed.
+//!
+//! @param[in] root
+//! @parblock
+//! The directory to measure.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] flags
+//! @parblock
+//! DISK_USAGE_ONE_FILE_SYSTEM and DISK_USAGE_COUNT_LINKS.
+//! @endparblock
+//!
+//! @param[in] threadCount
+//! @parblock
+//! How many directories to read at a time, 0 for one per processor.
+//! @endparblock
+//!
+//! @param[out] usage
+//! @parblock
+//! Receives one row per directory, with root's path and its subdirectories'
+//! paths under it. Free it with FreeDiskUsage.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t GetDiskUsage(const char* root, int32_t flags, int32_t threadCount, struct DiskUsage** usage)
+{
+    assert(root && usage);
+    if (root == nullptr || usage == nullptr || threadCount < 0 ||
+        (flags & ~(DISK_USAGE_ONE_FILE_SYSTEM | DISK_USAGE_COUNT_LINKS)) != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *usage = nullptr;
+
+    try
+    {
+        struct stat st;
+        if (stat(root, &st) != 0)
+        {
+            return -1;
+        }
+
+        std::vector<UsageRow> rows;
+        rows.push_back(UsageRow { std::string(), -1, 0, st.st_size, GetAllocatedSize(st), 0 });
+        UsageCollector collector(rows, (flags & DISK_USAGE_COUNT_LINKS) != 0);
+        if (!WalkTree(root, threadCount, (flags & DISK_USAGE_ONE_FILE_SYSTEM) != 0, 0, collector))
+        {
+            return -1;
+        }
+
+        // Rows are created parents first, so a single pass from the end rolls every
+        // subtree up into its parent
+        std::vector<DiskUsageEntry> totals(rows.size());
+        size_t pathsLength = 0;
+        size_t rootLength = strlen(root);
+        bool rootHasSeparator = rootLength > 0 && root[rootLength - 1] == '/';
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            pathsLength += rootLength + (rows[i].Path.empty() ? 0 : rows[i].Path.size() + 1) + 1;
+        }
+        if (rows.size() > static_cast<size_t>(INT32_MAX) || pathsLength > static_cast<size_t>(INT32_MAX))
+        {
+            errno = EOVERFLOW;
+            return -1;
+        }
+
+        for (size_t i = rows.size(); i-- > 0;)
+        {
+            DiskUsageEntry& entry = totals[i];
+            entry.Parent = static_cast<int32_t>(rows[i].Parent);
+            entry.Error = rows[i].Error;
+            entry.OwnApparentSize = rows[i].ApparentSize;
+            entry.OwnAllocatedSize = rows[i].AllocatedSize;
+            entry.OwnFileCount = rows[i].FileCount;
+            entry.TotalApparentSize += entry.OwnApparentSize;
+            entry.TotalAllocatedSize += entry.OwnAllocatedSize;
+            entry.TotalFileCount += entry.OwnFileCount;
+            entry.TotalDirectoryCount += 1;
+
+            if (entry.Parent >= 0)
+            {
+                DiskUsageEntry& parent = totals[entry.Parent];
+                parent.TotalApparentSize += entry.TotalApparentSize;
+                parent.TotalAllocatedSize += entry.TotalAllocatedSize;
+                parent.TotalFileCount += entry.TotalFileCount;
+                parent.TotalDirectoryCount += entry.TotalDirectoryCount;
+            }
+        }
+
+        DiskUsage* result = static_cast<DiskUsage*>(calloc(1, sizeof(DiskUsage)));
+        if (result == nullptr ||
+            (result->Directories = static_cast<DiskUsageEntry*>(malloc(totals.size() * sizeof(DiskUsageEntry)))) == nullptr ||
+            (result->Paths = static_cast<char*>(malloc(pathsLength))) == nullptr)
+        {
+            FreeDiskUsage(result);
+            errno = ENOMEM;
+            return -1;
+        }
+
+        result->Count = static_cast<int32_t>(totals.size());
+        size_t offset = 0;
+        for (size_t i = 0; i < totals.size(); i++)
+        {
+            char* path = result->Paths + offset;
+            memcpy(path, root, rootLength);
+            size_t length = rootLength;
+            if (!rows[i].Path.empty())
+            {
+                if (!rootHasSeparator)
+                {
+                    path[length++] = '/';
+                }
+                memcpy(path + length, rows[i].Path.data(), rows[i].Path.size());
+                length += rows[i].Path.size();
+            }
+            path[length] = '\0';
+
+            totals[i].PathOffset = static_cast<int32_t>(offset);
+            totals[i].PathLength = static_cast<int32_t>(length);
+            offset += length + 1;
+        }
+        memcpy(result->Directories, totals.data(), totals.size() * sizeof(DiskUsageEntry));
+
+        *usage = result;
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief FreeDiskUsage frees the rows returned by GetDiskUsage
+//!
+//! FreeDiskUsage
+//!
+void FreeDiskUsage(struct DiskUsage* usage)
+{
+    if (usage == nullptr)
+    {
+        return;
+    }
+
+    free(usage->Directories);
+    free(usage->Paths);
+    free(usage);
+}
@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Flags for GetDiskUsage
+enum
+{
+    DISK_USAGE_ONE_FILE_SYSTEM = 0x00000001,    // do not descend into other file systems
+    DISK_USAGE_COUNT_LINKS = 0x00000002         // count a file once per hard link rather than once
+};
+
+// One directory of the tree.  The Own fields cover the directory itself and the files
+// directly in it, the Total fields add everything in its subdirectories.
+struct DiskUsageEntry
+{
+    int32_t PathOffset;             // offset of the null terminated path in DiskUsage.Paths
+    int32_t PathLength;
+    int32_t Parent;                 // row of the parent directory, -1 for the root
+    int32_t Error;                  // errno if the directory could not be read, 0 otherwise
+    int64_t OwnApparentSize;        // sum of st_size
+    int64_t OwnAllocatedSize;       // sum of st_blocks in bytes
+    int64_t OwnFileCount;           // entries other than directories
+    int64_t TotalApparentSize;
+    int64_t TotalAllocatedSize;
+    int64_t TotalFileCount;
+    int64_t TotalDirectoryCount;    // including the directory itself
+};
+
+struct DiskUsage
+{
+    int32_t Count;
+    struct DiskUsageEntry* Directories; // parents before their subdirectories, the root first
+    char* Paths;
+};
+
+int32_t GetDiskUsage(const char* root, int32_t flags, int32_t threadCount, struct DiskUsage** usage);
+void FreeDiskUsage(struct DiskUsage* usage);
+
+PAL_END_EXTERNC
@@ -0,0 +1,384 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief list a directory, dropping entries that fail a filter before they are returned
+
+#include "enumeratedirectory.h"
+#include "directoryfilter.h"
+#include "directoryreader.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+
+namespace
+{
+    // Alignment of each array in DirectoryColumns, a cache line and the widest vector register
+    const size_t ColumnAlignment = 64;
+
+    struct CollectedEntry
+    {
+        size_t NameOffset;
+        size_t NameLength;
+        int Error;
+        struct stat Stat;
+    };
+}
+
+// Reads the entries of path that pass the filter, with their lstat, and their names
+// into a heap of null terminated strings.  Returns false with errno set.
+static bool CollectEntries(
+    const char* path,
+    const struct DirectoryFilter* filter,
+    std::vector<CollectedEntry>& entries,
+    std::vector<char>& names)
+{
+    CompiledDirectoryFilter compiled;
+    if (!compiled.Compile(filter))
+    {
+        return false;
+    }
+
+    DirectoryReader reader;
+    if (!reader.Open(AT_FDCWD, path))
+    {
+        return false;
+    }
+
+    DirectoryEntry entry;
+    CollectedEntry collected;
+    int status;
+    while ((status = reader.Next(&entry)) == 1)
+    {
+        if (!compiled.Evaluate(reader.Fd(), entry, &collected.Stat))
+        {
+            continue;
+        }
+
+        collected.NameOffset = names.size();
+        collected.NameLength = entry.NameLength;
+        collected.Error = 0;
+        entries.push_back(collected);
+        names.insert(names.end(), entry.Name, entry.Name + entry.NameLength + 1);
+    }
+
+    if (status == 0 && names.size() > static_cast<size_t>(INT32_MAX))
+    {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    return status == 0;
+}
+
+static size_t AlignColumn(size_t offset)
+{
+    return (offset + ColumnAlignment - 1) & ~(ColumnAlignment - 1);
+}
+
+// Lays the collected entries out as columns in a single allocation, freed with free()
+static DirectoryColumns* BuildColumns(const std::vector<CollectedEntry>& entries, const std::vector<char>& names)
+{
+    size_t count = entries.size();
+    size_t offset = AlignColumn(sizeof(DirectoryColumns));
+    size_t int32Offsets[8];
+    for (size_t& column : int32Offsets)
+    {
+        column = offset;
+        offset = AlignColumn(offset + count * sizeof(int32_t));
+    }
+    size_t int64Offsets[4];
+    for (size_t& column : int64Offsets)
+    {
+        column = offset;
+        offset = AlignColumn(offset + count * sizeof(int64_t));
+    }
+    size_t namesOffset = offset;
+    size_t total = namesOffset + names.size() + 1;
+
+    void* block = nullptr;
+    if (posix_memalign(&block, ColumnAlignment, total) != 0)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    char* base = static_cast<char*>(block);
+    DirectoryColumns* columns = static_cast<DirectoryColumns*>(block);
+    columns->Count = static_cast<int32_t>(count);
+    columns->NameOffsets = reinterpret_cast<int32_t*>(base + int32Offsets[0]);
+    columns->NameLengths = reinterpret_cast<int32_t*>(base + int32Offsets[1]);
+    columns->Types = reinterpret_cast<int32_t*>(base + int32Offsets[2]);
+    columns->Modes = reinterpret_cast<int32_t*>(base + int32Offsets[3]);
+    columns->UserIds = reinterpret_cast<int32_t*>(base + int32Offsets[4]);
+    columns->GroupIds = reinterpret_cast<int32_t*>(base + int32Offsets[5]);
+    columns->HardlinkCounts = reinterpret_cast<int32_t*>(base + int32Offsets[6]);
+    columns->Errors = reinterpret_cast<int32_t*>(base + int32Offsets[7]);
+    columns->Sizes = reinterpret_cast<int64_t*>(base + int64Offsets[0]);
+    columns->ModifiedTimes = reinterpret_cast<int64_t*>(base + int64Offsets[1]);
+    columns->ChangeTimes = reinterpret_cast<int64_t*>(base + int64Offsets[2]);
+    columns->Inodes = reinterpret_cast<int64_t*>(base + int64Offsets[3]);
+    columns->Names = base + namesOffset;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const CollectedEntry& entry = entries[i];
+        const struct stat& st = entry.Stat;
+        bool valid = entry.Error == 0;
+        columns->NameOffsets[i] = static_cast<int32_t>(entry.NameOffset);
+        columns->NameLengths[i] = static_cast<int32_t>(entry.NameLength);
+        columns->Types[i] = valid ? GetDirectoryEntryType(st.st_mode) : 0;
+        columns->Modes[i] = valid ? static_cast<int32_t>(st.st_mode) : 0;
+        columns->UserIds[i] = valid ? static_cast<int32_t>(st.st_uid) : 0;
+        columns->GroupIds[i] = valid ? static_cast<int32_t>(st.st_gid) : 0;
+        columns->HardlinkCounts[i] = valid ? static_cast<int32_t>(st.st_nlink) : 0;
+        columns->Errors[i] = entry.Error;
+        columns->Sizes[i] = valid ? st.st_size : 0;
+        columns->ModifiedTimes[i] = valid ? GetModifiedTimeNanoseconds(st) : 0;
+        columns->ChangeTimes[i] = valid ? GetChangeTimeNanoseconds(st) : 0;
+        columns->Inodes[i] = valid ? static_cast<int64_t>(st.st_ino) : 0;
+    }
+
+    if (!names.empty())
+    {
+        memcpy(columns->Names, names.data(), names.size());
+    }
+    columns->Names[names.size()] = '\0';
+    return columns;
+}
+
+//! @brief EnumerateDirectory lists the entries of a directory that pass a
+//! filter
+//!
+//! EnumerateDirectory
+//!
+//! The filter is applied as each entry is read. Name, hidden and type
+//! conditions are decided from the directory listing itself, so an entry
+//! they reject costs neither a stat nor any memory in the result.
+//!
+//! @param[in] path
+//! @parblock
+//! The directory to list.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] filter
+//! @parblock
+//! The conditions entries have to meet, or NULL for every entry.
+//! @endparblock
+//!
+//! @param[out] listing
+//! @parblock
+//! Receives the entries, in the order the directory returned them. Free it
+//! with FreeDirectoryListing.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t EnumerateDirectory(const char* path, const struct DirectoryFilter* filter, struct DirectoryListing** listing)
+{
+    assert(path && listing);
+    if (path == nullptr || listing == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *listing = nullptr;
+
+    try
+    {
+        std::vector<CollectedEntry> entries;
+        std::vector<char> names;
+        if (!CollectEntries(path, filter, entries, names))
+        {
+            return -1;
+        }
+
+        // Hand out plain malloc'd memory, so the listing outlives nothing of ours
+        DirectoryListing* result = static_cast<DirectoryListing*>(calloc(1, sizeof(DirectoryListing)));
+        if (result == nullptr ||
+            (result->Entries = static_cast<DirectoryEntryInfo*>(malloc(entries.size() * sizeof(DirectoryEntryInfo) + 1))) == nullptr ||
+            (result->Names = static_cast<char*>(malloc(names.size() + 1))) == nullptr)
+        {
+            FreeDirectoryListing(result);
+            errno = ENOMEM;
+            return -1;
+        }
+
+        result->Count = static_cast<int32_t>(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            DirectoryEntryInfo& info = result->Entries[i];
+            info.NameOffset = static_cast<int32_t>(entries[i].NameOffset);
+            info.NameLength = static_cast<int32_t>(entries[i].NameLength);
+            FillDirectoryEntryInfo(entries[i].Stat, &info);
+        }
+        if (!names.empty())
+        {
+            memcpy(result->Names, names.data(), names.size());
+        }
+
+        *listing = result;
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief FreeDirectoryListing frees a listing returned by EnumerateDirectory
+//!
+//! FreeDirectoryListing
+//!
+void FreeDirectoryListing(struct DirectoryListing* listing)
+{
+    if (listing == nullptr)
+    {
+        return;
+    }
+
+    free(listing->Entries);
+    free(listing->Names);
+    free(listing);
+}
+
+//! @brief EnumerateDirectoryColumns lists the entries of a directory that pass
+//! a filter, one array per field
+//!
+//! EnumerateDirectoryColumns
+//!
+//! Behaves like EnumerateDirectory, but returns the entries as columns.
+//!
+//! @param[out] columns
+//! @parblock
+//! Receives the entries, in the order the directory returned them. Free it
+//! with FreeDirectoryColumns.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t EnumerateDirectoryColumns(const char* path, const struct DirectoryFilter* filter, struct DirectoryColumns** columns)
+{
+    assert(path && columns);
+    if (path == nullptr || columns == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *columns = nullptr;
+
+    try
+    {
+        std::vector<CollectedEntry> entries;
+        std::vector<char> names;
+        if (!CollectEntries(path, filter, entries, names))
+        {
+            return -1;
+        }
+
+        *columns = BuildColumns(entries, names);
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return *columns != nullptr ? 0 : -1;
+}
+
+//! @brief StatPathsColumns stats many paths and returns the results as columns
+//!
+//! StatPathsColumns
+//!
+//! A path that cannot be stat'ed does not fail the call. Its Errors element
+//! holds the errno and its other fields are 0.
+//!
+//! @param[in] paths
+//! @parblock
+//! The paths to stat. They are copied into the Names heap, in order.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] followLinks
+//! @parblock
+//! Non-zero to stat what symbolic links point to, as GetStat does, zero to
+//! stat the links themselves, as GetLStat does.
+//! @endparblock
+//!
+//! @param[out] columns
+//! @parblock
+//! Receives one row per path. Free it with FreeDirectoryColumns.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t StatPathsColumns(const char* const paths[], int32_t pathCount, int32_t followLinks, struct DirectoryColumns** columns)
+{
+    assert(columns);
+    if (pathCount < 0 || (pathCount > 0 && paths == nullptr) || columns == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *columns = nullptr;
+
+    try
+    {
+        std::vector<CollectedEntry> entries(static_cast<size_t>(pathCount));
+        std::vector<char> names;
+        for (int32_t i = 0; i < pathCount; i++)
+        {
+            if (paths[i] == nullptr)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+
+            CollectedEntry& entry = entries[i];
+            size_t length = strlen(paths[i]);
+            entry.NameOffset = names.size();
+            entry.NameLength = length;
+            entry.Error = fstatat(AT_FDCWD, paths[i], &entry.Stat, followLinks ? 0 : AT_SYMLINK_NOFOLLOW) == 0 ? 0 : errno;
+            names.insert(names.end(), paths[i], paths[i] + length + 1);
+        }
+
+        if (names.size() > static_cast<size_t>(INT32_MAX))
+        {
+            errno = EOVERFLOW;
+            return -1;
+        }
+
+        *columns = BuildColumns(entries, names);
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return *columns != nullptr ? 0 : -1;
+}
+
+//! @brief FreeDirectoryColumns frees columns returned by
+//! EnumerateDirectoryColumns or StatPathsColumns
+//!
+//! FreeDirectoryColumns
+//!
+void FreeDirectoryColumns(struct DirectoryColumns* columns)
+{
+    free(columns);
+}
@@ -0,0 +1,97 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Entry types, used both in DirectoryEntryInfo.Type and as bits of DirectoryFilter.TypeMask.
+// Symbolic links are reported as links, not as what they point to.
+enum
+{
+    DIRECTORY_ENTRY_FILE = 0x00000001,
+    DIRECTORY_ENTRY_DIRECTORY = 0x00000002,
+    DIRECTORY_ENTRY_SYMLINK = 0x00000004,
+    DIRECTORY_ENTRY_OTHER = 0x00000008          // devices, pipes and sockets
+};
+
+// Bits in DirectoryFilter.Flags selecting which conditions an entry has to meet
+enum
+{
+    DIRECTORY_FILTER_INCLUDE = 0x00000001,      // name matches IncludeGlob
+    DIRECTORY_FILTER_EXCLUDE = 0x00000002,      // name does not match ExcludeGlob
+    DIRECTORY_FILTER_SIZE = 0x00000004,         // MinimumSize <= size <= MaximumSize
+    DIRECTORY_FILTER_MODIFIED_TIME = 0x00000008,// ModifiedAfter <= mtime < ModifiedBefore
+    DIRECTORY_FILTER_TYPE = 0x00000010,         // type is in TypeMask
+    DIRECTORY_FILTER_HIDDEN = 0x00000020,       // HiddenRule holds
+    DIRECTORY_FILTER_IGNORE_CASE = 0x00000040   // globs match case insensitively
+};
+
+// Values for DirectoryFilter.HiddenRule; hidden entries are those whose name starts with '.'
+enum
+{
+    DIRECTORY_HIDDEN_EXCLUDE = 0,
+    DIRECTORY_HIDDEN_ONLY = 1
+};
+
+struct DirectoryFilter
+{
+    int32_t Flags;                  // DIRECTORY_FILTER_* bits
+    const char* IncludeGlob;        // fnmatch pattern, matched against the entry name only
+    const char* ExcludeGlob;
+    int64_t MinimumSize;
+    int64_t MaximumSize;
+    int64_t ModifiedAfter;          // nanoseconds since the epoch
+    int64_t ModifiedBefore;
+    int32_t TypeMask;               // DIRECTORY_ENTRY_* bits
+    int32_t HiddenRule;             // DIRECTORY_HIDDEN_* value
+};
+
+struct DirectoryEntryInfo
+{
+    int32_t NameOffset;             // offset of the null terminated name in DirectoryListing.Names
+    int32_t NameLength;
+    int32_t Type;                   // DIRECTORY_ENTRY_* value
+    int32_t Mode;
+    int64_t Size;
+    int64_t ModifiedTime;           // nanoseconds since the epoch
+    int64_t Inode;
+};
+
+struct DirectoryListing
+{
+    int32_t Count;
+    struct DirectoryEntryInfo* Entries;
+    char* Names;
+};
+
+// The same information as a DirectoryListing, one contiguous array per field, so that
+// a consumer sorting or aggregating on one field only touches that field.  Every array
+// has Count elements and starts on a 64 byte boundary.
+struct DirectoryColumns
+{
+    int32_t Count;
+    int32_t* NameOffsets;           // offsets of the null terminated names in Names
+    int32_t* NameLengths;
+    int32_t* Types;                 // DIRECTORY_ENTRY_* values, 0 where Errors is set
+    int32_t* Modes;
+    int32_t* UserIds;
+    int32_t* GroupIds;
+    int32_t* HardlinkCounts;
+    int32_t* Errors;                // errno of a failed stat, 0 otherwise
+    int64_t* Sizes;
+    int64_t* ModifiedTimes;         // nanoseconds since the epoch
+    int64_t* ChangeTimes;           // nanoseconds since the epoch
+    int64_t* Inodes;
+    char* Names;
+};
+
+int32_t EnumerateDirectory(const char* path, const struct DirectoryFilter* filter, struct DirectoryListing** listing);
+void FreeDirectoryListing(struct DirectoryListing* listing);
+int32_t EnumerateDirectoryColumns(const char* path, const struct DirectoryFilter* filter, struct DirectoryColumns** columns);
+int32_t StatPathsColumns(const char* const paths[], int32_t pathCount, int32_t followLinks, struct DirectoryColumns** columns);
+void FreeDirectoryColumns(struct DirectoryColumns* columns);
+
+PAL_END_EXTERNC
@@ -0,0 +1,242 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief an environment for child processes that is built once and updated in place
+
+#include "environmentblock.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Entries are kept as "name=value" strings, in the order execve wants them, with
+// Variables holding a pointer to each followed by a null terminator.  Index maps each
+// name to its entry, so updating one variable touches only that entry and its pointer.
+struct EnvironmentBlock
+{
+    std::vector<std::string> Entries;
+    std::vector<char*> Variables;
+    std::unordered_map<std::string, size_t> Index;
+};
+
+static bool IsValidName(const char* name)
+{
+    return name != nullptr && name[0] != '\0' && strchr(name, '=') == nullptr;
+}
+
+// Points Variables at the current storage of every entry, needed whenever the
+// entries vector has grown and moved its strings
+static void RefreshVariables(EnvironmentBlock* block)
+{
+    block->Variables.resize(block->Entries.size() + 1);
+    for (size_t i = 0; i < block->Entries.size(); i++)
+    {
+        block->Variables[i] = &block->Entries[i][0];
+    }
+    block->Variables[block->Entries.size()] = nullptr;
+}
+
+static void SetEntry(EnvironmentBlock* block, std::string name, std::string entry)
+{
+    auto found = block->Index.find(name);
+    if (found != block->Index.end())
+    {
+        block->Entries[found->second] = std::move(entry);
+        block->Variables[found->second] = &block->Entries[found->second][0];
+        return;
+    }
+
+    size_t capacity = block->Entries.capacity();
+    block->Entries.push_back(std::move(entry));
+    block->Index.emplace(std::move(name), block->Entries.size() - 1);
+    if (block->Entries.capacity() != capacity)
+    {
+        RefreshVariables(block);
+    }
+    else
+    {
+        block->Variables.back() = &block->Entries.back()[0];
+        block->Variables.push_back(nullptr);
+    }
+}
+
+//! @brief EnvironmentBlockCreate builds an environment block for spawning
+//! child processes
+//!
+//! EnvironmentBlockCreate
+//!
+//! The block is passed to the ForkAndExec functions through
+//! SPAWN_ATTRIBUTE_ENVIRONMENT, so that launching many children with the same
+//! environment does not marshal the whole environment for every launch.
+//! Later changes are applied with EnvironmentBlockSet and
+//! EnvironmentBlockUnset, each in time independent of the block's size.
+//!
+//! A block may be used by several spawns at once, but must not be changed
+//! while it is being used.
+//!
+//! @param[in] envp
+//! @parblock
+//! A null terminated array of "name=value" strings to start with, or NULL
+//! for an empty block. Entries without '=' are dropped, and a later entry
+//! for a name replaces an earlier one.
+//! @endparblock
+//!
+//! @retval the block, or NULL with errno set if unsuccessful
+//!
+struct EnvironmentBlock* EnvironmentBlockCreate(char* const envp[])
+{
+    EnvironmentBlock* block = new (std::nothrow) EnvironmentBlock();
+    if (block == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    try
+    {
+        block->Variables.push_back(nullptr);
+        for (size_t i = 0; envp != nullptr && envp[i] != nullptr; i++)
+        {
+            const char* separator = strchr(envp[i], '=');
+            if (separator == nullptr || separator == envp[i])
+            {
+                continue;
+            }
+
+            SetEntry(block, std::string(envp[i], static_cast<size_t>(separator - envp[i])), std::string(envp[i]));
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        delete block;
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    return block;
+}
+
+//! @brief EnvironmentBlockSet adds a variable or changes its value
+//!
+//! EnvironmentBlockSet
+//!
+//! @retval 0 if successful, -1 otherwise with errno set (EINVAL if name is
+//! empty or contains '=')
+//!
+int32_t EnvironmentBlockSet(struct EnvironmentBlock* block, const char* name, const char* value)
+{
+    assert(block && value);
+    if (block == nullptr || !IsValidName(name) || value == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    try
+    {
+        std::string key(name);
+        std::string entry;
+        entry.reserve(key.size() + strlen(value) + 1);
+        entry.append(key).append(1, '=').append(value);
+        SetEntry(block, std::move(key), std::move(entry));
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief EnvironmentBlockUnset removes a variable
+//!
+//! EnvironmentBlockUnset
+//!
+//! Removing a variable that is not set is not an error. The order of the
+//! remaining variables may change.
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t EnvironmentBlockUnset(struct EnvironmentBlock* block, const char* name)
+{
+    assert(block);
+    if (block == nullptr || !IsValidName(name))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    auto found = block->Index.find(name);
+    if (found == block->Index.end())
+    {
+        return 0;
+    }
+
+    // Move the last entry into the hole, so nothing else has to shift
+    size_t slot = found->second;
+    size_t last = block->Entries.size() - 1;
+    block->Index.erase(found);
+    if (slot != last)
+    {
+        block->Entries[slot].swap(block->Entries[last]);
+        block->Variables[slot] = &block->Entries[slot][0];
+        const std::string& moved = block->Entries[slot];
+        block->Index[moved.substr(0, moved.find('='))] = slot;
+    }
+
+    block->Entries.pop_back();
+    block->Variables.pop_back();
+    block->Variables[last] = nullptr;
+    return 0;
+}
+
+//! @brief EnvironmentBlockGet returns the value of a variable
+//!
+//! EnvironmentBlockGet
+//!
+//! @retval the value, valid until the variable is next changed, or NULL if
+//! the variable is not set
+//!
+const char* EnvironmentBlockGet(const struct EnvironmentBlock* block, const char* name)
+{
+    assert(block);
+    if (block == nullptr || !IsValidName(name))
+    {
+        return nullptr;
+    }
+
+    auto found = block->Index.find(name);
+    if (found == block->Index.end())
+    {
+        return nullptr;
+    }
+
+    return block->Entries[found->second].c_str() + found->first.size() + 1;
+}
+
+//! @brief EnvironmentBlockGetVariables returns the block as an envp array
+//!
+//! EnvironmentBlockGetVariables
+//!
+//! @retval a null terminated array of "name=value" strings, valid until the
+//! block is next changed
+//!
+char* const* EnvironmentBlockGetVariables(const struct EnvironmentBlock* block)
+{
+    assert(block);
+    return block != nullptr ? block->Variables.data() : nullptr;
+}
+
+//! @brief EnvironmentBlockDestroy frees an environment block
+//!
+//! EnvironmentBlockDestroy
+//!
+void EnvironmentBlockDestroy(struct EnvironmentBlock* block)
+{
+    delete block;
+}
@@ -0,0 +1,19 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+struct EnvironmentBlock;
+
+struct EnvironmentBlock* EnvironmentBlockCreate(char* const envp[]);
+int32_t EnvironmentBlockSet(struct EnvironmentBlock* block, const char* name, const char* value);
+int32_t EnvironmentBlockUnset(struct EnvironmentBlock* block, const char* name);
+const char* EnvironmentBlockGet(const struct EnvironmentBlock* block, const char* name);
+char* const* EnvironmentBlockGetVariables(const struct EnvironmentBlock* block);
+void EnvironmentBlockDestroy(struct EnvironmentBlock* block);
+
+PAL_END_EXTERNC
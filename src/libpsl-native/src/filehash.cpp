@@ -0,0 +1,1023 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief hash the content of files with MD5, SHA-1, SHA-256 or SHA-512
+
+#include "filehash.h"
+#include "directoryfilter.h"
+#include "fileio.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
+
+#include <assert.h>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+#define PAL_HAVE_XATTR 1
+#include <sys/xattr.h>
+#endif
+
+namespace
+{
+    // Large reads keep the per-call overhead small next to the hashing, and leave
+    // room for the read-ahead that POSIX_FADV_SEQUENTIAL asks for
+    const size_t ReadBufferSize = 1024 * 1024;
+
+    // Hashing many files is mostly waiting for reads on slow storage, but each thread
+    // holds a read buffer
+    const int32_t MaxThreadCount = 64;
+
+    const char SidecarMagic[8] = { 'P', 'S', 'L', 'F', 'H', 'S', 'H', '1' };
+    const uint32_t SidecarVersion = 1;
+    const uint32_t AttributeVersion = 1;
+    const size_t MaxDigestSize = 64;
+
+    // What a cached digest was computed from.  The change time catches content
+    // rewritten with its modification time put back, but it cannot be part of an
+    // attribute's key, since setting the attribute changes it.
+    struct DigestKey
+    {
+        int64_t ModifiedTime;           // nanoseconds since the epoch
+        int64_t ChangeTime;
+        int64_t Size;
+        uint64_t Inode;
+
+        bool operator==(const DigestKey& other) const
+        {
+            return ModifiedTime == other.ModifiedTime && ChangeTime == other.ChangeTime &&
+                   Size == other.Size && Inode == other.Inode;
+        }
+    };
+
+    // The value of the user.psl.<algorithm> attribute
+    struct AttributeValue
+    {
+        uint32_t Version;
+        uint32_t Algorithm;
+        int64_t ModifiedTime;
+        int64_t Size;
+        uint64_t Inode;
+        uint8_t Digest[MaxDigestSize];  // only the algorithm's digest size is stored
+    };
+
+    struct SidecarId
+    {
+        uint64_t Device;
+        uint64_t Inode;
+        uint32_t Algorithm;
+
+        bool operator==(const SidecarId& other) const
+        {
+            return Device == other.Device && Inode == other.Inode && Algorithm == other.Algorithm;
+        }
+    };
+
+    struct SidecarIdHash
+    {
+        size_t operator()(const SidecarId& id) const
+        {
+            uint64_t hash = id.Inode;
+            hash = hash * 1099511628211ULL ^ id.Device;
+            hash = hash * 1099511628211ULL ^ id.Algorithm;
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    struct SidecarDigest
+    {
+        DigestKey Key;
+        uint8_t Digest[MaxDigestSize];
+        bool Used;                      // looked up or added since the cache was opened
+    };
+
+    // The sidecar file is a header followed by RecordCount records
+    struct SidecarHeader
+    {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t RecordSize;
+        uint64_t RecordCount;
+    };
+
+    struct SidecarRecord
+    {
+        uint64_t Device;
+        uint64_t Inode;
+        int64_t ModifiedTime;
+        int64_t ChangeTime;
+        int64_t Size;
+        uint32_t Algorithm;
+        uint32_t Reserved;
+        uint8_t Digest[MaxDigestSize];
+    };
+
+    class FileHasher
+    {
+    public:
+        virtual ~FileHasher() {}
+        virtual void Update(const void* data, size_t length) = 0;
+        virtual void Final(uint8_t* digest) = 0;
+        virtual void Reset() = 0;
+    };
+
+    template <typename Hash>
+    class FileHasherOf : public FileHasher
+    {
+    public:
+        void Update(const void* data, size_t length) override { m_hash.Update(data, length); }
+        void Final(uint8_t* digest) override { m_hash.Final(digest); }
+        void Reset() override { m_hash.Reset(); }
+
+    private:
+        Hash m_hash;
+    };
+
+    struct HashWork
+    {
+        const char* const* Paths;
+        int32_t Count;
+        int32_t Algorithm;
+        FileHashCache* Cache;
+        size_t DigestSize;
+        uint8_t* Digests;
+        int32_t* Errors;
+        std::atomic<int32_t> Next;
+        std::atomic<bool> OutOfMemory;
+    };
+}
+
+struct FileHashCache
+{
+    bool UseAttributes;
+    std::mutex Lock;
+    std::unordered_map<SidecarId, SidecarDigest, SidecarIdHash> Digests;
+};
+
+static size_t GetDigestSize(int32_t algorithm)
+{
+    switch (algorithm)
+    {
+        case FILE_HASH_MD5:
+            return Md5::DigestSize;
+        case FILE_HASH_SHA1:
+            return Sha1::DigestSize;
+        case FILE_HASH_SHA256:
+            return Sha256::DigestSize;
+        case FILE_HASH_SHA512:
+            return Sha512::DigestSize;
+        default:
+            return 0;
+    }
+}
+
+// Throws std::bad_alloc; algorithm has to be valid
+static std::unique_ptr<FileHasher> CreateHasher(int32_t algorithm)
+{
+    switch (algorithm)
+    {
+        case FILE_HASH_MD5:
+            return std::unique_ptr<FileHasher>(new FileHasherOf<Md5>());
+        case FILE_HASH_SHA1:
+            return std::unique_ptr<FileHasher>(new FileHasherOf<Sha1>());
+        case FILE_HASH_SHA256:
+            return std::unique_ptr<FileHasher>(new FileHasherOf<Sha256>());
+        default:
+            return std::unique_ptr<FileHasher>(new FileHasherOf<Sha512>());
+    }
+}
+
+// Hashes a regular file from its start with pread, so that the descriptor's offset
+// is left alone, and anything else from its current position to its end.  The
+// buffer is sized on first use, so that digests found in a cache cost no
+// allocation.  Returns 0 or an errno value; throws std::bad_alloc.
+static int HashDescriptor(int fd, FileHasher& hasher, std::vector<char>& buffer, uint8_t* digest)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        return errno;
+    }
+    if (S_ISDIR(st.st_mode))
+    {
+        return EISDIR;
+    }
+
+    if (buffer.empty())
+    {
+        buffer.resize(ReadBufferSize);
+    }
+
+    bool positioned = S_ISREG(st.st_mode);
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (positioned)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    hasher.Reset();
+    off_t offset = 0;
+    while (true)
+    {
+        ssize_t count = positioned ? pread(fd, buffer.data(), buffer.size(), offset) : read(fd, buffer.data(), buffer.size());
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+
+        hasher.Update(buffer.data(), static_cast<size_t>(count));
+        offset += count;
+    }
+
+    hasher.Final(digest);
+    return 0;
+}
+
+static DigestKey GetDigestKey(const struct stat& st)
+{
+    DigestKey key = { GetModifiedTimeNanoseconds(st), GetChangeTimeNanoseconds(st), st.st_size, static_cast<uint64_t>(st.st_ino) };
+    return key;
+}
+
+static const char* GetAttributeName(int32_t algorithm)
+{
+    switch (algorithm)
+    {
+        case FILE_HASH_MD5:
+            return "user.psl.md5";
+        case FILE_HASH_SHA1:
+            return "user.psl.sha1";
+        case FILE_HASH_SHA256:
+            return "user.psl.sha256";
+        default:
+            return "user.psl.sha512";
+    }
+}
+
+static bool LookUpAttribute(int fd, int32_t algorithm, const DigestKey& key, uint8_t* digest)
+{
+#ifdef PAL_HAVE_XATTR
+    AttributeValue value;
+    size_t expected = offsetof(AttributeValue, Digest) + GetDigestSize(algorithm);
+#if defined(__APPLE__)
+    ssize_t length = fgetxattr(fd, GetAttributeName(algorithm), &value, sizeof(value), 0, 0);
+#else
+    ssize_t length = fgetxattr(fd, GetAttributeName(algorithm), &value, sizeof(value));
+#endif
+    if (length < 0 || static_cast<size_t>(length) != expected || value.Version != AttributeVersion ||
+        value.Algorithm != static_cast<uint32_t>(algorithm) || value.ModifiedTime != key.ModifiedTime ||
+        value.Size != key.Size || value.Inode != key.Inode)
+    {
+        return false;
+    }
+
+    memcpy(digest, value.Digest, GetDigestSize(algorithm));
+    return true;
+#else
+    (void)fd;
+    (void)algorithm;
+    (void)key;
+    (void)digest;
+    return false;
+#endif
+}
+
+// Fails where the file system has no user attributes (tmpfs before Linux 6.6, for
+// one), is read-only, or the caller does not own the file
+static bool StoreAttribute(int fd, int32_t algorithm, const DigestKey& key, const uint8_t* digest)
+{
+#ifdef PAL_HAVE_XATTR
+    AttributeValue value = {};
+    value.Version = AttributeVersion;
+    value.Algorithm = static_cast<uint32_t>(algorithm);
+    value.ModifiedTime = key.ModifiedTime;
+    value.Size = key.Size;
+    value.Inode = key.Inode;
+    memcpy(value.Digest, digest, GetDigestSize(algorithm));
+    size_t length = offsetof(AttributeValue, Digest) + GetDigestSize(algorithm);
+#if defined(__APPLE__)
+    return fsetxattr(fd, GetAttributeName(algorithm), &value, length, 0, 0) == 0;
+#else
+    return fsetxattr(fd, GetAttributeName(algorithm), &value, length, 0) == 0;
+#endif
+#else
+    (void)fd;
+    (void)algorithm;
+    (void)key;
+    (void)digest;
+    return false;
+#endif
+}
+
+static bool LookUpSidecar(FileHashCache& cache, const struct stat& st, int32_t algorithm, uint8_t* digest)
+{
+    SidecarId id = { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino), static_cast<uint32_t>(algorithm) };
+    DigestKey key = GetDigestKey(st);
+    std::lock_guard<std::mutex> lock(cache.Lock);
+    auto cached = cache.Digests.find(id);
+    if (cached == cache.Digests.end() || cached->second.Key.ModifiedTime != key.ModifiedTime ||
+        cached->second.Key.ChangeTime != key.ChangeTime || cached->second.Key.Size != key.Size)
+    {
+        return false;
+    }
+
+    memcpy(digest, cached->second.Digest, GetDigestSize(algorithm));
+    cached->second.Used = true;
+    return true;
+}
+
+// Throws std::bad_alloc
+static void StoreSidecar(FileHashCache& cache, const struct stat& st, int32_t algorithm, const uint8_t* digest)
+{
+    SidecarId id = { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino), static_cast<uint32_t>(algorithm) };
+    std::lock_guard<std::mutex> lock(cache.Lock);
+    SidecarDigest& cached = cache.Digests[id];
+    cached.Key = GetDigestKey(st);
+    memset(cached.Digest, 0, sizeof(cached.Digest));
+    memcpy(cached.Digest, digest, GetDigestSize(algorithm));
+    cached.Used = true;
+}
+
+// Like HashDescriptor, but a regular file's digest is taken from its attribute or
+// the sidecar when its key still matches, and remembered otherwise.  Throws
+// std::bad_alloc.
+static int HashDescriptorCached(
+    int fd, int32_t algorithm, FileHashCache& cache, FileHasher& hasher, std::vector<char>& buffer, uint8_t* digest, bool* cached)
+{
+    *cached = false;
+    struct stat before;
+    if (fstat(fd, &before) != 0)
+    {
+        return errno;
+    }
+    if (!S_ISREG(before.st_mode))
+    {
+        return HashDescriptor(fd, hasher, buffer, digest);
+    }
+
+    DigestKey key = GetDigestKey(before);
+    if ((cache.UseAttributes && LookUpAttribute(fd, algorithm, key, digest)) || LookUpSidecar(cache, before, algorithm, digest))
+    {
+        *cached = true;
+        return 0;
+    }
+
+    int error = HashDescriptor(fd, hasher, buffer, digest);
+    if (error != 0)
+    {
+        return error;
+    }
+
+    // Only a file that did not change while it was read, and whose modification
+    // time is old enough to show a later change, may be cached
+    struct stat after;
+    if (fstat(fd, &after) != 0 || !(GetDigestKey(after) == key) || after.st_mtime + RacyWindowSeconds >= time(nullptr))
+    {
+        return 0;
+    }
+    if (!cache.UseAttributes || !StoreAttribute(fd, algorithm, key, digest))
+    {
+        StoreSidecar(cache, after, algorithm, digest);
+    }
+    return 0;
+}
+
+// Throws std::bad_alloc
+static int HashPath(
+    const char* path, int32_t algorithm, FileHashCache* cache, FileHasher& hasher, std::vector<char>& buffer, uint8_t* digest, bool* cached)
+{
+    *cached = false;
+    int fd;
+    while ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 && errno == EINTR);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    int error;
+    try
+    {
+        error = cache == nullptr ? HashDescriptor(fd, hasher, buffer, digest)
+                                 : HashDescriptorCached(fd, algorithm, *cache, hasher, buffer, digest, cached);
+    }
+    catch (const std::bad_alloc&)
+    {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+    return error;
+}
+
+static void RunHashWorker(HashWork* work)
+{
+    try
+    {
+        std::unique_ptr<FileHasher> hasher = CreateHasher(work->Algorithm);
+        std::vector<char> buffer;
+        int32_t index;
+        while (!work->OutOfMemory && (index = work->Next++) < work->Count)
+        {
+            uint8_t* digest = work->Digests + static_cast<size_t>(index) * work->DigestSize;
+            memset(digest, 0, work->DigestSize);
+            bool cached;
+            work->Errors[index] = work->Paths[index] == nullptr
+                ? EINVAL
+                : HashPath(work->Paths[index], work->Algorithm, work->Cache, *hasher, buffer, digest, &cached);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        work->OutOfMemory = true;
+    }
+}
+
+//! @brief FileHashCacheOpen opens a cache of file digests for HashFileCached
+//! and HashFiles
+//!
+//! FileHashCacheOpen
+//!
+//! A digest is kept with the modification time, size and inode of the file
+//! it was computed from, and is used again for as long as they match. It is
+//! stored in a user.psl.<algorithm> extended attribute on the file itself,
+//! so that it follows the file and a hit costs one fstat and one fgetxattr.
+//! Where the attribute cannot be set, on file systems without user
+//! attributes, read-only ones, or files the caller does not own, it goes to
+//! the sidecar instead, which also checks the change time. Digests are only
+//! stored for files that did not change while they were read and were not
+//! modified in the last couple of seconds.
+//!
+//! @param[in] sidecarPath
+//! @parblock
+//! A file saved by FileHashCacheSave, or NULL for a sidecar that only lives
+//! in memory. A file that does not exist yet opens as an empty sidecar.
+//! @endparblock
+//!
+//! @param[in] flags
+//! @parblock
+//! FILE_HASH_CACHE_NO_XATTR to neither read nor write attributes.
+//! @endparblock
+//!
+//! @retval the cache, or NULL with errno set if unsuccessful (EINVAL if the
+//! file is not a valid sidecar)
+//!
+struct FileHashCache* FileHashCacheOpen(const char* sidecarPath, int32_t flags)
+{
+    if ((flags & ~FILE_HASH_CACHE_NO_XATTR) != 0)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    FileHashCache* cache = new (std::nothrow) FileHashCache();
+    if (cache == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    cache->UseAttributes = (flags & FILE_HASH_CACHE_NO_XATTR) == 0;
+    if (sidecarPath == nullptr)
+    {
+        return cache;
+    }
+
+    int fd = open(sidecarPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return cache;
+        }
+
+        delete cache;
+        return nullptr;
+    }
+
+    int error = 0;
+    try
+    {
+        struct stat st;
+        SidecarHeader header;
+        if (fstat(fd, &st) != 0)
+        {
+            error = errno;
+        }
+        else if (static_cast<size_t>(st.st_size) < sizeof(header) || !ReadAll(fd, &header, sizeof(header)) ||
+                 memcmp(header.Magic, SidecarMagic, sizeof(SidecarMagic)) != 0 || header.Version != SidecarVersion ||
+                 header.RecordSize != sizeof(SidecarRecord) ||
+                 header.RecordCount != (static_cast<size_t>(st.st_size) - sizeof(header)) / sizeof(SidecarRecord) ||
+                 (static_cast<size_t>(st.st_size) - sizeof(header)) % sizeof(SidecarRecord) != 0)
+        {
+            error = EINVAL;
+        }
+        else
+        {
+            std::vector<SidecarRecord> records(header.RecordCount);
+            if (!ReadAll(fd, records.data(), records.size() * sizeof(SidecarRecord)))
+            {
+                error = errno;
+            }
+            else
+            {
+                cache->Digests.reserve(records.size());
+                for (const SidecarRecord& record : records)
+                {
+                    if (GetDigestSize(static_cast<int32_t>(record.Algorithm)) == 0)
+                    {
+                        continue;
+                    }
+
+                    SidecarId id = { record.Device, record.Inode, record.Algorithm };
+                    SidecarDigest& digest = cache->Digests[id];
+                    digest.Key.ModifiedTime = record.ModifiedTime;
+                    digest.Key.ChangeTime = record.ChangeTime;
+                    digest.Key.Size = record.Size;
+                    digest.Key.Inode = record.Inode;
+                    memcpy(digest.Digest, record.Digest, sizeof(digest.Digest));
+                    digest.Used = false;
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        error = ENOMEM;
+    }
+
+    close(fd);
+    if (error != 0)
+    {
+        delete cache;
+        errno = error;
+        return nullptr;
+    }
+
+    return cache;
+}
+
+//! @brief FileHashCacheSave saves the sidecar of a file digest cache
+//!
+//! FileHashCacheSave
+//!
+//! Only the digests looked up or added since the cache was opened are kept,
+//! so the sidecar does not keep growing with files that no longer exist.
+//! Digests stored in attributes are on the files already.
+//!
+//! @param[in] sidecarPath
+//! @parblock
+//! The file to save the sidecar to. It is replaced atomically.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t FileHashCacheSave(struct FileHashCache* cache, const char* sidecarPath)
+{
+    assert(cache && sidecarPath);
+    if (cache == nullptr || sidecarPath == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    try
+    {
+        std::vector<SidecarRecord> records;
+        {
+            std::lock_guard<std::mutex> lock(cache->Lock);
+            for (const auto& digest : cache->Digests)
+            {
+                if (digest.second.Used)
+                {
+                    SidecarRecord record = {};
+                    record.Device = digest.first.Device;
+                    record.Inode = digest.first.Inode;
+                    record.Algorithm = digest.first.Algorithm;
+                    record.ModifiedTime = digest.second.Key.ModifiedTime;
+                    record.ChangeTime = digest.second.Key.ChangeTime;
+                    record.Size = digest.second.Key.Size;
+                    memcpy(record.Digest, digest.second.Digest, sizeof(record.Digest));
+                    records.push_back(record);
+                }
+            }
+        }
+
+        SidecarHeader header = {};
+        memcpy(header.Magic, SidecarMagic, sizeof(header.Magic));
+        header.Version = SidecarVersion;
+        header.RecordSize = sizeof(SidecarRecord);
+        header.RecordCount = records.size();
+
+        FileSection sections[] = { { &header, sizeof(header) }, { records.data(), records.size() * sizeof(SidecarRecord) } };
+        if (!WriteFileAtomically(sidecarPath, sections, 2))
+        {
+            return -1;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief FileHashCacheClose frees a file digest cache without saving its
+//! sidecar
+//!
+//! FileHashCacheClose
+//!
+void FileHashCacheClose(struct FileHashCache* cache)
+{
+    delete cache;
+}
+
+//! @brief GetFileHashSize returns the size of an algorithm's digest
+//!
+//! GetFileHashSize
+//!
+//! @param[in] algorithm
+//! @parblock
+//! One of the FILE_HASH_* values.
+//! @endparblock
+//!
+//! @retval the digest size in bytes, or -1 with errno set to EINVAL if the
+//! algorithm is not known
+//!
+int32_t GetFileHashSize(int32_t algorithm)
+{
+    size_t size = GetDigestSize(algorithm);
+    if (size == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return static_cast<int32_t>(size);
+}
+
+//! @brief HashFile hashes the content of a file
+//!
+//! HashFile
+//!
+//! The file is read in large chunks with sequential read-ahead requested.
+//! SHA-256 and SHA-1 use the processor's SHA instructions where it has them.
+//!
+//! @param[in] path
+//! @parblock
+//! The file to hash; symbolic links are followed.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] algorithm
+//! @parblock
+//! One of the FILE_HASH_* values.
+//! @endparblock
+//!
+//! @param[out] digest
+//! @parblock
+//! Receives the digest.
+//! @endparblock
+//!
+//! @param[in] digestLength
+//! @parblock
+//! The size of digest, at least GetFileHashSize(algorithm).
+//! @endparblock
+//!
+//! @retval the digest size in bytes if successful, -1 otherwise with errno
+//! set; ERANGE if digest is too small, EISDIR for a directory
+//!
+int32_t HashFile(const char* path, int32_t algorithm, uint8_t* digest, int32_t digestLength)
+{
+    assert(path && digest);
+    size_t size = GetDigestSize(algorithm);
+    if (path == nullptr || digest == nullptr || size == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (digestLength < 0 || static_cast<size_t>(digestLength) < size)
+    {
+        errno = ERANGE;
+        return -1;
+    }
+
+    try
+    {
+        std::unique_ptr<FileHasher> hasher = CreateHasher(algorithm);
+        std::vector<char> buffer;
+        bool cached;
+        int error = HashPath(path, algorithm, nullptr, *hasher, buffer, digest, &cached);
+        if (error != 0)
+        {
+            errno = error;
+            return -1;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return static_cast<int32_t>(size);
+}
+
+//! @brief HashFileDescriptor hashes the content of an open file
+//!
+//! HashFileDescriptor
+//!
+//! A regular file is hashed in full, from its start, without moving the
+//! descriptor's offset. Anything else, such as a pipe, is read from its
+//! current position until end of file.
+//!
+//! @param[in] fd
+//! @parblock
+//! The descriptor to read, open for reading.
+//! @endparblock
+//!
+//! @param[in] algorithm
+//! @parblock
+//! One of the FILE_HASH_* values.
+//! @endparblock
+//!
+//! @param[out] digest
+//! @parblock
+//! Receives the digest.
+//! @endparblock
+//!
+//! @param[in] digestLength
+//! @parblock
+//! The size of digest, at least GetFileHashSize(algorithm).
+//! @endparblock
+//!
+//! @retval the digest size in bytes if successful, -1 otherwise with errno
+//! set; ERANGE if digest is too small
+//!
+int32_t HashFileDescriptor(int32_t fd, int32_t algorithm, uint8_t* digest, int32_t digestLength)
+{
+    assert(digest);
+    size_t size = GetDigestSize(algorithm);
+    if (fd < 0 || digest == nullptr || size == 0)
+    {
+        errno = fd < 0 ? EBADF : EINVAL;
+        return -1;
+    }
+    if (digestLength < 0 || static_cast<size_t>(digestLength) < size)
+    {
+        errno = ERANGE;
+        return -1;
+    }
+
+    try
+    {
+        std::unique_ptr<FileHasher> hasher = CreateHasher(algorithm);
+        std::vector<char> buffer;
+        int error = HashDescriptor(fd, *hasher, buffer, digest);
+        if (error != 0)
+        {
+            errno = error;
+            return -1;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return static_cast<int32_t>(size);
+}
+
+//! @brief HashFileCached hashes the content of a file, reusing the digest
+//! from a previous call while the file is unchanged
+//!
+//! HashFileCached
+//!
+//! See FileHashCacheOpen for how digests are kept. Anything other than a
+//! regular file is always read.
+//!
+//! @param[in] path
+//! @parblock
+//! The file to hash; symbolic links are followed.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] algorithm
+//! @parblock
+//! One of the FILE_HASH_* values.
+//! @endparblock
+//!
+//! @param[in] cache
+//! @parblock
+//! The cache from FileHashCacheOpen.
+//! @endparblock
+//!
+//! @param[out] digest
+//! @parblock
+//! Receives the digest.
+//! @endparblock
+//!
+//! @param[in] digestLength
+//! @parblock
+//! The size of digest, at least GetFileHashSize(algorithm).
+//! @endparblock
+//!
+//! @param[out] cached
+//! @parblock
+//! Receives 1 if the digest came from the cache, 0 if the file was read.
+//! @endparblock
+//!
+//! @retval the digest size in bytes if successful, -1 otherwise with errno
+//! set; ERANGE if digest is too small, EISDIR for a directory
+//!
+int32_t HashFileCached(const char* path, int32_t algorithm, struct FileHashCache* cache, uint8_t* digest, int32_t digestLength, int32_t* cached)
+{
+    assert(path && cache && digest && cached);
+    size_t size = GetDigestSize(algorithm);
+    if (path == nullptr || cache == nullptr || digest == nullptr || cached == nullptr || size == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (digestLength < 0 || static_cast<size_t>(digestLength) < size)
+    {
+        errno = ERANGE;
+        return -1;
+    }
+
+    *cached = 0;
+    try
+    {
+        std::unique_ptr<FileHasher> hasher = CreateHasher(algorithm);
+        std::vector<char> buffer;
+        bool fromCache;
+        int error = HashPath(path, algorithm, cache, *hasher, buffer, digest, &fromCache);
+        if (error != 0)
+        {
+            errno = error;
+            return -1;
+        }
+        *cached = fromCache ? 1 : 0;
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return static_cast<int32_t>(size);
+}
+
+//! @brief HashFiles hashes the content of many files at once
+//!
+//! HashFiles
+//!
+//! The files are shared out among a fixed number of threads, so that reads
+//! from storage with several queues, or with long latencies, overlap. A file
+//! that cannot be hashed does not stop the others; its error is reported in
+//! its slot of errors and its digest is left zeroed.
+//!
+//! @param[in] paths
+//! @parblock
+//! The files to hash; symbolic links are followed.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] count
+//! @parblock
+//! The number of paths.
+//! @endparblock
+//!
+//! @param[in] algorithm
+//! @parblock
+//! One of the FILE_HASH_* values.
+//! @endparblock
+//!
+//! @param[in] cache
+//! @parblock
+//! A cache from FileHashCacheOpen to take unchanged files' digests from, or
+//! NULL to read every file.
+//! @endparblock
+//!
+//! @param[in] threadCount
+//! @parblock
+//! How many files to hash at a time, 0 for one per processor. At most 64
+//! threads are used.
+//! @endparblock
+//!
+//! @param[out] digests
+//! @parblock
+//! Receives the digests one after another, GetFileHashSize(algorithm) bytes
+//! each, in the order of paths.
+//! @endparblock
+//!
+//! @param[out] errors
+//! @parblock
+//! Receives, for each path, 0 if it was hashed and its errno otherwise.
+//! @endparblock
+//!
+//! @retval the number of files that could not be hashed, or -1 with errno set
+//! if the arguments are not valid or memory ran out
+//!
+int32_t HashFiles(
+    const char* const* paths, int32_t count, int32_t algorithm, struct FileHashCache* cache, int32_t threadCount, uint8_t* digests, int32_t* errors)
+{
+    assert(paths && digests && errors);
+    size_t size = GetDigestSize(algorithm);
+    if (paths == nullptr || digests == nullptr || errors == nullptr || count < 0 || threadCount < 0 || size == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (threadCount == 0)
+    {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processors > 0 ? static_cast<int32_t>(processors) : 1;
+    }
+    if (threadCount > MaxThreadCount)
+    {
+        threadCount = MaxThreadCount;
+    }
+    if (threadCount > count)
+    {
+        threadCount = count > 0 ? count : 1;
+    }
+
+    HashWork work;
+    work.Paths = paths;
+    work.Count = count;
+    work.Algorithm = algorithm;
+    work.Cache = cache;
+    work.DigestSize = size;
+    work.Digests = digests;
+    work.Errors = errors;
+    work.Next = 0;
+    work.OutOfMemory = false;
+
+    std::vector<std::thread> threads;
+    try
+    {
+        threads.reserve(threadCount - 1);
+        for (int32_t i = 1; i < threadCount; i++)
+        {
+            threads.push_back(std::thread(RunHashWorker, &work));
+        }
+    }
+    catch (const std::exception&)
+    {
+        // Hash with the threads that did start
+    }
+
+    RunHashWorker(&work);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (work.OutOfMemory)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    int32_t failed = 0;
+    for (int32_t i = 0; i < count; i++)
+    {
+        if (errors[i] != 0)
+        {
+            failed++;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,50 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Algorithms for HashFile, HashFileDescriptor and HashFiles
+enum
+{
+    FILE_HASH_MD5 = 1,              // 16 byte digest
+    FILE_HASH_SHA1 = 2,             // 20 byte digest
+    FILE_HASH_SHA256 = 3,           // 32 byte digest
+    FILE_HASH_SHA512 = 4            // 64 byte digest
+};
+
+// Flags for FileHashCacheOpen
+enum
+{
+    FILE_HASH_CACHE_NO_XATTR = 0x00000001       // keep digests only in the sidecar, not on the files
+};
+
+struct FileHashCache;
+
+struct FileHashCache* FileHashCacheOpen(const char* sidecarPath, int32_t flags);
+int32_t FileHashCacheSave(struct FileHashCache* cache, const char* sidecarPath);
+void FileHashCacheClose(struct FileHashCache* cache);
+
+int32_t GetFileHashSize(int32_t algorithm);
+int32_t HashFile(const char* path, int32_t algorithm, uint8_t* digest, int32_t digestLength);
+int32_t HashFileDescriptor(int32_t fd, int32_t algorithm, uint8_t* digest, int32_t digestLength);
+int32_t HashFileCached(
+    const char* path,
+    int32_t algorithm,
+    struct FileHashCache* cache,
+    uint8_t* digest,
+    int32_t digestLength,
+    int32_t* cached);               // [out] 1 if the digest came from the cache, 0 if the file was read
+int32_t HashFiles(
+    const char* const* paths,
+    int32_t count,
+    int32_t algorithm,
+    struct FileHashCache* cache,    // NULL to read every file
+    int32_t threadCount,
+    uint8_t* digests,               // [out] count digests of GetFileHashSize(algorithm) bytes each
+    int32_t* errors);               // [out] errno for each file that could not be hashed, 0 otherwise
+
+PAL_END_EXTERNC
@@ -0,0 +1,1310 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief a persistent index of the names in a directory tree, kept current from change notifications
+
+#include "fileindex.h"
+#include "directoryfilter.h"
+#include "directoryreader.h"
+#include "fileio.h"
+#include "treewalker.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <mutex>
+#include <new>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#endif
+
+namespace
+{
+    const char IndexMagic[8] = { 'P', 'S', 'L', 'F', 'I', 'D', 'X', '1' };
+    const uint32_t IndexVersion = 1;
+    const int64_t NoParent = -1;
+
+    // The file starts with a header, followed by RecordCount records and then
+    // NamesLength bytes of null terminated names.  Records are in an order where
+    // every parent precedes its children, the root being record 0.
+    struct IndexHeader
+    {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t RecordSize;
+        uint64_t RecordCount;
+        uint64_t NamesLength;
+    };
+
+    struct IndexRecord
+    {
+        int64_t Parent;                 // record of the containing directory, NoParent for the root
+        uint64_t Device;
+        uint64_t Inode;
+        int64_t Size;
+        int64_t ModifiedTime;           // nanoseconds since the epoch
+        uint64_t NameOffset;            // the root's name is its absolute path
+        uint32_t NameLength;
+        uint32_t Mode;
+    };
+
+    enum WatchKind
+    {
+        WatchNone,
+        WatchFanotify,
+        WatchInotify
+    };
+
+#if defined(__linux__)
+    const uint32_t InotifyMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                                 IN_MODIFY | IN_CLOSE_WRITE | IN_ONLYDIR | IN_DONT_FOLLOW;
+    const uint64_t FanotifyMask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ATTRIB |
+                                  FAN_MODIFY | FAN_CLOSE_WRITE | FAN_ONDIR;
+#endif
+
+    const size_t EventBufferSize = 64 * 1024;
+}
+
+// Records read from the file stay in a private mapping, which takes in-place updates
+// of sizes and times without ever writing them back.  Records added since are kept
+// in Added, numbered after the mapped ones, and removed records are only flagged.
+// Children and the watch maps are only built once the index is watched.
+struct FileIndex
+{
+    std::mutex Lock;
+
+    void* Map = MAP_FAILED;
+    size_t MapLength = 0;
+    IndexRecord* Base = nullptr;
+    size_t BaseCount = 0;
+    const char* BaseNames = nullptr;
+
+    std::vector<IndexRecord> Added;
+    std::string AddedNames;
+    std::vector<bool> Dead;
+
+    WatchKind Watching = WatchNone;
+    int WatchFd = -1;
+    std::unordered_map<int64_t, std::unordered_map<std::string, int64_t>> Children;
+    std::unordered_map<int, int64_t> InotifyDirectories;
+    std::unordered_map<int64_t, int> InotifyWatches;
+    std::unordered_map<std::string, int64_t> HandleDirectories;
+    std::unordered_map<int64_t, std::string> DirectoryHandles;
+};
+
+static IndexRecord MakeRecord(int64_t parent, const std::string& name, const struct stat& st, std::string& names)
+{
+    IndexRecord record;
+    record.Parent = parent;
+    record.Device = static_cast<uint64_t>(st.st_dev);
+    record.Inode = static_cast<uint64_t>(st.st_ino);
+    record.Size = st.st_size;
+    record.ModifiedTime = GetModifiedTimeNanoseconds(st);
+    record.NameOffset = names.size();
+    record.NameLength = static_cast<uint32_t>(name.size());
+    record.Mode = static_cast<uint32_t>(st.st_mode);
+    names.append(name).append(1, '\0');
+    return record;
+}
+
+// Appends a record for every entry the walk finds.  Records are numbered by their
+// position in records plus firstSlot.
+class RecordCollector : public TreeVisitor
+{
+public:
+    RecordCollector(std::vector<IndexRecord>& records, std::string& names, int64_t firstSlot)
+        : m_records(records), m_names(names), m_firstSlot(firstSlot)
+    {
+    }
+
+    void Visit(const WalkDirectory& directory, std::vector<WalkEntry>& entries) override
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (WalkEntry& entry : entries)
+        {
+            entry.Tag = m_firstSlot + static_cast<int64_t>(m_records.size());
+            m_records.push_back(MakeRecord(directory.Tag, entry.Name, entry.Stat, m_names));
+        }
+    }
+
+private:
+    std::mutex m_lock;
+    std::vector<IndexRecord>& m_records;
+    std::string& m_names;
+    int64_t m_firstSlot;
+};
+
+// Writes the index to a temporary file next to indexPath and renames it into place,
+// so that readers never see a partial index
+static bool WriteIndex(const char* indexPath, const std::vector<IndexRecord>& records, const std::string& names)
+{
+    IndexHeader header = {};
+    memcpy(header.Magic, IndexMagic, sizeof(header.Magic));
+    header.Version = IndexVersion;
+    header.RecordSize = sizeof(IndexRecord);
+    header.RecordCount = records.size();
+    header.NamesLength = names.size();
+
+    FileSection sections[] =
+    {
+        { &header, sizeof(header) },
+        { records.data(), records.size() * sizeof(IndexRecord) },
+        { names.data(), names.size() }
+    };
+    return WriteFileAtomically(indexPath, sections, 3);
+}
+
+static inline size_t RecordCount(const FileIndex* index)
+{
+    return index->BaseCount + index->Added.size();
+}
+
+static inline IndexRecord& GetRecord(FileIndex* index, int64_t id)
+{
+    size_t slot = static_cast<size_t>(id);
+    return slot < index->BaseCount ? index->Base[slot] : index->Added[slot - index->BaseCount];
+}
+
+static inline const char* GetName(const FileIndex* index, const IndexRecord& record, int64_t id)
+{
+    return static_cast<size_t>(id) < index->BaseCount ? index->BaseNames + record.NameOffset
+                                                      : index->AddedNames.data() + record.NameOffset;
+}
+
+static inline bool IsDirectory(const IndexRecord& record)
+{
+    return S_ISDIR(static_cast<mode_t>(record.Mode));
+}
+
+static std::string GetRootPath(FileIndex* index)
+{
+    return std::string(GetName(index, GetRecord(index, 0), 0));
+}
+
+// Builds the path of a record relative to the root, caching the paths of directories
+static std::string GetRelativePath(FileIndex* index, int64_t id, std::unordered_map<int64_t, std::string>& paths)
+{
+    if (id == 0)
+    {
+        return std::string();
+    }
+
+    const IndexRecord& record = GetRecord(index, id);
+    std::string path;
+    if (record.Parent != 0)
+    {
+        auto parent = paths.find(record.Parent);
+        if (parent == paths.end())
+        {
+            parent = paths.emplace(record.Parent, GetRelativePath(index, record.Parent, paths)).first;
+        }
+        path.reserve(parent->second.size() + 1 + record.NameLength);
+        path.append(parent->second).append(1, '/');
+    }
+
+    return path.append(GetName(index, record, id), record.NameLength);
+}
+
+static std::string GetFullPath(const std::string& rootPath, const std::string& relativePath)
+{
+    if (relativePath.empty())
+    {
+        return rootPath;
+    }
+    return rootPath.size() == 1 ? rootPath + relativePath : rootPath + "/" + relativePath;
+}
+
+static std::string GetFullPath(FileIndex* index, int64_t id)
+{
+    std::unordered_map<int64_t, std::string> paths;
+    return GetFullPath(GetRootPath(index), GetRelativePath(index, id, paths));
+}
+
+//! @brief FileIndexBuild indexes the names in a directory tree and saves the
+//! index to a file
+//!
+//! FileIndexBuild
+//!
+//! The tree is walked with several threads. Each entry is recorded with its
+//! parent, name, device, inode, size, modification time and mode. Symbolic
+//! links and mount points are not followed, so the index covers a single
+//! file system.
+//!
+//! @param[in] root
+//! @parblock
+//! The directory to index.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] indexPath
+//! @parblock
+//! The file to save the index to. It is replaced atomically.
+//! @endparblock
+//!
+//! @param[in] threadCount
+//! @parblock
+//! How many directories to read at a time, 0 for one per processor.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t FileIndexBuild(const char* root, const char* indexPath, int32_t threadCount)
+{
+    assert(root && indexPath);
+    if (root == nullptr || indexPath == nullptr || threadCount < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char* rootPath = realpath(root, nullptr);
+    if (rootPath == nullptr)
+    {
+        return -1;
+    }
+
+    int32_t result = -1;
+    try
+    {
+        struct stat st;
+        std::vector<IndexRecord> records;
+        std::string names;
+        if (stat(rootPath, &st) == 0)
+        {
+            if (!S_ISDIR(st.st_mode))
+            {
+                errno = ENOTDIR;
+            }
+            else
+            {
+                records.push_back(MakeRecord(NoParent, rootPath, st, names));
+                RecordCollector collector(records, names, 0);
+                if (WalkTree(rootPath, threadCount, true, 0, collector) && WriteIndex(indexPath, records, names))
+                {
+                    result = 0;
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+    }
+
+    int priorErrno = errno;
+    free(rootPath);
+    errno = priorErrno;
+    return result;
+}
+
+static bool IsValidIndex(const IndexRecord* records, size_t count, const char* names, size_t namesLength)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const IndexRecord& record = records[i];
+        if (record.NameOffset >= namesLength || record.NameLength >= namesLength - record.NameOffset ||
+            names[record.NameOffset + record.NameLength] != '\0')
+        {
+            return false;
+        }
+
+        if (i == 0 ? (record.Parent != NoParent || !IsDirectory(record) || names[record.NameOffset] != '/') :
+                     (record.Parent < 0 || static_cast<size_t>(record.Parent) >= i || !IsDirectory(records[record.Parent])))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//! @brief FileIndexOpen opens an index saved by FileIndexBuild or
+//! FileIndexSave
+//!
+//! FileIndexOpen
+//!
+//! The file is mapped into memory rather than read, so opening even a large
+//! index is quick and its pages are shared with other processes using it.
+//!
+//! @retval the index, or NULL with errno set if unsuccessful (EINVAL if the
+//! file is not a valid index)
+//!
+struct FileIndex* FileIndexOpen(const char* indexPath)
+{
+    assert(indexPath);
+    if (indexPath == nullptr)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    int fd = open(indexPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int priorErrno = errno;
+        close(fd);
+        errno = priorErrno;
+        return nullptr;
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    if (!S_ISREG(st.st_mode) || length < sizeof(IndexHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    void* map = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    int priorErrno = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = priorErrno;
+        return nullptr;
+    }
+
+    const IndexHeader* header = static_cast<const IndexHeader*>(map);
+    size_t available = length - sizeof(IndexHeader);
+    const char* records = static_cast<const char*>(map) + sizeof(IndexHeader);
+    if (memcmp(header->Magic, IndexMagic, sizeof(IndexMagic)) != 0 || header->Version != IndexVersion ||
+        header->RecordSize != sizeof(IndexRecord) || header->RecordCount == 0 ||
+        header->RecordCount > available / sizeof(IndexRecord) ||
+        header->NamesLength != available - header->RecordCount * sizeof(IndexRecord) ||
+        !IsValidIndex(reinterpret_cast<const IndexRecord*>(records), header->RecordCount,
+                      records + header->RecordCount * sizeof(IndexRecord), header->NamesLength))
+    {
+        munmap(map, length);
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    FileIndex* index = new (std::nothrow) FileIndex();
+    if (index == nullptr)
+    {
+        munmap(map, length);
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    index->Map = map;
+    index->MapLength = length;
+    index->Base = reinterpret_cast<IndexRecord*>(static_cast<char*>(map) + sizeof(IndexHeader));
+    index->BaseCount = header->RecordCount;
+    index->BaseNames = records + header->RecordCount * sizeof(IndexRecord);
+    try
+    {
+        index->Dead.assign(index->BaseCount, false);
+    }
+    catch (const std::bad_alloc&)
+    {
+        FileIndexClose(index);
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    return index;
+}
+
+#if defined(__linux__)
+// Identifies a directory by its file handle, the way fanotify reports it
+static bool GetHandleKey(const char* path, std::string& key)
+{
+    alignas(struct file_handle) char buffer[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+    struct file_handle* handle = reinterpret_cast<struct file_handle*>(buffer);
+    handle->handle_bytes = MAX_HANDLE_SZ;
+    int mountId;
+    if (name_to_handle_at(AT_FDCWD, path, handle, &mountId, 0) != 0)
+    {
+        return false;
+    }
+
+    key.assign(buffer, sizeof(struct file_handle) + handle->handle_bytes);
+    return true;
+}
+#endif
+
+// Starts watching a directory.  Returns false with errno set.
+static bool AddWatch(FileIndex* index, int64_t id)
+{
+#if defined(__linux__)
+    std::string path = GetFullPath(index, id);
+    if (index->Watching == WatchInotify)
+    {
+        int wd = inotify_add_watch(index->WatchFd, path.c_str(), InotifyMask);
+        if (wd < 0)
+        {
+            return false;
+        }
+
+        index->InotifyDirectories[wd] = id;
+        index->InotifyWatches[id] = wd;
+    }
+    else if (index->Watching == WatchFanotify)
+    {
+        std::string key;
+        if (!GetHandleKey(path.c_str(), key))
+        {
+            return false;
+        }
+
+        index->HandleDirectories[key] = id;
+        index->DirectoryHandles[id] = std::move(key);
+    }
+    return true;
+#else
+    (void)index;
+    (void)id;
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+// A renamed directory is added under its new record before its old record is
+// removed, and both have the same inode, so the watch and handle key may already
+// belong to the new record; those are left alone
+static void RemoveWatch(FileIndex* index, int64_t id)
+{
+#if defined(__linux__)
+    auto watch = index->InotifyWatches.find(id);
+    if (watch != index->InotifyWatches.end())
+    {
+        auto directory = index->InotifyDirectories.find(watch->second);
+        if (directory != index->InotifyDirectories.end() && directory->second == id)
+        {
+            inotify_rm_watch(index->WatchFd, watch->second);
+            index->InotifyDirectories.erase(directory);
+        }
+        index->InotifyWatches.erase(watch);
+    }
+
+    auto handle = index->DirectoryHandles.find(id);
+    if (handle != index->DirectoryHandles.end())
+    {
+        auto directory = index->HandleDirectories.find(handle->second);
+        if (directory != index->HandleDirectories.end() && directory->second == id)
+        {
+            index->HandleDirectories.erase(directory);
+        }
+        index->DirectoryHandles.erase(handle);
+    }
+#else
+    (void)index;
+    (void)id;
+#endif
+}
+
+// Makes the records from firstId on known to Children and the watches.  Directories
+// that cannot be watched are still indexed; the first error is kept in watchError.
+static void RegisterRecords(FileIndex* index, int64_t firstId, int* watchError)
+{
+    index->Dead.resize(RecordCount(index), false);
+    for (int64_t id = firstId; static_cast<size_t>(id) < RecordCount(index); id++)
+    {
+        const IndexRecord& record = GetRecord(index, id);
+        if (index->Dead[id])
+        {
+            continue;
+        }
+
+        if (record.Parent != NoParent)
+        {
+            index->Children[record.Parent][std::string(GetName(index, record, id), record.NameLength)] = id;
+        }
+
+        if (IsDirectory(record) && !AddWatch(index, id) && *watchError == 0 && errno != ENOENT)
+        {
+            *watchError = errno;
+        }
+    }
+}
+
+// Drops a record and everything under it
+static void RemoveSubtree(FileIndex* index, int64_t id)
+{
+    std::vector<int64_t> pending(1, id);
+    while (!pending.empty())
+    {
+        int64_t current = pending.back();
+        pending.pop_back();
+        index->Dead[current] = true;
+        if (!IsDirectory(GetRecord(index, current)))
+        {
+            continue;
+        }
+
+        RemoveWatch(index, current);
+        auto children = index->Children.find(current);
+        if (children != index->Children.end())
+        {
+            for (const auto& child : children->second)
+            {
+                pending.push_back(child.second);
+            }
+            index->Children.erase(children);
+        }
+    }
+}
+
+static int32_t RescanDirectory(FileIndex* index, int64_t directoryId, int* watchError);
+
+// Brings the index up to date for one entry of a directory.  Returns true if anything changed.
+static bool ApplyChange(FileIndex* index, int64_t directoryId, const std::string& name, int* watchError)
+{
+    if (index->Dead[directoryId] || name.empty() || name == "." || name == "..")
+    {
+        return false;
+    }
+
+    std::string path = GetFullPath(index, directoryId) + "/" + name;
+    struct stat st;
+    bool exists = lstat(path.c_str(), &st) == 0;
+
+    auto& children = index->Children[directoryId];
+    auto existing = children.find(name);
+    if (existing != children.end())
+    {
+        IndexRecord& record = GetRecord(index, existing->second);
+        if (exists && record.Device == static_cast<uint64_t>(st.st_dev) && record.Inode == static_cast<uint64_t>(st.st_ino) &&
+            (record.Mode & S_IFMT) == (st.st_mode & S_IFMT))
+        {
+            bool changed = record.Size != st.st_size || record.ModifiedTime != GetModifiedTimeNanoseconds(st) ||
+                           record.Mode != static_cast<uint32_t>(st.st_mode);
+            record.Size = st.st_size;
+            record.ModifiedTime = GetModifiedTimeNanoseconds(st);
+            record.Mode = static_cast<uint32_t>(st.st_mode);
+            return changed;
+        }
+
+        RemoveSubtree(index, existing->second);
+        children.erase(existing);
+    }
+    else if (!exists)
+    {
+        return false;
+    }
+
+    if (exists)
+    {
+        int64_t id = static_cast<int64_t>(RecordCount(index));
+        index->Added.push_back(MakeRecord(directoryId, name, st, index->AddedNames));
+        if (S_ISDIR(st.st_mode) && static_cast<uint64_t>(st.st_dev) == GetRecord(index, 0).Device)
+        {
+            RecordCollector collector(index->Added, index->AddedNames, static_cast<int64_t>(index->BaseCount));
+            WalkTree(path.c_str(), 0, true, id, collector);
+        }
+        RegisterRecords(index, id, watchError);
+
+        // Entries created in a new directory between its walk and its watch raised no
+        // event, so read the new directories once more now that they are watched, as
+        // FileIndexWatch does for the whole tree
+        if (S_ISDIR(st.st_mode) && index->Watching != WatchNone)
+        {
+            size_t end = RecordCount(index);
+            for (int64_t added = id; static_cast<size_t>(added) < end; added++)
+            {
+                if (!index->Dead[added] && IsDirectory(GetRecord(index, added)))
+                {
+                    RescanDirectory(index, added, watchError);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// Brings the index up to date for a whole directory.  Returns the number of entries that changed.
+static int32_t RescanDirectory(FileIndex* index, int64_t directoryId, int* watchError)
+{
+    if (index->Dead[directoryId])
+    {
+        return 0;
+    }
+
+    DirectoryReader reader;
+    if (!reader.Open(AT_FDCWD, GetFullPath(index, directoryId).c_str()))
+    {
+        return 0;
+    }
+
+    std::unordered_set<std::string> names;
+    DirectoryEntry entry;
+    while (reader.Next(&entry) == 1)
+    {
+        names.emplace(entry.Name, entry.NameLength);
+    }
+
+    int32_t changes = 0;
+    auto& children = index->Children[directoryId];
+    for (auto child = children.begin(); child != children.end();)
+    {
+        if (names.find(child->first) == names.end())
+        {
+            RemoveSubtree(index, child->second);
+            child = children.erase(child);
+            changes++;
+        }
+        else
+        {
+            ++child;
+        }
+    }
+
+    for (const std::string& name : names)
+    {
+        changes += ApplyChange(index, directoryId, name, watchError) ? 1 : 0;
+    }
+
+    return changes;
+}
+
+#if defined(__linux__)
+static bool StartFanotify(FileIndex* index, const std::string& rootPath)
+{
+    int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FanotifyMask, AT_FDCWD, rootPath.c_str()) != 0)
+    {
+        int priorErrno = errno;
+        close(fd);
+        errno = priorErrno;
+        return false;
+    }
+
+    index->WatchFd = fd;
+    index->Watching = WatchFanotify;
+    return true;
+}
+
+static bool StartInotify(FileIndex* index)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    index->WatchFd = fd;
+    index->Watching = WatchInotify;
+    return true;
+}
+#endif
+
+static void StopWatching(FileIndex* index)
+{
+    if (index->WatchFd >= 0)
+    {
+        close(index->WatchFd);
+    }
+    index->WatchFd = -1;
+    index->Watching = WatchNone;
+    index->Children.clear();
+    index->InotifyDirectories.clear();
+    index->InotifyWatches.clear();
+    index->HandleDirectories.clear();
+    index->DirectoryHandles.clear();
+}
+
+// Rescans the whole tree, for when it may have changed without the index hearing
+// about it: before the first watch, and after notifications were lost
+static int32_t RescanAll(FileIndex* index, int* watchError)
+{
+    std::vector<int64_t> directories;
+    for (size_t id = 0; id < RecordCount(index); id++)
+    {
+        if (!index->Dead[id] && IsDirectory(GetRecord(index, static_cast<int64_t>(id))))
+        {
+            directories.push_back(static_cast<int64_t>(id));
+        }
+    }
+
+    int32_t changes = 0;
+    for (int64_t id : directories)
+    {
+        changes += RescanDirectory(index, id, watchError);
+    }
+    return changes;
+}
+
+//! @brief FileIndexWatch starts keeping an index current as the tree changes
+//!
+//! FileIndexWatch
+//!
+//! Uses a fanotify mark on the root's file system where the caller may set
+//! one, which takes CAP_SYS_ADMIN, and otherwise an inotify watch on every
+//! directory. Changes are applied by FileIndexRefresh. The tree is rescanned
+//! once when watching starts, to catch up with changes made since the index
+//! was saved.
+//!
+//! @param[in] flags
+//! @parblock
+//! FILE_INDEX_WATCH_INOTIFY to use inotify even where fanotify is available.
+//! @endparblock
+//!
+//! @retval FILE_INDEX_WATCHING_FANOTIFY or FILE_INDEX_WATCHING_INOTIFY, or
+//! -1 with errno set (ENOSPC if there are more directories than inotify
+//! watches allowed)
+//!
+int32_t FileIndexWatch(struct FileIndex* index, int32_t flags)
+{
+    assert(index);
+    if (index == nullptr || (flags & ~FILE_INDEX_WATCH_INOTIFY) != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+#if defined(__linux__)
+    std::lock_guard<std::mutex> lock(index->Lock);
+    if (index->Watching != WatchNone)
+    {
+        return index->Watching == WatchFanotify ? FILE_INDEX_WATCHING_FANOTIFY : FILE_INDEX_WATCHING_INOTIFY;
+    }
+
+    try
+    {
+        std::string rootPath = GetRootPath(index);
+        int watchError = 0;
+        bool started = false;
+        if ((flags & FILE_INDEX_WATCH_INOTIFY) == 0 && StartFanotify(index, rootPath))
+        {
+            // File handles are needed for every directory; without them fanotify is no use
+            RegisterRecords(index, 0, &watchError);
+            started = watchError == 0;
+            if (!started)
+            {
+                StopWatching(index);
+            }
+        }
+
+        if (!started)
+        {
+            watchError = 0;
+            if (!StartInotify(index))
+            {
+                return -1;
+            }
+
+            RegisterRecords(index, 0, &watchError);
+            if (watchError != 0)
+            {
+                StopWatching(index);
+                errno = watchError;
+                return -1;
+            }
+        }
+
+        RescanAll(index, &watchError);
+    }
+    catch (const std::bad_alloc&)
+    {
+        StopWatching(index);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return index->Watching == WatchFanotify ? FILE_INDEX_WATCHING_FANOTIFY : FILE_INDEX_WATCHING_INOTIFY;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+#if defined(__linux__)
+typedef std::set<std::pair<int64_t, std::string>> ChangeSet;
+
+// Returns false if events were lost and everything has to be rescanned
+static bool ReadInotifyEvents(FileIndex* index, const char* buffer, size_t length, ChangeSet& changes)
+{
+    bool complete = true;
+    for (size_t offset = 0; offset + sizeof(struct inotify_event) <= length;)
+    {
+        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+
+        if ((event->mask & IN_Q_OVERFLOW) != 0)
+        {
+            complete = false;
+            continue;
+        }
+
+        auto directory = index->InotifyDirectories.find(event->wd);
+        if (directory == index->InotifyDirectories.end())
+        {
+            continue;
+        }
+
+        if ((event->mask & IN_IGNORED) != 0)
+        {
+            index->InotifyWatches.erase(directory->second);
+            index->InotifyDirectories.erase(directory);
+        }
+        else if (event->len > 0)
+        {
+            changes.emplace(directory->second, std::string(event->name));
+        }
+    }
+    return complete;
+}
+
+static bool ReadFanotifyEvents(FileIndex* index, const char* buffer, size_t length, ChangeSet& changes)
+{
+    bool complete = true;
+    ssize_t remaining = static_cast<ssize_t>(length);
+    for (const struct fanotify_event_metadata* event = reinterpret_cast<const struct fanotify_event_metadata*>(buffer);
+         FAN_EVENT_OK(event, remaining); event = FAN_EVENT_NEXT(event, remaining))
+    {
+        if (event->fd >= 0)
+        {
+            close(event->fd);
+        }
+
+        if ((event->mask & FAN_Q_OVERFLOW) != 0)
+        {
+            complete = false;
+            continue;
+        }
+
+        const char* info = reinterpret_cast<const char*>(event) + event->metadata_len;
+        const char* end = reinterpret_cast<const char*>(event) + event->event_len;
+        while (info + sizeof(struct fanotify_event_info_fid) <= end)
+        {
+            const struct fanotify_event_info_fid* fid = reinterpret_cast<const struct fanotify_event_info_fid*>(info);
+            if (fid->hdr.len == 0)
+            {
+                break;
+            }
+
+            if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME)
+            {
+                const struct file_handle* handle = reinterpret_cast<const struct file_handle*>(fid->handle);
+                std::string key(reinterpret_cast<const char*>(handle), sizeof(struct file_handle) + handle->handle_bytes);
+                auto directory = index->HandleDirectories.find(key);
+                if (directory != index->HandleDirectories.end())
+                {
+                    changes.emplace(directory->second, std::string(reinterpret_cast<const char*>(handle->f_handle) + handle->handle_bytes));
+                }
+            }
+            info += fid->hdr.len;
+        }
+    }
+    return complete;
+}
+#endif
+
+//! @brief FileIndexRefresh applies the changes made to the tree since the
+//! last refresh
+//!
+//! FileIndexRefresh
+//!
+//! Each changed entry costs one lstat. A new directory is walked in full; a
+//! removed or renamed one drops its whole subtree. If the kernel dropped
+//! notifications, the whole tree is rescanned.
+//!
+//! @param[in] timeoutMilliseconds
+//! @parblock
+//! How long to wait for a first change, 0 to only apply changes already
+//! reported, -1 to wait indefinitely.
+//! @endparblock
+//!
+//! @retval the number of entries that changed, or -1 with errno set. Changes
+//! are applied even if the index then fails to watch a new directory, which
+//! is reported as the error.
+//!
+int32_t FileIndexRefresh(struct FileIndex* index, int32_t timeoutMilliseconds)
+{
+    assert(index);
+    if (index == nullptr || timeoutMilliseconds < -1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+#if defined(__linux__)
+    std::lock_guard<std::mutex> lock(index->Lock);
+    if (index->Watching == WatchNone)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct pollfd pfd = { index->WatchFd, POLLIN, 0 };
+    int ready;
+    while ((ready = poll(&pfd, 1, timeoutMilliseconds)) < 0 && errno == EINTR);
+    if (ready < 0)
+    {
+        return -1;
+    }
+    if (ready == 0)
+    {
+        return 0;
+    }
+
+    int watchError = 0;
+    int32_t changeCount = 0;
+    try
+    {
+        ChangeSet changes;
+        bool complete = true;
+        std::vector<char> buffer(EventBufferSize);
+        while (true)
+        {
+            ssize_t length = read(index->WatchFd, buffer.data(), buffer.size());
+            if (length < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                return -1;
+            }
+
+            complete &= index->Watching == WatchInotify ?
+                        ReadInotifyEvents(index, buffer.data(), static_cast<size_t>(length), changes) :
+                        ReadFanotifyEvents(index, buffer.data(), static_cast<size_t>(length), changes);
+        }
+
+        if (!complete)
+        {
+            changeCount = RescanAll(index, &watchError);
+        }
+        else
+        {
+            for (const auto& change : changes)
+            {
+                changeCount += ApplyChange(index, change.first, change.second, &watchError) ? 1 : 0;
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (watchError != 0)
+    {
+        errno = watchError;
+        return -1;
+    }
+    return changeCount;
+#else
+    (void)timeoutMilliseconds;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+namespace
+{
+    // Globs like "*.config" are by far the most common queries, so patterns with a
+    // single leading or trailing '*' and otherwise literal are compared directly
+    class NameMatcher
+    {
+    public:
+        NameMatcher(const char* pattern, bool ignoreCase, bool matchPath)
+            : m_pattern(pattern), m_ignoreCase(ignoreCase), m_matchPath(matchPath), m_kind(Glob)
+        {
+            size_t length = strlen(pattern);
+            bool literalBody = strpbrk(pattern, "?[\\") == nullptr;
+            const char* star = strchr(pattern, '*');
+            if (literalBody && star == nullptr)
+            {
+                m_kind = Exact;
+            }
+            else if (literalBody && !matchPath && star == pattern && strchr(pattern + 1, '*') == nullptr)
+            {
+                m_kind = Suffix;
+                m_literal.assign(pattern + 1);
+            }
+            else if (literalBody && !matchPath && star == pattern + length - 1)
+            {
+                m_kind = Prefix;
+                m_literal.assign(pattern, length - 1);
+            }
+            else
+            {
+                m_kind = Glob;
+            }
+            if (m_kind == Exact)
+            {
+                m_literal.assign(pattern);
+            }
+        }
+
+        bool Matches(const char* name, size_t length) const
+        {
+            switch (m_kind)
+            {
+                case Exact:
+                    return length == m_literal.size() && Compare(name, m_literal.data(), length);
+                case Suffix:
+                    return length >= m_literal.size() &&
+                           Compare(name + length - m_literal.size(), m_literal.data(), m_literal.size());
+                case Prefix:
+                    return length >= m_literal.size() && Compare(name, m_literal.data(), m_literal.size());
+                default:
+                    return fnmatch(m_pattern, name, (m_ignoreCase ? FNM_CASEFOLD : 0) | (m_matchPath ? FNM_PATHNAME : 0)) == 0;
+            }
+        }
+
+    private:
+        bool Compare(const char* left, const char* right, size_t length) const
+        {
+            return m_ignoreCase ? strncasecmp(left, right, length) == 0 : memcmp(left, right, length) == 0;
+        }
+
+        enum Kind
+        {
+            Exact,
+            Suffix,
+            Prefix,
+            Glob
+        };
+
+        const char* m_pattern;
+        bool m_ignoreCase;
+        bool m_matchPath;
+        Kind m_kind;
+        std::string m_literal;
+    };
+}
+
+//! @brief FileIndexQuery finds the indexed entries whose names match a glob
+//!
+//! FileIndexQuery
+//!
+//! @param[in] pattern
+//! @parblock
+//! A glob as understood by fnmatch, such as "*.config". With
+//! FILE_INDEX_QUERY_PATH it is matched against the path relative to the
+//! root, and '*' and '?' do not match '/'.
+//! @endparblock
+//!
+//! @param[in] flags
+//! @parblock
+//! FILE_INDEX_QUERY_IGNORE_CASE and FILE_INDEX_QUERY_PATH.
+//! @endparblock
+//!
+//! @param[out] results
+//! @parblock
+//! Receives the matches, their names being full paths. Free it with
+//! FreeDirectoryListing.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t FileIndexQuery(struct FileIndex* index, const char* pattern, int32_t flags, struct DirectoryListing** results)
+{
+    assert(index && pattern && results);
+    if (index == nullptr || pattern == nullptr || results == nullptr ||
+        (flags & ~(FILE_INDEX_QUERY_IGNORE_CASE | FILE_INDEX_QUERY_PATH)) != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *results = nullptr;
+    bool matchPath = (flags & FILE_INDEX_QUERY_PATH) != 0;
+
+    try
+    {
+        std::lock_guard<std::mutex> lock(index->Lock);
+        NameMatcher matcher(pattern, (flags & FILE_INDEX_QUERY_IGNORE_CASE) != 0, matchPath);
+        std::string rootPath = GetRootPath(index);
+        std::unordered_map<int64_t, std::string> paths;
+
+        std::vector<int64_t> matches;
+        std::vector<char> names;
+        for (size_t i = 1; i < RecordCount(index); i++)
+        {
+            int64_t id = static_cast<int64_t>(i);
+            if (index->Dead[i])
+            {
+                continue;
+            }
+
+            const IndexRecord& record = GetRecord(index, id);
+            std::string relativePath;
+            if (matchPath)
+            {
+                relativePath = GetRelativePath(index, id, paths);
+                if (!matcher.Matches(relativePath.c_str(), relativePath.size()))
+                {
+                    continue;
+                }
+            }
+            else if (matcher.Matches(GetName(index, record, id), record.NameLength))
+            {
+                relativePath = GetRelativePath(index, id, paths);
+            }
+            else
+            {
+                continue;
+            }
+
+            std::string path = GetFullPath(rootPath, relativePath);
+            matches.push_back(id);
+            names.insert(names.end(), path.c_str(), path.c_str() + path.size() + 1);
+        }
+
+        if (names.size() > static_cast<size_t>(INT32_MAX))
+        {
+            errno = EOVERFLOW;
+            return -1;
+        }
+
+        DirectoryListing* listing = static_cast<DirectoryListing*>(calloc(1, sizeof(DirectoryListing)));
+        if (listing == nullptr ||
+            (listing->Entries = static_cast<DirectoryEntryInfo*>(malloc(matches.size() * sizeof(DirectoryEntryInfo) + 1))) == nullptr ||
+            (listing->Names = static_cast<char*>(malloc(names.size() + 1))) == nullptr)
+        {
+            FreeDirectoryListing(listing);
+            errno = ENOMEM;
+            return -1;
+        }
+
+        size_t offset = 0;
+        listing->Count = static_cast<int32_t>(matches.size());
+        for (size_t i = 0; i < matches.size(); i++)
+        {
+            const IndexRecord& record = GetRecord(index, matches[i]);
+            DirectoryEntryInfo& info = listing->Entries[i];
+            info.NameOffset = static_cast<int32_t>(offset);
+            info.NameLength = static_cast<int32_t>(strlen(names.data() + offset));
+            info.Type = GetDirectoryEntryType(static_cast<mode_t>(record.Mode));
+            info.Mode = static_cast<int32_t>(record.Mode);
+            info.Size = record.Size;
+            info.ModifiedTime = record.ModifiedTime;
+            info.Inode = static_cast<int64_t>(record.Inode);
+            offset += static_cast<size_t>(info.NameLength) + 1;
+        }
+        if (!names.empty())
+        {
+            memcpy(listing->Names, names.data(), names.size());
+        }
+
+        *results = listing;
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief FileIndexSave saves an index, with the changes applied to it since
+//! it was opened
+//!
+//! FileIndexSave
+//!
+//! @param[in] indexPath
+//! @parblock
+//! The file to save the index to. It is replaced atomically, and may be the
+//! file the index was opened from.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t FileIndexSave(struct FileIndex* index, const char* indexPath)
+{
+    assert(index && indexPath);
+    if (index == nullptr || indexPath == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    try
+    {
+        std::lock_guard<std::mutex> lock(index->Lock);
+
+        // Records are numbered parents first, so renumbering in order keeps them that way
+        std::vector<int64_t> renumbered(RecordCount(index), NoParent);
+        std::vector<IndexRecord> records;
+        std::string names;
+        for (size_t i = 0; i < RecordCount(index); i++)
+        {
+            int64_t id = static_cast<int64_t>(i);
+            if (index->Dead[i])
+            {
+                continue;
+            }
+
+            IndexRecord record = GetRecord(index, id);
+            const char* name = GetName(index, record, id);
+            record.Parent = record.Parent == NoParent ? NoParent : renumbered[record.Parent];
+            record.NameOffset = names.size();
+            names.append(name, record.NameLength).append(1, '\0');
+            renumbered[i] = static_cast<int64_t>(records.size());
+            records.push_back(record);
+        }
+
+        if (!WriteIndex(indexPath, records, names))
+        {
+            return -1;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief FileIndexClose stops watching and frees an index
+//!
+//! FileIndexClose
+//!
+void FileIndexClose(struct FileIndex* index)
+{
+    if (index == nullptr)
+    {
+        return;
+    }
+
+    StopWatching(index);
+    if (index->Map != MAP_FAILED)
+    {
+        munmap(index->Map, index->MapLength);
+    }
+    delete index;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+#include "enumeratedirectory.h"
+
+PAL_BEGIN_EXTERNC
+
+// Flags for FileIndexQuery
+enum
+{
+    FILE_INDEX_QUERY_IGNORE_CASE = 0x00000001,
+    FILE_INDEX_QUERY_PATH = 0x00000002             // match the path relative to the root rather than the name
+};
+
+// Flags for FileIndexWatch
+enum
+{
+    FILE_INDEX_WATCH_INOTIFY = 0x00000001          // do not try fanotify first
+};
+
+// How FileIndexWatch ended up watching the tree
+enum
+{
+    FILE_INDEX_WATCHING_FANOTIFY = 1,
+    FILE_INDEX_WATCHING_INOTIFY = 2
+};
+
+struct FileIndex;
+
+int32_t FileIndexBuild(const char* root, const char* indexPath, int32_t threadCount);
+struct FileIndex* FileIndexOpen(const char* indexPath);
+int32_t FileIndexWatch(struct FileIndex* index, int32_t flags);
+int32_t FileIndexRefresh(struct FileIndex* index, int32_t timeoutMilliseconds);
+int32_t FileIndexQuery(
+    struct FileIndex* index,
+    const char* pattern,
+    int32_t flags,
+    struct DirectoryListing** results);             // [out] full paths of the matches, free with FreeDirectoryListing
+int32_t FileIndexSave(struct FileIndex* index, const char* indexPath);
+void FileIndexClose(struct FileIndex* index);
+
+PAL_END_EXTERNC
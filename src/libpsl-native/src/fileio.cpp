@@ -0,0 +1,92 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief read and write whole files for the caches and indexes kept on disk
+
+#include "fileio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+
+bool ReadAll(int fd, void* buffer, size_t length)
+{
+    char* data = static_cast<char*>(buffer);
+    while (length > 0)
+    {
+        ssize_t count = read(fd, data, length);
+        if (count <= 0)
+        {
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count == 0)
+            {
+                errno = EINVAL;
+            }
+            return false;
+        }
+
+        data += count;
+        length -= static_cast<size_t>(count);
+    }
+
+    return true;
+}
+
+bool WriteAll(int fd, const void* buffer, size_t length)
+{
+    const char* data = static_cast<const char*>(buffer);
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+bool WriteFileAtomically(const char* path, const FileSection* sections, size_t sectionCount)
+{
+    std::string temporary = std::string(path) + ".tmp." + std::to_string(getpid());
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < sectionCount; i++)
+    {
+        if (!WriteAll(fd, sections[i].Data, sections[i].Length))
+        {
+            int priorErrno = errno;
+            close(fd);
+            unlink(temporary.c_str());
+            errno = priorErrno;
+            return false;
+        }
+    }
+
+    if (close(fd) != 0 || rename(temporary.c_str(), path) != 0)
+    {
+        int priorErrno = errno;
+        unlink(temporary.c_str());
+        errno = priorErrno;
+        return false;
+    }
+
+    return true;
+}
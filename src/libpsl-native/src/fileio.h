@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Internal to libpsl-native, not exported
+
+#pragma once
+
+#include <stddef.h>
+#include <time.h>
+
+// A file or directory modified this recently may change again within the same timestamp
+// tick, so a result keyed on its modification time is not yet safe to reuse
+const time_t RacyWindowSeconds = 2;
+
+// One piece of a file written by WriteFileAtomically
+struct FileSection
+{
+    const void* Data;
+    size_t Length;
+};
+
+// Reads exactly length bytes, retrying after signals; a file that ends early fails with EINVAL
+bool ReadAll(int fd, void* buffer, size_t length);
+
+// Writes exactly length bytes, retrying after signals and short writes
+bool WriteAll(int fd, const void* buffer, size_t length);
+
+// Writes the sections one after another to a temporary file next to path and renames it
+// into place, so that readers see either the old file or the whole new one.  On failure
+// the temporary file is removed and errno is set.
+bool WriteFileAtomically(const char* path, const FileSection* sections, size_t sectionCount);
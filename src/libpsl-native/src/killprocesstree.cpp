@@ -0,0 +1,473 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief terminate a process and all of its descendants
+
+#include "killprocesstree.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifndef __NR_pidfd_send_signal
+#define __NR_pidfd_send_signal 424
+#endif
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
+namespace
+{
+    struct ProcessEntry
+    {
+        pid_t Pid;
+        pid_t ParentPid;
+        unsigned long long StartTime;
+    };
+
+    struct TreeMember
+    {
+        pid_t Pid;
+        pid_t ParentPid;
+        unsigned long long StartTime;
+        int PidFd;
+        int32_t Outcome;
+        int32_t Error;
+        bool Pending;
+    };
+
+    // Polling interval used for processes we could not open a pidfd for
+    const int FallbackPollMilliseconds = 10;
+}
+
+template <typename TInt>
+static inline bool CheckInterrupted(TInt result)
+{
+    return result < 0 && errno == EINTR;
+}
+
+static int64_t GetMonotonicMilliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Reads the parent pid, start time and state of a process from /proc/<pid>/stat.
+// Returns false if the process does not exist or the file could not be parsed.
+static bool ReadProcessStat(pid_t pid, pid_t* parentPid, unsigned long long* startTime, char* state)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+
+    int fd;
+    while (CheckInterrupted(fd = open(path, O_RDONLY | O_CLOEXEC)));
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char buffer[1024];
+    ssize_t count;
+    while (CheckInterrupted(count = read(fd, buffer, sizeof(buffer) - 1)));
+    close(fd);
+    if (count <= 0)
+    {
+        return false;
+    }
+    buffer[count] = '\0';
+
+    // The command name is wrapped in parentheses and may itself contain ')',
+    // so the remaining fields start after the last one
+    char* fields = strrchr(buffer, ')');
+    if (fields == nullptr)
+    {
+        return false;
+    }
+
+    char st;
+    int ppid;
+    unsigned long long start;
+    if (sscanf(fields + 1,
+               " %c %d %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu",
+               &st, &ppid, &start) != 3)
+    {
+        return false;
+    }
+
+    *parentPid = ppid;
+    *startTime = start;
+    *state = st;
+    return true;
+}
+
+// Returns true if pid still refers to the process that was snapshotted with startTime
+// and that process has not yet exited.
+static bool IsSameProcessAlive(pid_t pid, unsigned long long startTime)
+{
+    pid_t parentPid;
+    unsigned long long currentStartTime;
+    char state;
+    return ReadProcessStat(pid, &parentPid, &currentStartTime, &state) &&
+           currentStartTime == startTime &&
+           state != 'Z' && state != 'X';
+}
+
+static bool SnapshotProcesses(std::vector<ProcessEntry>& processes)
+{
+    DIR* proc = opendir("/proc");
+    if (proc == nullptr)
+    {
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(proc)) != nullptr)
+    {
+        char* end;
+        long pid = strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || pid <= 0)
+        {
+            continue;
+        }
+
+        ProcessEntry process;
+        char state;
+        process.Pid = static_cast<pid_t>(pid);
+        if (ReadProcessStat(process.Pid, &process.ParentPid, &process.StartTime, &state))
+        {
+            processes.push_back(process);
+        }
+    }
+
+    closedir(proc);
+    return true;
+}
+
+// Appends every process of the snapshot that descends from a member and is not one
+// yet, parents before their children
+static void AddDescendants(const std::vector<ProcessEntry>& processes, std::vector<TreeMember>& members)
+{
+    std::unordered_map<pid_t, std::vector<size_t>> children;
+    std::unordered_map<pid_t, unsigned long long> startTimes;
+    for (size_t i = 0; i < processes.size(); i++)
+    {
+        children[processes[i].ParentPid].push_back(i);
+        startTimes[processes[i].Pid] = processes[i].StartTime;
+    }
+
+    std::unordered_set<pid_t> known;
+    for (const TreeMember& member : members)
+    {
+        known.insert(member.Pid);
+    }
+
+    // Breadth-first walk so parents are always signaled before their children
+    for (size_t i = 0; i < members.size(); i++)
+    {
+        // The children of a pid that was recycled since the member exited are not ours
+        auto started = startTimes.find(members[i].Pid);
+        auto found = children.find(members[i].Pid);
+        if (started == startTimes.end() || started->second != members[i].StartTime || found == children.end())
+        {
+            continue;
+        }
+
+        for (size_t index : found->second)
+        {
+            const ProcessEntry& child = processes[index];
+            if (!known.insert(child.Pid).second)
+            {
+                continue;
+            }
+            members.push_back(TreeMember { child.Pid, child.ParentPid, child.StartTime, -1, PROCESS_TREE_KILL_TERMINATED, 0, true });
+        }
+    }
+}
+
+// Pins the members from first on. A pidfd only identifies the process that owned the pid
+// when it was opened, so check that this is still the process from the snapshot.
+static void PinMembers(std::vector<TreeMember>& members, size_t first, bool* havePidFds)
+{
+    for (size_t i = first; i < members.size(); i++)
+    {
+        TreeMember& member = members[i];
+        if (*havePidFds)
+        {
+            member.PidFd = static_cast<int>(syscall(__NR_pidfd_open, member.Pid, 0));
+            if (member.PidFd < 0 && errno == ENOSYS)
+            {
+                *havePidFds = false;
+            }
+        }
+
+        if (!IsSameProcessAlive(member.Pid, member.StartTime))
+        {
+            member.Outcome = PROCESS_TREE_KILL_ALREADY_EXITED;
+            member.Pending = false;
+        }
+    }
+}
+
+static int SendSignal(const TreeMember& member, int signal)
+{
+    if (member.PidFd >= 0)
+    {
+        return static_cast<int>(syscall(__NR_pidfd_send_signal, member.PidFd, signal, nullptr, 0));
+    }
+
+    // Without a pidfd, narrow the recycling window as much as we can
+    if (!IsSameProcessAlive(member.Pid, member.StartTime))
+    {
+        errno = ESRCH;
+        return -1;
+    }
+
+    return kill(member.Pid, signal);
+}
+
+// Waits until every pending member has exited or the deadline has passed.
+static void WaitForExit(std::vector<TreeMember>& members, int64_t deadline)
+{
+    std::vector<struct pollfd> pollFds;
+    std::vector<size_t> pollIndexes;
+
+    while (true)
+    {
+        pollFds.clear();
+        pollIndexes.clear();
+        bool needsFallbackPoll = false;
+
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            TreeMember& member = members[i];
+            if (!member.Pending)
+            {
+                continue;
+            }
+
+            if (member.PidFd >= 0)
+            {
+                struct pollfd pfd;
+                pfd.fd = member.PidFd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                pollFds.push_back(pfd);
+                pollIndexes.push_back(i);
+            }
+            else if (IsSameProcessAlive(member.Pid, member.StartTime))
+            {
+                needsFallbackPoll = true;
+            }
+            else
+            {
+                member.Pending = false;
+            }
+        }
+
+        if (pollFds.empty() && !needsFallbackPoll)
+        {
+            return;
+        }
+
+        int64_t remaining = deadline - GetMonotonicMilliseconds();
+        if (remaining < 0)
+        {
+            remaining = 0;
+        }
+
+        int timeout = static_cast<int>(remaining);
+        if (needsFallbackPoll && timeout > FallbackPollMilliseconds)
+        {
+            timeout = FallbackPollMilliseconds;
+        }
+
+        int result = poll(pollFds.data(), pollFds.size(), timeout);
+        if (result > 0)
+        {
+            for (size_t i = 0; i < pollFds.size(); i++)
+            {
+                if (pollFds[i].revents != 0)
+                {
+                    members[pollIndexes[i]].Pending = false;
+                }
+            }
+        }
+        else if (result < 0 && errno != EINTR)
+        {
+            return;
+        }
+
+        if (remaining == 0 && result <= 0)
+        {
+            return;
+        }
+    }
+}
+#endif
+
+//! @brief KillProcessTree terminates a process and all of its descendants,
+//! first asking politely with SIGTERM and then escalating to SIGKILL
+//!
+//! KillProcessTree
+//!
+//! The descendants are snapshotted from /proc before any signal is sent,
+//! and again before SIGKILL so that children forked during the grace period
+//! are killed too. Each process is then pinned with a pidfd so that a pid recycled while
+//! the tree is being torn down is never signaled by mistake.
+//!
+//! @param[in] pid
+//! @parblock
+//! The root of the process tree to terminate.
+//! @endparblock
+//!
+//! @param[in] gracePeriodMilliseconds
+//! @parblock
+//! How long to wait for the tree to exit after SIGTERM before SIGKILL is
+//! sent to the remaining processes. Zero escalates immediately.
+//! @endparblock
+//!
+//! @param[out] results
+//! @parblock
+//! Receives the outcome for each process, root first. At most resultsLength
+//! entries are written, but the whole tree is always terminated.
+//! @endparblock
+//!
+//! @param[in] resultsLength
+//! @parblock
+//! The number of elements in results.
+//! @endparblock
+//!
+//! @param[out] resultCount
+//! @parblock
+//! Receives the number of processes found in the tree, which may be larger
+//! than resultsLength.
+//! @endparblock
+//!
+//! @retval 0 if the tree was processed, -1 otherwise with errno set
+//!
+int32_t KillProcessTree(
+    pid_t pid,
+    int32_t gracePeriodMilliseconds,
+    struct ProcessTreeKillResult* results,
+    int32_t resultsLength,
+    int32_t* resultCount)
+{
+    if (pid <= 0 || gracePeriodMilliseconds < 0 || resultsLength < 0 ||
+        (results == nullptr && resultsLength != 0) || resultCount == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *resultCount = 0;
+
+#if defined(__linux__)
+    std::vector<ProcessEntry> processes;
+    if (!SnapshotProcesses(processes))
+    {
+        return -1;
+    }
+
+    const ProcessEntry* root = nullptr;
+    for (const ProcessEntry& process : processes)
+    {
+        if (process.Pid == pid)
+        {
+            root = &process;
+            break;
+        }
+    }
+
+    if (root == nullptr)
+    {
+        errno = ESRCH;
+        return -1;
+    }
+
+    std::vector<TreeMember> members;
+    members.push_back(TreeMember { root->Pid, root->ParentPid, root->StartTime, -1, PROCESS_TREE_KILL_TERMINATED, 0, true });
+    AddDescendants(processes, members);
+
+    bool havePidFds = true;
+    PinMembers(members, 0, &havePidFds);
+
+    for (TreeMember& member : members)
+    {
+        if (member.Pending && SendSignal(member, SIGTERM) != 0)
+        {
+            member.Outcome = errno == ESRCH ? PROCESS_TREE_KILL_ALREADY_EXITED : PROCESS_TREE_KILL_FAILED;
+            member.Error = errno == ESRCH ? 0 : errno;
+            member.Pending = false;
+        }
+    }
+
+    WaitForExit(members, GetMonotonicMilliseconds() + gracePeriodMilliseconds);
+
+    // Walk the tree again, so that children forked since the first snapshot, for
+    // example by a SIGTERM handler, are killed along with their parents
+    size_t snapshotted = members.size();
+    processes.clear();
+    if (SnapshotProcesses(processes))
+    {
+        AddDescendants(processes, members);
+        PinMembers(members, snapshotted, &havePidFds);
+    }
+
+    for (TreeMember& member : members)
+    {
+        if (!member.Pending)
+        {
+            continue;
+        }
+
+        if (SendSignal(member, SIGKILL) == 0)
+        {
+            member.Outcome = PROCESS_TREE_KILL_KILLED;
+        }
+        else if (errno != ESRCH)
+        {
+            member.Outcome = PROCESS_TREE_KILL_FAILED;
+            member.Error = errno;
+        }
+    }
+
+    for (size_t i = 0; i < members.size(); i++)
+    {
+        if (members[i].PidFd >= 0)
+        {
+            close(members[i].PidFd);
+        }
+
+        if (i < static_cast<size_t>(resultsLength))
+        {
+            results[i].ProcessId = members[i].Pid;
+            results[i].ParentProcessId = members[i].ParentPid;
+            results[i].Outcome = members[i].Outcome;
+            results[i].Error = members[i].Error;
+        }
+    }
+
+    *resultCount = static_cast<int32_t>(members.size());
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
@@ -0,0 +1,34 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+#include <sys/types.h>
+
+PAL_BEGIN_EXTERNC
+
+enum
+{
+    PROCESS_TREE_KILL_ALREADY_EXITED = 0,   // the process was gone before it could be signaled
+    PROCESS_TREE_KILL_TERMINATED = 1,       // the process exited within the grace period after SIGTERM
+    PROCESS_TREE_KILL_KILLED = 2,           // the process outlived the grace period and was sent SIGKILL
+    PROCESS_TREE_KILL_FAILED = 3            // the process could not be signaled, see Error
+};
+
+struct ProcessTreeKillResult
+{
+    int32_t ProcessId;
+    int32_t ParentProcessId;
+    int32_t Outcome;
+    int32_t Error;
+};
+
+int32_t KillProcessTree(
+    pid_t pid,                              // root of the process tree to terminate
+    int32_t gracePeriodMilliseconds,        // time to wait after SIGTERM before escalating to SIGKILL
+    struct ProcessTreeKillResult* results,  // [out] per-process outcomes, root first
+    int32_t resultsLength,                  // number of elements in results
+    int32_t* resultCount);                  // [out] number of processes in the tree
+
+PAL_END_EXTERNC
@@ -0,0 +1,166 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief MD5 for hashing files
+
+#include "md5.h"
+
+#include <string.h>
+
+namespace
+{
+    const uint32_t InitialState[4] =
+    {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+    };
+
+    const uint32_t RoundConstants[64] =
+    {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+
+    const int Shifts[64] =
+    {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    };
+}
+
+static inline uint32_t RotateLeft(uint32_t value, int count)
+{
+    return (value << count) | (value >> (32 - count));
+}
+
+static inline uint32_t LoadLittleEndian32(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static inline void StoreLittleEndian32(uint8_t* data, uint32_t value)
+{
+    data[0] = static_cast<uint8_t>(value);
+    data[1] = static_cast<uint8_t>(value >> 8);
+    data[2] = static_cast<uint8_t>(value >> 16);
+    data[3] = static_cast<uint8_t>(value >> 24);
+}
+
+Md5::Md5()
+{
+    Reset();
+}
+
+void Md5::Reset()
+{
+    memcpy(m_state, InitialState, sizeof(m_state));
+    m_length = 0;
+    m_buffered = 0;
+}
+
+void Md5::Transform(const uint8_t* blocks, size_t blockCount)
+{
+    uint32_t words[16];
+    for (; blockCount > 0; blockCount--, blocks += 64)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            words[i] = LoadLittleEndian32(blocks + i * 4);
+        }
+
+        uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t f;
+            int word;
+            if (i < 16)
+            {
+                f = (b & c) | (~b & d);
+                word = i;
+            }
+            else if (i < 32)
+            {
+                f = (d & b) | (~d & c);
+                word = (5 * i + 1) & 15;
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+                word = (3 * i + 5) & 15;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+                word = (7 * i) & 15;
+            }
+
+            uint32_t t = d;
+            d = c;
+            c = b;
+            b = b + RotateLeft(a + f + RoundConstants[i] + words[word], Shifts[i]);
+            a = t;
+        }
+
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+    }
+}
+
+void Md5::Update(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_length += length;
+
+    if (m_buffered > 0)
+    {
+        size_t take = sizeof(m_buffer) - m_buffered < length ? sizeof(m_buffer) - m_buffered : length;
+        memcpy(m_buffer + m_buffered, bytes, take);
+        m_buffered += take;
+        bytes += take;
+        length -= take;
+        if (m_buffered < sizeof(m_buffer))
+        {
+            return;
+        }
+
+        Transform(m_buffer, 1);
+        m_buffered = 0;
+    }
+
+    // Whole blocks are hashed straight from the caller's buffer
+    size_t blockCount = length / 64;
+    Transform(bytes, blockCount);
+    bytes += blockCount * 64;
+    length -= blockCount * 64;
+
+    memcpy(m_buffer, bytes, length);
+    m_buffered = length;
+}
+
+void Md5::Final(uint8_t digest[DigestSize])
+{
+    // Unlike the SHA family, MD5 stores the bit length little-endian
+    uint64_t bitLength = m_length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t paddingLength = m_buffered < 56 ? 56 - m_buffered : 120 - m_buffered;
+    for (int i = 0; i < 8; i++)
+    {
+        padding[paddingLength + i] = static_cast<uint8_t>(bitLength >> (i * 8));
+    }
+    Update(padding, paddingLength + 8);
+
+    for (int i = 0; i < 4; i++)
+    {
+        StoreLittleEndian32(digest + i * 4, m_state[i]);
+    }
+}
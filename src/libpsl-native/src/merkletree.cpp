@@ -0,0 +1,697 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief hash a directory tree into per-file and per-directory digests
+
+#include "merkletree.h"
+#include "directoryfilter.h"
+#include "fileio.h"
+#include "sha256.h"
+#include "treewalker.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    const char CacheMagic[8] = { 'P', 'S', 'L', 'M', 'R', 'K', 'L', '1' };
+    const uint32_t CacheVersion = 1;
+
+    // Large reads keep the number of system calls per file low
+    const size_t ReadBufferSize = 256 * 1024;
+
+    struct CacheKey
+    {
+        uint64_t Device;
+        uint64_t Inode;
+        int64_t ModifiedTime;           // nanoseconds since the epoch
+        int64_t Size;
+
+        bool operator==(const CacheKey& other) const
+        {
+            return Device == other.Device && Inode == other.Inode &&
+                   ModifiedTime == other.ModifiedTime && Size == other.Size;
+        }
+    };
+
+    struct CacheKeyHash
+    {
+        size_t operator()(const CacheKey& key) const
+        {
+            uint64_t hash = key.Inode;
+            hash = hash * 1099511628211ULL ^ key.Device;
+            hash = hash * 1099511628211ULL ^ static_cast<uint64_t>(key.ModifiedTime);
+            hash = hash * 1099511628211ULL ^ static_cast<uint64_t>(key.Size);
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    // The cache file is a header followed by RecordCount records
+    struct CacheHeader
+    {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t RecordSize;
+        uint64_t RecordCount;
+    };
+
+    struct CacheRecord
+    {
+        CacheKey Key;
+        uint8_t Digest[Sha256::DigestSize];
+    };
+
+    struct CachedDigest
+    {
+        uint8_t Digest[Sha256::DigestSize];
+        bool Used;                      // looked up or added since the cache was opened
+    };
+
+    struct MerkleNode
+    {
+        std::string Path;               // relative to the root
+        int64_t Parent;
+        int Error;
+        struct stat Stat;
+        uint8_t Digest[Sha256::DigestSize];
+    };
+}
+
+struct MerkleCache
+{
+    std::mutex Lock;
+    std::unordered_map<CacheKey, CachedDigest, CacheKeyHash> Digests;
+};
+
+static CacheKey GetCacheKey(const struct stat& st)
+{
+    CacheKey key = { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino), GetModifiedTimeNanoseconds(st), st.st_size };
+    return key;
+}
+
+//! @brief MerkleCacheOpen opens a cache of file digests for ComputeMerkleTree
+//!
+//! MerkleCacheOpen
+//!
+//! The cache maps a file's device, inode, modification time and size to the
+//! digest of its content, so that files that have not changed since they
+//! were last hashed are not read again.
+//!
+//! @param[in] cachePath
+//! @parblock
+//! A file saved by MerkleCacheSave, or NULL for a cache that only lives in
+//! memory. A file that does not exist yet opens as an empty cache.
+//! @endparblock
+//!
+//! @retval the cache, or NULL with errno set if unsuccessful (EINVAL if the
+//! file is not a valid cache)
+//!
+struct MerkleCache* MerkleCacheOpen(const char* cachePath)
+{
+    MerkleCache* cache = new (std::nothrow) MerkleCache();
+    if (cache == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    if (cachePath == nullptr)
+    {
+        return cache;
+    }
+
+    int fd = open(cachePath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return cache;
+        }
+
+        delete cache;
+        return nullptr;
+    }
+
+    int error = 0;
+    try
+    {
+        struct stat st;
+        CacheHeader header;
+        if (fstat(fd, &st) != 0)
+        {
+            error = errno;
+        }
+        else if (static_cast<size_t>(st.st_size) < sizeof(header) || !ReadAll(fd, &header, sizeof(header)) ||
+                 memcmp(header.Magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.Version != CacheVersion ||
+                 header.RecordSize != sizeof(CacheRecord) ||
+                 header.RecordCount != (static_cast<size_t>(st.st_size) - sizeof(header)) / sizeof(CacheRecord) ||
+                 (static_cast<size_t>(st.st_size) - sizeof(header)) % sizeof(CacheRecord) != 0)
+        {
+            error = EINVAL;
+        }
+        else
+        {
+            std::vector<CacheRecord> records(header.RecordCount);
+            if (!ReadAll(fd, records.data(), records.size() * sizeof(CacheRecord)))
+            {
+                error = errno;
+            }
+            else
+            {
+                cache->Digests.reserve(records.size());
+                for (const CacheRecord& record : records)
+                {
+                    CachedDigest& digest = cache->Digests[record.Key];
+                    memcpy(digest.Digest, record.Digest, sizeof(digest.Digest));
+                    digest.Used = false;
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        error = ENOMEM;
+    }
+
+    close(fd);
+    if (error != 0)
+    {
+        delete cache;
+        errno = error;
+        return nullptr;
+    }
+
+    return cache;
+}
+
+//! @brief MerkleCacheSave saves a cache of file digests
+//!
+//! MerkleCacheSave
+//!
+//! Only the digests looked up or added since the cache was opened are kept,
+//! so the cache does not keep growing with files that no longer exist.
+//!
+//! @param[in] cachePath
+//! @parblock
+//! The file to save the cache to. It is replaced atomically.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t MerkleCacheSave(struct MerkleCache* cache, const char* cachePath)
+{
+    assert(cache && cachePath);
+    if (cache == nullptr || cachePath == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    try
+    {
+        std::vector<CacheRecord> records;
+        {
+            std::lock_guard<std::mutex> lock(cache->Lock);
+            for (const auto& digest : cache->Digests)
+            {
+                if (digest.second.Used)
+                {
+                    CacheRecord record;
+                    record.Key = digest.first;
+                    memcpy(record.Digest, digest.second.Digest, sizeof(record.Digest));
+                    records.push_back(record);
+                }
+            }
+        }
+
+        CacheHeader header = {};
+        memcpy(header.Magic, CacheMagic, sizeof(header.Magic));
+        header.Version = CacheVersion;
+        header.RecordSize = sizeof(CacheRecord);
+        header.RecordCount = records.size();
+
+        FileSection sections[] = { { &header, sizeof(header) }, { records.data(), records.size() * sizeof(CacheRecord) } };
+        if (!WriteFileAtomically(cachePath, sections, 2))
+        {
+            return -1;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+//! @brief MerkleCacheClose frees a cache without saving it
+//!
+//! MerkleCacheClose
+//!
+void MerkleCacheClose(struct MerkleCache* cache)
+{
+    delete cache;
+}
+
+// Creates a node for every entry of the tree, directories' nodes before their entries
+class MerkleCollector : public TreeVisitor
+{
+public:
+    explicit MerkleCollector(std::vector<MerkleNode>& nodes)
+        : m_nodes(nodes)
+    {
+    }
+
+    void Visit(const WalkDirectory& directory, std::vector<WalkEntry>& entries) override
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_nodes[directory.Tag].Error = directory.Error;
+        std::string parentPath = m_nodes[directory.Tag].Path;
+        for (WalkEntry& entry : entries)
+        {
+            MerkleNode node;
+            node.Path = parentPath.empty() ? entry.Name : parentPath + "/" + entry.Name;
+            node.Parent = directory.Tag;
+            node.Error = 0;
+            node.Stat = entry.Stat;
+            entry.Tag = static_cast<int64_t>(m_nodes.size());
+            m_nodes.push_back(std::move(node));
+        }
+    }
+
+private:
+    std::mutex m_lock;
+    std::vector<MerkleNode>& m_nodes;
+};
+
+namespace
+{
+    // Hashes file contents and link targets on several threads
+    struct HashWork
+    {
+        int RootFd;
+        std::vector<MerkleNode>* Nodes;
+        const std::vector<size_t>* Pending;
+        MerkleCache* Cache;
+        std::atomic<size_t> Next;
+        std::atomic<int64_t> FilesHashed;
+        std::atomic<int64_t> BytesHashed;
+        std::atomic<bool> OutOfMemory;
+    };
+}
+
+// Returns 0, or the errno that kept the content from being read
+static int HashContent(HashWork& work, MerkleNode& node, Sha256& hasher, std::vector<char>& buffer, bool* stable)
+{
+    hasher.Reset();
+    *stable = false;
+
+    if (S_ISLNK(node.Stat.st_mode))
+    {
+        ssize_t length = readlinkat(work.RootFd, node.Path.c_str(), buffer.data(), buffer.size());
+        if (length < 0)
+        {
+            return errno;
+        }
+
+        hasher.Update(buffer.data(), static_cast<size_t>(length));
+        hasher.Final(node.Digest);
+        return 0;
+    }
+
+    int fd = openat(work.RootFd, node.Path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    int error = 0;
+    int64_t total = 0;
+    while (true)
+    {
+        ssize_t count = read(fd, buffer.data(), buffer.size());
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+
+        hasher.Update(buffer.data(), static_cast<size_t>(count));
+        total += count;
+    }
+
+    // Only a file that did not change while it was read, and whose modification
+    // time is old enough to show a later change, may be cached
+    struct stat after;
+    *stable = error == 0 && fstat(fd, &after) == 0 && GetCacheKey(after) == GetCacheKey(node.Stat) &&
+              after.st_mtime + RacyWindowSeconds < time(nullptr);
+    close(fd);
+    if (error != 0)
+    {
+        return error;
+    }
+
+    hasher.Final(node.Digest);
+    work.FilesHashed++;
+    work.BytesHashed += total;
+    return 0;
+}
+
+static void RunHashWorker(HashWork* work)
+{
+    try
+    {
+        Sha256 hasher;
+        std::vector<char> buffer(ReadBufferSize);
+        size_t index;
+        while (!work->OutOfMemory && (index = work->Next++) < work->Pending->size())
+        {
+            MerkleNode& node = (*work->Nodes)[(*work->Pending)[index]];
+            bool stable;
+            node.Error = HashContent(*work, node, hasher, buffer, &stable);
+            if (node.Error == 0 && stable && work->Cache != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(work->Cache->Lock);
+                CachedDigest& cached = work->Cache->Digests[GetCacheKey(node.Stat)];
+                memcpy(cached.Digest, node.Digest, sizeof(cached.Digest));
+                cached.Used = true;
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        work->OutOfMemory = true;
+    }
+}
+
+// Fills in the digest of every file and symbolic link, from the cache where it can.
+// Returns false with errno set.
+static bool HashFiles(int rootFd, std::vector<MerkleNode>& nodes, MerkleCache* cache, int32_t threadCount, MerkleTree* tree)
+{
+    std::vector<size_t> pending;
+    for (size_t i = 1; i < nodes.size(); i++)
+    {
+        MerkleNode& node = nodes[i];
+        memset(node.Digest, 0, sizeof(node.Digest));
+        if (S_ISLNK(node.Stat.st_mode))
+        {
+            pending.push_back(i);
+        }
+        else if (S_ISREG(node.Stat.st_mode))
+        {
+            if (cache != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(cache->Lock);
+                auto cached = cache->Digests.find(GetCacheKey(node.Stat));
+                if (cached != cache->Digests.end())
+                {
+                    memcpy(node.Digest, cached->second.Digest, sizeof(node.Digest));
+                    cached->second.Used = true;
+                    tree->FilesCached++;
+                    continue;
+                }
+            }
+            pending.push_back(i);
+        }
+        else if (!S_ISDIR(node.Stat.st_mode))
+        {
+            // Devices, pipes and sockets have no content to hash
+            Sha256 hasher;
+            hasher.Final(node.Digest);
+        }
+    }
+
+    HashWork work;
+    work.RootFd = rootFd;
+    work.Nodes = &nodes;
+    work.Pending = &pending;
+    work.Cache = cache;
+    work.Next = 0;
+    work.FilesHashed = 0;
+    work.BytesHashed = 0;
+    work.OutOfMemory = false;
+
+    if (threadCount == 0)
+    {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processors > 0 ? static_cast<int32_t>(processors) : 1;
+    }
+
+    std::vector<std::thread> threads;
+    try
+    {
+        for (int32_t i = 1; i < threadCount && static_cast<size_t>(i) < pending.size(); i++)
+        {
+            threads.push_back(std::thread(RunHashWorker, &work));
+        }
+    }
+    catch (const std::exception&)
+    {
+        // Hash with the threads that did start
+    }
+
+    RunHashWorker(&work);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    tree->FilesHashed = work.FilesHashed;
+    tree->BytesHashed = work.BytesHashed;
+    if (work.OutOfMemory)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+    return true;
+}
+
+// Hashes every directory from its entries, sorted by name: for each one its type,
+// its name and a terminating null, then its digest
+static void HashDirectories(std::vector<MerkleNode>& nodes)
+{
+    std::vector<std::vector<size_t>> children(nodes.size());
+    for (size_t i = 1; i < nodes.size(); i++)
+    {
+        children[nodes[i].Parent].push_back(i);
+    }
+
+    Sha256 hasher;
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        if (!S_ISDIR(nodes[i].Stat.st_mode))
+        {
+            continue;
+        }
+
+        // A directory that could not be listed keeps an all-zero digest rather
+        // than one that looks like the digest of an empty directory
+        if (nodes[i].Error != 0)
+        {
+            memset(nodes[i].Digest, 0, sizeof(nodes[i].Digest));
+            continue;
+        }
+
+        std::vector<size_t>& entries = children[i];
+        std::sort(entries.begin(), entries.end(), [&nodes](size_t left, size_t right)
+        {
+            const std::string& leftPath = nodes[left].Path;
+            const std::string& rightPath = nodes[right].Path;
+            size_t leftName = leftPath.rfind('/') + 1;
+            size_t rightName = rightPath.rfind('/') + 1;
+            return leftPath.compare(leftName, std::string::npos, rightPath, rightName, std::string::npos) < 0;
+        });
+
+        hasher.Reset();
+        for (size_t entry : entries)
+        {
+            const MerkleNode& node = nodes[entry];
+            uint8_t type = static_cast<uint8_t>(GetDirectoryEntryType(node.Stat.st_mode));
+            size_t name = node.Path.rfind('/') + 1;
+            hasher.Update(&type, sizeof(type));
+            hasher.Update(node.Path.c_str() + name, node.Path.size() - name + 1);
+            hasher.Update(node.Digest, sizeof(node.Digest));
+        }
+        hasher.Final(nodes[i].Digest);
+    }
+}
+
+//! @brief ComputeMerkleTree hashes every file and directory of a tree
+//!
+//! ComputeMerkleTree
+//!
+//! A file's digest is the SHA-256 of its content, and a symbolic link's that
+//! of its target. A directory's digest covers the type, name and digest of
+//! each of its entries, so the root's digest changes whenever anything in
+//! the tree does.
+//!
+//! The tree is walked with several threads, and file contents are hashed
+//! with several more. With a cache, a file whose device, inode, modification
+//! time and size match a cached digest is not read at all. Directories are
+//! always listed, as a directory's modification time does not change when a
+//! file in it is modified, but their digests cost only hashing their
+//! entries' digests.
+//!
+//! @param[in] root
+//! @parblock
+//! The directory to hash.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] cache
+//! @parblock
+//! A cache from MerkleCacheOpen, or NULL. Digests computed here are added to
+//! it, except for files modified in the last couple of seconds, whose
+//! modification time might not change again if they are written once more.
+//! @endparblock
+//!
+//! @param[in] threadCount
+//! @parblock
+//! How many directories to read, and files to hash, at a time, 0 for one per
+//! processor.
+//! @endparblock
+//!
+//! @param[out] tree
+//! @parblock
+//! Receives an entry per file and directory. Free it with FreeMerkleTree.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set. Entries that cannot
+//! be read do not fail the call; their Error is set and their digest is all
+//! zeros.
+//!
+int32_t ComputeMerkleTree(const char* root, struct MerkleCache* cache, int32_t threadCount, struct MerkleTree** tree)
+{
+    assert(root && tree);
+    if (root == nullptr || tree == nullptr || threadCount < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *tree = nullptr;
+
+    int rootFd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd < 0)
+    {
+        return -1;
+    }
+
+    int error = 0;
+    MerkleTree* result = nullptr;
+    try
+    {
+        std::vector<MerkleNode> nodes(1);
+        nodes[0].Parent = -1;
+        nodes[0].Error = 0;
+        MerkleCollector collector(nodes);
+        MerkleTree counters = {};
+        if (fstat(rootFd, &nodes[0].Stat) != 0 || !WalkTree(root, threadCount, false, 0, collector) ||
+            !HashFiles(rootFd, nodes, cache, threadCount, &counters))
+        {
+            error = errno;
+        }
+        else
+        {
+            HashDirectories(nodes);
+
+            size_t pathsLength = 0;
+            for (const MerkleNode& node : nodes)
+            {
+                pathsLength += node.Path.size() + 1;
+            }
+
+            if (nodes.size() > static_cast<size_t>(INT32_MAX) || pathsLength > static_cast<size_t>(INT32_MAX))
+            {
+                error = EOVERFLOW;
+            }
+            else if ((result = static_cast<MerkleTree*>(calloc(1, sizeof(MerkleTree)))) == nullptr ||
+                     (result->Entries = static_cast<MerkleEntry*>(malloc(nodes.size() * sizeof(MerkleEntry)))) == nullptr ||
+                     (result->Paths = static_cast<char*>(malloc(pathsLength))) == nullptr)
+            {
+                error = ENOMEM;
+            }
+            else
+            {
+                size_t offset = 0;
+                result->Count = static_cast<int32_t>(nodes.size());
+                result->FilesHashed = counters.FilesHashed;
+                result->BytesHashed = counters.BytesHashed;
+                result->FilesCached = counters.FilesCached;
+                for (size_t i = 0; i < nodes.size(); i++)
+                {
+                    const MerkleNode& node = nodes[i];
+                    MerkleEntry& entry = result->Entries[i];
+                    entry.PathOffset = static_cast<int32_t>(offset);
+                    entry.PathLength = static_cast<int32_t>(node.Path.size());
+                    entry.Parent = static_cast<int32_t>(node.Parent);
+                    entry.Type = GetDirectoryEntryType(node.Stat.st_mode);
+                    entry.Error = node.Error;
+                    memcpy(entry.Digest, node.Digest, sizeof(entry.Digest));
+                    memcpy(result->Paths + offset, node.Path.c_str(), node.Path.size() + 1);
+                    offset += node.Path.size() + 1;
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        error = ENOMEM;
+    }
+
+    close(rootFd);
+    if (error != 0)
+    {
+        FreeMerkleTree(result);
+        errno = error;
+        return -1;
+    }
+
+    *tree = result;
+    return 0;
+}
+
+//! @brief FreeMerkleTree frees the digests returned by ComputeMerkleTree
+//!
+//! FreeMerkleTree
+//!
+void FreeMerkleTree(struct MerkleTree* tree)
+{
+    if (tree == nullptr)
+    {
+        return;
+    }
+
+    free(tree->Entries);
+    free(tree->Paths);
+    free(tree);
+}
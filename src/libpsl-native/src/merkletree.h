@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+struct MerkleEntry
+{
+    int32_t PathOffset;             // offset of the null terminated path, relative to the root, in MerkleTree.Paths
+    int32_t PathLength;
+    int32_t Parent;                 // entry of the containing directory, -1 for the root
+    int32_t Type;                   // DIRECTORY_ENTRY_* value
+    int32_t Error;                  // errno if the entry could not be read, 0 otherwise
+    uint8_t Digest[32];             // SHA-256
+};
+
+struct MerkleTree
+{
+    int32_t Count;
+    struct MerkleEntry* Entries;    // parents before their entries, the root first
+    char* Paths;
+    int64_t FilesHashed;            // files whose content was read
+    int64_t BytesHashed;
+    int64_t FilesCached;            // files whose digest came from the cache
+};
+
+struct MerkleCache;
+
+struct MerkleCache* MerkleCacheOpen(const char* cachePath);
+int32_t MerkleCacheSave(struct MerkleCache* cache, const char* cachePath);
+void MerkleCacheClose(struct MerkleCache* cache);
+int32_t ComputeMerkleTree(const char* root, struct MerkleCache* cache, int32_t threadCount, struct MerkleTree** tree);
+void FreeMerkleTree(struct MerkleTree* tree);
+
+PAL_END_EXTERNC
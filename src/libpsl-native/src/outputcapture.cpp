@@ -0,0 +1,202 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief capture a child's output in anonymous memory instead of a pipe
+
+#include "outputcapture.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#endif
+
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+#endif
+
+// Creates an unlinked temporary file for systems without memfd_create
+static int CreateUnlinkedTempFile()
+{
+    const char* directory = getenv("TMPDIR");
+    std::string path = directory != nullptr && directory[0] != '\0' ? directory : "/tmp";
+    path += "/psl-capture.XXXXXX";
+
+    int fd = mkstemp(&path[0]);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    unlink(path.c_str());
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        int priorErrno = errno;
+        close(fd);
+        errno = priorErrno;
+        return -1;
+    }
+
+    return fd;
+}
+
+//! @brief CreateOutputCapture creates an anonymous in-memory file for a child's
+//! standard output
+//!
+//! CreateOutputCapture
+//!
+//! Pass the descriptor to ForkAndExecProcessWithAttributes as a SPAWN_STDIO_FD
+//! stdout target. The child then writes straight into memory, with no pipe
+//! reads or wakeups in the parent. Once the child has exited,
+//! MapOutputCapture exposes the output for decoding in a single pass.
+//!
+//! The file is a memfd on Linux, sealed against shrinking so that a mapping of it
+//! can never fault, and an unlinked temporary file elsewhere.
+//!
+//! Nothing bounds the size of the capture while the child runs: all of its
+//! output is held in memory, or in the temporary directory, however large it
+//! grows. The cap given to MapOutputCapture only decides whether the finished
+//! output is mapped. Use a pipe for children whose output may be unbounded.
+//!
+//! @param[out] fd
+//! @parblock
+//! Receives the descriptor, which the caller closes when done.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t CreateOutputCapture(int32_t* fd)
+{
+    assert(fd);
+
+#if defined(__linux__)
+    int memFd = static_cast<int>(syscall(SYS_memfd_create, "psl-capture", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (memFd >= 0)
+    {
+        // Without the seal a mapping could fault if the file were truncated
+        if (fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK) != 0)
+        {
+            int priorErrno = errno;
+            close(memFd);
+            errno = priorErrno;
+            return -1;
+        }
+
+        *fd = memFd;
+        return 0;
+    }
+
+    if (errno != ENOSYS)
+    {
+        return -1;
+    }
+#endif
+
+    *fd = CreateUnlinkedTempFile();
+    return *fd < 0 ? -1 : 0;
+}
+
+//! @brief MapOutputCapture maps the captured output for reading, unless it is
+//! larger than the caller is prepared to hold in one piece
+//!
+//! MapOutputCapture
+//!
+//! @param[in] fd
+//! @parblock
+//! The descriptor from CreateOutputCapture, after the child has exited.
+//! @endparblock
+//!
+//! @param[in] maxBytes
+//! @parblock
+//! The largest output to map. Anything larger is left for the caller to
+//! stream from the descriptor in chunks, for example with LineReaderCreate.
+//! This limits the address space used for the mapping, not the memory the
+//! capture already holds.
+//! @endparblock
+//!
+//! @param[out] data
+//! @parblock
+//! Receives the mapped output, or NULL if it is empty or too large.
+//! @endparblock
+//!
+//! @param[out] length
+//! @parblock
+//! Receives the size of the output in bytes.
+//! @endparblock
+//!
+//! @retval OUTPUT_CAPTURE_MAPPED if the output was mapped (or is empty)
+//! @retval OUTPUT_CAPTURE_TOO_LARGE if the output exceeds maxBytes; the
+//! descriptor has been rewound to the start for streaming
+//! @retval -1 if an error occurred, with errno set
+//!
+int32_t MapOutputCapture(int32_t fd, int64_t maxBytes, const uint8_t** data, int64_t* length)
+{
+    assert(data);
+    assert(length);
+
+    *data = nullptr;
+    *length = 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        return -1;
+    }
+
+    *length = st.st_size;
+    if (st.st_size > maxBytes || static_cast<uint64_t>(st.st_size) > SIZE_MAX)
+    {
+        return lseek(fd, 0, SEEK_SET) == -1 ? -1 : OUTPUT_CAPTURE_TOO_LARGE;
+    }
+
+    if (st.st_size == 0)
+    {
+        return OUTPUT_CAPTURE_MAPPED;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    *data = static_cast<const uint8_t*>(mapping);
+    return OUTPUT_CAPTURE_MAPPED;
+}
+
+//! @brief UnmapOutputCapture releases a mapping returned by MapOutputCapture
+//!
+//! UnmapOutputCapture
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t UnmapOutputCapture(const uint8_t* data, int64_t length)
+{
+    if (data == nullptr || length == 0)
+    {
+        return 0;
+    }
+
+    return munmap(const_cast<uint8_t*>(data), static_cast<size_t>(length));
+}
@@ -0,0 +1,20 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+enum
+{
+    OUTPUT_CAPTURE_MAPPED = 0,          // the whole output is mapped and can be decoded in one pass
+    OUTPUT_CAPTURE_TOO_LARGE = 1        // the output exceeds the mapping cap and should be streamed from the descriptor
+};
+
+int32_t CreateOutputCapture(int32_t* fd);
+int32_t MapOutputCapture(int32_t fd, int64_t maxBytes, const uint8_t** data, int64_t* length);
+int32_t UnmapOutputCapture(const uint8_t* data, int64_t length);
+
+PAL_END_EXTERNC
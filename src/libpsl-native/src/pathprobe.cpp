@@ -0,0 +1,276 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief check many candidate paths with one directory listing per parent
+
+#include "pathprobe.h"
+#include "directoryreader.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <linux/magic.h>
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+
+#ifndef FS_CASEFOLD_FL
+#define FS_CASEFOLD_FL 0x40000000
+#endif
+#endif
+
+namespace
+{
+    // A directory is only listed when at least this many candidates share it;
+    // a single candidate is cheaper to stat than a listing is to read
+    const size_t MinimumCandidatesForListing = 2;
+
+    struct Candidate
+    {
+        int32_t Index;
+        std::string Name;
+    };
+}
+
+static inline void SetBit(uint8_t* bitmap, int32_t index)
+{
+    bitmap[index / 8] |= static_cast<uint8_t>(1 << (index % 8));
+}
+
+static void ProbeWithStat(int dirFd, const char* path, int32_t index, uint8_t* existsBitmap, uint8_t* directoryBitmap)
+{
+    struct stat st;
+    if (fstatat(dirFd, path, &st, AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        return;
+    }
+
+    SetBit(existsBitmap, index);
+    if (S_ISDIR(st.st_mode) || (S_ISLNK(st.st_mode) && fstatat(dirFd, path, &st, 0) == 0 && S_ISDIR(st.st_mode)))
+    {
+        SetBit(directoryBitmap, index);
+    }
+}
+
+// Names are compared byte for byte, which is only the file system's own notion of
+// equality in directories that are case sensitive.  File systems that cannot report
+// case folding per directory, such as vfat, exfat, ntfs3 and CIFS, are only
+// trusted if they are known to always be case sensitive.
+static bool IsCaseSensitive(int dirFd)
+{
+#if defined(__linux__)
+    int flags = 0;
+    if (ioctl(dirFd, FS_IOC_GETFLAGS, &flags) == 0)
+    {
+        return (flags & FS_CASEFOLD_FL) == 0;
+    }
+
+    struct statfs fs;
+    if (fstatfs(dirFd, &fs) != 0)
+    {
+        return false;
+    }
+
+    switch (static_cast<unsigned long>(fs.f_type))
+    {
+        case TMPFS_MAGIC:
+        case RAMFS_MAGIC:
+        case EXT4_SUPER_MAGIC:
+        case XFS_SUPER_MAGIC:
+        case BTRFS_SUPER_MAGIC:
+        case OVERLAYFS_SUPER_MAGIC:
+            return true;
+        default:
+            return false;
+    }
+#else
+    (void)dirFd;
+    return false;
+#endif
+}
+
+// Answers every candidate in a directory from a single listing.  Returns false if
+// the directory could not be listed, in which case nothing has been answered yet.
+static bool ProbeWithListing(
+    const std::string& directory,
+    const std::vector<Candidate>& candidates,
+    uint8_t* existsBitmap,
+    uint8_t* directoryBitmap)
+{
+    DirectoryReader reader;
+    if (!reader.Open(AT_FDCWD, directory.c_str()))
+    {
+        // A missing parent answers every candidate at once; anything else, such as a
+        // directory we may search but not read, is left to the individual stats
+        if (errno == ENOENT || errno == ENOTDIR)
+        {
+            return true;
+        }
+        return false;
+    }
+
+    if (!IsCaseSensitive(reader.Fd()))
+    {
+        return false;
+    }
+
+    std::unordered_map<std::string, size_t> wanted;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        wanted.emplace(candidates[i].Name, i);
+    }
+
+    std::vector<unsigned char> types(candidates.size(), DT_UNKNOWN);
+    std::vector<bool> found(candidates.size(), false);
+    std::string name;
+    DirectoryEntry entry;
+    int result;
+    while ((result = reader.Next(&entry)) == 1)
+    {
+        name.assign(entry.Name, entry.NameLength);
+        auto match = wanted.find(name);
+        if (match != wanted.end())
+        {
+            found[match->second] = true;
+            types[match->second] = entry.Type;
+        }
+    }
+
+    if (result != 0)
+    {
+        return false;
+    }
+
+    // The same name may have been asked for more than once
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        size_t first = wanted[candidates[i].Name];
+        if (!found[first])
+        {
+            continue;
+        }
+
+        const Candidate& candidate = candidates[i];
+        if (types[first] == DT_DIR)
+        {
+            SetBit(existsBitmap, candidate.Index);
+            SetBit(directoryBitmap, candidate.Index);
+        }
+        else if (types[first] == DT_LNK || types[first] == DT_UNKNOWN)
+        {
+            ProbeWithStat(reader.Fd(), candidate.Name.c_str(), candidate.Index, existsBitmap, directoryBitmap);
+        }
+        else
+        {
+            SetBit(existsBitmap, candidate.Index);
+        }
+    }
+
+    return true;
+}
+
+//! @brief ProbePaths checks whether each of many candidate paths exists and
+//! whether it is a directory
+//!
+//! ProbePaths
+//!
+//! Candidates are grouped by parent directory. Each directory with more than
+//! one candidate is listed once and all of its candidates are answered from
+//! the listing, so candidates that do not exist cost no system call of their
+//! own. Directories that cannot be listed, and directories that may compare
+//! names case insensitively, fall back to a stat per candidate.
+//!
+//! @param[in] paths
+//! @parblock
+//! The candidate paths.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[out] existsBitmap
+//! @parblock
+//! Receives (pathCount + 7) / 8 bytes. Bit i % 8 of byte i / 8 is set if
+//! paths[i] exists, without following a final symbolic link.
+//! @endparblock
+//!
+//! @param[out] directoryBitmap
+//! @parblock
+//! Receives (pathCount + 7) / 8 bytes. Bit i % 8 of byte i / 8 is set if
+//! paths[i] is a directory or a symbolic link to one.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t ProbePaths(const char* const paths[], int32_t pathCount, uint8_t* existsBitmap, uint8_t* directoryBitmap)
+{
+    assert(paths && existsBitmap && directoryBitmap);
+    if (pathCount < 0 || (pathCount > 0 && (paths == nullptr || existsBitmap == nullptr || directoryBitmap == nullptr)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t bitmapLength = (static_cast<size_t>(pathCount) + 7) / 8;
+    memset(existsBitmap, 0, bitmapLength);
+    memset(directoryBitmap, 0, bitmapLength);
+
+    try
+    {
+        std::unordered_map<std::string, std::vector<Candidate>> groups;
+        for (int32_t i = 0; i < pathCount; i++)
+        {
+            const char* path = paths[i];
+            if (path == nullptr)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+
+            // Paths whose last component is empty, "." or ".." do not name an entry of
+            // their parent, so only a stat can answer them
+            const char* slash = strrchr(path, '/');
+            const char* name = slash != nullptr ? slash + 1 : path;
+            if (name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            {
+                ProbeWithStat(AT_FDCWD, path, i, existsBitmap, directoryBitmap);
+                continue;
+            }
+
+            std::string parent = slash == nullptr ? std::string(".") :
+                                 slash == path ? std::string("/") :
+                                 std::string(path, static_cast<size_t>(slash - path));
+            groups[parent].push_back(Candidate { i, std::string(name) });
+        }
+
+        for (auto& group : groups)
+        {
+            const std::vector<Candidate>& candidates = group.second;
+            if (candidates.size() >= MinimumCandidatesForListing &&
+                ProbeWithListing(group.first, candidates, existsBitmap, directoryBitmap))
+            {
+                continue;
+            }
+
+            for (const Candidate& candidate : candidates)
+            {
+                ProbeWithStat(AT_FDCWD, paths[candidate.Index], candidate.Index, existsBitmap, directoryBitmap);
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
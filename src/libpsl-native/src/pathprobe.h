@@ -0,0 +1,16 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+int32_t ProbePaths(
+    const char* const paths[],      // candidate paths
+    int32_t pathCount,
+    uint8_t* existsBitmap,          // [out] bit i is set if paths[i] exists, as for IsFile
+    uint8_t* directoryBitmap);      // [out] bit i is set if paths[i] is a directory, as for IsDirectory
+
+PAL_END_EXTERNC
@@ -0,0 +1,229 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief SHA-1 for hashing files
+
+#include "sha1.h"
+#include "cpufeatures.h"
+
+#include <string.h>
+
+#ifdef PAL_HAVE_X86_SHA_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t InitialState[5] =
+    {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+
+    const uint32_t RoundConstants[4] =
+    {
+        0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+    };
+}
+
+static inline uint32_t RotateLeft(uint32_t value, int count)
+{
+    return (value << count) | (value >> (32 - count));
+}
+
+static inline uint32_t LoadBigEndian32(const uint8_t* data)
+{
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+static inline void StoreBigEndian32(uint8_t* data, uint32_t value)
+{
+    data[0] = static_cast<uint8_t>(value >> 24);
+    data[1] = static_cast<uint8_t>(value >> 16);
+    data[2] = static_cast<uint8_t>(value >> 8);
+    data[3] = static_cast<uint8_t>(value);
+}
+
+Sha1::Sha1()
+{
+    Reset();
+}
+
+void Sha1::Reset()
+{
+    memcpy(m_state, InitialState, sizeof(m_state));
+    m_length = 0;
+    m_buffered = 0;
+}
+
+#ifdef PAL_HAVE_X86_SHA_KERNELS
+// The compression function on the SHA extensions.  Each sha1rnds4 runs four
+// rounds; the E value for the next four is derived with sha1nexte while the
+// message schedule is extended with sha1msg1/msg2 ahead of its use.
+__attribute__((target("sha,ssse3,sse4.1")))
+static void TransformShaExtensions(uint32_t state[5], const uint8_t* blocks, size_t blockCount)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0x1b);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+    __m128i e1 = _mm_setzero_si128();
+
+    for (; blockCount > 0; blockCount--, blocks += 64)
+    {
+        __m128i savedAbcd = abcd;
+        __m128i savedE = e0;
+        __m128i words[4];
+
+        for (int group = 0; group < 20; group++)
+        {
+            __m128i& current = words[group & 3];
+            if (group < 4)
+            {
+                current = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + group * 16)), byteSwap);
+            }
+
+            // The two E registers alternate between feeding this group and
+            // capturing the state for the next
+            __m128i& e = (group & 1) == 0 ? e0 : e1;
+            __m128i& nextE = (group & 1) == 0 ? e1 : e0;
+            e = group == 0 ? _mm_add_epi32(e, current) : _mm_sha1nexte_epu32(e, current);
+            nextE = abcd;
+            if (group >= 3 && group < 19)
+            {
+                __m128i& next = words[(group + 1) & 3];
+                next = _mm_sha1msg2_epu32(next, current);
+            }
+
+            switch (group / 5)
+            {
+                case 0: abcd = _mm_sha1rnds4_epu32(abcd, e, 0); break;
+                case 1: abcd = _mm_sha1rnds4_epu32(abcd, e, 1); break;
+                case 2: abcd = _mm_sha1rnds4_epu32(abcd, e, 2); break;
+                default: abcd = _mm_sha1rnds4_epu32(abcd, e, 3); break;
+            }
+
+            if (group >= 1 && group < 17)
+            {
+                __m128i& previous = words[(group + 3) & 3];
+                previous = _mm_sha1msg1_epu32(previous, current);
+            }
+            if (group >= 2 && group < 18)
+            {
+                __m128i& older = words[(group + 2) & 3];
+                older = _mm_xor_si128(older, current);
+            }
+        }
+
+        e0 = _mm_sha1nexte_epu32(e0, savedE);
+        abcd = _mm_add_epi32(abcd, savedAbcd);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+#endif
+
+void Sha1::Transform(const uint8_t* blocks, size_t blockCount)
+{
+#ifdef PAL_HAVE_X86_SHA_KERNELS
+    if (HasShaExtensions())
+    {
+        TransformShaExtensions(m_state, blocks, blockCount);
+        return;
+    }
+#endif
+
+    uint32_t schedule[80];
+    for (; blockCount > 0; blockCount--, blocks += 64)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            schedule[i] = LoadBigEndian32(blocks + i * 4);
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            schedule[i] = RotateLeft(schedule[i - 3] ^ schedule[i - 8] ^ schedule[i - 14] ^ schedule[i - 16], 1);
+        }
+
+        uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3], e = m_state[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+            }
+            else if (i < 40 || i >= 60)
+            {
+                f = b ^ c ^ d;
+            }
+            else
+            {
+                f = (b & c) | (b & d) | (c & d);
+            }
+
+            uint32_t t = RotateLeft(a, 5) + f + e + RoundConstants[i / 20] + schedule[i];
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = t;
+        }
+
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+    }
+}
+
+void Sha1::Update(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_length += length;
+
+    if (m_buffered > 0)
+    {
+        size_t take = sizeof(m_buffer) - m_buffered < length ? sizeof(m_buffer) - m_buffered : length;
+        memcpy(m_buffer + m_buffered, bytes, take);
+        m_buffered += take;
+        bytes += take;
+        length -= take;
+        if (m_buffered < sizeof(m_buffer))
+        {
+            return;
+        }
+
+        Transform(m_buffer, 1);
+        m_buffered = 0;
+    }
+
+    // Whole blocks are hashed straight from the caller's buffer
+    size_t blockCount = length / 64;
+    Transform(bytes, blockCount);
+    bytes += blockCount * 64;
+    length -= blockCount * 64;
+
+    memcpy(m_buffer, bytes, length);
+    m_buffered = length;
+}
+
+void Sha1::Final(uint8_t digest[DigestSize])
+{
+    uint64_t bitLength = m_length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t paddingLength = m_buffered < 56 ? 56 - m_buffered : 120 - m_buffered;
+    for (int i = 0; i < 8; i++)
+    {
+        padding[paddingLength + i] = static_cast<uint8_t>(bitLength >> (56 - i * 8));
+    }
+    Update(padding, paddingLength + 8);
+
+    for (int i = 0; i < 5; i++)
+    {
+        StoreBigEndian32(digest + i * 4, m_state[i]);
+    }
+}
@@ -0,0 +1,223 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief SHA-256 for hashing files and directory trees
+
+#include "sha256.h"
+#include "cpufeatures.h"
+
+#include <string.h>
+
+#ifdef PAL_HAVE_X86_SHA_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t InitialState[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    const uint32_t RoundConstants[64] =
+    {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+}
+
+static inline uint32_t RotateRight(uint32_t value, int count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+static inline uint32_t LoadBigEndian32(const uint8_t* data)
+{
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+static inline void StoreBigEndian32(uint8_t* data, uint32_t value)
+{
+    data[0] = static_cast<uint8_t>(value >> 24);
+    data[1] = static_cast<uint8_t>(value >> 16);
+    data[2] = static_cast<uint8_t>(value >> 8);
+    data[3] = static_cast<uint8_t>(value);
+}
+
+Sha256::Sha256()
+{
+    Reset();
+}
+
+void Sha256::Reset()
+{
+    memcpy(m_state, InitialState, sizeof(m_state));
+    m_length = 0;
+    m_buffered = 0;
+}
+
+#ifdef PAL_HAVE_X86_SHA_KERNELS
+// The compression function on the SHA extensions.  The state is kept as the ABEF
+// and CDGH halves sha256rnds2 works on, and each 4-word group of the message
+// schedule is extended with sha256msg1/msg2 three groups ahead of its use.
+__attribute__((target("sha,ssse3,sse4.1")))
+static void TransformShaExtensions(uint32_t state[8], const uint8_t* blocks, size_t blockCount)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i dcba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i hgfe = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+    for (; blockCount > 0; blockCount--, blocks += 64)
+    {
+        __m128i savedAbef = abef;
+        __m128i savedCdgh = cdgh;
+        __m128i words[4];
+
+        for (int group = 0; group < 16; group++)
+        {
+            __m128i& current = words[group & 3];
+            if (group < 4)
+            {
+                current = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + group * 16)), byteSwap);
+            }
+
+            __m128i message = _mm_add_epi32(current,
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(&RoundConstants[group * 4])));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+            if (group >= 3 && group < 15)
+            {
+                __m128i& next = words[(group + 1) & 3];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(current, words[(group + 3) & 3], 4));
+                next = _mm_sha256msg2_epu32(next, current);
+            }
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(message, 0x0e));
+            if (group >= 1 && group < 13)
+            {
+                __m128i& previous = words[(group + 3) & 3];
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+
+        abef = _mm_add_epi32(abef, savedAbef);
+        cdgh = _mm_add_epi32(cdgh, savedCdgh);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(dchg, feba, 8));
+}
+#endif
+
+void Sha256::Transform(const uint8_t* blocks, size_t blockCount)
+{
+#ifdef PAL_HAVE_X86_SHA_KERNELS
+    if (HasShaExtensions())
+    {
+        TransformShaExtensions(m_state, blocks, blockCount);
+        return;
+    }
+#endif
+
+    uint32_t schedule[64];
+    for (; blockCount > 0; blockCount--, blocks += 64)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            schedule[i] = LoadBigEndian32(blocks + i * 4);
+        }
+        for (int i = 16; i < 64; i++)
+        {
+            uint32_t s0 = RotateRight(schedule[i - 15], 7) ^ RotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+            uint32_t s1 = RotateRight(schedule[i - 2], 17) ^ RotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+        }
+
+        uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = h + (RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25)) + ((e & f) ^ (~e & g)) +
+                          RoundConstants[i] + schedule[i];
+            uint32_t t2 = (RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+}
+
+void Sha256::Update(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_length += length;
+
+    if (m_buffered > 0)
+    {
+        size_t take = sizeof(m_buffer) - m_buffered < length ? sizeof(m_buffer) - m_buffered : length;
+        memcpy(m_buffer + m_buffered, bytes, take);
+        m_buffered += take;
+        bytes += take;
+        length -= take;
+        if (m_buffered < sizeof(m_buffer))
+        {
+            return;
+        }
+
+        Transform(m_buffer, 1);
+        m_buffered = 0;
+    }
+
+    // Whole blocks are hashed straight from the caller's buffer
+    size_t blockCount = length / 64;
+    Transform(bytes, blockCount);
+    bytes += blockCount * 64;
+    length -= blockCount * 64;
+
+    memcpy(m_buffer, bytes, length);
+    m_buffered = length;
+}
+
+void Sha256::Final(uint8_t digest[DigestSize])
+{
+    uint64_t bitLength = m_length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t paddingLength = m_buffered < 56 ? 56 - m_buffered : 120 - m_buffered;
+    for (int i = 0; i < 8; i++)
+    {
+        padding[paddingLength + i] = static_cast<uint8_t>(bitLength >> (56 - i * 8));
+    }
+    Update(padding, paddingLength + 8);
+
+    for (int i = 0; i < 8; i++)
+    {
+        StoreBigEndian32(digest + i * 4, m_state[i]);
+    }
+}
@@ -0,0 +1,170 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief SHA-512 for hashing files
+
+#include "sha512.h"
+
+#include <string.h>
+
+namespace
+{
+    const uint64_t InitialState[8] =
+    {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+    };
+
+    const uint64_t RoundConstants[80] =
+    {
+        0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+        0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+        0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+        0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+        0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+        0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+        0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+        0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+        0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+        0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+        0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+        0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+        0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+        0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+        0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+        0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+        0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+        0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+        0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+        0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+    };
+}
+
+static inline uint64_t RotateRight(uint64_t value, int count)
+{
+    return (value >> count) | (value << (64 - count));
+}
+
+static inline uint64_t LoadBigEndian64(const uint8_t* data)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+static inline void StoreBigEndian64(uint8_t* data, uint64_t value)
+{
+    for (int i = 7; i >= 0; i--)
+    {
+        data[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+Sha512::Sha512()
+{
+    Reset();
+}
+
+void Sha512::Reset()
+{
+    memcpy(m_state, InitialState, sizeof(m_state));
+    m_length = 0;
+    m_buffered = 0;
+}
+
+void Sha512::Transform(const uint8_t* blocks, size_t blockCount)
+{
+    uint64_t schedule[80];
+    for (; blockCount > 0; blockCount--, blocks += 128)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            schedule[i] = LoadBigEndian64(blocks + i * 8);
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            uint64_t s0 = RotateRight(schedule[i - 15], 1) ^ RotateRight(schedule[i - 15], 8) ^ (schedule[i - 15] >> 7);
+            uint64_t s1 = RotateRight(schedule[i - 2], 19) ^ RotateRight(schedule[i - 2], 61) ^ (schedule[i - 2] >> 6);
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+        }
+
+        uint64_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        uint64_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+        for (int i = 0; i < 80; i++)
+        {
+            uint64_t t1 = h + (RotateRight(e, 14) ^ RotateRight(e, 18) ^ RotateRight(e, 41)) + ((e & f) ^ (~e & g)) +
+                          RoundConstants[i] + schedule[i];
+            uint64_t t2 = (RotateRight(a, 28) ^ RotateRight(a, 34) ^ RotateRight(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+}
+
+void Sha512::Update(const void* data, size_t length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_length += length;
+
+    if (m_buffered > 0)
+    {
+        size_t take = sizeof(m_buffer) - m_buffered < length ? sizeof(m_buffer) - m_buffered : length;
+        memcpy(m_buffer + m_buffered, bytes, take);
+        m_buffered += take;
+        bytes += take;
+        length -= take;
+        if (m_buffered < sizeof(m_buffer))
+        {
+            return;
+        }
+
+        Transform(m_buffer, 1);
+        m_buffered = 0;
+    }
+
+    // Whole blocks are hashed straight from the caller's buffer
+    size_t blockCount = length / 128;
+    Transform(bytes, blockCount);
+    bytes += blockCount * 128;
+    length -= blockCount * 128;
+
+    memcpy(m_buffer, bytes, length);
+    m_buffered = length;
+}
+
+void Sha512::Final(uint8_t digest[DigestSize])
+{
+    // The length field is 128 bits; its upper half is always zero here
+    uint64_t bitLength = m_length * 8;
+    uint8_t padding[144] = { 0x80 };
+    size_t paddingLength = m_buffered < 112 ? 112 - m_buffered : 240 - m_buffered;
+    for (int i = 0; i < 8; i++)
+    {
+        padding[paddingLength + 8 + i] = static_cast<uint8_t>(bitLength >> (56 - i * 8));
+    }
+    Update(padding, paddingLength + 16);
+
+    for (int i = 0; i < 8; i++)
+    {
+        StoreBigEndian64(digest + i * 8, m_state[i]);
+    }
+}
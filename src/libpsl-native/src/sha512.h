@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Internal to libpsl-native, not exported
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA-512 as specified in FIPS 180-4
+class Sha512
+{
+public:
+    static const size_t DigestSize = 64;
+
+    Sha512();
+
+    void Update(const void* data, size_t length);
+
+    // Writes the digest; the object has to be Reset before it is used again
+    void Final(uint8_t digest[DigestSize]);
+    void Reset();
+
+private:
+    void Transform(const uint8_t* blocks, size_t blockCount);
+
+    uint64_t m_state[8];
+    uint64_t m_length;              // in bytes; inputs beyond 2^61 bytes are not supported
+    uint8_t m_buffer[128];
+    size_t m_buffered;
+};
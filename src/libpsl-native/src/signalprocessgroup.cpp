@@ -0,0 +1,67 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief send a signal to every process in a process group
+
+#include "signalprocessgroup.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+//! @brief SignalProcessGroup sends a signal to every member of a process group
+//!
+//! SignalProcessGroup
+//!
+//! The caller's own process group is refused, so a child that was started
+//! without CREATE_NEW_PROCESS_GROUP can never take PowerShell down with it.
+//!
+//! @param[in] processGroupId
+//! @parblock
+//! The target process group, usually the pid of a child started with
+//! CREATE_NEW_PROCESS_GROUP or CREATE_NEW_SESSION.
+//! @endparblock
+//!
+//! @param[in] signal
+//! @parblock
+//! The signal to send. SIGHUP (1), SIGINT (2), SIGKILL (9) and SIGTERM (15)
+//! have the same value on every supported platform.
+//! @endparblock
+//!
+//! @retval 0 if the signal was sent, -1 otherwise with errno set
+//!
+int32_t SignalProcessGroup(pid_t processGroupId, int32_t signal)
+{
+    if (processGroupId <= 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (processGroupId == getpgrp())
+    {
+        errno = EPERM;
+        return -1;
+    }
+
+    return killpg(processGroupId, signal);
+}
+
+//! @brief SuspendProcessGroup stops every member of a process group with SIGSTOP
+//!
+//! @retval 0 if the signal was sent, -1 otherwise with errno set
+//!
+int32_t SuspendProcessGroup(pid_t processGroupId)
+{
+    return SignalProcessGroup(processGroupId, SIGSTOP);
+}
+
+//! @brief ResumeProcessGroup continues every member of a process group with SIGCONT
+//!
+//! @retval 0 if the signal was sent, -1 otherwise with errno set
+//!
+int32_t ResumeProcessGroup(pid_t processGroupId)
+{
+    return SignalProcessGroup(processGroupId, SIGCONT);
+}
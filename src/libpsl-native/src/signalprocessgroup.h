@@ -0,0 +1,15 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+#include <sys/types.h>
+
+PAL_BEGIN_EXTERNC
+
+int32_t SignalProcessGroup(pid_t processGroupId, int32_t signal);
+int32_t SuspendProcessGroup(pid_t processGroupId);
+int32_t ResumeProcessGroup(pid_t processGroupId);
+
+PAL_END_EXTERNC
@@ -0,0 +1,489 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief split native command output into lines and validate it as UTF-8
+
+#include "splitlines.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+namespace
+{
+    const size_t DefaultLineReaderBufferSize = 64 * 1024;
+
+    struct SplitState
+    {
+        const uint8_t* Buffer;
+        size_t LineStart;           // offset of the line being scanned
+        bool LineHasNonAscii;       // whether a byte >= 0x80 was seen in it so far
+        struct LineSpan* Lines;
+        int32_t LinesLength;
+        int32_t LineCount;
+    };
+}
+
+// Returns true if the bytes are well-formed UTF-8 as defined by RFC 3629,
+// rejecting overlong forms, surrogates and code points above U+10FFFF.
+static bool IsValidUtf8(const uint8_t* data, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+        uint8_t lead = data[i];
+        if (lead < 0x80)
+        {
+            i++;
+            continue;
+        }
+
+        size_t extra;
+        uint8_t min = 0x80;
+        uint8_t max = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            extra = 1;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            extra = 2;
+            if (lead == 0xE0)
+            {
+                min = 0xA0;
+            }
+            else if (lead == 0xED)
+            {
+                max = 0x9F;
+            }
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            extra = 3;
+            if (lead == 0xF0)
+            {
+                min = 0x90;
+            }
+            else if (lead == 0xF4)
+            {
+                max = 0x8F;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        if (length - i <= extra || data[i + 1] < min || data[i + 1] > max)
+        {
+            return false;
+        }
+
+        for (size_t j = 2; j <= extra; j++)
+        {
+            if ((data[i + j] & 0xC0) != 0x80)
+            {
+                return false;
+            }
+        }
+
+        i += extra + 1;
+    }
+
+    return true;
+}
+
+// Records the line ending at end (exclusive). Only lines that contained a non-ASCII
+// byte have to be validated; every other line is known to be ASCII from the scan.
+static inline bool EmitLine(SplitState& state, size_t end, size_t next)
+{
+    if (state.LineCount == state.LinesLength)
+    {
+        return false;
+    }
+
+    size_t length = end - state.LineStart;
+    if (length > 0 && state.Buffer[end - 1] == '\r')
+    {
+        length--;
+    }
+
+    struct LineSpan& line = state.Lines[state.LineCount++];
+    line.Offset = static_cast<int32_t>(state.LineStart);
+    line.Length = static_cast<int32_t>(length);
+    if (!state.LineHasNonAscii)
+    {
+        line.Flags = LINE_IS_ASCII;
+    }
+    else
+    {
+        line.Flags = IsValidUtf8(state.Buffer + state.LineStart, end - state.LineStart) ? 0 : LINE_IS_INVALID_UTF8;
+    }
+
+    state.LineStart = next;
+    state.LineHasNonAscii = false;
+    return true;
+}
+
+// Consumes one block of up to 32 bytes starting at base, given as a bit mask of its
+// newlines and a bit mask of its bytes with the high bit set.
+// Returns false once the caller's lines array is full.
+static inline bool ProcessBlock(SplitState& state, size_t base, uint32_t newlines, uint32_t nonAscii)
+{
+    while (newlines != 0)
+    {
+        int bit = __builtin_ctz(newlines);
+        uint32_t before = (1u << bit) - 1;
+        if (nonAscii & before)
+        {
+            state.LineHasNonAscii = true;
+        }
+
+        if (!EmitLine(state, base + bit, base + bit + 1))
+        {
+            return false;
+        }
+
+        uint32_t after = bit == 31 ? 0 : ~0u << (bit + 1);
+        newlines &= after;
+        nonAscii &= after;
+    }
+
+    if (nonAscii != 0)
+    {
+        state.LineHasNonAscii = true;
+    }
+
+    return true;
+}
+
+static bool ScanScalar(SplitState& state, size_t start, size_t length, size_t* scanned)
+{
+    for (size_t i = start; i < length; i += 32)
+    {
+        size_t width = length - i < 32 ? length - i : 32;
+        uint32_t newlines = 0;
+        uint32_t nonAscii = 0;
+        for (size_t j = 0; j < width; j++)
+        {
+            uint8_t c = state.Buffer[i + j];
+            newlines |= static_cast<uint32_t>(c == '\n') << j;
+            nonAscii |= static_cast<uint32_t>(c >> 7) << j;
+        }
+
+        if (!ProcessBlock(state, i, newlines, nonAscii))
+        {
+            return false;
+        }
+    }
+
+    *scanned = length;
+    return true;
+}
+
+#if HAVE_X86_SIMD
+static bool ScanSse2(SplitState& state, size_t length, size_t* scanned)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state.Buffer + i));
+        uint32_t newlines = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        uint32_t nonAscii = static_cast<uint32_t>(_mm_movemask_epi8(block));
+        if ((newlines | nonAscii) != 0 && !ProcessBlock(state, i, newlines, nonAscii))
+        {
+            return false;
+        }
+    }
+
+    *scanned = i;
+    return true;
+}
+
+__attribute__((target("avx2")))
+static bool ScanAvx2(SplitState& state, size_t length, size_t* scanned)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state.Buffer + i));
+        uint32_t newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+        uint32_t nonAscii = static_cast<uint32_t>(_mm256_movemask_epi8(block));
+        if ((newlines | nonAscii) != 0 && !ProcessBlock(state, i, newlines, nonAscii))
+        {
+            return false;
+        }
+    }
+
+    *scanned = i;
+    return true;
+}
+
+static bool HasAvx2()
+{
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2;
+}
+#endif
+
+//! @brief SplitLines finds the lines in a buffer of output and classifies
+//! each one as ASCII, valid UTF-8 or invalid UTF-8 in the same pass
+//!
+//! SplitLines
+//!
+//! Newlines and non-ASCII bytes are found 32 bytes at a time with AVX2, or 16
+//! with SSE2, falling back to a scalar loop on other processors. Only lines
+//! that contain non-ASCII bytes are then checked byte by byte.
+//!
+//! @param[in] buffer
+//! @parblock
+//! The output to split.
+//! @endparblock
+//!
+//! @param[in] isFinal
+//! @parblock
+//! Whether the bytes after the last newline are the last line of the stream.
+//! Otherwise they are left for the next call.
+//! @endparblock
+//!
+//! @param[out] lines
+//! @parblock
+//! Receives up to linesLength lines, as offsets and lengths into buffer.
+//! @endparblock
+//!
+//! @param[out] consumed
+//! @parblock
+//! Receives the number of bytes covered by the returned lines. The caller
+//! passes the buffer starting from here again once it has more data.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t SplitLines(
+    const uint8_t* buffer,
+    int32_t length,
+    int32_t isFinal,
+    struct LineSpan* lines,
+    int32_t linesLength,
+    int32_t* lineCount,
+    int32_t* consumed)
+{
+    if ((buffer == nullptr && length != 0) || length < 0 || lines == nullptr || linesLength <= 0 ||
+        lineCount == nullptr || consumed == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    SplitState state = { buffer, 0, false, lines, linesLength, 0 };
+    size_t size = static_cast<size_t>(length);
+    size_t scanned = 0;
+
+#if HAVE_X86_SIMD
+    bool complete = HasAvx2() ? ScanAvx2(state, size, &scanned) : ScanSse2(state, size, &scanned);
+#else
+    bool complete = true;
+#endif
+
+    if (complete && ScanScalar(state, scanned, size, &scanned) && isFinal && state.LineStart < size)
+    {
+        EmitLine(state, size, size);
+    }
+
+    *lineCount = state.LineCount;
+    *consumed = static_cast<int32_t>(state.LineStart);
+    return 0;
+}
+
+struct LineReader
+{
+    int Fd;
+    uint8_t* Buffer;
+    size_t Capacity;
+    size_t Start;       // first byte not yet returned as part of a line
+    size_t End;         // end of the data read so far
+    size_t Scanned;     // end of the data already searched for a newline without finding one
+    bool EndOfFile;
+};
+
+//! @brief LineReaderCreate wraps a descriptor, typically a redirected stdout
+//! or stderr from ForkAndExecProcess, to read it line by line
+//!
+//! LineReaderCreate
+//!
+//! @param[in] fd
+//! @parblock
+//! The descriptor to read. It is not closed by LineReaderDestroy.
+//! @endparblock
+//!
+//! @param[in] bufferSize
+//! @parblock
+//! The initial buffer size, or 0 for 64 KiB. The buffer grows to fit lines
+//! longer than that.
+//! @endparblock
+//!
+//! @retval the reader, or NULL with errno set if unsuccessful
+//!
+struct LineReader* LineReaderCreate(int32_t fd, int32_t bufferSize)
+{
+    if (fd < 0 || bufferSize < 0)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    struct LineReader* reader = static_cast<struct LineReader*>(malloc(sizeof(struct LineReader)));
+    if (reader == nullptr)
+    {
+        return nullptr;
+    }
+
+    reader->Fd = fd;
+    reader->Capacity = bufferSize == 0 ? DefaultLineReaderBufferSize : static_cast<size_t>(bufferSize);
+    reader->Buffer = static_cast<uint8_t*>(malloc(reader->Capacity));
+    reader->Start = 0;
+    reader->End = 0;
+    reader->Scanned = 0;
+    reader->EndOfFile = false;
+    if (reader->Buffer == nullptr)
+    {
+        free(reader);
+        return nullptr;
+    }
+
+    return reader;
+}
+
+//! @brief LineReaderRead returns the next batch of complete lines
+//!
+//! LineReaderRead
+//!
+//! Blocks until at least one complete line is available or the descriptor
+//! reaches end of file. The returned lines point into the reader's buffer
+//! and stay valid until the next call.
+//!
+//! @param[out] buffer
+//! @parblock
+//! Receives the buffer the line offsets refer to.
+//! @endparblock
+//!
+//! @param[out] lines
+//! @parblock
+//! Receives up to linesLength lines.
+//! @endparblock
+//!
+//! @param[out] lineCount
+//! @parblock
+//! Receives the number of lines returned, 0 once the end of file was reached
+//! and every line has been returned.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t LineReaderRead(
+    struct LineReader* reader,
+    const uint8_t** buffer,
+    struct LineSpan* lines,
+    int32_t linesLength,
+    int32_t* lineCount)
+{
+    if (reader == nullptr || buffer == nullptr || lines == nullptr || linesLength <= 0 || lineCount == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *buffer = reader->Buffer;
+    *lineCount = 0;
+
+    // The caller is done with the previous batch, so the unconsumed tail can move to the front
+    if (reader->Start > 0)
+    {
+        memmove(reader->Buffer, reader->Buffer + reader->Start, reader->End - reader->Start);
+        reader->End -= reader->Start;
+        reader->Start = 0;
+        reader->Scanned = 0;
+    }
+
+    while (true)
+    {
+        // Only search the bytes read since the last search, so that a long line arriving
+        // in many reads is not scanned from its start again after each one
+        int32_t consumed;
+        if (!reader->EndOfFile && memchr(reader->Buffer + reader->Scanned, '\n', reader->End - reader->Scanned) == nullptr)
+        {
+            reader->Scanned = reader->End;
+        }
+        else if (reader->End > 0 &&
+                 SplitLines(reader->Buffer, static_cast<int32_t>(reader->End), reader->EndOfFile,
+                            lines, linesLength, lineCount, &consumed) == 0 &&
+                 *lineCount > 0)
+        {
+            reader->Start = static_cast<size_t>(consumed);
+            return 0;
+        }
+
+        if (reader->EndOfFile)
+        {
+            return 0;
+        }
+
+        // No complete line yet; make room for a longer one if the buffer is full
+        if (reader->End == reader->Capacity)
+        {
+            if (reader->Capacity > INT32_MAX / 2)
+            {
+                errno = ENOMEM;
+                return -1;
+            }
+
+            uint8_t* grown = static_cast<uint8_t*>(realloc(reader->Buffer, reader->Capacity * 2));
+            if (grown == nullptr)
+            {
+                return -1;
+            }
+
+            reader->Buffer = grown;
+            reader->Capacity *= 2;
+            *buffer = reader->Buffer;
+        }
+
+        ssize_t count;
+        while ((count = read(reader->Fd, reader->Buffer + reader->End, reader->Capacity - reader->End)) < 0 &&
+               errno == EINTR);
+        if (count < 0)
+        {
+            return -1;
+        }
+
+        if (count == 0)
+        {
+            reader->EndOfFile = true;
+        }
+        reader->End += static_cast<size_t>(count);
+    }
+}
+
+//! @brief LineReaderDestroy frees a reader created by LineReaderCreate
+//!
+//! LineReaderDestroy
+//!
+void LineReaderDestroy(struct LineReader* reader)
+{
+    if (reader != nullptr)
+    {
+        free(reader->Buffer);
+        free(reader);
+    }
+}
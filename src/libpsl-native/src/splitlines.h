@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Bits in LineSpan.Flags
+enum
+{
+    LINE_IS_ASCII = 0x00000001,         // the line only contains 7-bit characters
+    LINE_IS_INVALID_UTF8 = 0x00000002   // the line is not well-formed UTF-8
+};
+
+struct LineSpan
+{
+    int32_t Offset;     // offset of the first byte of the line in the buffer
+    int32_t Length;     // length of the line, without the "\n" or "\r\n" terminator
+    int32_t Flags;      // LINE_* bits
+};
+
+int32_t SplitLines(
+    const uint8_t* buffer,
+    int32_t length,
+    int32_t isFinal,                // whether bytes after the last newline form a line of their own
+    struct LineSpan* lines,         // [out] receives the lines found
+    int32_t linesLength,
+    int32_t* lineCount,             // [out] number of lines returned
+    int32_t* consumed);             // [out] number of bytes covered by the returned lines
+
+struct LineReader;
+
+struct LineReader* LineReaderCreate(int32_t fd, int32_t bufferSize);
+int32_t LineReaderRead(
+    struct LineReader* reader,
+    const uint8_t** buffer,         // [out] the buffer the returned lines point into
+    struct LineSpan* lines,         // [out] receives the lines read
+    int32_t linesLength,
+    int32_t* lineCount);            // [out] number of lines returned, 0 at end of file
+void LineReaderDestroy(struct LineReader* reader);
+
+PAL_END_EXTERNC
@@ -0,0 +1,364 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief feed large inputs to a child's standard input without extra copies
+
+#include "stdinfeeder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+
+namespace
+{
+    // Upper bound for a single transfer, well below what ssize_t can report
+    const size_t MaxChunkSize = 1 << 30;
+
+    // Size of the bounce buffer used when a file cannot be spliced
+    const size_t CopyBufferSize = 64 * 1024;
+}
+
+template <typename TInt>
+static inline bool CheckInterrupted(TInt result)
+{
+    return result < 0 && errno == EINTR;
+}
+
+static bool IsPipe(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+static int WaitWritable(int fd)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    int result;
+    while (CheckInterrupted(result = poll(&pfd, 1, -1)));
+    return result < 0 ? -1 : 0;
+}
+
+// Returns how many bytes can be written to fd right now without blocking, capped at
+// limit, for callers that must not block on a descriptor in blocking mode.
+static size_t GetWritableBytes(int fd, size_t limit)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags != -1 && (flags & O_NONBLOCK))
+    {
+        // write itself will stop short or fail with EAGAIN
+        return limit;
+    }
+
+#if defined(__linux__)
+    int capacity = fcntl(fd, F_GETPIPE_SZ);
+    int pending = 0;
+    if (capacity > 0 && ioctl(fd, FIONREAD, &pending) == 0)
+    {
+        return std::min(limit, static_cast<size_t>(capacity > pending ? capacity - pending : 0));
+    }
+#endif
+
+    // POLLOUT on a pipe guarantees room for at least PIPE_BUF bytes
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) == 1 ? std::min(limit, static_cast<size_t>(PIPE_BUF)) : 0;
+}
+
+static ssize_t WriteChunk(int fd, const uint8_t* data, size_t length, bool nonBlocking)
+{
+    if (nonBlocking)
+    {
+        length = GetWritableBytes(fd, length);
+        if (length == 0)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    ssize_t count;
+    while (CheckInterrupted(count = write(fd, data, length)));
+    return count;
+}
+
+// Handles a failed transfer: returns 0 if the caller should retry, or the value
+// the feeder should return.
+static int32_t HandleTransferError(int fd, bool nonBlocking)
+{
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        return -1;
+    }
+
+    if (nonBlocking)
+    {
+        return FEED_STDIN_BACKPRESSURE;
+    }
+
+    return WaitWritable(fd) == 0 ? 0 : -1;
+}
+
+//! @brief FeedStdinFromBuffer hands a buffer to a child's standard input
+//!
+//! FeedStdinFromBuffer
+//!
+//! When stdinFd is a pipe, the buffer's pages are spliced into it with
+//! vmsplice instead of being copied. The child then reads the caller's
+//! memory directly, so the buffer must stay pinned and unmodified until
+//! GetStdinPendingBytes reports that the child has consumed it. Pass
+//! FEED_STDIN_COPY to copy with write() when that cannot be guaranteed.
+//!
+//! @param[in] stdinFd
+//! @parblock
+//! The parent's end of the child's stdin, as returned by ForkAndExecProcess.
+//! @endparblock
+//!
+//! @param[in] flags
+//! @parblock
+//! FEED_STDIN_* bits. With FEED_STDIN_NONBLOCKING the call returns as soon as
+//! the child stops keeping up instead of waiting for it.
+//! @endparblock
+//!
+//! @param[out] written
+//! @parblock
+//! Receives the number of bytes handed to the child.
+//! @endparblock
+//!
+//! @retval FEED_STDIN_COMPLETE if the whole buffer was written
+//! @retval FEED_STDIN_BACKPRESSURE if FEED_STDIN_NONBLOCKING was set and the
+//! child's stdin is full; call again with the rest once it is writable
+//! @retval -1 if an error occurred, with errno set (EPIPE once the child
+//! has closed its stdin)
+//!
+int32_t FeedStdinFromBuffer(int32_t stdinFd, const uint8_t* buffer, int64_t length, int32_t flags, int64_t* written)
+{
+    if (stdinFd < 0 || (buffer == nullptr && length != 0) || length < 0 || written == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *written = 0;
+    bool nonBlocking = (flags & FEED_STDIN_NONBLOCKING) != 0;
+#if defined(__linux__)
+    bool useVmsplice = (flags & FEED_STDIN_COPY) == 0 && IsPipe(stdinFd);
+#endif
+
+    while (*written < length)
+    {
+        size_t chunk = std::min(static_cast<size_t>(length - *written), MaxChunkSize);
+        const uint8_t* data = buffer + *written;
+        ssize_t count;
+
+#if defined(__linux__)
+        if (useVmsplice)
+        {
+            struct iovec iov;
+            iov.iov_base = const_cast<uint8_t*>(data);
+            iov.iov_len = chunk;
+            while (CheckInterrupted(count = vmsplice(stdinFd, &iov, 1, SPLICE_F_NONBLOCK)));
+            if (count < 0 && (errno == ENOSYS || errno == EINVAL))
+            {
+                useVmsplice = false;
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            count = WriteChunk(stdinFd, data, chunk, nonBlocking);
+        }
+
+        if (count < 0)
+        {
+            int32_t result = HandleTransferError(stdinFd, nonBlocking);
+            if (result != 0)
+            {
+                return result;
+            }
+            continue;
+        }
+
+        *written += count;
+    }
+
+    return FEED_STDIN_COMPLETE;
+}
+
+//! @brief FeedStdinFromFile hands part of a file to a child's standard input
+//!
+//! FeedStdinFromFile
+//!
+//! The data moves from the page cache into the pipe with splice and never
+//! enters this process. Where splice is not available it is copied through a
+//! small bounce buffer.
+//!
+//! @param[in] sourceFd
+//! @parblock
+//! The file to read. Its file offset is not used or changed.
+//! @endparblock
+//!
+//! @param[in] offset
+//! @parblock
+//! Where in the file to start.
+//! @endparblock
+//!
+//! @param[in] length
+//! @parblock
+//! The number of bytes to feed, or -1 to feed up to the end of the file.
+//! @endparblock
+//!
+//! @param[out] written
+//! @parblock
+//! Receives the number of bytes handed to the child. The next call for the
+//! same file continues at offset + *written.
+//! @endparblock
+//!
+//! @retval FEED_STDIN_COMPLETE if the requested range (or the file up to its
+//! end) was written
+//! @retval FEED_STDIN_BACKPRESSURE if FEED_STDIN_NONBLOCKING was set and the
+//! child's stdin is full
+//! @retval -1 if an error occurred, with errno set
+//!
+int32_t FeedStdinFromFile(int32_t stdinFd, int32_t sourceFd, int64_t offset, int64_t length, int32_t flags, int64_t* written)
+{
+    if (stdinFd < 0 || sourceFd < 0 || offset < 0 || length < -1 || written == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *written = 0;
+    bool nonBlocking = (flags & FEED_STDIN_NONBLOCKING) != 0;
+    bool untilEnd = length == -1;
+    uint8_t* copyBuffer = nullptr;
+    int32_t result = FEED_STDIN_COMPLETE;
+#if defined(__linux__)
+    bool useSplice = IsPipe(stdinFd);
+#endif
+
+    while (untilEnd || *written < length)
+    {
+        size_t chunk = untilEnd ? MaxChunkSize : std::min(static_cast<size_t>(length - *written), MaxChunkSize);
+        off_t position = static_cast<off_t>(offset + *written);
+        ssize_t count;
+
+#if defined(__linux__)
+        if (useSplice)
+        {
+            while (CheckInterrupted(count = splice(sourceFd, &position, stdinFd, nullptr, chunk,
+                                                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK)));
+            if (count < 0 && (errno == ENOSYS || errno == EINVAL))
+            {
+                useSplice = false;
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            if (copyBuffer == nullptr && (copyBuffer = new (std::nothrow) uint8_t[CopyBufferSize]) == nullptr)
+            {
+                errno = ENOMEM;
+                result = -1;
+                break;
+            }
+
+            chunk = std::min(chunk, CopyBufferSize);
+            if (nonBlocking && (chunk = GetWritableBytes(stdinFd, chunk)) == 0)
+            {
+                result = FEED_STDIN_BACKPRESSURE;
+                break;
+            }
+
+            while (CheckInterrupted(count = pread(sourceFd, copyBuffer, chunk, position)));
+            if (count < 0)
+            {
+                result = -1;
+                break;
+            }
+
+            // Whatever was read has to reach the child before we can report it as written
+            ssize_t copied = 0;
+            while (copied < count)
+            {
+                ssize_t sent = WriteChunk(stdinFd, copyBuffer + copied, count - copied, false);
+                if (sent < 0 && (result = HandleTransferError(stdinFd, false)) != 0)
+                {
+                    break;
+                }
+                copied += sent > 0 ? sent : 0;
+            }
+
+            if (result != 0)
+            {
+                break;
+            }
+        }
+
+        if (count == 0)
+        {
+            // End of the file
+            break;
+        }
+
+        if (count < 0)
+        {
+            result = HandleTransferError(stdinFd, nonBlocking);
+            if (result != 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        *written += count;
+    }
+
+    int priorErrno = errno;
+    delete[] copyBuffer;
+    errno = priorErrno;
+    return result;
+}
+
+//! @brief GetStdinPendingBytes returns how much data the child has not read
+//! from its stdin yet
+//!
+//! GetStdinPendingBytes
+//!
+//! Once this reaches 0, every buffer handed to FeedStdinFromBuffer has been
+//! consumed and can be reused.
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t GetStdinPendingBytes(int32_t stdinFd, int32_t* pending)
+{
+    if (pending == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int count = 0;
+    if (ioctl(stdinFd, FIONREAD, &count) != 0)
+    {
+        return -1;
+    }
+
+    *pending = count;
+    return 0;
+}
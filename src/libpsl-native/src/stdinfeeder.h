@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Bits for the flags argument of the feeders
+enum
+{
+    FEED_STDIN_NONBLOCKING = 0x00000001,    // return FEED_STDIN_BACKPRESSURE instead of waiting for the child
+    FEED_STDIN_COPY = 0x00000002            // copy the buffer so it can be reused as soon as the call returns
+};
+
+enum
+{
+    FEED_STDIN_COMPLETE = 0,                // everything was handed to the child
+    FEED_STDIN_BACKPRESSURE = 1             // the child's stdin is full, *written says how far we got
+};
+
+int32_t FeedStdinFromBuffer(int32_t stdinFd, const uint8_t* buffer, int64_t length, int32_t flags, int64_t* written);
+int32_t FeedStdinFromFile(int32_t stdinFd, int32_t sourceFd, int64_t offset, int64_t length, int32_t flags, int64_t* written);
+int32_t GetStdinPendingBytes(int32_t stdinFd, int32_t* pending);
+
+PAL_END_EXTERNC
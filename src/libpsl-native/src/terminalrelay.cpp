@@ -0,0 +1,459 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief relay data between a pseudo-terminal and the caller's descriptors
+
+#include "terminalrelay.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include <vector>
+
+namespace
+{
+    const size_t DefaultBufferSize = 64 * 1024;
+}
+
+struct TerminalRelay
+{
+    int MasterFd = -1;
+    int InputFd = -1;
+    int OutputFd = -1;
+    int WakeFds[2] = { -1, -1 };
+    std::vector<uint8_t> OutputBuffer;
+    std::vector<uint8_t> InputBuffer;
+    size_t InputOffset = 0;         // start of the input not yet written to the terminal
+    size_t InputLength = 0;         // end of the input not yet written to the terminal
+    bool InputOpen = false;
+};
+
+template <typename TInt>
+static inline bool CheckInterrupted(TInt result)
+{
+    return result < 0 && errno == EINTR;
+}
+
+static int64_t GetMonotonicMilliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int SetNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags == -1 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Writes all of data to fd, waiting for it to become writable if it is nonblocking
+static int WriteAll(int fd, const uint8_t* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t count;
+        while (CheckInterrupted(count = write(fd, data, length)));
+        if (count < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return -1;
+            }
+
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            int result;
+            while (CheckInterrupted(result = poll(&pfd, 1, -1)));
+            if (result < 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        data += count;
+        length -= static_cast<size_t>(count);
+    }
+
+    return 0;
+}
+
+// Reads everything the terminal has to offer, up to a full buffer, and hands it to the
+// output descriptor in a single write.  Coalescing the small writes a terminal program
+// typically makes keeps the number of writes, and wakeups of whoever reads the output,
+// low.  Returns 1 once the terminal has been hung up, 0 if it may have more, -1 on error.
+static int DrainTerminal(TerminalRelay* relay)
+{
+    size_t gathered = 0;
+    int state = 0;
+    while (gathered < relay->OutputBuffer.size())
+    {
+        ssize_t count;
+        while (CheckInterrupted(count = read(relay->MasterFd, relay->OutputBuffer.data() + gathered,
+                                             relay->OutputBuffer.size() - gathered)));
+        if (count > 0)
+        {
+            gathered += static_cast<size_t>(count);
+            continue;
+        }
+
+        // Linux reports EIO on the master once the last slave descriptor is closed
+        if (count == 0 || errno == EIO)
+        {
+            state = 1;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            state = -1;
+        }
+        break;
+    }
+
+    if (gathered > 0 && WriteAll(relay->OutputFd, relay->OutputBuffer.data(), gathered) == -1)
+    {
+        return -1;
+    }
+
+    return state;
+}
+
+// Reads the next block of input, or passes end of input on to the terminal as its
+// EOF character so that a program reading in canonical mode sees it too
+static int ReadInput(TerminalRelay* relay)
+{
+    ssize_t count;
+    while (CheckInterrupted(count = read(relay->InputFd, relay->InputBuffer.data(), relay->InputBuffer.size())));
+    if (count > 0)
+    {
+        relay->InputOffset = 0;
+        relay->InputLength = static_cast<size_t>(count);
+        return 0;
+    }
+
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return 0;
+    }
+
+    if (count < 0 && errno != EIO)
+    {
+        return -1;
+    }
+
+    relay->InputOpen = false;
+    struct termios attributes;
+    if (tcgetattr(relay->MasterFd, &attributes) == 0)
+    {
+        relay->InputBuffer[0] = attributes.c_cc[VEOF];
+        relay->InputOffset = 0;
+        relay->InputLength = 1;
+    }
+    return 0;
+}
+
+// Writes as much pending input to the terminal as it takes without blocking.  Input is
+// never written with a blocking write, as the program may itself be blocked writing
+// output that only the relay can drain.
+static int WriteInput(TerminalRelay* relay)
+{
+    ssize_t count;
+    while (CheckInterrupted(count = write(relay->MasterFd, relay->InputBuffer.data() + relay->InputOffset,
+                                          relay->InputLength - relay->InputOffset)));
+    if (count < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EIO ? 0 : -1;
+    }
+
+    relay->InputOffset += static_cast<size_t>(count);
+    if (relay->InputOffset == relay->InputLength)
+    {
+        relay->InputOffset = 0;
+        relay->InputLength = 0;
+    }
+    return 0;
+}
+
+//! @brief TerminalRelayCreate prepares a relay between a pseudo-terminal and
+//! the caller's descriptors
+//!
+//! TerminalRelayCreate
+//!
+//! The relay does not take ownership of the descriptors. The master is put
+//! into nonblocking mode.
+//!
+//! @param[in] masterFd
+//! @parblock
+//! The master returned by ForkAndExecProcessInTerminal.
+//! @endparblock
+//!
+//! @param[in] inputFd
+//! @parblock
+//! Data read from here is written to the terminal, typically the caller's own
+//! terminal or a pipe. End of input is passed on as the terminal's EOF
+//! character. -1 sends no input.
+//! @endparblock
+//!
+//! @param[in] outputFd
+//! @parblock
+//! Receives everything the programs on the terminal write to it, escape
+//! sequences included.
+//! @endparblock
+//!
+//! @param[in] bufferSize
+//! @parblock
+//! The most output gathered from the terminal before it is written to
+//! outputFd, or 0 for the default of 64 KiB.
+//! @endparblock
+//!
+//! @retval the relay, or NULL with errno set if unsuccessful
+//!
+struct TerminalRelay* TerminalRelayCreate(int32_t masterFd, int32_t inputFd, int32_t outputFd, int32_t bufferSize)
+{
+    if (masterFd < 0 || inputFd < -1 || outputFd < 0 || bufferSize < 0)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    TerminalRelay* relay = new (std::nothrow) TerminalRelay();
+    if (relay == nullptr)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    relay->MasterFd = masterFd;
+    relay->InputFd = inputFd;
+    relay->OutputFd = outputFd;
+    relay->InputOpen = inputFd != -1;
+
+    size_t size = bufferSize != 0 ? static_cast<size_t>(bufferSize) : DefaultBufferSize;
+    try
+    {
+        relay->OutputBuffer.resize(size);
+        relay->InputBuffer.resize(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        delete relay;
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    if (pipe(relay->WakeFds) == -1 ||
+        fcntl(relay->WakeFds[0], F_SETFD, FD_CLOEXEC) == -1 ||
+        fcntl(relay->WakeFds[1], F_SETFD, FD_CLOEXEC) == -1 ||
+        SetNonBlocking(relay->WakeFds[0]) == -1 ||
+        SetNonBlocking(relay->WakeFds[1]) == -1 ||
+        SetNonBlocking(masterFd) == -1)
+    {
+        TerminalRelayDestroy(relay);
+        return nullptr;
+    }
+
+    return relay;
+}
+
+//! @brief TerminalRelayRun relays data until the terminal is hung up, the
+//! timeout elapses or the relay is stopped
+//!
+//! TerminalRelayRun
+//!
+//! Output is gathered from the terminal in batches of up to the relay's
+//! buffer size. Input is only read once the previous block has been taken
+//! by the terminal, so a program that does not read its input cannot make
+//! the relay buffer without bound.
+//!
+//! @param[in] timeoutMilliseconds
+//! @parblock
+//! How long to relay before returning, or -1 to relay until the terminal is
+//! hung up or TerminalRelayStop is called.
+//! @endparblock
+//!
+//! @retval TERMINAL_RELAY_CLOSED, TERMINAL_RELAY_TIMEOUT or
+//! TERMINAL_RELAY_STOPPED, or -1 with errno set if unsuccessful
+//!
+int32_t TerminalRelayRun(struct TerminalRelay* relay, int32_t timeoutMilliseconds)
+{
+    if (relay == nullptr || timeoutMilliseconds < -1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int64_t deadline = timeoutMilliseconds == -1 ? -1 : GetMonotonicMilliseconds() + timeoutMilliseconds;
+    while (true)
+    {
+        bool inputPending = relay->InputOffset < relay->InputLength;
+
+        struct pollfd pfds[3];
+        memset(pfds, 0, sizeof(pfds));
+        pfds[0].fd = relay->WakeFds[0];
+        pfds[0].events = POLLIN;
+        pfds[1].fd = relay->MasterFd;
+        pfds[1].events = static_cast<short>(POLLIN | (inputPending ? POLLOUT : 0));
+        pfds[2].fd = relay->InputOpen && !inputPending ? relay->InputFd : -1;
+        pfds[2].events = POLLIN;
+
+        int timeout = -1;
+        if (deadline != -1)
+        {
+            int64_t remaining = deadline - GetMonotonicMilliseconds();
+            timeout = remaining > 0 ? static_cast<int>(remaining) : 0;
+        }
+
+        int result = poll(pfds, 3, timeout);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        if (result == 0)
+        {
+            return TERMINAL_RELAY_TIMEOUT;
+        }
+
+        if (pfds[0].revents != 0)
+        {
+            uint8_t drain[64];
+            while (read(relay->WakeFds[0], drain, sizeof(drain)) > 0);
+            return TERMINAL_RELAY_STOPPED;
+        }
+
+        if (pfds[1].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            int state = DrainTerminal(relay);
+            if (state != 0)
+            {
+                return state == 1 ? TERMINAL_RELAY_CLOSED : -1;
+            }
+        }
+
+        if ((pfds[1].revents & POLLOUT) && WriteInput(relay) == -1)
+        {
+            return -1;
+        }
+
+        if ((pfds[2].revents & (POLLIN | POLLHUP | POLLERR)) && ReadInput(relay) == -1)
+        {
+            return -1;
+        }
+    }
+}
+
+//! @brief TerminalRelayResize changes the window size of the relayed terminal
+//!
+//! TerminalRelayResize
+//!
+//! The kernel sends SIGWINCH to the terminal's foreground process group.
+//! Safe to call from any thread, including while TerminalRelayRun is running.
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t TerminalRelayResize(struct TerminalRelay* relay, int32_t columns, int32_t rows)
+{
+    if (relay == nullptr || columns < 0 || columns > USHRT_MAX || rows < 0 || rows > USHRT_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct winsize size;
+    memset(&size, 0, sizeof(size));
+    size.ws_col = static_cast<unsigned short>(columns);
+    size.ws_row = static_cast<unsigned short>(rows);
+    return ioctl(relay->MasterFd, TIOCSWINSZ, &size);
+}
+
+//! @brief TerminalRelaySyncWindowSize copies the window size of another
+//! terminal, typically the caller's own, to the relayed terminal
+//!
+//! TerminalRelaySyncWindowSize
+//!
+//! Call this when the caller's terminal reports SIGWINCH, so that the
+//! programs on the relayed terminal lay out their output for the window the
+//! user actually sees.
+//!
+//! @retval 0 if successful, -1 otherwise with errno set (ENOTTY if
+//! terminalFd is not a terminal)
+//!
+int32_t TerminalRelaySyncWindowSize(struct TerminalRelay* relay, int32_t terminalFd)
+{
+    if (relay == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct winsize size;
+    if (ioctl(terminalFd, TIOCGWINSZ, &size) == -1)
+    {
+        return -1;
+    }
+
+    return ioctl(relay->MasterFd, TIOCSWINSZ, &size);
+}
+
+//! @brief TerminalRelayStop makes a running or the next call to
+//! TerminalRelayRun return TERMINAL_RELAY_STOPPED
+//!
+//! TerminalRelayStop
+//!
+//! Safe to call from any thread.
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t TerminalRelayStop(struct TerminalRelay* relay)
+{
+    if (relay == nullptr)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint8_t value = 1;
+    ssize_t result;
+    while (CheckInterrupted(result = write(relay->WakeFds[1], &value, sizeof(value))));
+
+    // A full pipe already has a wakeup pending
+    return result < 0 && errno != EAGAIN ? -1 : 0;
+}
+
+//! @brief TerminalRelayDestroy frees a relay
+//!
+//! TerminalRelayDestroy
+//!
+//! TerminalRelayRun must not be running. The terminal and the caller's
+//! descriptors are left open.
+//!
+void TerminalRelayDestroy(struct TerminalRelay* relay)
+{
+    if (relay == nullptr)
+    {
+        return;
+    }
+
+    for (int fd : relay->WakeFds)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    delete relay;
+}
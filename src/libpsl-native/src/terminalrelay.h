@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Values returned by TerminalRelayRun
+enum
+{
+    TERMINAL_RELAY_CLOSED = 0,          // the terminal was hung up, every process on it has closed it
+    TERMINAL_RELAY_TIMEOUT = 1,         // the timeout elapsed
+    TERMINAL_RELAY_STOPPED = 2          // TerminalRelayStop was called
+};
+
+struct TerminalRelay;
+
+struct TerminalRelay* TerminalRelayCreate(
+    int32_t masterFd,               // the pseudo-terminal master from ForkAndExecProcessInTerminal
+    int32_t inputFd,                // read and sent to the terminal, -1 for none
+    int32_t outputFd,               // receives everything written to the terminal
+    int32_t bufferSize);            // bytes gathered from the terminal before each write, 0 for the default
+int32_t TerminalRelayRun(struct TerminalRelay* relay, int32_t timeoutMilliseconds);
+int32_t TerminalRelayResize(struct TerminalRelay* relay, int32_t columns, int32_t rows);
+int32_t TerminalRelaySyncWindowSize(struct TerminalRelay* relay, int32_t terminalFd);
+int32_t TerminalRelayStop(struct TerminalRelay* relay);
+void TerminalRelayDestroy(struct TerminalRelay* relay);
+
+PAL_END_EXTERNC
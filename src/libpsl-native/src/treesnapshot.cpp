@@ -0,0 +1,639 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief capture the state of a directory tree and compare it with another
+
+#include "treesnapshot.h"
+#include "directoryfilter.h"
+#include "fileio.h"
+#include "treewalker.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    const char SnapshotMagic[8] = { 'P', 'S', 'L', 'S', 'N', 'A', 'P', '1' };
+    const uint32_t SnapshotVersion = 1;
+
+    // The file starts with a header, followed by RecordCount records and then
+    // PathsLength bytes of null terminated paths.  Records are sorted by path hash,
+    // then by path, so that two snapshots are compared in a single merge.
+    struct SnapshotHeader
+    {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t RecordSize;
+        uint64_t RecordCount;
+        uint64_t PathsLength;
+    };
+
+    struct SnapshotRecord
+    {
+        uint64_t PathHash;
+        uint64_t Device;
+        uint64_t Inode;
+        int64_t Size;
+        int64_t ModifiedTime;           // nanoseconds since the epoch
+        uint64_t PathOffset;            // relative to the root
+        uint32_t PathLength;
+        uint32_t Mode;
+    };
+
+    // A snapshot, either mapped from a file or captured from the live tree
+    struct SnapshotView
+    {
+        const SnapshotRecord* Records;
+        size_t Count;
+        const char* Paths;
+    };
+
+    struct PendingChange
+    {
+        int32_t Kind;
+        const SnapshotRecord* Record;   // the entry as it is now, or was if removed
+        const char* Path;
+        const char* OldPath;
+        size_t OldPathLength;
+    };
+}
+
+struct TreeSnapshot
+{
+    void* Map;
+    size_t MapLength;
+    SnapshotView View;
+};
+
+// FNV-1a, which is quick on short strings such as paths
+static uint64_t HashPath(const char* path, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<unsigned char>(path[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int CompareRecords(const SnapshotRecord& left, const char* leftPaths, const SnapshotRecord& right, const char* rightPaths)
+{
+    if (left.PathHash != right.PathHash)
+    {
+        return left.PathHash < right.PathHash ? -1 : 1;
+    }
+    return strcmp(leftPaths + left.PathOffset, rightPaths + right.PathOffset);
+}
+
+// Records a snapshot entry for everything the walk finds, and the first directory
+// that could not be read
+class SnapshotCollector : public TreeVisitor
+{
+public:
+    SnapshotCollector(std::vector<SnapshotRecord>& records, std::string& paths)
+        : m_records(records), m_paths(paths), m_error(0)
+    {
+    }
+
+    int GetError() const
+    {
+        return m_error;
+    }
+
+    void Visit(const WalkDirectory& directory, std::vector<WalkEntry>& entries) override
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (directory.Error != 0 && m_error == 0)
+        {
+            m_error = directory.Error;
+        }
+
+        for (const WalkEntry& entry : entries)
+        {
+            SnapshotRecord record;
+            record.PathOffset = m_paths.size();
+            if (!directory.Path.empty())
+            {
+                m_paths.append(directory.Path).append(1, '/');
+            }
+            m_paths.append(entry.Name);
+            record.PathLength = static_cast<uint32_t>(m_paths.size() - record.PathOffset);
+            record.PathHash = HashPath(m_paths.data() + record.PathOffset, record.PathLength);
+            m_paths.append(1, '\0');
+
+            record.Device = static_cast<uint64_t>(entry.Stat.st_dev);
+            record.Inode = static_cast<uint64_t>(entry.Stat.st_ino);
+            record.Size = entry.Stat.st_size;
+            record.ModifiedTime = GetModifiedTimeNanoseconds(entry.Stat);
+            record.Mode = static_cast<uint32_t>(entry.Stat.st_mode);
+            m_records.push_back(record);
+        }
+    }
+
+private:
+    std::mutex m_lock;
+    std::vector<SnapshotRecord>& m_records;
+    std::string& m_paths;
+    int m_error;
+};
+
+// Walks the tree and sorts what it found into snapshot order.  Returns false with errno set,
+// also when a directory could not be read: a snapshot missing its entries would have them
+// reported as removed.
+static bool CaptureTree(const char* root, int32_t threadCount, std::vector<SnapshotRecord>& records, std::string& paths)
+{
+    SnapshotCollector collector(records, paths);
+    if (!WalkTree(root, threadCount, false, 0, collector))
+    {
+        return false;
+    }
+    if (collector.GetError() != 0)
+    {
+        errno = collector.GetError();
+        return false;
+    }
+
+    const char* data = paths.data();
+    std::sort(records.begin(), records.end(), [data](const SnapshotRecord& left, const SnapshotRecord& right)
+    {
+        return CompareRecords(left, data, right, data) < 0;
+    });
+    return true;
+}
+
+//! @brief TreeSnapshotCapture records the state of every entry in a
+//! directory tree to a file
+//!
+//! TreeSnapshotCapture
+//!
+//! Each entry is recorded with a hash of its path relative to the root, its
+//! device, inode, size, modification time and mode. The tree is walked with
+//! several threads; symbolic links are recorded, not followed. The capture
+//! fails if any directory in the tree cannot be read.
+//!
+//! @param[in] root
+//! @parblock
+//! The directory to capture.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @param[in] snapshotPath
+//! @parblock
+//! The file to write. It is replaced atomically.
+//! @endparblock
+//!
+//! @param[in] threadCount
+//! @parblock
+//! How many directories to read at a time, 0 for one per processor.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set (the error of the
+//! first directory that could not be read, if that is what failed)
+//!
+int32_t TreeSnapshotCapture(const char* root, const char* snapshotPath, int32_t threadCount)
+{
+    assert(root && snapshotPath);
+    if (root == nullptr || snapshotPath == nullptr || threadCount < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    try
+    {
+        std::vector<SnapshotRecord> records;
+        std::string paths;
+        if (!CaptureTree(root, threadCount, records, paths))
+        {
+            return -1;
+        }
+
+        SnapshotHeader header = {};
+        memcpy(header.Magic, SnapshotMagic, sizeof(header.Magic));
+        header.Version = SnapshotVersion;
+        header.RecordSize = sizeof(SnapshotRecord);
+        header.RecordCount = records.size();
+        header.PathsLength = paths.size();
+
+        FileSection sections[] =
+        {
+            { &header, sizeof(header) },
+            { records.data(), records.size() * sizeof(SnapshotRecord) },
+            { paths.data(), paths.size() }
+        };
+        if (!WriteFileAtomically(snapshotPath, sections, 3))
+        {
+            return -1;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool IsValidSnapshot(const SnapshotView& view, size_t pathsLength)
+{
+    for (size_t i = 0; i < view.Count; i++)
+    {
+        const SnapshotRecord& record = view.Records[i];
+        if (record.PathOffset >= pathsLength || record.PathLength >= pathsLength - record.PathOffset ||
+            view.Paths[record.PathOffset + record.PathLength] != '\0' ||
+            (i > 0 && CompareRecords(view.Records[i - 1], view.Paths, record, view.Paths) >= 0))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//! @brief TreeSnapshotOpen opens a snapshot written by TreeSnapshotCapture
+//!
+//! TreeSnapshotOpen
+//!
+//! The file is mapped into memory rather than read.
+//!
+//! @retval the snapshot, or NULL with errno set if unsuccessful (EINVAL if
+//! the file is not a valid snapshot)
+//!
+struct TreeSnapshot* TreeSnapshotOpen(const char* snapshotPath)
+{
+    assert(snapshotPath);
+    if (snapshotPath == nullptr)
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    int fd = open(snapshotPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int priorErrno = errno;
+        close(fd);
+        errno = priorErrno;
+        return nullptr;
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    if (!S_ISREG(st.st_mode) || length < sizeof(SnapshotHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    void* map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    int priorErrno = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = priorErrno;
+        return nullptr;
+    }
+
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(map);
+    size_t available = length - sizeof(SnapshotHeader);
+    const char* records = static_cast<const char*>(map) + sizeof(SnapshotHeader);
+    SnapshotView view = {};
+    bool valid = memcmp(header->Magic, SnapshotMagic, sizeof(SnapshotMagic)) == 0 && header->Version == SnapshotVersion &&
+                 header->RecordSize == sizeof(SnapshotRecord) && header->RecordCount <= available / sizeof(SnapshotRecord) &&
+                 header->PathsLength == available - header->RecordCount * sizeof(SnapshotRecord);
+    if (valid)
+    {
+        view.Records = reinterpret_cast<const SnapshotRecord*>(records);
+        view.Count = header->RecordCount;
+        view.Paths = records + header->RecordCount * sizeof(SnapshotRecord);
+        valid = IsValidSnapshot(view, header->PathsLength);
+    }
+
+    if (!valid)
+    {
+        munmap(map, length);
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    TreeSnapshot* snapshot = new (std::nothrow) TreeSnapshot();
+    if (snapshot == nullptr)
+    {
+        munmap(map, length);
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    snapshot->Map = map;
+    snapshot->MapLength = length;
+    snapshot->View = view;
+    return snapshot;
+}
+
+// Directories change their mtime and size whenever an entry is added or removed,
+// which the entries themselves already report, so only their mode counts
+static bool IsModified(const SnapshotRecord& older, const SnapshotRecord& newer, bool ignoreInodes)
+{
+    if (older.Mode != newer.Mode)
+    {
+        return true;
+    }
+    if (S_ISDIR(static_cast<mode_t>(newer.Mode)))
+    {
+        return false;
+    }
+    return older.Size != newer.Size || older.ModifiedTime != newer.ModifiedTime ||
+           (!ignoreInodes && (older.Device != newer.Device || older.Inode != newer.Inode));
+}
+
+// A removed and an added entry are the same one renamed if they share an inode and,
+// to guard against inode reuse, a file also kept its size and modification time
+static bool IsSameEntry(const SnapshotRecord& removed, const SnapshotRecord& added)
+{
+    return (removed.Mode & S_IFMT) == (added.Mode & S_IFMT) &&
+           (S_ISDIR(static_cast<mode_t>(added.Mode)) ||
+            (removed.Size == added.Size && removed.ModifiedTime == added.ModifiedTime));
+}
+
+static int32_t DiffViews(const SnapshotView& older, const SnapshotView& newer, int32_t flags, struct TreeDiff** diff)
+{
+    bool ignoreInodes = (flags & TREE_DIFF_IGNORE_INODES) != 0;
+    std::vector<PendingChange> changes;
+    std::vector<size_t> removed;
+    std::vector<size_t> added;
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < older.Count || j < newer.Count)
+    {
+        int order = i == older.Count ? 1 :
+                    j == newer.Count ? -1 :
+                    CompareRecords(older.Records[i], older.Paths, newer.Records[j], newer.Paths);
+        if (order < 0)
+        {
+            removed.push_back(i++);
+        }
+        else if (order > 0)
+        {
+            added.push_back(j++);
+        }
+        else
+        {
+            const SnapshotRecord& record = newer.Records[j];
+            if (IsModified(older.Records[i], record, ignoreInodes))
+            {
+                changes.push_back(PendingChange { TREE_CHANGE_MODIFIED, &record, newer.Paths + record.PathOffset, nullptr, 0 });
+            }
+            i++;
+            j++;
+        }
+    }
+
+    // Pair removed and added entries that are the same inode under a new name
+    std::unordered_map<uint64_t, std::vector<size_t>> removedByInode;
+    std::vector<bool> renamed(removed.size(), false);
+    if (!ignoreInodes)
+    {
+        for (size_t k = 0; k < removed.size(); k++)
+        {
+            removedByInode[older.Records[removed[k]].Inode].push_back(k);
+        }
+    }
+
+    for (size_t index : added)
+    {
+        const SnapshotRecord& record = newer.Records[index];
+        PendingChange change = { TREE_CHANGE_ADDED, &record, newer.Paths + record.PathOffset, nullptr, 0 };
+        auto candidates = removedByInode.find(record.Inode);
+        if (candidates != removedByInode.end())
+        {
+            for (size_t k : candidates->second)
+            {
+                const SnapshotRecord& old = older.Records[removed[k]];
+                if (!renamed[k] && old.Device == record.Device && IsSameEntry(old, record))
+                {
+                    renamed[k] = true;
+                    change.Kind = TREE_CHANGE_RENAMED;
+                    change.OldPath = older.Paths + old.PathOffset;
+                    change.OldPathLength = old.PathLength;
+                    break;
+                }
+            }
+        }
+        changes.push_back(change);
+    }
+
+    for (size_t k = 0; k < removed.size(); k++)
+    {
+        if (!renamed[k])
+        {
+            const SnapshotRecord& record = older.Records[removed[k]];
+            changes.push_back(PendingChange { TREE_CHANGE_REMOVED, &record, older.Paths + record.PathOffset, nullptr, 0 });
+        }
+    }
+
+    std::sort(changes.begin(), changes.end(), [](const PendingChange& left, const PendingChange& right)
+    {
+        return strcmp(left.Path, right.Path) < 0;
+    });
+
+    size_t pathsLength = 0;
+    for (const PendingChange& change : changes)
+    {
+        pathsLength += change.Record->PathLength + 1 + (change.OldPath != nullptr ? change.OldPathLength + 1 : 0);
+    }
+    if (changes.size() > static_cast<size_t>(INT32_MAX) || pathsLength > static_cast<size_t>(INT32_MAX))
+    {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    TreeDiff* result = static_cast<TreeDiff*>(calloc(1, sizeof(TreeDiff)));
+    if (result == nullptr ||
+        (result->Changes = static_cast<TreeChange*>(malloc(changes.size() * sizeof(TreeChange) + 1))) == nullptr ||
+        (result->Paths = static_cast<char*>(malloc(pathsLength + 1))) == nullptr)
+    {
+        FreeTreeDiff(result);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    size_t offset = 0;
+    result->Count = static_cast<int32_t>(changes.size());
+    for (size_t k = 0; k < changes.size(); k++)
+    {
+        const PendingChange& change = changes[k];
+        TreeChange& out = result->Changes[k];
+        out.Kind = change.Kind;
+        out.PathOffset = static_cast<int32_t>(offset);
+        out.PathLength = static_cast<int32_t>(change.Record->PathLength);
+        memcpy(result->Paths + offset, change.Path, change.Record->PathLength + 1);
+        offset += change.Record->PathLength + 1;
+
+        out.OldPathOffset = -1;
+        out.OldPathLength = 0;
+        if (change.OldPath != nullptr)
+        {
+            out.OldPathOffset = static_cast<int32_t>(offset);
+            out.OldPathLength = static_cast<int32_t>(change.OldPathLength);
+            memcpy(result->Paths + offset, change.OldPath, change.OldPathLength + 1);
+            offset += change.OldPathLength + 1;
+        }
+
+        out.Mode = static_cast<int32_t>(change.Record->Mode);
+        out.Size = change.Record->Size;
+        out.ModifiedTime = change.Record->ModifiedTime;
+        out.Inode = static_cast<int64_t>(change.Record->Inode);
+    }
+
+    *diff = result;
+    return 0;
+}
+
+//! @brief TreeSnapshotDiff compares two snapshots
+//!
+//! TreeSnapshotDiff
+//!
+//! Entries are matched by their path relative to the root, so the snapshots
+//! may be of different roots, such as a tree and its mirror. An entry is
+//! modified if its type, mode, size or modification time changed, or if it
+//! is now a different inode. Directories only count as modified if their
+//! mode changed. A removed and an added entry that are the same inode, with
+//! the same size and modification time, are reported as one rename.
+//!
+//! @param[in] flags
+//! @parblock
+//! TREE_DIFF_IGNORE_INODES when the snapshots are of different copies of a
+//! tree. Inodes then neither make an entry modified nor detect renames.
+//! @endparblock
+//!
+//! @param[out] diff
+//! @parblock
+//! Receives the changes from older to newer. Free it with FreeTreeDiff.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t TreeSnapshotDiff(const struct TreeSnapshot* older, const struct TreeSnapshot* newer, int32_t flags, struct TreeDiff** diff)
+{
+    assert(older && newer && diff);
+    if (older == nullptr || newer == nullptr || diff == nullptr || (flags & ~TREE_DIFF_IGNORE_INODES) != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *diff = nullptr;
+
+    try
+    {
+        return DiffViews(older->View, newer->View, flags, diff);
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+}
+
+//! @brief TreeSnapshotDiffLive compares a snapshot with the tree as it is now
+//!
+//! TreeSnapshotDiffLive
+//!
+//! Behaves like TreeSnapshotDiff, with the tree walked, with several threads,
+//! in place of the newer snapshot. Fails if any directory in the tree cannot
+//! be read, rather than report its entries as removed.
+//!
+//! @param[in] root
+//! @parblock
+//! The directory to compare the snapshot with.
+//!
+//! char* is marshaled as an LPStr, which on Linux is UTF-8.
+//! @endparblock
+//!
+//! @retval 0 if successful, -1 otherwise with errno set
+//!
+int32_t TreeSnapshotDiffLive(const struct TreeSnapshot* snapshot, const char* root, int32_t flags, int32_t threadCount, struct TreeDiff** diff)
+{
+    assert(snapshot && root && diff);
+    if (snapshot == nullptr || root == nullptr || diff == nullptr || threadCount < 0 ||
+        (flags & ~TREE_DIFF_IGNORE_INODES) != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *diff = nullptr;
+
+    try
+    {
+        std::vector<SnapshotRecord> records;
+        std::string paths;
+        if (!CaptureTree(root, threadCount, records, paths))
+        {
+            return -1;
+        }
+
+        SnapshotView live = { records.data(), records.size(), paths.data() };
+        return DiffViews(snapshot->View, live, flags, diff);
+    }
+    catch (const std::bad_alloc&)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+}
+
+//! @brief FreeTreeDiff frees the changes returned by TreeSnapshotDiff or
+//! TreeSnapshotDiffLive
+//!
+//! FreeTreeDiff
+//!
+void FreeTreeDiff(struct TreeDiff* diff)
+{
+    if (diff == nullptr)
+    {
+        return;
+    }
+
+    free(diff->Changes);
+    free(diff->Paths);
+    free(diff);
+}
+
+//! @brief TreeSnapshotClose closes a snapshot
+//!
+//! TreeSnapshotClose
+//!
+void TreeSnapshotClose(struct TreeSnapshot* snapshot)
+{
+    if (snapshot == nullptr)
+    {
+        return;
+    }
+
+    munmap(snapshot->Map, snapshot->MapLength);
+    delete snapshot;
+}
@@ -0,0 +1,63 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+
+PAL_BEGIN_EXTERNC
+
+// Flags for TreeSnapshotDiff and TreeSnapshotDiffLive
+enum
+{
+    TREE_DIFF_IGNORE_INODES = 0x00000001    // the trees are different copies; compare content stamps only
+};
+
+// Values of TreeChange.Kind
+enum
+{
+    TREE_CHANGE_ADDED = 1,
+    TREE_CHANGE_REMOVED = 2,
+    TREE_CHANGE_MODIFIED = 3,
+    TREE_CHANGE_RENAMED = 4
+};
+
+struct TreeChange
+{
+    int32_t Kind;                   // TREE_CHANGE_* value
+    int32_t PathOffset;             // offset of the null terminated relative path in TreeDiff.Paths
+    int32_t PathLength;
+    int32_t OldPathOffset;          // for TREE_CHANGE_RENAMED, the path it had before, otherwise -1
+    int32_t OldPathLength;
+    int32_t Mode;                   // the entry as it is now, or was for TREE_CHANGE_REMOVED
+    int64_t Size;
+    int64_t ModifiedTime;           // nanoseconds since the epoch
+    int64_t Inode;
+};
+
+struct TreeDiff
+{
+    int32_t Count;
+    struct TreeChange* Changes;     // ordered by path
+    char* Paths;
+};
+
+struct TreeSnapshot;
+
+int32_t TreeSnapshotCapture(const char* root, const char* snapshotPath, int32_t threadCount);
+struct TreeSnapshot* TreeSnapshotOpen(const char* snapshotPath);
+int32_t TreeSnapshotDiff(
+    const struct TreeSnapshot* older,
+    const struct TreeSnapshot* newer,
+    int32_t flags,
+    struct TreeDiff** diff);
+int32_t TreeSnapshotDiffLive(
+    const struct TreeSnapshot* snapshot,
+    const char* root,
+    int32_t flags,
+    int32_t threadCount,
+    struct TreeDiff** diff);
+void FreeTreeDiff(struct TreeDiff* diff);
+void TreeSnapshotClose(struct TreeSnapshot* snapshot);
+
+PAL_END_EXTERNC
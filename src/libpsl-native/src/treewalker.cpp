@@ -0,0 +1,221 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief walk a directory tree with several threads
+
+#include "treewalker.h"
+#include "directoryreader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace
+{
+    // Directory reads are mostly waiting on the file system, network ones in particular,
+    // so more threads than processors can help, but not without limit
+    const int32_t MaximumThreads = 64;
+
+    struct WalkJob
+    {
+        std::string Path;
+        int64_t Tag;
+    };
+
+    // Directories waiting to be read.  Kept as a stack, so the walk stays close to
+    // depth first and the number of pending directories small.
+    struct WalkState
+    {
+        int RootFd;
+        dev_t RootDevice;
+        bool SameDevice;
+        TreeVisitor* Visitor;
+
+        std::mutex Lock;
+        std::condition_variable Changed;
+        std::vector<WalkJob> Pending;
+        size_t Active = 0;             // jobs taken but not finished
+        bool Failed = false;
+    };
+}
+
+static void ReadDirectory(WalkState& state, const WalkJob& job, std::vector<WalkJob>& subdirectories)
+{
+    WalkDirectory directory;
+    directory.Path = job.Path;
+    directory.Tag = job.Tag;
+    directory.Error = 0;
+    directory.Fd = -1;
+
+    std::vector<WalkEntry> entries;
+    DirectoryReader reader;
+    if (!reader.Open(state.RootFd, job.Path.empty() ? "." : job.Path.c_str()) || fstat(reader.Fd(), &directory.Stat) != 0)
+    {
+        directory.Error = errno;
+        state.Visitor->Visit(directory, entries);
+        return;
+    }
+    directory.Fd = reader.Fd();
+
+    DirectoryEntry entry;
+    WalkEntry walked;
+    int status;
+    while ((status = reader.Next(&entry)) == 1)
+    {
+        // Entries removed since the listing are simply left out
+        if (fstatat(reader.Fd(), entry.Name, &walked.Stat, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+            continue;
+        }
+
+        walked.Name.assign(entry.Name, entry.NameLength);
+        walked.Descend = S_ISDIR(walked.Stat.st_mode) && (!state.SameDevice || walked.Stat.st_dev == state.RootDevice);
+        walked.Tag = 0;
+        entries.push_back(walked);
+    }
+
+    if (status != 0)
+    {
+        directory.Error = errno;
+    }
+
+    state.Visitor->Visit(directory, entries);
+
+    for (const WalkEntry& visited : entries)
+    {
+        if (visited.Descend)
+        {
+            WalkJob subdirectory;
+            subdirectory.Path = job.Path.empty() ? visited.Name : job.Path + "/" + visited.Name;
+            subdirectory.Tag = visited.Tag;
+            subdirectories.push_back(std::move(subdirectory));
+        }
+    }
+}
+
+static void RunWorker(WalkState* state)
+{
+    std::vector<WalkJob> subdirectories;
+    std::unique_lock<std::mutex> lock(state->Lock);
+    while (true)
+    {
+        state->Changed.wait(lock, [state] { return !state->Pending.empty() || state->Active == 0 || state->Failed; });
+        if (state->Pending.empty() || state->Failed)
+        {
+            return;
+        }
+
+        WalkJob job = std::move(state->Pending.back());
+        state->Pending.pop_back();
+        state->Active++;
+        lock.unlock();
+
+        bool failed = false;
+        subdirectories.clear();
+        try
+        {
+            ReadDirectory(*state, job, subdirectories);
+        }
+        catch (const std::bad_alloc&)
+        {
+            failed = true;
+        }
+
+        lock.lock();
+        state->Active--;
+        if (failed)
+        {
+            state->Failed = true;
+        }
+        else
+        {
+            for (WalkJob& subdirectory : subdirectories)
+            {
+                state->Pending.push_back(std::move(subdirectory));
+            }
+        }
+        state->Changed.notify_all();
+    }
+}
+
+bool WalkTree(const char* root, int32_t threadCount, bool sameDevice, int64_t rootTag, TreeVisitor& visitor)
+{
+    if (root == nullptr || threadCount < 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (threadCount == 0)
+    {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processors > 0 ? static_cast<int32_t>(processors) : 1;
+    }
+    if (threadCount > MaximumThreads)
+    {
+        threadCount = MaximumThreads;
+    }
+
+    WalkState state;
+    struct stat rootStat;
+    state.RootFd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state.RootFd < 0)
+    {
+        return false;
+    }
+    if (fstat(state.RootFd, &rootStat) != 0)
+    {
+        int priorErrno = errno;
+        close(state.RootFd);
+        errno = priorErrno;
+        return false;
+    }
+
+    state.RootDevice = rootStat.st_dev;
+    state.SameDevice = sameDevice;
+    state.Visitor = &visitor;
+
+    try
+    {
+        state.Pending.push_back(WalkJob { std::string(), rootTag });
+    }
+    catch (const std::bad_alloc&)
+    {
+        close(state.RootFd);
+        errno = ENOMEM;
+        return false;
+    }
+
+    // The calling thread is one of the workers
+    std::vector<std::thread> threads;
+    try
+    {
+        for (int32_t i = 1; i < threadCount; i++)
+        {
+            threads.push_back(std::thread(RunWorker, &state));
+        }
+    }
+    catch (const std::exception&)
+    {
+        // Walk with the threads that did start
+    }
+
+    RunWorker(&state);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    close(state.RootFd);
+    if (state.Failed)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    return true;
+}
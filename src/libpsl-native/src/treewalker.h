@@ -0,0 +1,46 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Internal to libpsl-native, not exported
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+struct WalkEntry
+{
+    std::string Name;
+    struct stat Stat;           // lstat of the entry
+    bool Descend;               // set for subdirectories the walker will visit; the visitor may clear it
+    int64_t Tag;                // handed back as WalkDirectory::Tag when the subdirectory is visited
+};
+
+struct WalkDirectory
+{
+    std::string Path;           // relative to the root, empty for the root itself
+    int Fd;                     // the open directory, valid during the visit, -1 if Error is set
+    int Error;                  // errno if the directory could not be read, 0 otherwise
+    struct stat Stat;           // stat of the directory, valid if Error is 0
+    int64_t Tag;
+};
+
+// Receives the contents of every directory of a walk
+class TreeVisitor
+{
+public:
+    virtual ~TreeVisitor() {}
+
+    // Called once per directory with all of its entries, on any of the walker's threads
+    // and concurrently with other directories, but never before the visit of its parent
+    // has returned.  Exceptions must not escape, other than std::bad_alloc.
+    virtual void Visit(const WalkDirectory& directory, std::vector<WalkEntry>& entries) = 0;
+};
+
+// Walks the tree under root, reading up to threadCount directories at a time (0 for one
+// per processor).  Symbolic links are not followed, and with sameDevice set neither are
+// mount points.  Directories that cannot be read are visited with Error set and do not
+// fail the walk.  Returns false with errno set if root cannot be opened or memory runs out.
+bool WalkTree(const char* root, int32_t threadCount, bool sameDevice, int64_t rootTag, TreeVisitor& visitor);
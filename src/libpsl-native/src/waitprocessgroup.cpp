@@ -0,0 +1,59 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief wait for any child in a process group to terminate
+
+#include "waitprocessgroup.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+//! @brief wait for any child in a process group to terminate
+//!
+//! WaitProcessGroup
+//!
+//! Only children of the calling process can be waited on, so this reaps
+//! the direct children started into the group, one per call.
+//!
+//! @param[in] processGroupId
+//! @parblock
+//! The process group to wait on.
+//! @endparblock
+//!
+//! @param[in] nohang
+//! @parblock
+//! Whether to return immediately if no member has terminated yet.
+//! @endparblock
+//!
+//! @param[out] exitCode
+//! @parblock
+//! Receives the exit status of the reaped child, or 128 plus the signal
+//! number if it was killed by a signal.
+//! @endparblock
+//!
+//! @retval PID of the reaped child, 0 if nohang and no child has terminated,
+//! or -1 if error (ECHILD once the group has no children left)
+//!
+pid_t WaitProcessGroup(pid_t processGroupId, bool nohang, int32_t* exitCode)
+{
+    assert(exitCode);
+
+    if (processGroupId <= 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int status = 0;
+    pid_t result;
+    while ((result = waitpid(-processGroupId, &status, nohang ? WNOHANG : 0)) < 0 && errno == EINTR);
+
+    if (result > 0)
+    {
+        *exitCode = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    }
+
+    return result;
+}
@@ -0,0 +1,13 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "pal.h"
+#include <sys/types.h>
+
+PAL_BEGIN_EXTERNC
+
+pid_t WaitProcessGroup(pid_t processGroupId, bool nohang, int32_t* exitCode);
+
+PAL_END_EXTERNC
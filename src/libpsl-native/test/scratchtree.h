@@ -0,0 +1,75 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Fixture for tests that build a directory tree under /tmp
+
+#pragma once
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static inline int RemoveScratchEntry(const char* path, const struct stat*, int type, struct FTW*)
+{
+    return unlinkat(AT_FDCWD, path, type == FTW_DP ? AT_REMOVEDIR : 0);
+}
+
+// Removes a file or a directory and everything below it; a path that does not exist is not an error
+static inline int RemoveScratchTree(const std::string& path)
+{
+    if (nftw(path.c_str(), RemoveScratchEntry, 16, FTW_DEPTH | FTW_PHYS) != 0 && errno != ENOENT)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+class ScratchTreeTest : public ::testing::Test
+{
+protected:
+
+    std::string root;
+
+    // Creates an empty root directory named after prefix
+    explicit ScratchTreeTest(const char* prefix)
+    {
+        std::string rootTemplate = std::string("/tmp/") + prefix + "XXXXXX";
+        EXPECT_TRUE(mkdtemp(&rootTemplate[0]) != nullptr);
+        root = rootTemplate;
+    }
+
+    ~ScratchTreeTest()
+    {
+        EXPECT_EQ(0, RemoveScratchTree(root));
+        for (const std::string& path : m_siblings)
+        {
+            EXPECT_EQ(0, RemoveScratchTree(path));
+        }
+    }
+
+    // Returns the root with suffix appended, a path next to the root that is removed with it
+    std::string SiblingPath(const char* suffix)
+    {
+        m_siblings.push_back(root + suffix);
+        return m_siblings.back();
+    }
+
+    // Creates or replaces a file below the root
+    void CreateFile(const std::string& name, const std::string& content = std::string())
+    {
+        int fd = open((root + "/" + name).c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        ASSERT_NE(-1, fd);
+        ASSERT_EQ(static_cast<ssize_t>(content.size()), write(fd, content.data(), content.size()));
+        close(fd);
+    }
+
+private:
+
+    std::vector<std::string> m_siblings;
+};
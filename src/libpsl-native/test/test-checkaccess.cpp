@@ -0,0 +1,59 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for CheckAccessBatch()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include "scratchtree.h"
+#include "checkaccess.h"
+
+class CheckAccessTest : public ScratchTreeTest
+{
+protected:
+
+    int dirFd = -1;
+
+    CheckAccessTest()
+        : ScratchTreeTest("checkaccess")
+    {
+        close(open((root + "/data").c_str(), O_CREAT | O_WRONLY, 0644));
+        close(open((root + "/tool").c_str(), O_CREAT | O_WRONLY, 0755));
+        EXPECT_EQ(0, mkdir((root + "/dir").c_str(), 0755));
+        close(open((root + "/dir/nested").c_str(), O_CREAT | O_WRONLY, 0700));
+        dirFd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+    }
+
+    ~CheckAccessTest()
+    {
+        close(dirFd);
+    }
+};
+
+TEST_F(CheckAccessTest, ChecksEachName)
+{
+    const char* names[] = { "data", "tool", "missing", "dir/nested" };
+    uint8_t results[4];
+
+    EXPECT_EQ(2, CheckAccessBatch(dirFd, names, 4, X_OK, results));
+    EXPECT_EQ(0, results[0]);
+    EXPECT_EQ(1, results[1]);
+    EXPECT_EQ(0, results[2]);
+    EXPECT_EQ(1, results[3]);
+
+    EXPECT_EQ(3, CheckAccessBatch(dirFd, names, 4, F_OK, results));
+    EXPECT_EQ(0, results[2]);
+}
+
+TEST_F(CheckAccessTest, RejectsUnknownMode)
+{
+    const char* names[] = { "data" };
+    uint8_t results[1];
+    EXPECT_EQ(-1, CheckAccessBatch(dirFd, names, 1, 0x100, results));
+    EXPECT_EQ(EINVAL, errno);
+}
@@ -0,0 +1,55 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for ClassifyPath()
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include "scratchtree.h"
+#include "classifypath.h"
+
+class ClassifyPathTest : public ScratchTreeTest
+{
+protected:
+
+
+    ClassifyPathTest()
+        : ScratchTreeTest("classifypath")
+    {
+        close(open((root + "/data").c_str(), O_CREAT | O_WRONLY, 0644));
+        close(open((root + "/tool").c_str(), O_CREAT | O_WRONLY, 0755));
+        EXPECT_EQ(0, mkdir((root + "/dir").c_str(), 0755));
+        EXPECT_EQ(0, mkfifo((root + "/fifo").c_str(), 0644));
+        EXPECT_EQ(0, symlink("tool", (root + "/toollink").c_str()));
+        EXPECT_EQ(0, symlink("dir", (root + "/dirlink").c_str()));
+        EXPECT_EQ(0, symlink("missing", (root + "/dangling").c_str()));
+    }
+
+    int32_t Classify(const char* name)
+    {
+        return ClassifyPath((root + "/" + name).c_str());
+    }
+};
+
+TEST_F(ClassifyPathTest, ClassifiesEntries)
+{
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_FILE, Classify("data"));
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_FILE | PATH_CLASS_EXECUTABLE, Classify("tool"));
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_DIRECTORY, Classify("dir"));
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_FIFO, Classify("fifo"));
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_CHARACTER_DEVICE, ClassifyPath("/dev/null"));
+    EXPECT_EQ(0, Classify("missing"));
+    EXPECT_EQ(0, Classify("data/child"));
+}
+
+TEST_F(ClassifyPathTest, ClassifiesSymbolicLinks)
+{
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_SYMLINK | PATH_CLASS_FILE | PATH_CLASS_EXECUTABLE, Classify("toollink"));
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_SYMLINK | PATH_CLASS_DIRECTORY | PATH_CLASS_SYMLINK_TO_DIRECTORY,
+              Classify("dirlink"));
+    EXPECT_EQ(PATH_CLASS_EXISTS | PATH_CLASS_SYMLINK | PATH_CLASS_BROKEN_LINK, Classify("dangling"));
+}
@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for the PATH command index
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include "scratchtree.h"
+#include "commandindex.h"
+
+class CommandIndexTest : public ScratchTreeTest
+{
+protected:
+
+    std::string first;
+    std::string second;
+    CommandIndex* index = nullptr;
+
+    CommandIndexTest()
+        : ScratchTreeTest("commandindex")
+    {
+        first = root + "/first";
+        second = root + "/second";
+        EXPECT_EQ(0, mkdir(first.c_str(), 0755));
+        EXPECT_EQ(0, mkdir(second.c_str(), 0755));
+    }
+
+    ~CommandIndexTest()
+    {
+        CommandIndexDestroy(index);
+    }
+
+    void CreateCommand(const std::string& path, mode_t mode)
+    {
+        int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, mode);
+        ASSERT_NE(-1, fd);
+        close(fd);
+        ASSERT_EQ(0, chmod(path.c_str(), mode));
+    }
+
+    std::string Lookup(const char* name)
+    {
+        char buffer[4096];
+        int32_t length = CommandIndexLookup(index, name, buffer, sizeof(buffer));
+        EXPECT_GE(length, 0);
+        return length > 0 ? std::string(buffer, length) : std::string();
+    }
+};
+
+TEST_F(CommandIndexTest, ResolvesInSearchOrder)
+{
+    CreateCommand(first + "/tool", 0755);
+    CreateCommand(second + "/tool", 0755);
+    CreateCommand(second + "/other", 0755);
+    CreateCommand(first + "/data", 0644);
+    ASSERT_EQ(0, mkdir((first + "/dir").c_str(), 0755));
+
+    std::string path = "relative::" + first + "/:" + second;
+    index = CommandIndexCreate(path.c_str(), 0);
+    ASSERT_NE(nullptr, index);
+
+    EXPECT_EQ(first + "/tool", Lookup("tool"));
+    EXPECT_EQ(second + "/other", Lookup("other"));
+    EXPECT_EQ("", Lookup("data"));
+    EXPECT_EQ("", Lookup("dir"));
+    EXPECT_EQ("", Lookup("missing"));
+    EXPECT_EQ("", Lookup("sub/tool"));
+}
+
+TEST_F(CommandIndexTest, SeesChangesToDirectories)
+{
+    std::string path = first + ":" + second;
+    index = CommandIndexCreate(path.c_str(), 0);
+    ASSERT_NE(nullptr, index);
+    EXPECT_EQ("", Lookup("tool"));
+
+    CreateCommand(second + "/tool", 0755);
+    EXPECT_EQ(second + "/tool", Lookup("tool"));
+
+    CreateCommand(first + "/tool", 0755);
+    EXPECT_EQ(first + "/tool", Lookup("tool"));
+
+    ASSERT_EQ(0, unlink((first + "/tool").c_str()));
+    EXPECT_EQ(second + "/tool", Lookup("tool"));
+
+    ASSERT_EQ(0, CommandIndexSetSearchPath(index, first.c_str()));
+    EXPECT_EQ("", Lookup("tool"));
+}
+
+TEST_F(CommandIndexTest, ReportsShortBuffer)
+{
+    CreateCommand(first + "/tool", 0755);
+    index = CommandIndexCreate(first.c_str(), 0);
+    ASSERT_NE(nullptr, index);
+
+    char buffer[8];
+    EXPECT_EQ(-1, CommandIndexLookup(index, "tool", buffer, sizeof(buffer)));
+    EXPECT_EQ(ERANGE, errno);
+}
@@ -0,0 +1,228 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for SearchFileContents()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "scratchtree.h"
+#include "contentsearch.h"
+
+class ContentSearchTest : public ScratchTreeTest
+{
+protected:
+
+    std::vector<std::string> names;
+    ContentSearchResult* result;
+
+    ContentSearchTest()
+        : ScratchTreeTest("contentsearch"), result(nullptr)
+    {
+        CreateFile("app.log",
+            "starting\n"
+            "Error 12: disk full\n"
+            "retrying\n"
+            "error 13: disk still full\n"
+            "done");
+        CreateFile("crlf.log", "first\r\nsecond error\r\n42\r\n");
+        CreateFile("empty.log", "");
+    }
+
+    ~ContentSearchTest()
+    {
+        FreeContentSearchResult(result);
+    }
+
+    int32_t Search(const std::vector<std::string>& files, const char* pattern, int32_t flags)
+    {
+        FreeContentSearchResult(result);
+        result = nullptr;
+        names.clear();
+        std::vector<const char*> paths;
+        for (const std::string& file : files)
+        {
+            names.push_back(root + "/" + file);
+        }
+        for (const std::string& name : names)
+        {
+            paths.push_back(name.c_str());
+        }
+        return SearchFileContents(paths.data(), static_cast<int32_t>(paths.size()), pattern, flags, 2, &result);
+    }
+
+    std::string Line(int32_t match)
+    {
+        return result->Text + result->Matches[match].TextOffset;
+    }
+};
+
+TEST_F(ContentSearchTest, SimpleMatch)
+{
+    ASSERT_EQ(0, Search({ "app.log" }, "disk", CONTENT_SEARCH_SIMPLE_MATCH));
+    ASSERT_EQ(2, result->MatchCount);
+    EXPECT_EQ(0, result->Errors[0]);
+
+    EXPECT_EQ(0, result->Matches[0].File);
+    EXPECT_EQ(2, result->Matches[0].LineNumber);
+    EXPECT_EQ(9, result->Matches[0].LineOffset);
+    EXPECT_EQ(19, result->Matches[0].LineLength);
+    EXPECT_EQ(10, result->Matches[0].MatchOffset);
+    EXPECT_EQ(4, result->Matches[0].MatchLength);
+    EXPECT_EQ("Error 12: disk full", Line(0));
+
+    EXPECT_EQ(4, result->Matches[1].LineNumber);
+    EXPECT_EQ(38, result->Matches[1].LineOffset);
+    EXPECT_EQ("error 13: disk still full", Line(1));
+}
+
+TEST_F(ContentSearchTest, IgnoreCase)
+{
+    ASSERT_EQ(0, Search({ "app.log" }, "ERROR", CONTENT_SEARCH_SIMPLE_MATCH));
+    EXPECT_EQ(0, result->MatchCount);
+
+    ASSERT_EQ(0, Search({ "app.log" }, "ERROR", CONTENT_SEARCH_SIMPLE_MATCH | CONTENT_SEARCH_IGNORE_CASE));
+    ASSERT_EQ(2, result->MatchCount);
+    EXPECT_EQ(2, result->Matches[0].LineNumber);
+    EXPECT_EQ(4, result->Matches[1].LineNumber);
+
+    ASSERT_EQ(0, Search({ "app.log" }, "^E", 0));
+    ASSERT_EQ(1, result->MatchCount);
+    ASSERT_EQ(0, Search({ "app.log" }, "^E", CONTENT_SEARCH_IGNORE_CASE));
+    EXPECT_EQ(2, result->MatchCount);
+}
+
+TEST_F(ContentSearchTest, RegularExpression)
+{
+    // Prefiltered on "rror "
+    ASSERT_EQ(0, Search({ "app.log" }, "[Ee]rror 1[3-9]", 0));
+    ASSERT_EQ(1, result->MatchCount);
+    EXPECT_EQ(4, result->Matches[0].LineNumber);
+    EXPECT_EQ(0, result->Matches[0].MatchOffset);
+    EXPECT_EQ(8, result->Matches[0].MatchLength);
+
+    // Optional characters are not required
+    ASSERT_EQ(0, Search({ "app.log" }, "retry(ing)?|done", 0));
+    EXPECT_EQ(2, result->MatchCount);
+    ASSERT_EQ(0, Search({ "app.log" }, "startx?ing", 0));
+    EXPECT_EQ(1, result->MatchCount);
+
+    // No literal at all
+    ASSERT_EQ(0, Search({ "app.log" }, "^[a-z]+$", 0));
+    ASSERT_EQ(3, result->MatchCount);
+    EXPECT_EQ(1, result->Matches[0].LineNumber);
+    EXPECT_EQ(3, result->Matches[1].LineNumber);
+    EXPECT_EQ(5, result->Matches[2].LineNumber);
+}
+
+TEST_F(ContentSearchTest, CarriageReturns)
+{
+    ASSERT_EQ(0, Search({ "crlf.log" }, "error$", 0));
+    ASSERT_EQ(1, result->MatchCount);
+    EXPECT_EQ(2, result->Matches[0].LineNumber);
+    EXPECT_EQ(12, result->Matches[0].LineLength);
+    EXPECT_EQ("second error", Line(0));
+
+    ASSERT_EQ(0, Search({ "crlf.log" }, "^[0-9]+$", 0));
+    ASSERT_EQ(1, result->MatchCount);
+    EXPECT_EQ(3, result->Matches[0].LineNumber);
+}
+
+TEST_F(ContentSearchTest, ManyFiles)
+{
+    std::vector<std::string> files;
+    for (int i = 0; i < 20; i++)
+    {
+        files.push_back(i % 2 == 0 ? "app.log" : "crlf.log");
+    }
+    files.push_back("missing.log");
+    files.push_back("empty.log");
+
+    ASSERT_EQ(0, Search(files, "error", CONTENT_SEARCH_IGNORE_CASE));
+    ASSERT_EQ(22, result->FileCount);
+    ASSERT_EQ(30, result->MatchCount);
+    int32_t match = 0;
+    for (int32_t file = 0; file < 20; file++)
+    {
+        EXPECT_EQ(0, result->Errors[file]);
+        int32_t expected = file % 2 == 0 ? 2 : 1;
+        for (int32_t i = 0; i < expected; i++, match++)
+        {
+            EXPECT_EQ(file, result->Matches[match].File);
+        }
+    }
+    EXPECT_EQ(ENOENT, result->Errors[20]);
+    EXPECT_EQ(0, result->Errors[21]);
+
+    ASSERT_EQ(0, Search(files, "error", CONTENT_SEARCH_IGNORE_CASE | CONTENT_SEARCH_LIST));
+    EXPECT_EQ(20, result->MatchCount);
+    EXPECT_EQ(2, result->Matches[0].LineNumber);
+}
+
+TEST_F(ContentSearchTest, LongLines)
+{
+    // Lines that span several reads
+    std::string content = "first\n" + std::string(3 * 1024 * 1024, 'x') + "needle\n";
+    content += std::string(100, 'y') + "\nneedle";
+    CreateFile("long.log", content);
+
+    ASSERT_EQ(0, Search({ "long.log" }, "needle", CONTENT_SEARCH_SIMPLE_MATCH));
+    ASSERT_EQ(2, result->MatchCount);
+    EXPECT_EQ(2, result->Matches[0].LineNumber);
+    EXPECT_EQ(6, result->Matches[0].LineOffset);
+    EXPECT_EQ(3 * 1024 * 1024, result->Matches[0].MatchOffset);
+    EXPECT_EQ(4, result->Matches[1].LineNumber);
+    EXPECT_EQ(static_cast<int64_t>(content.size()) - 6, result->Matches[1].LineOffset);
+}
+
+TEST_F(ContentSearchTest, Errors)
+{
+    EXPECT_EQ(-1, Search({ "app.log" }, "error(", 0));
+    EXPECT_EQ(EINVAL, errno);
+    EXPECT_EQ(-1, Search({ "app.log" }, "", 0));
+    EXPECT_EQ(EINVAL, errno);
+
+    ASSERT_EQ(0, Search({ "app.log" }, "disk\nfull", CONTENT_SEARCH_SIMPLE_MATCH));
+    EXPECT_EQ(0, result->MatchCount);
+}
+
+TEST_F(ContentSearchTest, EscapedAnchors)
+{
+    CreateFile("words.log", "an error here\nerrors\n");
+
+    // \< and \> are word boundaries, not literal characters
+    ASSERT_EQ(0, Search({ "words.log" }, "\\<error\\>", 0));
+    ASSERT_EQ(1, result->MatchCount);
+    EXPECT_EQ(1, result->Matches[0].LineNumber);
+    EXPECT_EQ(3, result->Matches[0].MatchOffset);
+
+    // Escaped metacharacters are still literal
+    CreateFile("dots.log", "a.b\naxb\n");
+    ASSERT_EQ(0, Search({ "dots.log" }, "a\\.b", 0));
+    ASSERT_EQ(1, result->MatchCount);
+    EXPECT_EQ(1, result->Matches[0].LineNumber);
+}
+
+TEST_F(ContentSearchTest, OptionalMultibyteCharacter)
+{
+    const char* previous = setlocale(LC_ALL, nullptr);
+    std::string saved = previous != nullptr ? previous : "C";
+    if (setlocale(LC_ALL, "C.UTF-8") == nullptr && setlocale(LC_ALL, "C.utf8") == nullptr)
+    {
+        return;
+    }
+
+    CreateFile("accents.log", "xy\nx\xc3\xa9y\nxz\n");
+    EXPECT_EQ(0, Search({ "accents.log" }, "x\xc3\xa9?y", 0));
+    setlocale(LC_ALL, saved.c_str());
+    ASSERT_TRUE(result != nullptr);
+    ASSERT_EQ(2, result->MatchCount);
+    EXPECT_EQ(1, result->Matches[0].LineNumber);
+    EXPECT_EQ(2, result->Matches[1].LineNumber);
+}
@@ -0,0 +1,348 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for ForkAndExecProcessWithAttributes()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include "createprocess.h"
+#include "environmentblock.h"
+
+// Matches CREATE_NEW_PROCESS_GROUP in createprocess.cpp
+static const int32_t CreateNewProcessGroup = 0x00000002;
+
+class CreateProcessTest : public ::testing::Test
+{
+protected:
+
+    // Runs a shell command with the given attributes and returns its standard output
+    std::string RunShell(const char* command, const SpawnAttributes* attributes, int32_t* exitCode)
+    {
+        char arg0[] = "sh";
+        char arg1[] = "-c";
+        std::string script(command);
+        char* argv[] = { arg0, arg1, &script[0], nullptr };
+        char* envp[] = { nullptr };
+        int32_t pid, stdinFd, stdoutFd, stderrFd;
+
+        int32_t ret = ForkAndExecProcessWithAttributes("/bin/sh", argv, envp, nullptr, 0, 1, 0, 0,
+                                                       attributes, &pid, &stdinFd, &stdoutFd, &stderrFd);
+        EXPECT_EQ(0, ret);
+        if (ret != 0)
+        {
+            return std::string();
+        }
+
+        std::string output;
+        char buffer[256];
+        ssize_t count;
+        while ((count = read(stdoutFd, buffer, sizeof(buffer))) > 0)
+        {
+            output.append(buffer, count);
+        }
+        close(stdoutFd);
+
+        int status;
+        EXPECT_EQ(pid, waitpid(pid, &status, 0));
+        *exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        return output;
+    }
+};
+
+TEST_F(CreateProcessTest, NullAttributesBehaveLikeForkAndExecProcess)
+{
+    int32_t exitCode;
+    EXPECT_EQ("hello\n", RunShell("echo hello", nullptr, &exitCode));
+    EXPECT_EQ(0, exitCode);
+}
+
+TEST_F(CreateProcessTest, UsesEnvironmentBlock)
+{
+    EnvironmentBlock* block = EnvironmentBlockCreate(nullptr);
+    ASSERT_NE(nullptr, block);
+    ASSERT_EQ(0, EnvironmentBlockSet(block, "PSL_FIRST", "one"));
+    ASSERT_EQ(0, EnvironmentBlockSet(block, "PSL_SECOND", "two"));
+
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_ENVIRONMENT;
+    attributes.Environment = block;
+
+    int32_t exitCode;
+    EXPECT_EQ("one two\n", RunShell("echo $PSL_FIRST $PSL_SECOND", &attributes, &exitCode));
+
+    ASSERT_EQ(0, EnvironmentBlockUnset(block, "PSL_FIRST"));
+    EXPECT_EQ("two\n", RunShell("echo $PSL_FIRST $PSL_SECOND", &attributes, &exitCode));
+    EnvironmentBlockDestroy(block);
+}
+
+TEST_F(CreateProcessTest, AppliesNiceAndResourceLimits)
+{
+    SpawnResourceLimit limit = { SPAWN_RLIMIT_NOFILE, 64, 64 };
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_NICE | SPAWN_ATTRIBUTE_RESOURCE_LIMITS;
+    attributes.Nice = 7;
+    attributes.ResourceLimits = &limit;
+    attributes.ResourceLimitCount = 1;
+
+    int32_t exitCode;
+    std::string output = RunShell("echo $(cut -d ' ' -f 19 /proc/self/stat) $(ulimit -n)", &attributes, &exitCode);
+    EXPECT_EQ(0, exitCode);
+    EXPECT_EQ("7 64\n", output);
+}
+
+TEST_F(CreateProcessTest, AppliesCpuAffinity)
+{
+    uint64_t mask = 1;
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_CPU_AFFINITY;
+    attributes.CpuAffinityMask = &mask;
+    attributes.CpuAffinityMaskLength = 1;
+
+    int32_t exitCode;
+    std::string output = RunShell("grep Cpus_allowed_list /proc/self/status", &attributes, &exitCode);
+    EXPECT_EQ(0, exitCode);
+    EXPECT_EQ("Cpus_allowed_list:\t0\n", output);
+}
+
+TEST_F(CreateProcessTest, RejectsUnknownResource)
+{
+    SpawnResourceLimit limit = { 1000, 1, 1 };
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_RESOURCE_LIMITS;
+    attributes.ResourceLimits = &limit;
+    attributes.ResourceLimitCount = 1;
+
+    char arg0[] = "true";
+    char* argv[] = { arg0, nullptr };
+    char* envp[] = { nullptr };
+    int32_t pid, stdinFd, stdoutFd, stderrFd;
+    EXPECT_EQ(-1, ForkAndExecProcessWithAttributes("/bin/true", argv, envp, nullptr, 0, 0, 0, 0,
+                                                   &attributes, &pid, &stdinFd, &stdoutFd, &stderrFd));
+    EXPECT_EQ(EINVAL, errno);
+    EXPECT_EQ(-1, pid);
+}
+
+TEST_F(CreateProcessTest, MissingCgroupFailsInParent)
+{
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_CGROUP;
+    attributes.CgroupPath = "/SomeMadeUpCgroupThatDoesNotExist";
+
+    char arg0[] = "true";
+    char* argv[] = { arg0, nullptr };
+    char* envp[] = { nullptr };
+    int32_t pid, stdinFd, stdoutFd, stderrFd;
+    EXPECT_EQ(-1, ForkAndExecProcessWithAttributes("/bin/true", argv, envp, nullptr, 0, 0, 0, 0,
+                                                   &attributes, &pid, &stdinFd, &stdoutFd, &stderrFd));
+    EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_F(CreateProcessTest, PipelineConnectsStagesDirectly)
+{
+    char sh[] = "sh";
+    char c[] = "-c";
+    char produce[] = "printf 'b\\na\\nc\\n'";
+    char sort[] = "sort";
+    char tr[] = "tr";
+    char lower[] = "a-z";
+    char upper[] = "A-Z";
+    char* produceArgv[] = { sh, c, produce, nullptr };
+    char* sortArgv[] = { sort, nullptr };
+    char* trArgv[] = { tr, lower, upper, nullptr };
+    const char* filenames[] = { "/bin/sh", "/usr/bin/sort", "/usr/bin/tr" };
+    char* const* argvs[] = { produceArgv, sortArgv, trArgv };
+    char* envp[] = { nullptr };
+    int32_t pids[3];
+    int32_t stdinFd, stdoutFd, stderrFd;
+
+    ASSERT_EQ(0, ForkAndExecPipeline(3, filenames, argvs, envp, nullptr, 0, 1, 0, 0, nullptr,
+                                     pids, &stdinFd, &stdoutFd, &stderrFd));
+    EXPECT_EQ(-1, stdinFd);
+    EXPECT_EQ(-1, stderrFd);
+
+    std::string output;
+    char buffer[64];
+    ssize_t count;
+    while ((count = read(stdoutFd, buffer, sizeof(buffer))) > 0)
+    {
+        output.append(buffer, count);
+    }
+    close(stdoutFd);
+    EXPECT_EQ("A\nB\nC\n", output);
+
+    for (int i = 0; i < 3; i++)
+    {
+        int status;
+        EXPECT_EQ(pids[i], waitpid(pids[i], &status, 0));
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+}
+
+TEST_F(CreateProcessTest, PipelineStagesJoinGroupOfExitedFirstStage)
+{
+    char arg0[] = "true";
+    char* trueArgv[] = { arg0, nullptr };
+    char echo[] = "echo";
+    char joined[] = "joined";
+    char* echoArgv[] = { echo, joined, nullptr };
+    const char* filenames[] = { "/bin/true", "/bin/echo" };
+    char* const* argvs[] = { trueArgv, echoArgv };
+    char* envp[] = { nullptr };
+
+    // With SIGCHLD ignored, a stage that exits is reaped at once and its process group goes with it
+    struct sigaction ignore, previous;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    ASSERT_EQ(0, sigaction(SIGCHLD, &ignore, &previous));
+
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        int32_t pids[2];
+        int32_t stdinFd, stdoutFd, stderrFd;
+        ASSERT_EQ(0, ForkAndExecPipeline(2, filenames, argvs, envp, nullptr, 0, 1, 0, CreateNewProcessGroup, nullptr,
+                                         pids, &stdinFd, &stdoutFd, &stderrFd));
+
+        std::string output;
+        char buffer[64];
+        ssize_t count;
+        while ((count = read(stdoutFd, buffer, sizeof(buffer))) > 0)
+        {
+            output.append(buffer, count);
+        }
+        close(stdoutFd);
+        EXPECT_EQ("joined\n", output);
+    }
+
+    ASSERT_EQ(0, sigaction(SIGCHLD, &previous, nullptr));
+}
+
+TEST_F(CreateProcessTest, PipelineFailsBeforeStartingWhenAStageIsMissing)
+{
+    char arg0[] = "true";
+    char* argv[] = { arg0, nullptr };
+    const char* filenames[] = { "/bin/true", "/SomeMadeUpCommandThatDoesNotExist" };
+    char* const* argvs[] = { argv, argv };
+    char* envp[] = { nullptr };
+    int32_t pids[2];
+    int32_t stdinFd, stdoutFd, stderrFd;
+
+    EXPECT_EQ(-1, ForkAndExecPipeline(2, filenames, argvs, envp, nullptr, 1, 1, 1, 0, nullptr,
+                                      pids, &stdinFd, &stdoutFd, &stderrFd));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(-1, pids[0]);
+    EXPECT_EQ(-1, stdoutFd);
+}
+
+TEST_F(CreateProcessTest, StdoutGoesStraightToFile)
+{
+    char path[] = "/tmp/createprocess.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_STDIO;
+    attributes.Stdout.Kind = SPAWN_STDIO_PATH;
+    attributes.Stdout.Path = path;
+    attributes.Stdout.OpenFlags = SPAWN_OPEN_CREATE | SPAWN_OPEN_TRUNCATE;
+    attributes.Stdout.Mode = 0600;
+    attributes.Stderr.Kind = SPAWN_STDIO_MERGE_STDOUT;
+
+    char arg0[] = "sh";
+    char arg1[] = "-c";
+    char arg2[] = "echo out; echo err >&2";
+    char* argv[] = { arg0, arg1, arg2, nullptr };
+    char* envp[] = { nullptr };
+    int32_t pid, stdinFd, stdoutFd, stderrFd;
+    ASSERT_EQ(0, ForkAndExecProcessWithAttributes("/bin/sh", argv, envp, nullptr, 0, 0, 0, 0,
+                                                  &attributes, &pid, &stdinFd, &stdoutFd, &stderrFd));
+    EXPECT_EQ(-1, stdoutFd);
+    EXPECT_EQ(-1, stderrFd);
+    waitpid(pid, NULL, 0);
+
+    char buffer[64] = {};
+    fd = open(path, O_RDONLY);
+    ASSERT_NE(-1, fd);
+    EXPECT_EQ(8, read(fd, buffer, sizeof(buffer)));
+    close(fd);
+    unlink(path);
+    EXPECT_STREQ("out\nerr\n", buffer);
+}
+
+TEST_F(CreateProcessTest, StderrToStandardDescriptorIsNotOverwrittenByStdout)
+{
+    char path[] = "/tmp/createprocess.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    // Point this process's stdout at a pipe, which the child's stderr then names as fd 1
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    int savedStdout = dup(STDOUT_FILENO);
+    ASSERT_NE(-1, savedStdout);
+    ASSERT_EQ(STDOUT_FILENO, dup2(fds[1], STDOUT_FILENO));
+    close(fds[1]);
+
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_STDIO;
+    attributes.Stdout.Kind = SPAWN_STDIO_PATH;
+    attributes.Stdout.Path = path;
+    attributes.Stdout.OpenFlags = SPAWN_OPEN_TRUNCATE;
+    attributes.Stderr.Kind = SPAWN_STDIO_FD;
+    attributes.Stderr.Fd = STDOUT_FILENO;
+
+    char arg0[] = "sh";
+    char arg1[] = "-c";
+    char arg2[] = "echo out; echo err >&2";
+    char* argv[] = { arg0, arg1, arg2, nullptr };
+    char* envp[] = { nullptr };
+    int32_t pid, stdinFd, stdoutFd, stderrFd;
+    int32_t result = ForkAndExecProcessWithAttributes("/bin/sh", argv, envp, nullptr, 0, 0, 0, 0,
+                                                      &attributes, &pid, &stdinFd, &stdoutFd, &stderrFd);
+    ASSERT_EQ(STDOUT_FILENO, dup2(savedStdout, STDOUT_FILENO));
+    close(savedStdout);
+    ASSERT_EQ(0, result);
+    waitpid(pid, NULL, 0);
+
+    char buffer[64] = {};
+    EXPECT_EQ(4, read(fds[0], buffer, sizeof(buffer)));
+    close(fds[0]);
+    EXPECT_STREQ("err\n", buffer);
+
+    char fileBuffer[64] = {};
+    fd = open(path, O_RDONLY);
+    ASSERT_NE(-1, fd);
+    EXPECT_EQ(4, read(fd, fileBuffer, sizeof(fileBuffer)));
+    close(fd);
+    unlink(path);
+    EXPECT_STREQ("out\n", fileBuffer);
+}
+
+TEST_F(CreateProcessTest, StdinFromDescriptorAndStderrMergedIntoPipe)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    ASSERT_EQ(6, write(fds[1], "input\n", 6));
+    close(fds[1]);
+
+    SpawnAttributes attributes = {};
+    attributes.Flags = SPAWN_ATTRIBUTE_STDIO;
+    attributes.Stdin.Kind = SPAWN_STDIO_FD;
+    attributes.Stdin.Fd = fds[0];
+    attributes.Stderr.Kind = SPAWN_STDIO_MERGE_STDOUT;
+
+    int32_t exitCode;
+    EXPECT_EQ("input\nerr\n", RunShell("cat; echo err >&2", &attributes, &exitCode));
+    EXPECT_EQ(0, exitCode);
+
+    // The descriptor belongs to the caller and is still open
+    EXPECT_NE(-1, fcntl(fds[0], F_GETFD));
+    close(fds[0]);
+}
@@ -0,0 +1,167 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for DirectoryCursorOpen() and DirectoryCursorNext()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "scratchtree.h"
+#include "directorycursor.h"
+
+class DirectoryCursorTest : public ScratchTreeTest
+{
+protected:
+
+    static const int FileCount = 100;
+    std::set<std::string> all;
+
+    DirectoryCursorTest()
+        : ScratchTreeTest("directorycursor")
+    {
+        for (int i = 0; i < FileCount; i++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "file%03d.%s", i, i % 2 == 0 ? "txt" : "log");
+            int fd = open((root + "/" + name).c_str(), O_CREAT | O_WRONLY, 0644);
+            EXPECT_NE(-1, fd);
+            close(fd);
+            all.insert(name);
+        }
+    }
+
+    // Reads pages of at most pageSize entries until the end, or until pageLimit pages have been read
+    int32_t ReadPages(DirectoryCursor* cursor, int32_t pageSize, int pageLimit, std::vector<std::string>& names, int64_t* token)
+    {
+        std::vector<DirectoryEntryInfo> entries(pageSize);
+        char buffer[256];
+        int32_t result = 1;
+        for (int page = 0; page < pageLimit && result == 1; page++)
+        {
+            int32_t count = -1;
+            result = DirectoryCursorNext(cursor, entries.data(), pageSize, buffer, sizeof(buffer), &count, token);
+            EXPECT_NE(-1, result);
+            EXPECT_LE(count, pageSize);
+            for (int32_t i = 0; i < count; i++)
+            {
+                names.push_back(std::string(buffer + entries[i].NameOffset, entries[i].NameLength));
+            }
+        }
+        return result;
+    }
+};
+
+TEST_F(DirectoryCursorTest, PagesThroughEveryEntryOnce)
+{
+    DirectoryCursor* cursor = DirectoryCursorOpen(root.c_str(), nullptr, 0);
+    ASSERT_TRUE(cursor != nullptr);
+
+    std::vector<std::string> names;
+    int64_t token = 0;
+    EXPECT_EQ(0, ReadPages(cursor, 7, FileCount, names, &token));
+    DirectoryCursorClose(cursor);
+
+    EXPECT_EQ(static_cast<size_t>(FileCount), names.size());
+    EXPECT_EQ(all, std::set<std::string>(names.begin(), names.end()));
+}
+
+TEST_F(DirectoryCursorTest, NamesBufferLimitsThePage)
+{
+    DirectoryCursor* cursor = DirectoryCursorOpen(root.c_str(), nullptr, 0);
+    ASSERT_TRUE(cursor != nullptr);
+
+    // Each name takes 12 bytes with its terminator, so 30 bytes hold two
+    DirectoryEntryInfo entries[10];
+    char buffer[30];
+    int32_t count = 0;
+    int64_t token = 0;
+    EXPECT_EQ(1, DirectoryCursorNext(cursor, entries, 10, buffer, sizeof(buffer), &count, &token));
+    EXPECT_EQ(2, count);
+
+    char tiny[4];
+    EXPECT_EQ(-1, DirectoryCursorNext(cursor, entries, 10, tiny, sizeof(tiny), &count, &token));
+    EXPECT_EQ(ERANGE, errno);
+
+    // The entry that did not fit is still returned by the next call
+    std::vector<std::string> names;
+    EXPECT_EQ(0, ReadPages(cursor, 10, FileCount, names, &token));
+    EXPECT_EQ(static_cast<size_t>(FileCount - 2), names.size());
+    DirectoryCursorClose(cursor);
+}
+
+TEST_F(DirectoryCursorTest, RetriesAfterFirstEntryDoesNotFit)
+{
+    DirectoryCursor* cursor = DirectoryCursorOpen(root.c_str(), nullptr, 0);
+    ASSERT_TRUE(cursor != nullptr);
+
+    DirectoryEntryInfo entries[10];
+    char tiny[4];
+    int32_t count = -1;
+    int64_t token = 0;
+    EXPECT_EQ(-1, DirectoryCursorNext(cursor, entries, 10, tiny, sizeof(tiny), &count, &token));
+    EXPECT_EQ(ERANGE, errno);
+    EXPECT_EQ(0, count);
+
+    // No entry is skipped by the failed call
+    std::vector<std::string> names;
+    EXPECT_EQ(0, ReadPages(cursor, 10, FileCount, names, &token));
+    DirectoryCursorClose(cursor);
+    EXPECT_EQ(all, std::set<std::string>(names.begin(), names.end()));
+    EXPECT_EQ(static_cast<size_t>(FileCount), names.size());
+}
+
+TEST_F(DirectoryCursorTest, FiltersEntries)
+{
+    DirectoryFilter filter = {};
+    filter.Flags = DIRECTORY_FILTER_INCLUDE;
+    filter.IncludeGlob = "*.log";
+    DirectoryCursor* cursor = DirectoryCursorOpen(root.c_str(), &filter, 0);
+    ASSERT_TRUE(cursor != nullptr);
+
+    std::vector<std::string> names;
+    int64_t token = 0;
+    EXPECT_EQ(0, ReadPages(cursor, 9, FileCount, names, &token));
+    DirectoryCursorClose(cursor);
+
+    EXPECT_EQ(static_cast<size_t>(FileCount / 2), names.size());
+    for (const std::string& name : names)
+    {
+        EXPECT_EQ(".log", name.substr(name.size() - 4));
+    }
+}
+
+#if defined(__linux__)
+TEST_F(DirectoryCursorTest, ResumesFromTokenInNewCursor)
+{
+    DirectoryCursor* cursor = DirectoryCursorOpen(root.c_str(), nullptr, 0);
+    ASSERT_TRUE(cursor != nullptr);
+
+    std::vector<std::string> names;
+    int64_t token = 0;
+    EXPECT_EQ(1, ReadPages(cursor, 10, 3, names, &token));
+    DirectoryCursorClose(cursor);
+    EXPECT_EQ(30u, names.size());
+    EXPECT_NE(0, token);
+
+    cursor = DirectoryCursorOpen(root.c_str(), nullptr, token);
+    ASSERT_TRUE(cursor != nullptr);
+    EXPECT_EQ(0, ReadPages(cursor, 10, FileCount, names, &token));
+    DirectoryCursorClose(cursor);
+
+    EXPECT_EQ(static_cast<size_t>(FileCount), names.size());
+    EXPECT_EQ(all, std::set<std::string>(names.begin(), names.end()));
+}
+#endif
+
+TEST_F(DirectoryCursorTest, FailsForMissingDirectory)
+{
+    EXPECT_TRUE(DirectoryCursorOpen((root + "/missing").c_str(), nullptr, 0) == nullptr);
+    EXPECT_EQ(ENOENT, errno);
+}
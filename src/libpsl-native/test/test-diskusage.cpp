@@ -0,0 +1,117 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for GetDiskUsage()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include "diskusage.h"
+#include "scratchtree.h"
+
+class DiskUsageTest : public ScratchTreeTest
+{
+protected:
+
+    DiskUsageTest()
+        : ScratchTreeTest("diskusage")
+    {
+        EXPECT_EQ(0, mkdir((root + "/a").c_str(), 0755));
+        EXPECT_EQ(0, mkdir((root + "/a/b").c_str(), 0755));
+        EXPECT_EQ(0, mkdir((root + "/c").c_str(), 0755));
+        CreateSizedFile("top", 100);
+        CreateSizedFile("a/one", 1000);
+        CreateSizedFile("a/b/two", 20000);
+        CreateSizedFile("c/three", 300);
+        EXPECT_EQ(0, link((root + "/a/b/two").c_str(), (root + "/c/two-link").c_str()));
+    }
+
+    // Creates a sparse file of the given size
+    void CreateSizedFile(const char* name, off_t size)
+    {
+        CreateFile(name);
+        ASSERT_EQ(0, truncate((root + "/" + name).c_str(), size));
+    }
+
+    int64_t DirectorySize(const char* name)
+    {
+        struct stat st;
+        EXPECT_EQ(0, stat((root + name).c_str(), &st));
+        return st.st_size;
+    }
+
+    // Returns the rows by path relative to the root, "" being the root itself
+    std::map<std::string, DiskUsageEntry> Measure(int32_t flags)
+    {
+        DiskUsage* usage = nullptr;
+        EXPECT_EQ(0, GetDiskUsage(root.c_str(), flags, 3, &usage));
+        std::map<std::string, DiskUsageEntry> rows;
+        if (usage == nullptr)
+        {
+            return rows;
+        }
+
+        for (int32_t i = 0; i < usage->Count; i++)
+        {
+            const DiskUsageEntry& entry = usage->Directories[i];
+            std::string path(usage->Paths + entry.PathOffset, entry.PathLength);
+            EXPECT_EQ(0, path.compare(0, root.size(), root));
+            EXPECT_EQ(i == 0 ? -1 : 1, entry.Parent < 0 ? -1 : 1);
+            EXPECT_LT(entry.Parent, i);
+            rows[path.substr(root.size())] = entry;
+        }
+        FreeDiskUsage(usage);
+        return rows;
+    }
+};
+
+TEST_F(DiskUsageTest, RollsUpSubdirectories)
+{
+    std::map<std::string, DiskUsageEntry> rows = Measure(0);
+    ASSERT_EQ(4u, rows.size());
+
+    EXPECT_EQ(20000 + DirectorySize("/a/b"), rows["/a/b"].TotalApparentSize);
+    EXPECT_EQ(1000 + DirectorySize("/a"), rows["/a"].OwnApparentSize);
+    EXPECT_EQ(21000 + DirectorySize("/a") + DirectorySize("/a/b"), rows["/a"].TotalApparentSize);
+    EXPECT_EQ(2, rows["/a"].TotalFileCount);
+    EXPECT_EQ(2, rows["/a"].TotalDirectoryCount);
+
+    const DiskUsageEntry& top = rows[""];
+    EXPECT_EQ(4, top.TotalFileCount);
+    EXPECT_EQ(4, top.TotalDirectoryCount);
+    EXPECT_EQ(0, top.Error);
+    EXPECT_GE(top.TotalAllocatedSize, top.OwnAllocatedSize);
+}
+
+TEST_F(DiskUsageTest, CountsHardLinksOnce)
+{
+    std::map<std::string, DiskUsageEntry> rows = Measure(0);
+    int64_t directories = DirectorySize("") + DirectorySize("/a") + DirectorySize("/a/b") + DirectorySize("/c");
+    EXPECT_EQ(100 + 1000 + 20000 + 300 + directories, rows[""].TotalApparentSize);
+    EXPECT_EQ(4, rows[""].TotalFileCount);
+
+    // Whichever directory was read first owns the file
+    EXPECT_EQ(20000, rows["/a/b"].OwnApparentSize - DirectorySize("/a/b") + rows["/c"].OwnApparentSize - DirectorySize("/c") - 300);
+}
+
+TEST_F(DiskUsageTest, CountsEveryLinkWhenAsked)
+{
+    std::map<std::string, DiskUsageEntry> rows = Measure(DISK_USAGE_COUNT_LINKS);
+    int64_t directories = DirectorySize("") + DirectorySize("/a") + DirectorySize("/a/b") + DirectorySize("/c");
+    EXPECT_EQ(100 + 1000 + 40000 + 300 + directories, rows[""].TotalApparentSize);
+    EXPECT_EQ(5, rows[""].TotalFileCount);
+}
+
+TEST_F(DiskUsageTest, FailsForMissingRoot)
+{
+    DiskUsage* usage = nullptr;
+    EXPECT_EQ(-1, GetDiskUsage((root + "/missing").c_str(), 0, 0, &usage));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_TRUE(usage == nullptr);
+}
@@ -0,0 +1,181 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for EnumerateDirectory()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <set>
+#include <string>
+#include "enumeratedirectory.h"
+#include "scratchtree.h"
+
+class EnumerateDirectoryTest : public ScratchTreeTest
+{
+protected:
+
+    EnumerateDirectoryTest()
+        : ScratchTreeTest("enumeratedirectory")
+    {
+        CreateDatedFile("app.log", 100, 1000);
+        CreateDatedFile("app.LOG.1", 5000, 2000);
+        CreateDatedFile("notes.txt", 10, 3000);
+        CreateDatedFile(".hidden.log", 10, 3000);
+        EXPECT_EQ(0, mkdir((root + "/archive.log").c_str(), 0755));
+        EXPECT_EQ(0, symlink("app.log", (root + "/current.log").c_str()));
+    }
+
+    // Creates a sparse file of the given size, modified at the given time
+    void CreateDatedFile(const char* name, off_t size, time_t modified)
+    {
+        std::string path = root + "/" + name;
+        CreateFile(name);
+        ASSERT_EQ(0, truncate(path.c_str(), size));
+        struct timespec times[2] = { { modified, 0 }, { modified, 0 } };
+        ASSERT_EQ(0, utimensat(AT_FDCWD, path.c_str(), times, 0));
+    }
+
+    std::set<std::string> List(const DirectoryFilter* filter)
+    {
+        DirectoryListing* listing = nullptr;
+        EXPECT_EQ(0, EnumerateDirectory(root.c_str(), filter, &listing));
+        std::set<std::string> names;
+        if (listing == nullptr)
+        {
+            return names;
+        }
+
+        for (int32_t i = 0; i < listing->Count; i++)
+        {
+            const DirectoryEntryInfo& entry = listing->Entries[i];
+            std::string name(listing->Names + entry.NameOffset, entry.NameLength);
+            EXPECT_EQ('\0', listing->Names[entry.NameOffset + entry.NameLength]);
+            names.insert(name);
+        }
+        FreeDirectoryListing(listing);
+        return names;
+    }
+};
+
+TEST_F(EnumerateDirectoryTest, ListsEverythingWithoutFilter)
+{
+    EXPECT_EQ((std::set<std::string> { "app.log", "app.LOG.1", "notes.txt", ".hidden.log", "archive.log", "current.log" }),
+              List(nullptr));
+}
+
+TEST_F(EnumerateDirectoryTest, ReportsEntryDetails)
+{
+    DirectoryFilter filter = {};
+    filter.Flags = DIRECTORY_FILTER_INCLUDE;
+    filter.IncludeGlob = "app.log";
+
+    DirectoryListing* listing = nullptr;
+    ASSERT_EQ(0, EnumerateDirectory(root.c_str(), &filter, &listing));
+    ASSERT_EQ(1, listing->Count);
+    EXPECT_EQ(DIRECTORY_ENTRY_FILE, listing->Entries[0].Type);
+    EXPECT_EQ(100, listing->Entries[0].Size);
+    EXPECT_EQ(1000000000000LL, listing->Entries[0].ModifiedTime);
+    EXPECT_TRUE(S_ISREG(listing->Entries[0].Mode));
+    FreeDirectoryListing(listing);
+}
+
+TEST_F(EnumerateDirectoryTest, AppliesNameAndHiddenConditions)
+{
+    DirectoryFilter filter = {};
+    filter.Flags = DIRECTORY_FILTER_INCLUDE | DIRECTORY_FILTER_HIDDEN;
+    filter.IncludeGlob = "*.log";
+    filter.HiddenRule = DIRECTORY_HIDDEN_EXCLUDE;
+    EXPECT_EQ((std::set<std::string> { "app.log", "archive.log", "current.log" }), List(&filter));
+
+    filter.Flags = DIRECTORY_FILTER_INCLUDE | DIRECTORY_FILTER_EXCLUDE | DIRECTORY_FILTER_IGNORE_CASE;
+    filter.IncludeGlob = "app.log*";
+    filter.ExcludeGlob = "*.1";
+    EXPECT_EQ((std::set<std::string> { "app.log" }), List(&filter));
+
+    filter.Flags = DIRECTORY_FILTER_HIDDEN;
+    filter.HiddenRule = DIRECTORY_HIDDEN_ONLY;
+    EXPECT_EQ((std::set<std::string> { ".hidden.log" }), List(&filter));
+}
+
+TEST_F(EnumerateDirectoryTest, AppliesTypeSizeAndTimeConditions)
+{
+    DirectoryFilter filter = {};
+    filter.Flags = DIRECTORY_FILTER_TYPE;
+    filter.TypeMask = DIRECTORY_ENTRY_DIRECTORY | DIRECTORY_ENTRY_SYMLINK;
+    EXPECT_EQ((std::set<std::string> { "archive.log", "current.log" }), List(&filter));
+
+    filter.Flags = DIRECTORY_FILTER_TYPE | DIRECTORY_FILTER_SIZE;
+    filter.TypeMask = DIRECTORY_ENTRY_FILE;
+    filter.MinimumSize = 50;
+    filter.MaximumSize = 1000;
+    EXPECT_EQ((std::set<std::string> { "app.log" }), List(&filter));
+
+    filter.Flags = DIRECTORY_FILTER_TYPE | DIRECTORY_FILTER_MODIFIED_TIME;
+    filter.ModifiedAfter = 1500 * 1000000000LL;
+    filter.ModifiedBefore = 3000 * 1000000000LL;
+    EXPECT_EQ((std::set<std::string> { "app.LOG.1" }), List(&filter));
+}
+
+TEST_F(EnumerateDirectoryTest, RejectsInconsistentFilter)
+{
+    DirectoryFilter filter = {};
+    filter.Flags = DIRECTORY_FILTER_INCLUDE;
+
+    DirectoryListing* listing = nullptr;
+    EXPECT_EQ(-1, EnumerateDirectory(root.c_str(), &filter, &listing));
+    EXPECT_EQ(EINVAL, errno);
+    EXPECT_EQ(nullptr, listing);
+}
+
+TEST_F(EnumerateDirectoryTest, ReturnsColumns)
+{
+    DirectoryFilter filter = {};
+    filter.Flags = DIRECTORY_FILTER_TYPE;
+    filter.TypeMask = DIRECTORY_ENTRY_FILE;
+
+    DirectoryColumns* columns = nullptr;
+    ASSERT_EQ(0, EnumerateDirectoryColumns(root.c_str(), &filter, &columns));
+    ASSERT_EQ(4, columns->Count);
+
+    int64_t totalSize = 0;
+    for (int32_t i = 0; i < columns->Count; i++)
+    {
+        EXPECT_EQ(DIRECTORY_ENTRY_FILE, columns->Types[i]);
+        EXPECT_EQ(0, columns->Errors[i]);
+        EXPECT_EQ(columns->NameLengths[i], static_cast<int32_t>(strlen(columns->Names + columns->NameOffsets[i])));
+        totalSize += columns->Sizes[i];
+    }
+    EXPECT_EQ(5120, totalSize);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(columns->Sizes) % 64);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(columns->ModifiedTimes) % 64);
+    FreeDirectoryColumns(columns);
+}
+
+TEST_F(EnumerateDirectoryTest, StatsPathsIntoColumns)
+{
+    std::string file = root + "/app.log";
+    std::string link = root + "/current.log";
+    std::string missing = root + "/missing";
+    const char* paths[] = { file.c_str(), link.c_str(), missing.c_str() };
+
+    DirectoryColumns* columns = nullptr;
+    ASSERT_EQ(0, StatPathsColumns(paths, 3, 0, &columns));
+    ASSERT_EQ(3, columns->Count);
+    EXPECT_EQ(DIRECTORY_ENTRY_FILE, columns->Types[0]);
+    EXPECT_EQ(100, columns->Sizes[0]);
+    EXPECT_EQ(DIRECTORY_ENTRY_SYMLINK, columns->Types[1]);
+    EXPECT_EQ(ENOENT, columns->Errors[2]);
+    EXPECT_EQ(0, columns->Types[2]);
+    EXPECT_STREQ(missing.c_str(), columns->Names + columns->NameOffsets[2]);
+    FreeDirectoryColumns(columns);
+
+    ASSERT_EQ(0, StatPathsColumns(paths, 2, 1, &columns));
+    EXPECT_EQ(DIRECTORY_ENTRY_FILE, columns->Types[1]);
+    EXPECT_EQ(100, columns->Sizes[1]);
+    FreeDirectoryColumns(columns);
+}
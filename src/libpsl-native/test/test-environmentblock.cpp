@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for the environment block
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <set>
+#include <string>
+#include "environmentblock.h"
+
+static std::set<std::string> GetVariables(const EnvironmentBlock* block)
+{
+    std::set<std::string> variables;
+    for (char* const* entry = EnvironmentBlockGetVariables(block); *entry != nullptr; entry++)
+    {
+        variables.insert(*entry);
+    }
+    return variables;
+}
+
+TEST(EnvironmentBlockTest, StartsFromEnvp)
+{
+    char first[] = "A=1";
+    char invalid[] = "NOEQUALS";
+    char replaced[] = "A=2";
+    char second[] = "B=x=y";
+    char* envp[] = { first, invalid, replaced, second, nullptr };
+
+    EnvironmentBlock* block = EnvironmentBlockCreate(envp);
+    ASSERT_NE(nullptr, block);
+    EXPECT_EQ((std::set<std::string> { "A=2", "B=x=y" }), GetVariables(block));
+    EXPECT_STREQ("x=y", EnvironmentBlockGet(block, "B"));
+    EXPECT_EQ(nullptr, EnvironmentBlockGet(block, "C"));
+    EnvironmentBlockDestroy(block);
+}
+
+TEST(EnvironmentBlockTest, AppliesSetAndUnset)
+{
+    EnvironmentBlock* block = EnvironmentBlockCreate(nullptr);
+    ASSERT_NE(nullptr, block);
+    EXPECT_EQ(nullptr, *EnvironmentBlockGetVariables(block));
+
+    // Enough variables to make the block grow a few times
+    for (int i = 0; i < 100; i++)
+    {
+        std::string name = "VAR" + std::to_string(i);
+        ASSERT_EQ(0, EnvironmentBlockSet(block, name.c_str(), std::to_string(i).c_str()));
+    }
+    ASSERT_EQ(0, EnvironmentBlockSet(block, "VAR5", "changed"));
+    ASSERT_EQ(0, EnvironmentBlockUnset(block, "VAR0"));
+    ASSERT_EQ(0, EnvironmentBlockUnset(block, "VAR99"));
+    ASSERT_EQ(0, EnvironmentBlockUnset(block, "MISSING"));
+
+    std::set<std::string> variables = GetVariables(block);
+    EXPECT_EQ(98u, variables.size());
+    EXPECT_EQ(1u, variables.count("VAR5=changed"));
+    EXPECT_EQ(1u, variables.count("VAR98=98"));
+    EXPECT_EQ(0u, variables.count("VAR0=0"));
+    EXPECT_STREQ("changed", EnvironmentBlockGet(block, "VAR5"));
+    EXPECT_STREQ("1", EnvironmentBlockGet(block, "VAR1"));
+
+    EXPECT_EQ(-1, EnvironmentBlockSet(block, "BAD=NAME", "value"));
+    EXPECT_EQ(EINVAL, errno);
+    EnvironmentBlockDestroy(block);
+}
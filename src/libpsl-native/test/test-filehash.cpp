@@ -0,0 +1,258 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for HashFile(), HashFileDescriptor(), HashFileCached(),
+//! HashFiles() and the FileHashCache functions
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "scratchtree.h"
+#include "filehash.h"
+
+class FileHashTest : public ScratchTreeTest
+{
+protected:
+
+    FileHashTest()
+        : ScratchTreeTest("filehash")
+    {
+        CreateFile("abc.txt", "abc");
+        CreateFile("empty.txt", "");
+
+        // Large enough to take several reads, and not a whole number of blocks
+        std::string large;
+        for (int i = 0; i < 3000000; i++)
+        {
+            large += static_cast<char>('a' + i % 26);
+        }
+        CreateFile("large.txt", large);
+    }
+
+    std::string Hash(const std::string& name, int32_t algorithm)
+    {
+        uint8_t digest[64];
+        int32_t size = HashFile((root + "/" + name).c_str(), algorithm, digest, sizeof(digest));
+        EXPECT_EQ(GetFileHashSize(algorithm), size);
+        return size < 0 ? std::string() : ToHex(digest, size);
+    }
+
+    std::string HashCached(const std::string& name, FileHashCache* cache, int32_t* cached)
+    {
+        uint8_t digest[32];
+        int32_t size = HashFileCached((root + "/" + name).c_str(), FILE_HASH_SHA256, cache, digest, sizeof(digest), cached);
+        EXPECT_EQ(32, size);
+        return size < 0 ? std::string() : ToHex(digest, size);
+    }
+
+    // Moves a file's modification time back an hour, so that it is old enough to cache
+    void Backdate(const std::string& name)
+    {
+        struct timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = time(nullptr) - 3600;
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        ASSERT_EQ(0, utimensat(AT_FDCWD, (root + "/" + name).c_str(), times, 0));
+    }
+
+    // Rewrites a file with content of the same size and puts its modification time back
+    void RewriteKeepingTime(const std::string& name, const std::string& content)
+    {
+        struct stat st;
+        ASSERT_EQ(0, stat((root + "/" + name).c_str(), &st));
+        CreateFile(name, content);
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        ASSERT_EQ(0, utimensat(AT_FDCWD, (root + "/" + name).c_str(), times, 0));
+    }
+
+    static std::string ToHex(const uint8_t* digest, int32_t size)
+    {
+        std::string hex;
+        char byte[3];
+        for (int32_t i = 0; i < size; i++)
+        {
+            snprintf(byte, sizeof(byte), "%02x", digest[i]);
+            hex += byte;
+        }
+        return hex;
+    }
+};
+
+TEST_F(FileHashTest, KnownDigests)
+{
+    EXPECT_EQ("900150983cd24fb0d6963f7d28e17f72", Hash("abc.txt", FILE_HASH_MD5));
+    EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", Hash("abc.txt", FILE_HASH_SHA1));
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", Hash("abc.txt", FILE_HASH_SHA256));
+    EXPECT_EQ("ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+              "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f", Hash("abc.txt", FILE_HASH_SHA512));
+
+    EXPECT_EQ("d41d8cd98f00b204e9800998ecf8427e", Hash("empty.txt", FILE_HASH_MD5));
+    EXPECT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", Hash("empty.txt", FILE_HASH_SHA256));
+}
+
+TEST_F(FileHashTest, LargeFile)
+{
+    EXPECT_EQ("cddad10b3de5db0377aebbe26d558537", Hash("large.txt", FILE_HASH_MD5));
+    EXPECT_EQ("52da6acb547c94ba299850dfa929854161b0c89a", Hash("large.txt", FILE_HASH_SHA1));
+    EXPECT_EQ("d6cf32dbb23114747b830011f8d26023eda7c54e0ef816ca9d1925e234b12ca1", Hash("large.txt", FILE_HASH_SHA256));
+}
+
+TEST_F(FileHashTest, DescriptorOffsetIsIgnoredForRegularFiles)
+{
+    int fd = open((root + "/abc.txt").c_str(), O_RDONLY);
+    ASSERT_NE(-1, fd);
+    char first;
+    ASSERT_EQ(1, read(fd, &first, 1));
+
+    uint8_t digest[32];
+    EXPECT_EQ(32, HashFileDescriptor(fd, FILE_HASH_SHA256, digest, sizeof(digest)));
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", ToHex(digest, 32));
+    EXPECT_EQ(1, lseek(fd, 0, SEEK_CUR));
+    close(fd);
+}
+
+TEST_F(FileHashTest, Pipe)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    ASSERT_EQ(3, write(fds[1], "abc", 3));
+    close(fds[1]);
+
+    uint8_t digest[20];
+    EXPECT_EQ(20, HashFileDescriptor(fds[0], FILE_HASH_SHA1, digest, sizeof(digest)));
+    EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", ToHex(digest, 20));
+    close(fds[0]);
+}
+
+TEST_F(FileHashTest, Errors)
+{
+    uint8_t digest[64];
+    EXPECT_EQ(-1, HashFile((root + "/abc.txt").c_str(), 0, digest, sizeof(digest)));
+    EXPECT_EQ(EINVAL, errno);
+    EXPECT_EQ(-1, HashFile((root + "/abc.txt").c_str(), FILE_HASH_SHA512, digest, 32));
+    EXPECT_EQ(ERANGE, errno);
+    EXPECT_EQ(-1, HashFile((root + "/missing").c_str(), FILE_HASH_SHA256, digest, sizeof(digest)));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(-1, HashFile(root.c_str(), FILE_HASH_SHA256, digest, sizeof(digest)));
+    EXPECT_EQ(EISDIR, errno);
+}
+
+TEST_F(FileHashTest, ManyFiles)
+{
+    std::vector<std::string> names;
+    for (int i = 0; i < 50; i++)
+    {
+        names.push_back(root + (i % 2 == 0 ? "/abc.txt" : "/empty.txt"));
+    }
+    names.push_back(root + "/missing");
+
+    std::vector<const char*> paths;
+    for (const std::string& name : names)
+    {
+        paths.push_back(name.c_str());
+    }
+
+    std::vector<uint8_t> digests(paths.size() * 32);
+    std::vector<int32_t> errors(paths.size());
+    EXPECT_EQ(1, HashFiles(paths.data(), static_cast<int32_t>(paths.size()), FILE_HASH_SHA256, nullptr, 4, digests.data(), errors.data()));
+    for (size_t i = 0; i < 50; i++)
+    {
+        EXPECT_EQ(0, errors[i]);
+        EXPECT_EQ(i % 2 == 0 ? "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+                             : "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+                  ToHex(&digests[i * 32], 32));
+    }
+    EXPECT_EQ(ENOENT, errors[50]);
+    EXPECT_EQ(std::string(64, '0'), ToHex(&digests[50 * 32], 32));
+}
+
+TEST_F(FileHashTest, SidecarCache)
+{
+    std::string sidecar = SiblingPath(".sidecar");
+    Backdate("abc.txt");
+    FileHashCache* cache = FileHashCacheOpen(sidecar.c_str(), FILE_HASH_CACHE_NO_XATTR);
+    ASSERT_TRUE(cache != nullptr);
+
+    int32_t cached;
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(0, cached);
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(1, cached);
+    EXPECT_EQ(-1, getxattr((root + "/abc.txt").c_str(), "user.psl.sha256", nullptr, 0));
+
+    EXPECT_EQ(0, FileHashCacheSave(cache, sidecar.c_str()));
+    FileHashCacheClose(cache);
+
+    cache = FileHashCacheOpen(sidecar.c_str(), FILE_HASH_CACHE_NO_XATTR);
+    ASSERT_TRUE(cache != nullptr);
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(1, cached);
+
+    // The change time gives away content rewritten behind an unchanged modification time
+    RewriteKeepingTime("abc.txt", "xyz");
+    EXPECT_EQ("3608bca1e44ea6c4d268eb6db02260269892c0b42b86bbf1e77a6fa16c3c9282", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(0, cached);
+    FileHashCacheClose(cache);
+}
+
+TEST_F(FileHashTest, AttributeCache)
+{
+    Backdate("abc.txt");
+    FileHashCache* cache = FileHashCacheOpen(nullptr, 0);
+    ASSERT_TRUE(cache != nullptr);
+
+    int32_t cached;
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(0, cached);
+    FileHashCacheClose(cache);
+
+    // Without user attributes the digest went to the sidecar, which was not saved
+    bool attributes = getxattr((root + "/abc.txt").c_str(), "user.psl.sha256", nullptr, 0) > 0;
+    cache = FileHashCacheOpen(nullptr, 0);
+    ASSERT_TRUE(cache != nullptr);
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(attributes ? 1 : 0, cached);
+
+    CreateFile("abc.txt", "abcd");
+    EXPECT_EQ("88d4266fd4e6338d13b845fcf289579d209c897823b9217da3e161936f031589", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(0, cached);
+
+    std::vector<const char*> paths;
+    std::string abc = root + "/abc.txt";
+    paths.push_back(abc.c_str());
+    uint8_t digest[32];
+    int32_t error;
+    EXPECT_EQ(0, HashFiles(paths.data(), 1, FILE_HASH_SHA256, cache, 1, digest, &error));
+    EXPECT_EQ("88d4266fd4e6338d13b845fcf289579d209c897823b9217da3e161936f031589", ToHex(digest, 32));
+    FileHashCacheClose(cache);
+}
+
+TEST_F(FileHashTest, RecentlyModifiedFileIsNotCached)
+{
+    FileHashCache* cache = FileHashCacheOpen(nullptr, 0);
+    ASSERT_TRUE(cache != nullptr);
+
+    // A write within the same timestamp tick would leave the key unchanged
+    int32_t cached;
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(0, cached);
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", HashCached("abc.txt", cache, &cached));
+    EXPECT_EQ(0, cached);
+    EXPECT_EQ(-1, getxattr((root + "/abc.txt").c_str(), "user.psl.sha256", nullptr, 0));
+    FileHashCacheClose(cache);
+}
+
+TEST_F(FileHashTest, InvalidSidecar)
+{
+    CreateFile("sidecar", "not a sidecar");
+    EXPECT_TRUE(FileHashCacheOpen((root + "/sidecar").c_str(), 0) == nullptr);
+    EXPECT_EQ(EINVAL, errno);
+}
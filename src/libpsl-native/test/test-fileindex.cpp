@@ -0,0 +1,199 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for the FileIndex functions
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <set>
+#include <string>
+#include "fileindex.h"
+#include "scratchtree.h"
+
+class FileIndexTest : public ScratchTreeTest
+{
+protected:
+
+    std::string indexPath;
+
+    FileIndexTest()
+        : ScratchTreeTest("fileindex")
+    {
+        char* resolved = realpath(root.c_str(), nullptr);
+        root = resolved;
+        free(resolved);
+        indexPath = SiblingPath(".index");
+
+        EXPECT_EQ(0, mkdir((root + "/app").c_str(), 0755));
+        EXPECT_EQ(0, mkdir((root + "/app/bin").c_str(), 0755));
+        EXPECT_EQ(0, mkdir((root + "/lib").c_str(), 0755));
+        CreateFile("web.config");
+        CreateFile("app/App.Config");
+        CreateFile("app/bin/tool.config");
+        CreateFile("app/bin/tool.dll");
+        CreateFile("lib/readme.txt");
+    }
+
+    std::set<std::string> Query(FileIndex* index, const char* pattern, int32_t flags)
+    {
+        DirectoryListing* listing = nullptr;
+        EXPECT_EQ(0, FileIndexQuery(index, pattern, flags, &listing));
+        std::set<std::string> paths;
+        if (listing == nullptr)
+        {
+            return paths;
+        }
+
+        for (int32_t i = 0; i < listing->Count; i++)
+        {
+            const DirectoryEntryInfo& entry = listing->Entries[i];
+            EXPECT_EQ(0, strncmp(listing->Names + entry.NameOffset, root.c_str(), root.size()));
+            paths.insert(std::string(listing->Names + entry.NameOffset + root.size() + 1, entry.NameLength - root.size() - 1));
+        }
+        FreeDirectoryListing(listing);
+        return paths;
+    }
+
+    // Refreshes until the index has seen at least one change or a second has passed
+    void Refresh(FileIndex* index)
+    {
+        int32_t changes = 0;
+        for (int attempt = 0; attempt < 10 && changes == 0; attempt++)
+        {
+            changes = FileIndexRefresh(index, 100);
+            ASSERT_NE(-1, changes);
+        }
+        // Pick up events that arrived while the first batch was applied
+        while (FileIndexRefresh(index, 50) > 0);
+    }
+
+    void WatchAndUpdate(int32_t flags)
+    {
+        ASSERT_EQ(0, FileIndexBuild(root.c_str(), indexPath.c_str(), 2));
+        FileIndex* index = FileIndexOpen(indexPath.c_str());
+        ASSERT_TRUE(index != nullptr);
+        int32_t watching = FileIndexWatch(index, flags);
+        ASSERT_TRUE(watching == FILE_INDEX_WATCHING_FANOTIFY || watching == FILE_INDEX_WATCHING_INOTIFY);
+
+        CreateFile("lib/new.config");
+        EXPECT_EQ(0, mkdir((root + "/lib/sub").c_str(), 0755));
+        CreateFile("lib/sub/deep.config");
+        EXPECT_EQ(0, unlink((root + "/web.config").c_str()));
+        EXPECT_EQ(0, rename((root + "/app/bin").c_str(), (root + "/app/out").c_str()));
+        Refresh(index);
+
+        EXPECT_EQ((std::set<std::string> { "app/out/tool.config", "lib/new.config", "lib/sub/deep.config" }),
+                  Query(index, "*.config", 0));
+
+        // The changes survive a save and reopen
+        ASSERT_EQ(0, FileIndexSave(index, indexPath.c_str()));
+        FileIndexClose(index);
+        index = FileIndexOpen(indexPath.c_str());
+        ASSERT_TRUE(index != nullptr);
+        EXPECT_EQ((std::set<std::string> { "app/out/tool.config", "lib/new.config", "lib/sub/deep.config" }),
+                  Query(index, "*.config", 0));
+        FileIndexClose(index);
+    }
+
+    // A directory renamed to a name that sorts earlier keeps its watch
+    void WatchRenamedDirectory(int32_t flags)
+    {
+        ASSERT_EQ(0, FileIndexBuild(root.c_str(), indexPath.c_str(), 2));
+        FileIndex* index = FileIndexOpen(indexPath.c_str());
+        ASSERT_TRUE(index != nullptr);
+        int32_t watching = FileIndexWatch(index, flags);
+        ASSERT_TRUE(watching == FILE_INDEX_WATCHING_FANOTIFY || watching == FILE_INDEX_WATCHING_INOTIFY);
+
+        EXPECT_EQ(0, rename((root + "/lib").c_str(), (root + "/a-lib").c_str()));
+        Refresh(index);
+        CreateFile("a-lib/later.config");
+        Refresh(index);
+
+        EXPECT_EQ((std::set<std::string> { "a-lib/later.config" }), Query(index, "later.config", 0));
+        EXPECT_EQ((std::set<std::string> { "a-lib/readme.txt" }), Query(index, "readme.txt", 0));
+        FileIndexClose(index);
+    }
+};
+
+TEST_F(FileIndexTest, QueriesByName)
+{
+    ASSERT_EQ(0, FileIndexBuild(root.c_str(), indexPath.c_str(), 0));
+    FileIndex* index = FileIndexOpen(indexPath.c_str());
+    ASSERT_TRUE(index != nullptr);
+
+    EXPECT_EQ((std::set<std::string> { "web.config", "app/bin/tool.config" }), Query(index, "*.config", 0));
+    EXPECT_EQ((std::set<std::string> { "web.config", "app/App.Config", "app/bin/tool.config" }),
+              Query(index, "*.config", FILE_INDEX_QUERY_IGNORE_CASE));
+    EXPECT_EQ((std::set<std::string> { "app/bin/tool.config", "app/bin/tool.dll" }), Query(index, "tool*", 0));
+    EXPECT_EQ((std::set<std::string> { "app/bin" }), Query(index, "bin", 0));
+    EXPECT_EQ((std::set<std::string> { "app/bin/tool.dll" }), Query(index, "t?ol.[d]ll", 0));
+    EXPECT_TRUE(Query(index, "missing", 0).empty());
+    FileIndexClose(index);
+}
+
+TEST_F(FileIndexTest, QueriesByPath)
+{
+    ASSERT_EQ(0, FileIndexBuild(root.c_str(), indexPath.c_str(), 1));
+    FileIndex* index = FileIndexOpen(indexPath.c_str());
+    ASSERT_TRUE(index != nullptr);
+
+    EXPECT_EQ((std::set<std::string> { "web.config" }), Query(index, "*.config", FILE_INDEX_QUERY_PATH));
+    EXPECT_EQ((std::set<std::string> { "app/bin/tool.config", "app/bin/tool.dll" }), Query(index, "app/*/*", FILE_INDEX_QUERY_PATH));
+    FileIndexClose(index);
+}
+
+TEST_F(FileIndexTest, ReportsEntryDetails)
+{
+    ASSERT_EQ(0, FileIndexBuild(root.c_str(), indexPath.c_str(), 0));
+    FileIndex* index = FileIndexOpen(indexPath.c_str());
+    ASSERT_TRUE(index != nullptr);
+
+    DirectoryListing* listing = nullptr;
+    ASSERT_EQ(0, FileIndexQuery(index, "bin", 0, &listing));
+    ASSERT_EQ(1, listing->Count);
+    struct stat st;
+    ASSERT_EQ(0, stat((root + "/app/bin").c_str(), &st));
+    EXPECT_EQ(DIRECTORY_ENTRY_DIRECTORY, listing->Entries[0].Type);
+    EXPECT_EQ(static_cast<int64_t>(st.st_ino), listing->Entries[0].Inode);
+    EXPECT_STREQ((root + "/app/bin").c_str(), listing->Names + listing->Entries[0].NameOffset);
+    FreeDirectoryListing(listing);
+    FileIndexClose(index);
+}
+
+TEST_F(FileIndexTest, KeepsCurrentWithInotify)
+{
+    WatchAndUpdate(FILE_INDEX_WATCH_INOTIFY);
+}
+
+TEST_F(FileIndexTest, KeepsCurrentWithBestWatcher)
+{
+    WatchAndUpdate(0);
+}
+
+TEST_F(FileIndexTest, KeepsRenamedDirectoryWithInotify)
+{
+    WatchRenamedDirectory(FILE_INDEX_WATCH_INOTIFY);
+}
+
+TEST_F(FileIndexTest, KeepsRenamedDirectoryWithBestWatcher)
+{
+    WatchRenamedDirectory(0);
+}
+
+TEST_F(FileIndexTest, RejectsInvalidIndex)
+{
+    int fd = open(indexPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    ASSERT_NE(-1, fd);
+    const char garbage[] = "not an index, just some text that is long enough";
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(garbage)), write(fd, garbage, sizeof(garbage)));
+    close(fd);
+
+    EXPECT_TRUE(FileIndexOpen(indexPath.c_str()) == nullptr);
+    EXPECT_EQ(EINVAL, errno);
+}
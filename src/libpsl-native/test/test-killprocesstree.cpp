@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for KillProcessTree()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "killprocesstree.h"
+
+// Forks a child that outlives the SIGTERM sent to its parent
+static void ForkOnTerm(int)
+{
+    if (fork() == 0)
+    {
+        while (true)
+        {
+            pause();
+        }
+    }
+}
+
+class KillProcessTreeTest : public ::testing::Test
+{
+protected:
+
+    pid_t child = -1;
+    pid_t grandchild = -1;
+
+    // Forks a child that forks a grandchild; both then sleep until signaled.
+    // The grandchild handles SIGTERM with termHandler.
+    void SpawnTree(void (*termHandler)(int))
+    {
+        int fds[2];
+        ASSERT_EQ(0, pipe(fds));
+
+        child = fork();
+        ASSERT_NE(-1, child);
+        if (child == 0)
+        {
+            pid_t inner = fork();
+            if (inner == 0)
+            {
+                signal(SIGTERM, termHandler);
+                pid_t self = getpid();
+                if (write(fds[1], &self, sizeof(self)) != sizeof(self))
+                {
+                    _exit(1);
+                }
+                while (true)
+                {
+                    pause();
+                }
+            }
+            while (true)
+            {
+                pause();
+            }
+        }
+
+        close(fds[1]);
+        ASSERT_EQ(static_cast<ssize_t>(sizeof(grandchild)), read(fds[0], &grandchild, sizeof(grandchild)));
+        close(fds[0]);
+    }
+
+    ~KillProcessTreeTest()
+    {
+        if (child > 0)
+        {
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+        }
+    }
+};
+
+TEST_F(KillProcessTreeTest, TerminatesTreeWithSigterm)
+{
+    SpawnTree(SIG_DFL);
+
+    ProcessTreeKillResult results[8];
+    int32_t count = 0;
+    ASSERT_EQ(0, KillProcessTree(child, 5000, results, 8, &count));
+    ASSERT_EQ(2, count);
+
+    EXPECT_EQ(child, results[0].ProcessId);
+    EXPECT_EQ(getpid(), results[0].ParentProcessId);
+    EXPECT_EQ(PROCESS_TREE_KILL_TERMINATED, results[0].Outcome);
+    EXPECT_EQ(grandchild, results[1].ProcessId);
+    EXPECT_EQ(PROCESS_TREE_KILL_TERMINATED, results[1].Outcome);
+
+    int status;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    EXPECT_TRUE(WIFSIGNALED(status));
+    EXPECT_EQ(SIGTERM, WTERMSIG(status));
+    child = -1;
+}
+
+TEST_F(KillProcessTreeTest, EscalatesToSigkill)
+{
+    SpawnTree(SIG_IGN);
+
+    ProcessTreeKillResult results[8];
+    int32_t count = 0;
+    ASSERT_EQ(0, KillProcessTree(child, 100, results, 8, &count));
+    ASSERT_EQ(2, count);
+
+    EXPECT_EQ(PROCESS_TREE_KILL_TERMINATED, results[0].Outcome);
+    EXPECT_EQ(grandchild, results[1].ProcessId);
+    EXPECT_EQ(PROCESS_TREE_KILL_KILLED, results[1].Outcome);
+}
+
+TEST_F(KillProcessTreeTest, KillsChildrenForkedDuringGracePeriod)
+{
+    SpawnTree(ForkOnTerm);
+
+    ProcessTreeKillResult results[8];
+    int32_t count = 0;
+    ASSERT_EQ(0, KillProcessTree(child, 200, results, 8, &count));
+    ASSERT_EQ(3, count);
+
+    EXPECT_EQ(PROCESS_TREE_KILL_TERMINATED, results[0].Outcome);
+    EXPECT_EQ(grandchild, results[1].ProcessId);
+    EXPECT_EQ(PROCESS_TREE_KILL_KILLED, results[1].Outcome);
+    EXPECT_EQ(grandchild, results[2].ParentProcessId);
+    EXPECT_EQ(PROCESS_TREE_KILL_KILLED, results[2].Outcome);
+}
+
+TEST_F(KillProcessTreeTest, ReportsTotalCountWhenResultsAreTruncated)
+{
+    SpawnTree(SIG_DFL);
+
+    ProcessTreeKillResult results[1];
+    int32_t count = 0;
+    ASSERT_EQ(0, KillProcessTree(child, 5000, results, 1, &count));
+    EXPECT_EQ(2, count);
+    EXPECT_EQ(child, results[0].ProcessId);
+}
+
+TEST_F(KillProcessTreeTest, NonexistentProcessFails)
+{
+    int32_t count = 0;
+    EXPECT_EQ(-1, KillProcessTree(INT_MAX, 0, NULL, 0, &count));
+    EXPECT_EQ(ESRCH, errno);
+}
@@ -0,0 +1,175 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for ComputeMerkleTree() and the MerkleCache functions
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include "merkletree.h"
+#include "scratchtree.h"
+
+class MerkleTreeTest : public ScratchTreeTest
+{
+protected:
+
+    std::string cachePath;
+    std::string copyPath;
+
+    MerkleTreeTest()
+        : ScratchTreeTest("merkletree")
+    {
+        cachePath = SiblingPath(".cache");
+        copyPath = SiblingPath(".copy");
+        EXPECT_EQ(0, mkdir((root + "/module").c_str(), 0755));
+        CreateFile("abc.txt", "abc");
+        CreateFile("empty.txt", "");
+        CreateFile("module/module.psm1", "function Test-Module {}");
+        EXPECT_EQ(0, symlink("abc.txt", (root + "/link").c_str()));
+    }
+
+    // Moves every modification time back an hour, so that the files are old enough to cache
+    void Backdate()
+    {
+        struct timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = time(nullptr) - 3600;
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        for (const char* name : { "abc.txt", "empty.txt", "module/module.psm1" })
+        {
+            ASSERT_EQ(0, utimensat(AT_FDCWD, (root + "/" + name).c_str(), times, 0));
+        }
+    }
+
+    static std::string ToHex(const uint8_t* digest)
+    {
+        std::string hex;
+        char byte[3];
+        for (int i = 0; i < 32; i++)
+        {
+            snprintf(byte, sizeof(byte), "%02x", digest[i]);
+            hex += byte;
+        }
+        return hex;
+    }
+
+    // Returns the digests by relative path, "" being the root
+    static std::map<std::string, std::string> Digests(MerkleTree* tree)
+    {
+        std::map<std::string, std::string> digests;
+        for (int32_t i = 0; i < tree->Count; i++)
+        {
+            const MerkleEntry& entry = tree->Entries[i];
+            EXPECT_EQ(0, entry.Error);
+            EXPECT_LT(entry.Parent, i);
+            digests[std::string(tree->Paths + entry.PathOffset, entry.PathLength)] = ToHex(entry.Digest);
+        }
+        return digests;
+    }
+};
+
+TEST_F(MerkleTreeTest, HashesFilesWithSha256)
+{
+    MerkleTree* tree = nullptr;
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), nullptr, 2, &tree));
+    std::map<std::string, std::string> digests = Digests(tree);
+    EXPECT_EQ(6u, digests.size());
+    EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", digests["abc.txt"]);
+    EXPECT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", digests["empty.txt"]);
+
+    // A link hashes as the path it holds
+    EXPECT_EQ("6c7015743716459d7fa1fc359664de136ca215afa0bea28efa1f744b38dff164", digests["link"]);
+    EXPECT_EQ(3, tree->FilesHashed);
+    EXPECT_EQ(26, tree->BytesHashed);
+    FreeMerkleTree(tree);
+}
+
+TEST_F(MerkleTreeTest, DirectoryDigestsFollowContent)
+{
+    MerkleTree* tree = nullptr;
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), nullptr, 0, &tree));
+    std::map<std::string, std::string> before = Digests(tree);
+    FreeMerkleTree(tree);
+
+    // A copy has the same digests, wherever it is
+    std::string command = "cp -a " + root + " " + copyPath;
+    ASSERT_EQ(0, system(command.c_str()));
+    ASSERT_EQ(0, ComputeMerkleTree(copyPath.c_str(), nullptr, 0, &tree));
+    EXPECT_EQ(before, Digests(tree));
+    FreeMerkleTree(tree);
+
+    CreateFile("module/module.psm1", "function Test-Module { 'changed' }");
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), nullptr, 0, &tree));
+    std::map<std::string, std::string> after = Digests(tree);
+    FreeMerkleTree(tree);
+
+    EXPECT_NE(before["module/module.psm1"], after["module/module.psm1"]);
+    EXPECT_NE(before["module"], after["module"]);
+    EXPECT_NE(before[""], after[""]);
+    EXPECT_EQ(before["abc.txt"], after["abc.txt"]);
+}
+
+TEST_F(MerkleTreeTest, CacheSkipsUnchangedFiles)
+{
+    Backdate();
+    MerkleCache* cache = MerkleCacheOpen(cachePath.c_str());
+    ASSERT_TRUE(cache != nullptr);
+    MerkleTree* tree = nullptr;
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), cache, 0, &tree));
+    std::map<std::string, std::string> first = Digests(tree);
+    EXPECT_EQ(0, tree->FilesCached);
+    FreeMerkleTree(tree);
+    ASSERT_EQ(0, MerkleCacheSave(cache, cachePath.c_str()));
+    MerkleCacheClose(cache);
+
+    cache = MerkleCacheOpen(cachePath.c_str());
+    ASSERT_TRUE(cache != nullptr);
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), cache, 0, &tree));
+    EXPECT_EQ(first, Digests(tree));
+    EXPECT_EQ(3, tree->FilesCached);
+    EXPECT_EQ(0, tree->FilesHashed);
+    FreeMerkleTree(tree);
+
+    CreateFile("abc.txt", "abcd");
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), cache, 0, &tree));
+    EXPECT_EQ(2, tree->FilesCached);
+    EXPECT_EQ(1, tree->FilesHashed);
+    EXPECT_EQ("88d4266fd4e6338d13b845fcf289579d209c897823b9217da3e161936f031589", Digests(tree)["abc.txt"]);
+    FreeMerkleTree(tree);
+    MerkleCacheClose(cache);
+}
+
+TEST_F(MerkleTreeTest, CacheSkipsRecentlyModifiedFiles)
+{
+    MerkleCache* cache = MerkleCacheOpen(nullptr);
+    ASSERT_TRUE(cache != nullptr);
+    MerkleTree* tree = nullptr;
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), cache, 0, &tree));
+    FreeMerkleTree(tree);
+
+    // A file written again within the same tick would keep its key, so none was cached
+    ASSERT_EQ(0, ComputeMerkleTree(root.c_str(), cache, 0, &tree));
+    EXPECT_EQ(0, tree->FilesCached);
+    EXPECT_EQ(3, tree->FilesHashed);
+    FreeMerkleTree(tree);
+    MerkleCacheClose(cache);
+}
+
+TEST_F(MerkleTreeTest, RejectsInvalidCache)
+{
+    int fd = open(cachePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    ASSERT_NE(-1, fd);
+    const char garbage[] = "not a cache";
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(garbage)), write(fd, garbage, sizeof(garbage)));
+    close(fd);
+
+    EXPECT_TRUE(MerkleCacheOpen(cachePath.c_str()) == nullptr);
+    EXPECT_EQ(EINVAL, errno);
+}
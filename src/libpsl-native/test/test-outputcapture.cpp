@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for the memory backed output capture
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include "createprocess.h"
+#include "outputcapture.h"
+
+class OutputCaptureTest : public ::testing::Test
+{
+protected:
+
+    int32_t fd = -1;
+
+    OutputCaptureTest()
+    {
+        EXPECT_EQ(0, CreateOutputCapture(&fd));
+
+        SpawnAttributes attributes = {};
+        attributes.Flags = SPAWN_ATTRIBUTE_STDIO;
+        attributes.Stdout.Kind = SPAWN_STDIO_FD;
+        attributes.Stdout.Fd = fd;
+
+        char arg0[] = "sh";
+        char arg1[] = "-c";
+        char arg2[] = "echo captured output";
+        char* argv[] = { arg0, arg1, arg2, nullptr };
+        char* envp[] = { nullptr };
+        int32_t pid, stdinFd, stdoutFd, stderrFd;
+        EXPECT_EQ(0, ForkAndExecProcessWithAttributes("/bin/sh", argv, envp, nullptr, 0, 0, 0, 0,
+                                                      &attributes, &pid, &stdinFd, &stdoutFd, &stderrFd));
+        waitpid(pid, NULL, 0);
+    }
+
+    ~OutputCaptureTest()
+    {
+        close(fd);
+    }
+};
+
+TEST_F(OutputCaptureTest, MapsWholeOutput)
+{
+    const uint8_t* data;
+    int64_t length;
+    ASSERT_EQ(OUTPUT_CAPTURE_MAPPED, MapOutputCapture(fd, 1024, &data, &length));
+    ASSERT_EQ(16, length);
+    EXPECT_EQ("captured output\n", std::string(reinterpret_cast<const char*>(data), length));
+    EXPECT_EQ(0, UnmapOutputCapture(data, length));
+}
+
+TEST_F(OutputCaptureTest, FallsBackToStreamingAboveCap)
+{
+    const uint8_t* data;
+    int64_t length;
+    ASSERT_EQ(OUTPUT_CAPTURE_TOO_LARGE, MapOutputCapture(fd, 8, &data, &length));
+    EXPECT_TRUE(data == nullptr);
+    EXPECT_EQ(16, length);
+
+    char buffer[8];
+    EXPECT_EQ(8, read(fd, buffer, sizeof(buffer)));
+    EXPECT_EQ("captured", std::string(buffer, 8));
+}
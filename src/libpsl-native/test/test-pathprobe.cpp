@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for ProbePaths()
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "scratchtree.h"
+#include "pathprobe.h"
+
+class PathProbeTest : public ScratchTreeTest
+{
+protected:
+
+
+    PathProbeTest()
+        : ScratchTreeTest("pathprobe")
+    {
+        close(open((root + "/module.psd1").c_str(), O_CREAT | O_WRONLY, 0644));
+        EXPECT_EQ(0, mkdir((root + "/sub").c_str(), 0755));
+        EXPECT_EQ(0, symlink("sub", (root + "/link").c_str()));
+        EXPECT_EQ(0, symlink("missing", (root + "/dangling").c_str()));
+    }
+
+    static bool IsSet(const std::vector<uint8_t>& bitmap, size_t index)
+    {
+        return (bitmap[index / 8] >> (index % 8)) & 1;
+    }
+};
+
+TEST_F(PathProbeTest, AnswersCandidatesFromListing)
+{
+    std::vector<std::string> names = {
+        root + "/module.psd1",
+        root + "/module.psm1",
+        root + "/module.dll",
+        root + "/sub",
+        root + "/link",
+        root + "/dangling",
+        root + "/sub/",
+        root + "/missing/module.psd1",
+        root + "/missing/module.psm1",
+        root + "/module.psd1",
+        "/",
+    };
+    std::vector<const char*> paths;
+    for (const std::string& name : names)
+    {
+        paths.push_back(name.c_str());
+    }
+
+    std::vector<uint8_t> exists(2, 0xff);
+    std::vector<uint8_t> directories(2, 0xff);
+    ASSERT_EQ(0, ProbePaths(paths.data(), static_cast<int32_t>(paths.size()), exists.data(), directories.data()));
+
+    const bool expectedExists[] = { true, false, false, true, true, true, true, false, false, true, true };
+    const bool expectedDirectory[] = { false, false, false, true, true, false, true, false, false, false, true };
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        EXPECT_EQ(expectedExists[i], IsSet(exists, i)) << names[i];
+        EXPECT_EQ(expectedDirectory[i], IsSet(directories, i)) << names[i];
+    }
+
+    // Bits past the last path are cleared
+    EXPECT_EQ(0, exists[1] >> 3);
+}
@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for SignalProcessGroup() and WaitProcessGroup()
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "createprocess.h"
+#include "signalprocessgroup.h"
+#include "waitprocessgroup.h"
+
+// Matches CREATE_NEW_PROCESS_GROUP in createprocess.cpp
+static const int32_t CreateNewProcessGroup = 0x00000002;
+
+class SignalProcessGroupTest : public ::testing::Test
+{
+protected:
+
+    pid_t StartSleep()
+    {
+        char arg0[] = "sleep";
+        char arg1[] = "30";
+        char* argv[] = { arg0, arg1, nullptr };
+        char* envp[] = { nullptr };
+        int32_t pid, stdinFd, stdoutFd, stderrFd;
+
+        int32_t ret = ForkAndExecProcess("/bin/sleep", argv, envp, nullptr, 0, 0, 0,
+                                         CreateNewProcessGroup, &pid, &stdinFd, &stdoutFd, &stderrFd);
+        EXPECT_EQ(0, ret);
+        return pid;
+    }
+};
+
+TEST_F(SignalProcessGroupTest, ChildLeadsItsOwnGroup)
+{
+    pid_t pid = StartSleep();
+    EXPECT_EQ(pid, getpgid(pid));
+
+    EXPECT_EQ(0, SignalProcessGroup(pid, SIGKILL));
+
+    int32_t exitCode = 0;
+    EXPECT_EQ(pid, WaitProcessGroup(pid, false, &exitCode));
+    EXPECT_EQ(128 + SIGKILL, exitCode);
+}
+
+TEST_F(SignalProcessGroupTest, SuspendAndResumeGroup)
+{
+    pid_t pid = StartSleep();
+    int32_t exitCode = 0;
+
+    int status = 0;
+
+    EXPECT_EQ(0, SuspendProcessGroup(pid));
+    ASSERT_EQ(pid, waitpid(pid, &status, WUNTRACED));
+    EXPECT_TRUE(WIFSTOPPED(status));
+    EXPECT_EQ(SIGSTOP, WSTOPSIG(status));
+
+    EXPECT_EQ(0, ResumeProcessGroup(pid));
+    ASSERT_EQ(pid, waitpid(pid, &status, WCONTINUED));
+    EXPECT_TRUE(WIFCONTINUED(status));
+    EXPECT_EQ(0, WaitProcessGroup(pid, true, &exitCode));
+
+    EXPECT_EQ(0, SignalProcessGroup(pid, SIGTERM));
+    EXPECT_EQ(pid, WaitProcessGroup(pid, false, &exitCode));
+    EXPECT_EQ(128 + SIGTERM, exitCode);
+
+    EXPECT_EQ(-1, WaitProcessGroup(pid, true, &exitCode));
+    EXPECT_EQ(ECHILD, errno);
+}
+
+TEST_F(SignalProcessGroupTest, RefusesOwnGroup)
+{
+    EXPECT_EQ(-1, SignalProcessGroup(getpgrp(), 0));
+    EXPECT_EQ(EPERM, errno);
+}
@@ -0,0 +1,153 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for SplitLines() and the line reader
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "splitlines.h"
+
+static std::vector<std::string> Split(const std::string& text, bool isFinal, std::vector<int32_t>* flags = nullptr)
+{
+    std::vector<LineSpan> lines(text.size() + 1);
+    int32_t count = 0;
+    int32_t consumed = 0;
+    EXPECT_EQ(0, SplitLines(reinterpret_cast<const uint8_t*>(text.data()), text.size(), isFinal,
+                            lines.data(), lines.size(), &count, &consumed));
+
+    std::vector<std::string> result;
+    for (int32_t i = 0; i < count; i++)
+    {
+        result.push_back(text.substr(lines[i].Offset, lines[i].Length));
+        if (flags != nullptr)
+        {
+            flags->push_back(lines[i].Flags);
+        }
+    }
+    return result;
+}
+
+TEST(SplitLinesTest, SplitsOnNewlineAndCarriageReturnNewline)
+{
+    std::vector<std::string> expected = { "one", "two", "", "three" };
+    EXPECT_EQ(expected, Split("one\ntwo\r\n\nthree", true));
+}
+
+TEST(SplitLinesTest, LeavesPartialLineUnlessFinal)
+{
+    std::string text = "complete\npartial";
+    std::vector<LineSpan> lines(4);
+    int32_t count = 0;
+    int32_t consumed = 0;
+    ASSERT_EQ(0, SplitLines(reinterpret_cast<const uint8_t*>(text.data()), text.size(), 0,
+                            lines.data(), lines.size(), &count, &consumed));
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(9, consumed);
+}
+
+TEST(SplitLinesTest, StopsWhenLinesArrayIsFull)
+{
+    std::string text = "a\nb\nc\n";
+    LineSpan lines[2];
+    int32_t count = 0;
+    int32_t consumed = 0;
+    ASSERT_EQ(0, SplitLines(reinterpret_cast<const uint8_t*>(text.data()), text.size(), 1,
+                            lines, 2, &count, &consumed));
+    EXPECT_EQ(2, count);
+    EXPECT_EQ(4, consumed);
+}
+
+TEST(SplitLinesTest, ClassifiesEncoding)
+{
+    std::vector<int32_t> flags;
+    Split("plain ascii line that is longer than one simd block\n"
+          "caf\xc3\xa9 and more text to cross the block boundary \xe2\x82\xac\n"
+          "bad \xc3\x28 sequence\n"
+          "overlong \xc0\xaf slash\n"
+          "surrogate \xed\xa0\x80\n", true, &flags);
+
+    std::vector<int32_t> expected = { LINE_IS_ASCII, 0, LINE_IS_INVALID_UTF8, LINE_IS_INVALID_UTF8, LINE_IS_INVALID_UTF8 };
+    EXPECT_EQ(expected, flags);
+}
+
+TEST(SplitLinesTest, MatchesNaiveSplitAcrossBlockBoundaries)
+{
+    std::string text;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 300; i++)
+    {
+        std::string line(i % 70, static_cast<char>('a' + i % 26));
+        if (i % 7 == 0)
+        {
+            line += "\xc3\xa9";
+        }
+        expected.push_back(line);
+        text += line + "\n";
+    }
+
+    EXPECT_EQ(expected, Split(text, true));
+}
+
+TEST(SplitLinesTest, LineReaderReadsLinesFromPipe)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    std::string text = "first line\nsecond line that is long enough to outgrow the buffer\nlast";
+    ASSERT_EQ(static_cast<ssize_t>(text.size()), write(fds[1], text.data(), text.size()));
+    close(fds[1]);
+
+    LineReader* reader = LineReaderCreate(fds[0], 8);
+    ASSERT_TRUE(reader != nullptr);
+
+    std::vector<std::string> result;
+    const uint8_t* buffer;
+    LineSpan lines[4];
+    int32_t count;
+    while (LineReaderRead(reader, &buffer, lines, 4, &count) == 0 && count > 0)
+    {
+        for (int32_t i = 0; i < count; i++)
+        {
+            result.push_back(std::string(reinterpret_cast<const char*>(buffer) + lines[i].Offset, lines[i].Length));
+        }
+    }
+
+    LineReaderDestroy(reader);
+    close(fds[0]);
+
+    std::vector<std::string> expected = { "first line", "second line that is long enough to outgrow the buffer", "last" };
+    EXPECT_EQ(expected, result);
+}
+
+TEST(SplitLinesTest, LineReaderReturnsBufferedLinesOneAtATime)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    std::string text = "a\nb\nc\n";
+    ASSERT_EQ(static_cast<ssize_t>(text.size()), write(fds[1], text.data(), text.size()));
+
+    LineReader* reader = LineReaderCreate(fds[0], 0);
+    ASSERT_TRUE(reader != nullptr);
+
+    // Lines already in the buffer are returned without waiting for more input
+    std::vector<std::string> result;
+    const uint8_t* buffer;
+    LineSpan lines[1];
+    int32_t count;
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(0, LineReaderRead(reader, &buffer, lines, 1, &count));
+        ASSERT_EQ(1, count);
+        result.push_back(std::string(reinterpret_cast<const char*>(buffer) + lines[0].Offset, lines[0].Length));
+    }
+
+    close(fds[1]);
+    EXPECT_EQ(0, LineReaderRead(reader, &buffer, lines, 1, &count));
+    EXPECT_EQ(0, count);
+    LineReaderDestroy(reader);
+    close(fds[0]);
+
+    std::vector<std::string> expected = { "a", "b", "c" };
+    EXPECT_EQ(expected, result);
+}
@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for the stdin feeders
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "stdinfeeder.h"
+
+class StdinFeederTest : public ::testing::Test
+{
+protected:
+
+    int fds[2] = { -1, -1 };
+
+    StdinFeederTest()
+    {
+        EXPECT_EQ(0, pipe(fds));
+    }
+
+    ~StdinFeederTest()
+    {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    std::vector<uint8_t> ReadAll(size_t length)
+    {
+        std::vector<uint8_t> data(length);
+        size_t total = 0;
+        while (total < length)
+        {
+            ssize_t count = read(fds[0], data.data() + total, length - total);
+            if (count <= 0)
+            {
+                break;
+            }
+            total += count;
+        }
+        data.resize(total);
+        return data;
+    }
+};
+
+TEST_F(StdinFeederTest, FeedsBufferThroughPipe)
+{
+    const uint8_t data[] = "hello from the parent\n";
+    int64_t written = 0;
+    ASSERT_EQ(FEED_STDIN_COMPLETE, FeedStdinFromBuffer(fds[1], data, sizeof(data) - 1, 0, &written));
+    EXPECT_EQ(static_cast<int64_t>(sizeof(data) - 1), written);
+
+    int32_t pending = 0;
+    ASSERT_EQ(0, GetStdinPendingBytes(fds[0], &pending));
+    EXPECT_EQ(static_cast<int32_t>(sizeof(data) - 1), pending);
+
+    std::vector<uint8_t> result = ReadAll(sizeof(data) - 1);
+    EXPECT_EQ(0, memcmp(data, result.data(), sizeof(data) - 1));
+}
+
+TEST_F(StdinFeederTest, ReportsBackpressureWhenPipeIsFull)
+{
+    int capacity = 16 * 4096;
+#if defined(F_GETPIPE_SZ)
+    capacity = fcntl(fds[1], F_GETPIPE_SZ);
+#endif
+    std::vector<uint8_t> data(capacity * 4, 'x');
+
+    const int32_t modes[] = { FEED_STDIN_NONBLOCKING, FEED_STDIN_NONBLOCKING | FEED_STDIN_COPY };
+    for (int32_t flags : modes)
+    {
+        int64_t written = 0;
+        ASSERT_EQ(FEED_STDIN_BACKPRESSURE, FeedStdinFromBuffer(fds[1], data.data(), data.size(), flags, &written));
+        EXPECT_GT(written, 0);
+        EXPECT_LT(written, static_cast<int64_t>(data.size()));
+        EXPECT_EQ(static_cast<size_t>(written), ReadAll(written).size());
+    }
+}
+
+TEST_F(StdinFeederTest, FeedsFileRange)
+{
+    char path[] = "/tmp/stdinfeederXXXXXX";
+    int file = mkstemp(path);
+    ASSERT_NE(-1, file);
+    unlink(path);
+    const char contents[] = "0123456789abcdef";
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(contents) - 1), write(file, contents, sizeof(contents) - 1));
+
+    int64_t written = 0;
+    ASSERT_EQ(FEED_STDIN_COMPLETE, FeedStdinFromFile(fds[1], file, 4, 6, 0, &written));
+    EXPECT_EQ(6, written);
+    std::vector<uint8_t> result = ReadAll(6);
+    EXPECT_EQ(0, memcmp("456789", result.data(), 6));
+
+    // -1 feeds up to the end of the file
+    ASSERT_EQ(FEED_STDIN_COMPLETE, FeedStdinFromFile(fds[1], file, 10, -1, 0, &written));
+    EXPECT_EQ(6, written);
+    result = ReadAll(6);
+    EXPECT_EQ(0, memcmp("abcdef", result.data(), 6));
+
+    close(file);
+}
+
+TEST_F(StdinFeederTest, FailsWithEpipeWhenReaderIsGone)
+{
+    signal(SIGPIPE, SIG_IGN);
+    close(fds[0]);
+    fds[0] = -1;
+
+    const uint8_t data[] = "lost";
+    int64_t written = 0;
+    EXPECT_EQ(-1, FeedStdinFromBuffer(fds[1], data, 4, 0, &written));
+    EXPECT_EQ(EPIPE, errno);
+}
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for ForkAndExecProcessInTerminal() and the terminal relay
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <string>
+#include "createprocess.h"
+#include "terminalrelay.h"
+
+class TerminalRelayTest : public ::testing::Test
+{
+protected:
+
+    int32_t pid = -1;
+    int32_t master = -1;
+    int output[2] = { -1, -1 };
+    TerminalRelay* relay = nullptr;
+
+    void Start(const char* script, int inputFd)
+    {
+        char arg0[] = "sh";
+        char arg1[] = "-c";
+        char* argv[] = { arg0, arg1, const_cast<char*>(script), nullptr };
+        char* envp[] = { nullptr };
+        ASSERT_EQ(0, ForkAndExecProcessInTerminal("/bin/sh", argv, envp, nullptr, 0, nullptr, 100, 30, &pid, &master));
+        ASSERT_EQ(0, pipe(output));
+        relay = TerminalRelayCreate(master, inputFd, output[1], 0);
+        ASSERT_NE(nullptr, relay);
+    }
+
+    std::string RunToCompletion()
+    {
+        EXPECT_EQ(TERMINAL_RELAY_CLOSED, TerminalRelayRun(relay, 10000));
+        close(output[1]);
+        output[1] = -1;
+
+        std::string text;
+        char buffer[256];
+        ssize_t count;
+        while ((count = read(output[0], buffer, sizeof(buffer))) > 0)
+        {
+            text.append(buffer, count);
+        }
+        return text;
+    }
+
+    ~TerminalRelayTest()
+    {
+        TerminalRelayDestroy(relay);
+        if (pid > 0)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        }
+        for (int fd : { master, output[0], output[1] })
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+};
+
+TEST_F(TerminalRelayTest, ChildRunsOnTerminalWithRequestedSize)
+{
+    Start("test -t 0 && test -t 1 && test -t 2 && echo tty; stty size", -1);
+    std::string text = RunToCompletion();
+    EXPECT_NE(std::string::npos, text.find("tty\r\n")) << text;
+    EXPECT_NE(std::string::npos, text.find("30 100")) << text;
+}
+
+TEST_F(TerminalRelayTest, RelaysInputAndEndOfInput)
+{
+    int input[2];
+    ASSERT_EQ(0, pipe(input));
+    ASSERT_EQ(6, write(input[1], "hello\n", 6));
+    close(input[1]);
+
+    Start("stty -echo; read line; echo \"got $line\"; cat; echo done", input[0]);
+    std::string text = RunToCompletion();
+    close(input[0]);
+    EXPECT_NE(std::string::npos, text.find("got hello")) << text;
+    EXPECT_NE(std::string::npos, text.find("done")) << text;
+}
+
+TEST_F(TerminalRelayTest, ResizeAndStop)
+{
+    Start("sleep 10", -1);
+    ASSERT_EQ(0, TerminalRelayResize(relay, 120, 40));
+
+    struct winsize size;
+    ASSERT_EQ(0, ioctl(master, TIOCGWINSZ, &size));
+    EXPECT_EQ(120, size.ws_col);
+    EXPECT_EQ(40, size.ws_row);
+
+    EXPECT_EQ(TERMINAL_RELAY_TIMEOUT, TerminalRelayRun(relay, 10));
+    ASSERT_EQ(0, TerminalRelayStop(relay));
+    EXPECT_EQ(TERMINAL_RELAY_STOPPED, TerminalRelayRun(relay, -1));
+}
@@ -0,0 +1,208 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+//! @brief Implements test for the TreeSnapshot functions
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include "scratchtree.h"
+#include "treesnapshot.h"
+
+class TreeSnapshotTest : public ScratchTreeTest
+{
+protected:
+
+    std::string snapshotPath;
+    std::string newerSnapshotPath;
+    std::string copyPath;
+
+    TreeSnapshotTest()
+        : ScratchTreeTest("treesnapshot")
+    {
+        snapshotPath = SiblingPath(".snapshot");
+        newerSnapshotPath = SiblingPath(".snapshot.2");
+        copyPath = SiblingPath(".copy");
+        EXPECT_EQ(0, mkdir((root + "/modules").c_str(), 0755));
+        EXPECT_EQ(0, mkdir((root + "/modules/net").c_str(), 0755));
+        CreateFile("modules/net/net.psm1", "function Get-Net {}");
+        CreateFile("modules/net/net.psd1", "@{}");
+        CreateFile("readme.md", "hello");
+        CreateFile("old.log", "log");
+    }
+
+    void ChangeTree()
+    {
+        CreateFile("modules/net/net.psm1", "function Get-Net { 'changed' }");
+        CreateFile("modules/new.txt", "new");
+        ASSERT_EQ(0, unlink((root + "/old.log").c_str()));
+        ASSERT_EQ(0, rename((root + "/readme.md").c_str(), (root + "/README.md").c_str()));
+    }
+
+    // Runs action in a child that drops to an unprivileged user if need be, since root can read
+    // any directory. Returns the errno the action failed with, or 0.
+    template <typename TAction>
+    int RunUnprivileged(TAction action)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            if (geteuid() == 0 && (setgid(65534) != 0 || setuid(65534) != 0))
+            {
+                _exit(255);
+            }
+            _exit(action() == 0 ? 0 : errno);
+        }
+
+        int status;
+        EXPECT_EQ(pid, waitpid(pid, &status, 0));
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    // Makes modules/net unreadable to everyone but root
+    void HideSubdirectory()
+    {
+        ASSERT_EQ(0, chmod(root.c_str(), 0755));
+        ASSERT_EQ(0, chmod((root + "/modules/net").c_str(), 0));
+    }
+
+    // Returns the changes by path, with the old path of renames appended after "<-"
+    static std::map<std::string, int32_t> Describe(TreeDiff* diff)
+    {
+        std::map<std::string, int32_t> changes;
+        for (int32_t i = 0; diff != nullptr && i < diff->Count; i++)
+        {
+            const TreeChange& change = diff->Changes[i];
+            std::string path(diff->Paths + change.PathOffset, change.PathLength);
+            if (change.OldPathOffset >= 0)
+            {
+                path += "<-" + std::string(diff->Paths + change.OldPathOffset, change.OldPathLength);
+            }
+            changes[path] = change.Kind;
+        }
+        FreeTreeDiff(diff);
+        return changes;
+    }
+
+    static std::map<std::string, int32_t> ExpectedChanges()
+    {
+        return std::map<std::string, int32_t> {
+            { "modules/net/net.psm1", TREE_CHANGE_MODIFIED },
+            { "modules/new.txt", TREE_CHANGE_ADDED },
+            { "old.log", TREE_CHANGE_REMOVED },
+            { "README.md<-readme.md", TREE_CHANGE_RENAMED } };
+    }
+};
+
+TEST_F(TreeSnapshotTest, UnchangedTreeHasNoChanges)
+{
+    ASSERT_EQ(0, TreeSnapshotCapture(root.c_str(), snapshotPath.c_str(), 0));
+    TreeSnapshot* snapshot = TreeSnapshotOpen(snapshotPath.c_str());
+    ASSERT_TRUE(snapshot != nullptr);
+
+    TreeDiff* diff = nullptr;
+    ASSERT_EQ(0, TreeSnapshotDiffLive(snapshot, root.c_str(), 0, 2, &diff));
+    EXPECT_EQ(0, diff->Count);
+    FreeTreeDiff(diff);
+    TreeSnapshotClose(snapshot);
+}
+
+TEST_F(TreeSnapshotTest, DiffsAgainstLiveTree)
+{
+    ASSERT_EQ(0, TreeSnapshotCapture(root.c_str(), snapshotPath.c_str(), 2));
+    TreeSnapshot* snapshot = TreeSnapshotOpen(snapshotPath.c_str());
+    ASSERT_TRUE(snapshot != nullptr);
+    ChangeTree();
+
+    TreeDiff* diff = nullptr;
+    ASSERT_EQ(0, TreeSnapshotDiffLive(snapshot, root.c_str(), 0, 0, &diff));
+    EXPECT_EQ(ExpectedChanges(), Describe(diff));
+    TreeSnapshotClose(snapshot);
+}
+
+TEST_F(TreeSnapshotTest, DiffsTwoSnapshots)
+{
+    ASSERT_EQ(0, TreeSnapshotCapture(root.c_str(), snapshotPath.c_str(), 1));
+    ChangeTree();
+    ASSERT_EQ(0, TreeSnapshotCapture(root.c_str(), newerSnapshotPath.c_str(), 1));
+
+    TreeSnapshot* older = TreeSnapshotOpen(snapshotPath.c_str());
+    TreeSnapshot* newer = TreeSnapshotOpen(newerSnapshotPath.c_str());
+    ASSERT_TRUE(older != nullptr && newer != nullptr);
+
+    TreeDiff* diff = nullptr;
+    ASSERT_EQ(0, TreeSnapshotDiff(older, newer, 0, &diff));
+    EXPECT_EQ(ExpectedChanges(), Describe(diff));
+
+    // Reversed, the additions become removals and the rename goes back
+    ASSERT_EQ(0, TreeSnapshotDiff(newer, older, 0, &diff));
+    std::map<std::string, int32_t> reversed = Describe(diff);
+    EXPECT_EQ(TREE_CHANGE_REMOVED, reversed["modules/new.txt"]);
+    EXPECT_EQ(TREE_CHANGE_RENAMED, reversed["readme.md<-README.md"]);
+    TreeSnapshotClose(older);
+    TreeSnapshotClose(newer);
+}
+
+TEST_F(TreeSnapshotTest, ComparesCopiesWithoutInodes)
+{
+    std::string command = "cp -a " + root + " " + copyPath;
+    ASSERT_EQ(0, system(command.c_str()));
+    ASSERT_EQ(0, TreeSnapshotCapture(root.c_str(), snapshotPath.c_str(), 0));
+    TreeSnapshot* snapshot = TreeSnapshotOpen(snapshotPath.c_str());
+    ASSERT_TRUE(snapshot != nullptr);
+
+    TreeDiff* diff = nullptr;
+    ASSERT_EQ(0, TreeSnapshotDiffLive(snapshot, copyPath.c_str(), TREE_DIFF_IGNORE_INODES, 0, &diff));
+    EXPECT_EQ(0, diff->Count);
+    FreeTreeDiff(diff);
+
+    // Compared by inode, every file of the copy is a different one
+    ASSERT_EQ(0, TreeSnapshotDiffLive(snapshot, copyPath.c_str(), 0, 0, &diff));
+    EXPECT_EQ(4, diff->Count);
+    FreeTreeDiff(diff);
+    TreeSnapshotClose(snapshot);
+}
+
+TEST_F(TreeSnapshotTest, CaptureFailsForUnreadableDirectory)
+{
+    HideSubdirectory();
+    EXPECT_EQ(EACCES, RunUnprivileged([this] { return TreeSnapshotCapture(root.c_str(), snapshotPath.c_str(), 2); }));
+    EXPECT_NE(0, access(snapshotPath.c_str(), F_OK));
+}
+
+TEST_F(TreeSnapshotTest, DiffFailsForUnreadableDirectory)
+{
+    ASSERT_EQ(0, TreeSnapshotCapture(root.c_str(), snapshotPath.c_str(), 2));
+    TreeSnapshot* snapshot = TreeSnapshotOpen(snapshotPath.c_str());
+    ASSERT_TRUE(snapshot != nullptr);
+
+    // Its entries must not be reported as removed
+    HideSubdirectory();
+    EXPECT_EQ(EACCES, RunUnprivileged([this, snapshot]
+    {
+        TreeDiff* diff = nullptr;
+        int32_t result = TreeSnapshotDiffLive(snapshot, root.c_str(), 0, 2, &diff);
+        FreeTreeDiff(diff);
+        return result;
+    }));
+    TreeSnapshotClose(snapshot);
+}
+
+TEST_F(TreeSnapshotTest, RejectsInvalidSnapshot)
+{
+    int fd = open(snapshotPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    ASSERT_NE(-1, fd);
+    const char garbage[] = "not a snapshot, just some text that is long enough";
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(garbage)), write(fd, garbage, sizeof(garbage)));
+    close(fd);
+
+    EXPECT_TRUE(TreeSnapshotOpen(snapshotPath.c_str()) == nullptr);
+    EXPECT_EQ(EINVAL, errno);
+}